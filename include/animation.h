@@ -0,0 +1,88 @@
+#pragma once
+#include <DirectXMath.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct NodeTransform {
+	DirectX::XMFLOAT3 translation = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT4 rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+	DirectX::XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f };
+};
+
+enum class AnimationPath : uint8_t {
+	Translation,
+	Rotation,
+	Scale,
+	Weights,
+};
+
+enum class Interpolation : uint8_t {
+	Step,
+	Linear,
+	CubicSpline,
+};
+
+constexpr uint32_t kAnimationPathCount = 4;
+constexpr uint32_t kInterpolationCount = 3;
+
+struct AnimationStats {
+	uint64_t sampledChannels = 0;
+	uint64_t cursorHits = 0;
+	uint64_t binarySearches = 0;
+};
+
+// Keyframes of every channel of every animation, stored structure of arrays:
+// one array of key times and one of key values shared by all channels, so a
+// sample pass streams through them without chasing per channel allocations.
+class AnimationSet {
+public:
+	uint32_t AddAnimation();
+	// times holds keyCount ascending times. values holds components floats per
+	// key, or three times as many for CubicSpline (in tangent, value, out tangent).
+	void AddChannel(uint32_t animation, uint32_t node, AnimationPath path, Interpolation interpolation, const float* times, uint32_t keyCount, const float* values, uint32_t components);
+
+	uint32_t AnimationCount() const { return static_cast<uint32_t>(m_animations.size()); }
+	uint32_t ChannelCount(uint32_t animation) const { return static_cast<uint32_t>(m_animations[animation].channels.size()); }
+	float Duration(uint32_t animation) const { return m_animations[animation].duration; }
+
+	// Samples every channel of animation at time, wrapped to its duration, and
+	// writes the results into transforms and weights, both indexed by node.
+	// Sequential times find their keys through cached cursors.
+	void Sample(uint32_t animation, float time, std::vector<NodeTransform>& transforms, std::vector<std::vector<float>>& weights, AnimationStats& stats);
+
+private:
+	struct Channel {
+		uint32_t node;
+		AnimationPath path;
+		Interpolation interpolation;
+		uint32_t components;
+		uint32_t keyOffset;
+		uint32_t keyCount;
+		uint32_t valueOffset;
+	};
+
+	struct Animation {
+		// Sorted by interpolation and path, so each kind is evaluated in one tight loop.
+		std::vector<uint32_t> channels;
+		// Where each kind's channels end, indexed by interpolation * kAnimationPathCount + path.
+		std::array<uint32_t, kInterpolationCount * kAnimationPathCount> kindEnds = {};
+		bool sorted = true;
+		float duration = 0.0f;
+	};
+
+	// Interpolates channels [begin, end) of target, all of one kind, from the
+	// keys and factors found for them.
+	template <Interpolation interpolation, AnimationPath path>
+	void sampleKind(const Animation& target, size_t begin, size_t end, std::vector<NodeTransform>& transforms, std::vector<std::vector<float>>& weights) const;
+
+	std::vector<Animation> m_animations;
+	std::vector<Channel> m_channels;
+	std::vector<float> m_times;
+	std::vector<float> m_values;
+	std::vector<uint32_t> m_cursors;
+
+	// Per sample scratch: the key each channel interpolates from and its factor.
+	std::vector<uint32_t> m_keys;
+	std::vector<float> m_factors;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator over a list of blocks. Allocations are never freed one at a
+// time; all of them go at once when the arena is reset or destroyed, so it
+// only holds trivially destructible types.
+class Arena {
+public:
+	explicit Arena(size_t blockSize = 64 * 1024);
+	Arena(Arena&&) noexcept = default;
+	Arena& operator=(Arena&&) noexcept = default;
+
+	void* Allocate(size_t size, size_t alignment);
+
+	template <typename T>
+	std::span<T> AllocateArray(size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>);
+		if (count == 0) {
+			return {};
+		}
+		T* data = static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+		std::uninitialized_value_construct_n(data, count);
+		return { data, count };
+	}
+
+	template <typename T>
+	std::span<const T> Copy(const T* data, size_t count) {
+		std::span<T> copy = AllocateArray<T>(count);
+		std::copy_n(data, count, copy.begin());
+		return copy;
+	}
+
+	// Null terminated, for APIs that take C strings.
+	std::string_view CopyString(std::string_view value);
+
+	void Reset();
+	// Bytes of the blocks held, used or not.
+	size_t Bytes() const { return m_bytes; }
+
+private:
+	size_t m_blockSize;
+	std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+	size_t m_blockCapacity = 0;
+	size_t m_blockUsed = 0;
+	size_t m_bytes = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct IoRing;
+
+struct AssetReadStats {
+	// "io_uring" or "threads".
+	const char* backend = "";
+	uint64_t files = 0;
+	uint64_t failedFiles = 0;
+	uint64_t bytes = 0;
+	// Reads issued, a file taking one per chunk with io_uring.
+	uint64_t reads = 0;
+	double wallMilliseconds = 0.0;
+	// Reads in flight: the most at once, and the average over the wall time,
+	// which is the summed read latency divided by it.
+	uint32_t peakQueueDepth = 0;
+	double meanQueueDepth = 0.0;
+	// Whether reads landed straight in registered destination buffers.
+	bool registeredBuffers = false;
+};
+
+// Reads whole files concurrently. On Linux reads go through an io_uring, every
+// file split into chunks and up to queueDepth chunks in flight; the
+// destination buffers are registered with the ring for the whole run, so the
+// kernel pins their pages once instead of on every read. Where io_uring is
+// unavailable, queueDepth threads read one file each with blocking reads.
+class AssetReader {
+public:
+	explicit AssetReader(uint32_t queueDepth = 64, bool forceThreads = false);
+	~AssetReader();
+	AssetReader(const AssetReader&) = delete;
+	AssetReader& operator=(const AssetReader&) = delete;
+
+	uint32_t Add(std::string path);
+	// Reads every file added since the last run and returns once all are done.
+	// completion(file) is called once per file as soon as it is complete, on
+	// the thread that saw it finish; with the thread fallback calls overlap.
+	void Run(const std::function<void(uint32_t file)>& completion = {});
+
+	const std::string& Path(uint32_t file) const { return m_files[file].path; }
+	bool Succeeded(uint32_t file) const { return m_files[file].succeeded; }
+	std::vector<unsigned char>& Data(uint32_t file) { return m_files[file].data; }
+
+	// Totals over every run.
+	const AssetReadStats& Stats() const { return m_stats; }
+	std::string Report() const;
+
+private:
+	struct File {
+		std::string path;
+		std::vector<unsigned char> data;
+		bool succeeded = false;
+	};
+
+	void runRing(const std::function<void(uint32_t)>& completion);
+	void runThreads(const std::function<void(uint32_t)>& completion);
+
+	uint32_t m_queueDepth;
+	std::unique_ptr<IoRing> m_ring;
+	std::vector<File> m_files;
+	uint32_t m_nextFile = 0;
+	AssetReadStats m_stats;
+	// Summed time from issuing each read to its completion.
+	double m_latencyMilliseconds = 0.0;
+};
+
+struct SceneFile {
+	std::string path;
+	bool image;
+};
+
+// The file a glTF URI that is not a data URI refers to, resolved against the
+// scene's directory.
+std::string SceneFilePath(const std::string& scenePath, const std::string& uri);
+
+// External buffers and images a glTF or GLB scene references, resolved
+// against the scene's directory. scene holds the scene file's bytes; data
+// URIs and images inside buffer views are skipped. Returns false when the
+// scene cannot be parsed.
+bool ListSceneFiles(const std::string& scenePath, const std::vector<unsigned char>& scene, std::vector<SceneFile>& files);
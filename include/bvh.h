@@ -0,0 +1,36 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "threadPool.h"
+
+struct BvhBounds {
+	DirectX::XMFLOAT3 min;
+	DirectX::XMFLOAT3 max;
+};
+
+// Interior nodes have count 0 and their two children at first and first + 1.
+// Leaves cover count entries of Bvh::primitives starting at first.
+struct BvhNode {
+	DirectX::XMFLOAT3 min;
+	uint32_t first;
+	DirectX::XMFLOAT3 max;
+	uint32_t count;
+};
+
+struct Bvh {
+	// nodes[0] is the root; empty when there are no primitives.
+	std::vector<BvhNode> nodes;
+	// Input primitive indices in leaf order.
+	std::vector<uint32_t> primitives;
+};
+
+constexpr uint32_t kBvhBinCount = 16;
+constexpr uint32_t kBvhMaxLeafSize = 8;
+// Deepest tree the builder produces; traversal stacks can be sized from it.
+constexpr uint32_t kBvhMaxDepth = 64;
+
+// Binned SAH build over primitive bounds. The top of the tree is split with
+// binning spread over the pool, the independent subtrees below it are then
+// built one per task. pool may be null to build on the calling thread.
+Bvh BuildBvh(const std::vector<BvhBounds>& bounds, ThreadPool* pool);
@@ -0,0 +1,74 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+struct ConstantAllocatorStats {
+	uint64_t allocations = 0;
+	// Allocations that did not fit in their slot's page.
+	uint64_t failures = 0;
+	// Most bytes one slot used, alignment included.
+	uint64_t peakSlotBytes = 0;
+};
+
+struct ConstantAllocation {
+	void* data = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS address = 0;
+	explicit operator bool() const { return data != nullptr; }
+};
+
+// Hands out constant buffer space for the submissions in flight. One
+// persistently mapped upload buffer is split into a page per scheduler slot;
+// allocations bump through the current slot's page at constant buffer
+// alignment, and a page starts over when its slot is acquired again, which
+// the scheduler only allows once the fence of the slot's previous submission
+// has passed. Constants are never rewritten while the GPU may read them, so a
+// submission can draw any number of views and transforms without a buffer
+// per object or a wait for the queue.
+class ConstantAllocator {
+public:
+	static constexpr uint64_t kAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
+	ConstantAllocator() = default;
+	~ConstantAllocator();
+	ConstantAllocator(const ConstantAllocator&) = delete;
+	ConstantAllocator& operator=(const ConstantAllocator&) = delete;
+
+	static uint64_t Align(uint64_t size) { return (size + kAlignment - 1) & ~(kAlignment - 1); }
+
+	// buffer must be a mappable upload heap buffer of slotCount pages.
+	HRESULT Init(Microsoft::WRL::ComPtr<ID3D12Resource> buffer, uint32_t slotCount);
+	uint64_t PageSize() const { return m_pageSize; }
+
+	// Starts over at the beginning of the slot's page. The slot's previous
+	// submission must have finished.
+	void BeginSlot(uint32_t slot);
+	// size bytes in the current slot's page, empty once the page is full.
+	ConstantAllocation Allocate(uint64_t size);
+
+	template <typename T>
+	ConstantAllocation Write(const T& value) {
+		ConstantAllocation allocation = Allocate(sizeof(T));
+		if (allocation) {
+			std::memcpy(allocation.data, &value, sizeof(T));
+		}
+		return allocation;
+	}
+
+	// Stats gathered since the previous call.
+	ConstantAllocatorStats TakeStats();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_buffer;
+	uint8_t* m_data = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS m_address = 0;
+	uint64_t m_pageSize = 0;
+	uint32_t m_slotCount = 0;
+	// Start of the current slot's page and the next free byte in it.
+	uint64_t m_pageOffset = 0;
+	uint64_t m_head = 0;
+
+	ConstantAllocatorStats m_stats;
+};
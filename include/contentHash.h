@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct ContentHash {
+	uint64_t low;
+	uint64_t high;
+
+	bool operator==(const ContentHash& other) const { return low == other.low && high == other.high; }
+};
+
+struct ContentHashHasher {
+	size_t operator()(const ContentHash& hash) const { return static_cast<size_t>(hash.low); }
+};
+
+// 128 bit hash for finding identical content. Four xxHash64 lanes run over 32
+// byte stripes and are merged twice, in opposite orders, into two independent
+// 64 bit halves. Not cryptographic: callers that act on a match compare the
+// bytes as well.
+ContentHash HashContent(const void* data, size_t size, uint64_t seed = 0);
+
+// Maps every item to the first one with the same hash that equal(first, item)
+// also confirms, so items whose hashes collide are kept apart.
+template <typename Equal>
+std::vector<int> FirstCopies(const std::vector<ContentHash>& hashes, const Equal& equal) {
+	std::vector<int> first(hashes.size());
+	std::unordered_multimap<ContentHash, int, ContentHashHasher> seen;
+	for (int index = 0; index < static_cast<int>(hashes.size()); ++index) {
+		first[index] = index;
+		auto [begin, end] = seen.equal_range(hashes[index]);
+		for (auto candidate = begin; candidate != end; ++candidate) {
+			if (equal(candidate->second, index)) {
+				first[index] = candidate->second;
+				break;
+			}
+		}
+		if (first[index] == index) {
+			seen.emplace(hashes[index], index);
+		}
+	}
+	return first;
+}
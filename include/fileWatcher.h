@@ -0,0 +1,46 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Polls files for changes of their modification time or size. A change is
+// reported once the file has stayed the same for the settle time, so an
+// editor saving in several writes triggers one report, and a file replaced
+// by deleting and recreating it is reported once it is back.
+class FileWatcher {
+public:
+	explicit FileWatcher(std::chrono::milliseconds interval = std::chrono::milliseconds(250), std::chrono::milliseconds settle = std::chrono::milliseconds(200));
+
+	// Watching a path again has no effect.
+	void Watch(const std::string& path);
+	void Clear() { m_files.clear(); }
+	size_t Count() const { return m_files.size(); }
+
+	// Paths that changed and settled since they were last reported. Files are
+	// looked at no more than once per interval; calls in between return nothing.
+	std::vector<std::string> Poll();
+
+private:
+	struct State {
+		bool exists = false;
+		std::filesystem::file_time_type time;
+		uintmax_t size = 0;
+		bool operator==(const State& other) const { return exists == other.exists && time == other.time && size == other.size; }
+	};
+	struct File {
+		std::string path;
+		State reported;
+		State seen;
+		// When seen was first observed.
+		std::chrono::steady_clock::time_point seenAt;
+	};
+
+	static State state(const std::string& path);
+
+	std::chrono::milliseconds m_interval;
+	std::chrono::milliseconds m_settle;
+	std::chrono::steady_clock::time_point m_lastPoll;
+	std::vector<File> m_files;
+};
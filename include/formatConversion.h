@@ -0,0 +1,11 @@
+#pragma once
+#include <dxgiformat.h>
+#include <cstdint>
+
+// Render target formats the renderer can be configured with.
+bool IsSupportedRenderTargetFormat(DXGI_FORMAT format);
+uint32_t BytesPerPixel(DXGI_FORMAT format);
+
+// Converts one row of width pixels in a supported render target format to
+// 8 bit RGBA, clamping to [0, 1]. Formats without alpha get opaque alpha.
+void ConvertRowToRGBA8(DXGI_FORMAT format, const void* source, uint8_t* destination, uint32_t width);
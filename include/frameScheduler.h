@@ -0,0 +1,89 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <cstdint>
+#include <vector>
+
+struct FrameSchedulerStats {
+	uint64_t submissions = 0;
+	// Time the CPU spent blocked on fences.
+	double cpuStallMicroseconds = 0.0;
+	// Gaps between consecutive submissions on the direct queue, and the time
+	// spent inside them, from GPU timestamps of retired submissions.
+	double gpuIdleMicroseconds = 0.0;
+	double gpuBusyMicroseconds = 0.0;
+};
+
+// Keeps a ring of submissions in flight. Each slot owns one submission: a
+// direct command list followed by a copy command list that the copy queue
+// only starts once the direct work has finished, so reading back one slot
+// overlaps rendering the next. Slots are reused in order; acquiring a slot
+// blocks until its previous submission has finished on both queues. Waits go
+// through two events created once and reused for every fence.
+class FrameScheduler {
+public:
+	FrameScheduler() = default;
+	~FrameScheduler();
+	FrameScheduler(const FrameScheduler&) = delete;
+	FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+	HRESULT Init(ID3D12Device* device, ID3D12CommandQueue* directQueue, ID3D12CommandQueue* copyQueue, uint32_t slotCount);
+	uint32_t SlotCount() const { return static_cast<uint32_t>(m_slots.size()); }
+
+	// Next slot in the ring, once its previous submission has finished.
+	uint32_t AcquireSlot();
+	// Bracket the slot's direct work with GPU timestamps.
+	void BeginTimestamp(ID3D12GraphicsCommandList* commandList, uint32_t slot);
+	void EndTimestamp(ID3D12GraphicsCommandList* commandList, uint32_t slot);
+	void Submit(uint32_t slot, ID3D12CommandList* directCommandList, ID3D12CommandList* copyCommandList);
+	// Blocks until the slot's copy has finished, so its readback can be read.
+	void WaitForSlot(uint32_t slot);
+
+	// Blocks until all direct work submitted so far has finished, for CPU
+	// writes to data every draw reads.
+	void WaitForDirectQueue();
+	// Blocks until the direct queue has reached a value SubmittedDirectValue
+	// returned, for CPU writes to data only the submissions up to it read.
+	void WaitForDirectValue(uint64_t value);
+	void WaitIdle();
+	// Direct fence value of the latest submission, and the one the GPU has
+	// reached; objects the GPU may still read are released once the second
+	// passes the first as it was when they were replaced.
+	uint64_t SubmittedDirectValue() const { return m_directFenceValue; }
+	uint64_t CompletedDirectValue() const { return m_directFence->GetCompletedValue(); }
+
+	// Stats gathered since the previous call.
+	FrameSchedulerStats TakeStats();
+
+private:
+	struct Slot {
+		uint64_t directFenceValue = 0;
+		uint64_t copyFenceValue = 0;
+		bool timed = false;
+		bool pending = false;
+	};
+
+	void wait(ID3D12Fence* fence, uint64_t value, HANDLE event);
+	void retire(Slot& slot, uint32_t slotIndex);
+
+	ID3D12CommandQueue* m_directQueue = nullptr;
+	ID3D12CommandQueue* m_copyQueue = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_directFence;
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_copyFence;
+	uint64_t m_directFenceValue = 0;
+	uint64_t m_copyFenceValue = 0;
+	HANDLE m_directEvent = nullptr;
+	HANDLE m_copyEvent = nullptr;
+
+	std::vector<Slot> m_slots;
+	uint32_t m_nextSlot = 0;
+
+	// Two timestamps per slot, resolved into a persistently mapped readback buffer.
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_timestampHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_timestampBuffer;
+	const uint64_t* m_timestamps = nullptr;
+	uint64_t m_timestampFrequency = 0;
+	uint64_t m_lastTimestamp = 0;
+
+	FrameSchedulerStats m_stats;
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct IoRing;
+
+// One file's writes, known once the last of them has completed.
+struct FrameWriteReport {
+	uint64_t frame = 0;
+	std::string path;
+	bool succeeded = false;
+	uint64_t bytes = 0;
+	uint32_t writes = 0;
+	// Time with at least one of the file's writes in flight.
+	double busyMilliseconds = 0.0;
+	// From issuing a write to its completion.
+	double p50Milliseconds = 0.0;
+	double p99Milliseconds = 0.0;
+	double maxMilliseconds = 0.0;
+};
+
+struct FrameWriteStats {
+	// "io_uring" or "threads".
+	const char* backend = "";
+	uint64_t files = 0;
+	uint64_t failedFiles = 0;
+	// Files written around the page cache; file systems that refuse direct
+	// I/O get buffered writes instead.
+	uint64_t directFiles = 0;
+	uint64_t bytes = 0;
+	uint64_t preallocatedBytes = 0;
+	uint64_t writes = 0;
+	// Blocks queued or in flight, at most the writer's limit.
+	uint32_t peakOutstanding = 0;
+	// Time callers waited for a block to be written and handed back.
+	double stallMilliseconds = 0.0;
+	// Time with any write in flight.
+	double busyMilliseconds = 0.0;
+};
+
+// Writes files on a thread of its own, one at a time from the caller's side,
+// while the files before are still being written. Bytes are gathered into
+// aligned blocks that are written with direct I/O, so output that is never
+// read back does not fill the page cache: through an io_uring on Linux, with
+// blocking writes elsewhere. Every block is outstanding from when it is
+// filled until its write completes, and callers wait for one to come back
+// once all are. Each file is preallocated to the size of the one before, and
+// its tail block, padded for direct I/O, is trimmed when it is finished.
+class FrameWriter {
+public:
+	explicit FrameWriter(uint32_t maxOutstanding = 8, bool forceThreads = false);
+	~FrameWriter();
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+
+	// Starts a file, after closing the one before. frame only labels its report.
+	bool Open(const std::string& path, uint64_t frame);
+	void Write(const uint8_t* data, size_t size);
+	// Queues the rest of the file; it is finished once its writes complete.
+	void Close();
+	// Waits until every file closed so far is finished.
+	void Flush();
+
+	// Reports of the files finished since the last call, in the order they
+	// finished.
+	void TakeCompleted(std::vector<FrameWriteReport>& reports);
+	FrameWriteStats Stats() const;
+	std::string Report() const;
+
+private:
+	struct File;
+	// A block's bytes, and what to do once they are written: a block with
+	// no bytes finishes its file.
+	struct Block {
+		File* file = nullptr;
+		uint8_t* data = nullptr;
+		uint64_t offset = 0;
+		uint32_t length = 0;
+		std::chrono::high_resolution_clock::time_point issued;
+	};
+	struct AlignedDelete {
+		void operator()(uint8_t* data) const;
+	};
+
+	uint8_t* acquireBlock();
+	void queue(Block block);
+	void run();
+	void runRing();
+	void runThreads();
+	// Returns the block to the pool and finishes its file when it was the last.
+	void complete(const Block& block, bool succeeded);
+	void beginWrite(File& file);
+	void endWrite(File& file);
+	void finish(File& file);
+
+	uint32_t m_maxOutstanding;
+	std::unique_ptr<IoRing> m_ring;
+	std::vector<std::unique_ptr<uint8_t[], AlignedDelete>> m_blocks;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_queued;
+	std::condition_variable m_returned;
+	std::deque<Block> m_queue;
+	std::vector<uint8_t*> m_freeBlocks;
+	std::vector<std::unique_ptr<File>> m_files;
+	// Files closed by the caller and not yet finished.
+	uint32_t m_closedFiles = 0;
+	bool m_stop = false;
+	std::vector<FrameWriteReport> m_reports;
+	FrameWriteStats m_stats;
+	std::vector<double> m_latencies;
+
+	// Caller side.
+	File* m_file = nullptr;
+	bool m_direct = false;
+	uint64_t m_fileOffset = 0;
+	uint64_t m_fileBytes = 0;
+	uint64_t m_previousBytes = 0;
+	uint8_t* m_block = nullptr;
+	uint32_t m_blockUsed = 0;
+
+	// Writer side.
+	uint32_t m_inFlight = 0;
+	std::chrono::high_resolution_clock::time_point m_busyStart;
+
+	std::thread m_thread;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// PSNR reported for identical images, where the real value is infinite.
+constexpr double kIdenticalPsnr = 100.0;
+
+// 8 bit RGBA pixels; alpha is ignored by every metric.
+struct ImageView {
+	const uint8_t* pixels;
+	uint32_t width;
+	uint32_t height;
+	size_t rowPitch;
+};
+
+struct TileComparison {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+	uint32_t maxAbs;
+	double mse;
+	double psnr;
+	// Mean SSIM of the 8x8 luma windows in the tile.
+	double ssim;
+};
+
+struct ImageComparison {
+	uint32_t tileSize = 0;
+	uint32_t tileColumns = 0;
+	uint32_t tileRows = 0;
+	std::vector<TileComparison> tiles;
+	uint32_t maxAbs = 0;
+	double mse = 0.0;
+	double psnr = kIdenticalPsnr;
+	double ssim = 1.0;
+};
+
+struct CompareOptions {
+	// Rounded up to a multiple of the 8 pixel SSIM window.
+	uint32_t tileSize = 64;
+	// 0 uses every hardware thread.
+	uint32_t threadCount = 0;
+};
+
+// Compares two images of equal size tile by tile, spreading tiles over
+// threadCount threads. Returns false if the sizes differ.
+bool CompareImages(const ImageView& output, const ImageView& golden, const CompareOptions& options, ImageComparison& result);
+
+// Fills rowCount rows of 8 bit RGBA, starting at firstRow, with the largest
+// channel difference per pixel scaled by gain and mapped black, red, yellow, white.
+void BuildHeatmapRows(const ImageView& output, const ImageView& golden, uint32_t firstRow, uint32_t rowCount, float gain, uint8_t* rows);
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#if defined(__linux__)
+#include <cstddef>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__linux__)
+// The submission and completion rings shared with the kernel, driven through
+// the raw system calls.
+struct IoRing {
+	int fd = -1;
+	void* sqRing = nullptr;
+	size_t sqRingSize = 0;
+	void* cqRing = nullptr;
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+	unsigned* sqTail = nullptr;
+	unsigned sqMask = 0;
+	unsigned* sqArray = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* cqes = nullptr;
+
+	IoRing() = default;
+	~IoRing();
+	IoRing(const IoRing&) = delete;
+	IoRing& operator=(const IoRing&) = delete;
+
+	bool setup(uint32_t entries);
+	// The caller keeps no more than the ring's entries in flight, so there is
+	// always a free slot.
+	io_uring_sqe* nextEntry();
+	int enter(unsigned submit, unsigned waitFor);
+};
+#else
+struct IoRing {
+	bool setup(uint32_t) { return false; }
+};
+#endif
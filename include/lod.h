@@ -0,0 +1,45 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "meshlet.h"
+
+// One level of a primitive's LOD chain. Index ranges and meshlets are absolute
+// offsets into the index buffer holding the whole chain.
+struct Lod {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	// Object space distance to the full detail surface.
+	float error;
+	std::vector<Meshlet> meshlets;
+};
+
+struct LodChain {
+	std::vector<Lod> lods;
+	DirectX::XMFLOAT3 center;
+	float radius;
+};
+
+struct LodStats {
+	uint64_t submittedTriangles = 0;
+	uint64_t fullDetailTriangles = 0;
+};
+
+constexpr uint32_t kMaxLodCount = 8;
+// Largest simplification error allowed for the chain, relative to the bounding radius.
+constexpr float kLodErrorBudget = 0.02f;
+// Largest error a selected LOD may project to, in pixels.
+constexpr float kLodPixelError = 1.0f;
+
+// Quadric error edge collapse simplification. Collapses vertices onto existing
+// vertices, so the result indexes the original vertex buffer. Seam and border
+// vertices are kept in place. Returns the object space error of the result.
+float SimplifyMesh(const std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+// Builds LOD 0 from indices and halves the triangle count per level until the
+// error budget is spent. indices receives every level concatenated, each in meshlet order.
+LodChain BuildLodChain(std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount);
+
+// Returns the coarsest LOD whose error projects to at most kLodPixelError.
+// projectionScale is the number of pixels covered by one unit at distance one.
+size_t SelectLod(const std::vector<Lod>& lods, float worldScale, float distance, float projectionScale);
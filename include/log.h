@@ -0,0 +1,173 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel : uint8_t {
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Off,
+};
+
+const char* LogLevelName(LogLevel level);
+// Accepts the names LogLevelName returns.
+bool ParseLogLevel(const char* name, LogLevel& level);
+
+// Structured fields of a message. stage must be a string literal; frame is
+// -1 and hresult 0 when they do not apply.
+struct LogFields {
+	LogFields(const char* stage = nullptr, int64_t frame = -1, uint32_t hresult = 0) :
+		stage(stage),
+		frame(frame),
+		hresult(hresult)
+	{
+	}
+	const char* stage;
+	int64_t frame;
+	uint32_t hresult;
+};
+
+// A message as the sinks see it, formatted on the logging thread.
+struct LogEntry {
+	LogLevel level;
+	// Nanoseconds since the Unix epoch.
+	int64_t time;
+	// Small id of the thread that logged it, in order of first use.
+	uint32_t thread;
+	const char* stage;
+	int64_t frame;
+	uint32_t hresult;
+	std::string message;
+};
+
+class LogSink {
+public:
+	virtual ~LogSink() = default;
+	virtual void Write(const LogEntry& entry) = 0;
+	virtual void Flush() {}
+};
+
+// One line per entry: time, level, fields and message.
+std::string FormatLogLine(const LogEntry& entry);
+// One JSON object per entry, without a trailing newline.
+std::string FormatLogJson(const LogEntry& entry);
+
+class StderrLogSink : public LogSink {
+public:
+	void Write(const LogEntry& entry) override;
+	void Flush() override;
+};
+
+// Writes lines as FormatLogLine, or JSON lines as FormatLogJson.
+class FileLogSink : public LogSink {
+public:
+	explicit FileLogSink(const std::string& path, bool json = false);
+	~FileLogSink() override;
+	bool IsOpen() const { return m_file != nullptr; }
+	void Write(const LogEntry& entry) override;
+	void Flush() override;
+
+private:
+	FILE* m_file = nullptr;
+	bool m_json;
+};
+
+#ifdef _WIN32
+// The debugger's output window, where OutputDebugString used to write.
+class DebuggerLogSink : public LogSink {
+public:
+	void Write(const LogEntry& entry) override;
+};
+#endif
+
+// Nothing is logged until the first sink is added; from then on messages
+// below the level are dropped at the call site. Info by default.
+void SetLogLevel(LogLevel level);
+void AddLogSink(std::unique_ptr<LogSink> sink);
+// Blocks until every message logged before the call has reached the sinks,
+// and the sinks are flushed.
+void FlushLog();
+// Flushes, stops the logging thread and removes the sinks.
+void ShutdownLog();
+
+// Packs a message's arguments into the calling thread's scratch buffer.
+// Strings are copied, everything else is kept as a 64 bit value.
+class LogArguments {
+public:
+	enum class Type : uint8_t {
+		Signed,
+		Unsigned,
+		Float,
+		Bool,
+		String,
+	};
+
+	LogArguments();
+
+	template <typename T>
+	void Add(const T& value) {
+		if constexpr (std::is_same_v<T, bool>) {
+			append(Type::Bool, static_cast<uint64_t>(value));
+		}
+		else if constexpr (std::is_enum_v<T>) {
+			Add(static_cast<std::underlying_type_t<T>>(value));
+		}
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+			append(Type::Signed, static_cast<uint64_t>(static_cast<int64_t>(value)));
+		}
+		else if constexpr (std::is_integral_v<T>) {
+			append(Type::Unsigned, static_cast<uint64_t>(value));
+		}
+		else if constexpr (std::is_floating_point_v<T>) {
+			double number = static_cast<double>(value);
+			uint64_t bits;
+			static_assert(sizeof(bits) == sizeof(number));
+			std::memcpy(&bits, &number, sizeof(bits));
+			append(Type::Float, bits);
+		}
+		else if constexpr (std::is_pointer_v<T>) {
+			appendString(value ? std::string_view(value) : std::string_view("(null)"));
+		}
+		else {
+			appendString(std::string_view(value));
+		}
+	}
+
+	void Submit(LogLevel level, const LogFields& fields, const char* format);
+
+private:
+	void append(Type type, uint64_t value);
+	void appendString(std::string_view value);
+
+	uint8_t* m_data;
+	uint32_t m_size = 0;
+	uint32_t m_count = 0;
+};
+
+// The lowest level that is logged, Off while there are no sinks.
+extern std::atomic<uint8_t> g_logThreshold;
+
+inline bool LogEnabled(LogLevel level) {
+	return static_cast<uint8_t>(level) >= g_logThreshold.load(std::memory_order_relaxed);
+}
+
+// Queues a message for the logging thread. format is a string literal with
+// {} placeholders, each optionally carrying a printf style width, precision
+// and type such as {:.1f} or {:>8}; {{ and }} stand for braces. A message
+// filtered out by its level costs one relaxed load and a compare.
+template <typename... Args>
+void Log(LogLevel level, const LogFields& fields, const char* format, const Args&... args) {
+	if (!LogEnabled(level)) {
+		return;
+	}
+	LogArguments arguments;
+	(arguments.Add(args), ...);
+	arguments.Submit(level, fields, format);
+}
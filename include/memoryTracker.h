@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory : uint32_t {
+	Geometry,
+	Textures,
+	Staging,
+	RenderTargets,
+	Readback,
+	Constants,
+	OutputImage,
+	// Decoded glTF buffers and images kept on the CPU.
+	SceneSource,
+	RayTracing,
+	// Occluder meshes and the occlusion depth pyramid.
+	Occlusion,
+	Count
+};
+
+// Where the bytes live. NonLocal covers upload and readback heaps, which sit in
+// system memory on discrete adapters but count against the GPU's non local budget.
+enum class MemoryDomain : uint32_t {
+	Local,
+	NonLocal,
+	Cpu,
+	Count
+};
+
+struct MemoryAllocation {
+	uint32_t scene;
+	MemoryCategory category;
+	MemoryDomain domain;
+	uint64_t bytes;
+};
+
+struct MemoryUsage {
+	uint64_t current = 0;
+	uint64_t peak = 0;
+};
+
+// Current and peak bytes per scene, category and domain. Budgets can be set per
+// domain and for the process as a whole; the warning callback fires once when
+// usage climbs past kMemoryWarningFraction of a budget and once when it
+// exceeds it, and is re-armed when usage falls back below the warning level.
+class MemoryTracker {
+public:
+	MemoryTracker();
+
+	// Scene 0 is "shared" and holds allocations not owned by any scene.
+	uint32_t AddScene(const std::string& name);
+	void Add(const MemoryAllocation& allocation);
+	void Remove(const MemoryAllocation& allocation);
+	// Moves a long lived CPU container's record to its new size.
+	void Resize(MemoryAllocation& allocation, uint64_t bytes);
+
+	// 0 disables the budget.
+	void SetBudget(MemoryDomain domain, uint64_t bytes);
+	void SetProcessBudget(uint64_t bytes);
+	void SetWarningCallback(std::function<void(const std::string&)> callback);
+
+	MemoryUsage Usage(MemoryDomain domain) const;
+	MemoryUsage ProcessUsage() const;
+	MemoryUsage Usage(uint32_t scene, MemoryCategory category, MemoryDomain domain) const;
+
+	// One line per scene, category and domain in use, then totals.
+	std::string Report() const;
+
+private:
+	static constexpr size_t kCellsPerScene = static_cast<size_t>(MemoryCategory::Count) * static_cast<size_t>(MemoryDomain::Count);
+	// Budget slot of the process total, after the per domain slots.
+	static constexpr size_t kProcessSlot = static_cast<size_t>(MemoryDomain::Count);
+
+	struct Budget {
+		uint64_t bytes = 0;
+		// 0 below the warning level, 1 once warned, 2 once over budget.
+		uint32_t level = 0;
+	};
+
+	static size_t cell(MemoryCategory category, MemoryDomain domain);
+	void grow(MemoryUsage& usage, uint64_t bytes);
+	void checkBudget(size_t slot, const MemoryUsage& usage, std::string& warning);
+
+	mutable std::mutex m_mutex;
+	std::vector<std::string> m_scenes;
+	std::vector<MemoryUsage> m_cells;
+	MemoryUsage m_totals[static_cast<size_t>(MemoryDomain::Count) + 1];
+	Budget m_budgets[static_cast<size_t>(MemoryDomain::Count) + 1];
+	std::function<void(const std::string&)> m_warning;
+};
+
+constexpr double kMemoryWarningFraction = 0.9;
+
+const char* MemoryCategoryName(MemoryCategory category);
+const char* MemoryDomainName(MemoryDomain domain);
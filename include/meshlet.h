@@ -0,0 +1,47 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Cluster of at most kMaxMeshletVertices unique vertices and kMaxMeshletTriangles
+// triangles. Meshlets index into a reordered copy of the primitive's index buffer
+// so that every cluster is one contiguous index range.
+struct Meshlet {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	DirectX::XMFLOAT3 center;
+	float radius;
+	DirectX::XMFLOAT3 coneAxis;
+	// 1.0 disables backface cone culling for this meshlet.
+	float coneCutoff;
+};
+
+struct MeshletStats {
+	uint64_t tested = 0;
+	uint64_t rejected = 0;
+};
+
+struct IndexRange {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+};
+
+// World space frustum planes (inward facing, normalized) and eye position.
+struct CullingView {
+	DirectX::XMFLOAT4 planes[6];
+	DirectX::XMFLOAT3 cameraPosition;
+};
+
+constexpr uint32_t kMaxMeshletVertices = 64;
+constexpr uint32_t kMaxMeshletTriangles = 124;
+
+// Groups triangles into spatially coherent meshlets. indices is rewritten in
+// meshlet order; positions are read with positionStride bytes between vertices.
+std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount);
+
+CullingView BuildCullingView(DirectX::FXMMATRIX viewProjection, DirectX::FXMVECTOR cameraPosition);
+
+// Appends the index ranges of meshlets surviving frustum and (optionally) backface
+// cone culling to ranges, merging neighbours into a single range.
+void CullMeshlets(const std::vector<Meshlet>& meshlets, const DirectX::XMFLOAT4X4& world, const CullingView& view, bool coneCulling, std::vector<IndexRange>& ranges, MeshletStats& stats);
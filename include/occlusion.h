@@ -0,0 +1,93 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+struct OcclusionStats {
+	uint64_t occluders = 0;
+	// Triangles left to rasterize after near plane and screen rejection.
+	uint64_t occluderTriangles = 0;
+	uint64_t tested = 0;
+	uint64_t rejected = 0;
+	double rasterMicroseconds = 0.0;
+	double testMicroseconds = 0.0;
+};
+
+// Object space triangle list drawn into the occlusion buffer, with three
+// floats per vertex.
+struct Occluder {
+	const float* positions;
+	uint32_t vertexCount;
+	const uint32_t* indices;
+	uint32_t indexCount;
+	DirectX::XMFLOAT4X4 world;
+};
+
+// Width of the occlusion buffer in pixels; the height follows the frame's
+// aspect ratio.
+constexpr uint32_t kOcclusionWidth = 256;
+// Largest simplification error, relative to the bounding radius, of the LOD
+// level kept as a primitive's occluder. Simplified surfaces can bulge past
+// the real one, which would hide draws that are actually visible.
+constexpr float kOccluderError = 0.002f;
+
+// Low resolution depth buffer of the largest occluders and a pyramid of its
+// farthest depths. Occluder triangles are set up in parallel, one occluder
+// per task, then rasterized four pixels at a time with SSE in horizontal
+// bands, one band per task, so no two threads write the same pixel. Pixels
+// are covered when their centre is, which can grow an occluder by up to half
+// a pixel at its silhouette; tests round their bounds outwards to whole
+// pixels to make up for most of it.
+class OcclusionBuffer {
+public:
+	// width is rounded up to a multiple of four.
+	void Resize(uint32_t width, uint32_t height);
+	uint32_t Width() const { return m_width; }
+	uint32_t Height() const { return m_height; }
+	// Bytes of the depth pyramid.
+	uint64_t ByteSize() const;
+
+	// Clears the buffer and draws the occluders as seen through viewProjection,
+	// a row vector matrix mapping to D3D clip space.
+	void Rasterize(const std::vector<Occluder>& occluders, const DirectX::XMFLOAT4X4& viewProjection, ThreadPool& threadPool, OcclusionStats& stats);
+	// True when a world space sphere lies entirely behind the occluders drawn
+	// by the last Rasterize. Spheres crossing the near plane count as visible.
+	bool SphereOccluded(const DirectX::XMFLOAT3& center, float radius) const;
+
+	// 8 bit RGBA image of the full resolution level: near is bright, pixels
+	// no occluder covers are black.
+	void Visualize(std::vector<uint8_t>& pixels) const;
+
+private:
+	// Edge functions and depth plane in pixel coordinates, evaluated at pixel
+	// centres. Edges are oriented so inside is where all three are >= 0.
+	struct Triangle {
+		float edgeX[3];
+		float edgeY[3];
+		float edgeC[3];
+		// depth = depthC + depthX * x + depthY * y
+		float depthX;
+		float depthY;
+		float depthC;
+		int32_t minX;
+		int32_t maxX;
+		int32_t minY;
+		int32_t maxY;
+	};
+
+	void setupOccluder(const Occluder& occluder, std::vector<Triangle>& triangles) const;
+	void rasterizeBand(uint32_t firstRow, uint32_t endRow);
+	void buildPyramid();
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	// Level 0 is the buffer itself, every further level is half the size and
+	// holds the farthest depth of the texels it covers.
+	std::vector<std::vector<float>> m_levels;
+	std::vector<uint32_t> m_levelWidths;
+	std::vector<uint32_t> m_levelHeights;
+	std::vector<std::vector<Triangle>> m_triangles;
+	DirectX::XMFLOAT4X4 m_viewProjection = {};
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes an 8 bit RGBA PNG a band of rows at a time, so the whole image never
+// has to be resident. Every band is compressed as its own fixed Huffman deflate
+// block and emitted as one IDAT chunk.
+class PngWriter {
+public:
+	bool Open(const std::string& path, uint32_t width, uint32_t height);
+	// Encodes into memory instead, for callers that write the file themselves;
+	// TakeOutput hands over what was encoded since it was last called.
+	bool Open(uint32_t width, uint32_t height);
+	void WriteRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount);
+	void TakeOutput(std::vector<uint8_t>& output);
+	bool Close();
+
+private:
+	bool begin(uint32_t width, uint32_t height);
+	void emit(const void* data, size_t size);
+	void filterRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount);
+	void deflate(const uint8_t* data, size_t size);
+	void putBits(uint32_t value, uint32_t count);
+	void putCode(uint32_t code, uint32_t length);
+	void putLiteral(uint32_t literal);
+	void putMatch(uint32_t length, uint32_t distance);
+	void flushBits(bool pad);
+	void writeChunk(const char type[4], const uint8_t* data, size_t size);
+
+	std::ofstream m_file;
+	bool m_open = false;
+	bool m_toMemory = false;
+	std::vector<uint8_t> m_output;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_rowsWritten = 0;
+	uint32_t m_adler = 1;
+
+	uint64_t m_bitBuffer = 0;
+	uint32_t m_bitCount = 0;
+	std::vector<uint8_t> m_compressed;
+
+	std::vector<uint8_t> m_previousRow;
+	std::vector<uint8_t> m_filtered;
+	std::vector<int32_t> m_hashHead;
+	std::vector<int32_t> m_hashPrevious;
+};
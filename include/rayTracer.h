@@ -0,0 +1,128 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "threadPool.h"
+
+struct RayTracingMaterial {
+	DirectX::XMFLOAT4 baseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+	// Index returned by AddTexture, -1 for none.
+	int32_t baseColorTexture = -1;
+};
+
+// One indexed triangle list of a mesh. texcoords may be empty.
+struct RayTracingPrimitive {
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT2> texcoords;
+	std::vector<uint32_t> indices;
+	// Index returned by AddMaterial, UINT32_MAX for plain white.
+	uint32_t material = UINT32_MAX;
+};
+
+struct RayTracingView {
+	// Maps clip space back to world space for the full frame.
+	DirectX::XMFLOAT4X4 inverseViewProjection;
+	DirectX::XMFLOAT3 eye;
+	uint32_t width;
+	uint32_t height;
+	// Unit vector towards the directional light.
+	DirectX::XMFLOAT3 lightDirection = { 0.4f, 0.8f, 0.45f };
+	DirectX::XMFLOAT4 background = { 0.0f, 0.1f, 0.2f, 1.0f };
+	// Ambient occlusion rays per hit, rounded up to whole packets; 0 disables them.
+	uint32_t occlusionSamples = 8;
+	// Occluders further away than this do not darken a hit, 0 uses a fifth of the scene's diagonal.
+	float occlusionDistance = 0.0f;
+};
+
+struct RayTracingStats {
+	uint64_t primaryRays = 0;
+	uint64_t shadowRays = 0;
+	uint64_t occlusionRays = 0;
+	uint64_t Rays() const { return primaryRays + shadowRays + occlusionRays; }
+};
+
+struct RayPacket;
+struct RayPacketHit;
+
+// CPU ray tracer over a two level hierarchy: one bottom level BVH per mesh in
+// object space, and a top level BVH over the instances placing meshes in the
+// world. Rays are traced as packets of four lanes in DirectXMath vectors, each
+// lane one pixel for primary rays.
+class RayTracer {
+public:
+	explicit RayTracer(ThreadPool& pool);
+
+	// Pixels are 8 bit RGBA and must outlive the tracer.
+	int32_t AddTexture(const uint8_t* pixels, uint32_t width, uint32_t height);
+	uint32_t AddMaterial(const RayTracingMaterial& material);
+	// Builds the mesh's bottom level BVH. Primitives without triangles are dropped.
+	uint32_t AddMesh(const std::vector<RayTracingPrimitive>& primitives);
+	uint32_t MeshTriangleCount(uint32_t mesh) const { return static_cast<uint32_t>(m_meshes[mesh].triangles.size()); }
+
+	// Instances are collected and take effect on the next BuildInstances.
+	void ClearInstances();
+	void AddInstance(uint32_t mesh, const DirectX::XMFLOAT4X4& world);
+	void BuildInstances();
+	uint32_t InstanceCount() const { return static_cast<uint32_t>(m_instances.size()); }
+	// Bytes held by meshes, instances and their BVHs.
+	uint64_t ByteSize() const;
+
+	// Traces rows [firstRow, firstRow + rowCount) of the view and writes them
+	// as 8 bit RGBA, rowPitch bytes apart. Rays are counted into stats.
+	void Render(const RayTracingView& view, uint32_t firstRow, uint32_t rowCount, uint8_t* rows, size_t rowPitch, RayTracingStats& stats);
+
+private:
+	struct Triangle {
+		DirectX::XMFLOAT3 v0;
+		DirectX::XMFLOAT3 e1;
+		DirectX::XMFLOAT3 e2;
+	};
+
+	// Kept apart from Triangle so traversal only touches the intersection data.
+	struct TriangleShading {
+		DirectX::XMFLOAT2 uv0;
+		DirectX::XMFLOAT2 uv1;
+		DirectX::XMFLOAT2 uv2;
+		uint32_t material;
+	};
+
+	struct Mesh {
+		std::vector<BvhNode> nodes;
+		// In leaf order.
+		std::vector<Triangle> triangles;
+		std::vector<TriangleShading> shading;
+	};
+
+	struct Instance {
+		uint32_t mesh;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4X4 inverseWorld;
+		// Transposed inverse, for normals.
+		DirectX::XMFLOAT4X4 normalMatrix;
+	};
+
+	struct Texture {
+		const uint8_t* pixels;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// Closest hit when AnyHit is false. Otherwise lanes are cleared from
+	// packet.active as soon as anything blocks them and hit is unused.
+	template <bool AnyHit>
+	void traceInstances(RayPacket& packet, RayPacketHit* hit) const;
+	template <bool AnyHit>
+	void traceMesh(const Mesh& mesh, uint32_t instance, RayPacket& packet, RayPacketHit* hit) const;
+	DirectX::XMVECTOR baseColor(const TriangleShading& shading, float u, float v) const;
+
+	ThreadPool& m_pool;
+	std::vector<Texture> m_textures;
+	std::vector<RayTracingMaterial> m_materials;
+	std::vector<Mesh> m_meshes;
+	std::vector<Instance> m_pendingInstances;
+	std::vector<Instance> m_instances;
+	std::vector<BvhNode> m_instanceNodes;
+	float m_sceneDiagonal = 0.0f;
+};
@@ -8,22 +8,107 @@
 #include <D3Dcompiler.h>
 #include <cmath>
 #include <chrono>
+#include <memory>
+#include <numeric>
 #include "tiny_gltf.h"
 #include "json.hpp"
+#include "meshlet.h"
+#include "lod.h"
+#include "pngWriter.h"
+#include "sequenceEncoder.h"
+#include "frameWriter.h"
+#include "formatConversion.h"
+#include "animation.h"
+#include "skinning.h"
+#include "threadPool.h"
+#include "rayTracer.h"
+#include "memoryTracker.h"
+#include "textureResidency.h"
+#include "frameScheduler.h"
+#include "uploadManager.h"
+#include "constantAllocator.h"
+#include "occlusion.h"
+#include "contentHash.h"
+#include "sceneModel.h"
+#include "taskGraph.h"
+#include "assetReader.h"
+#include "fileWatcher.h"
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <unordered_map>
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
+struct RendererOptions {
+	// Edge length of the square tiles a frame is rendered in, 0 renders the
+	// whole frame at once. Render target and readback memory scale with the
+	// tile, the encoder's band buffer with the tile height.
+	UINT tileSize = 0;
+	// One of R32G32B32A32_FLOAT, R16G16B16A16_FLOAT, R11G11B10_FLOAT or
+	// R8G8B8A8_UNORM_SRGB. Smaller formats cut readback and conversion bandwidth.
+	DXGI_FORMAT renderTargetFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	// When set, frames are appended to this delta coded sequence file instead
+	// of being written as individual PNGs.
+	std::string sequencePath;
+	UINT keyframeInterval = 30;
+	// Index of the glTF animation to play, -1 disables playback.
+	int animation = 0;
+	// Threads used for CPU side per frame work such as skinning, 0 uses all.
+	UINT workerThreads = 0;
+	// Trace frames on the CPU instead of rasterizing them.
+	bool rayTrace = false;
+	// Ambient occlusion rays per traced hit.
+	UINT occlusionSamples = 8;
+	// Process wide memory budget in MiB to warn against, 0 disables it. Local
+	// video memory is always checked against the budget the OS reports.
+	UINT memoryBudget = 0;
+	// Frames between memory breakdowns, 0 reports only at shutdown.
+	UINT memoryReportInterval = 0;
+	// Bytes of texture mips to keep resident in MiB, 0 for no limit. Textures
+	// start with their tail mips either way and stream in finer ones on demand.
+	UINT textureBudget = 0;
+	// Size of the staging ring all uploads stream through, in MiB.
+	UINT uploadRingSize = 64;
+	// Largest primitives drawn into the CPU occlusion buffer each frame, 0
+	// disables occlusion culling.
+	UINT occluders = 32;
+	// Frames between dumps of the occlusion buffer as a PNG, 0 for none.
+	UINT occlusionDumpInterval = 0;
+	// glTF or GLB scene to load, the bundled Cube when empty.
+	std::string scenePath;
+	// Reads kept in flight while the scene's files load.
+	UINT assetQueueDepth = 64;
+	// Watch the scene's files and the shaders, and rebuild what changed in
+	// them between frames. Rasterized frames only.
+	bool hotReload = false;
+	// 1 MiB blocks of encoded images queued or being written at once; the
+	// encoder waits for one to complete beyond that.
+	UINT writeQueueDepth = 8;
+};
+
 class Renderer {
 public:
-	Renderer(UINT width, UINT height, std::string title);
+	Renderer(UINT width, UINT height, std::string title, const RendererOptions& options = {});
 	~Renderer();
 
 	void Init();
 	void Update(double_t deltaTime);
 	void DrawNode(uint64_t nodeIndex);
 	void Render();
+	// Updates to the time of frame at frameRate and renders it as that frame,
+	// for shard workers that are handed frames out of order. Returns once the
+	// frame is written, so it can be reported done.
+	void RenderFrame(uint64_t frame, double_t frameRate);
 	void Destroy();
+	// Writes current and peak memory by scene, category and domain, with the
+	// OS view of video memory next to the tracked totals.
+	void ReportMemory();
+	// Tracked bytes across every domain, and in local video memory.
+	MemoryUsage TrackedMemory() const { return m_memoryTracker.ProcessUsage(); }
+	MemoryUsage TrackedMemory(MemoryDomain domain) const { return m_memoryTracker.Usage(domain); }
 
 	LONG GetWidth() const { return m_width; }
 	LONG GetHeight() const { return m_height; }
@@ -38,6 +123,38 @@ private:
 	UINT fCounter = 0;
 
 	uint64_t alignPow2(uint64_t value, uint64_t alignement);
+	void renderTile(LONG x, LONG y, UINT width, UINT height);
+	void writeRows(const uint8_t* rows, size_t rowPitch, UINT rowCount);
+	void retireTile();
+	void beginFrameOutput(uint64_t frame);
+	void endFrameOutput(uint64_t frame);
+	// Logs the images whose writes have completed.
+	void reportFrameWrites();
+	const uint8_t* accessorData(const tinygltf::Accessor& accessor);
+	std::vector<uint32_t> readIndices(const tinygltf::Accessor& accessor);
+	std::vector<float> readFloats(const tinygltf::Accessor& accessor);
+	struct DedupStats;
+	// Loads a glTF or GLB scene, returning the files it was read from in files.
+	bool loadScene(const std::string& path, tinygltf::Model& model, std::vector<std::string>& files);
+	// Points every reference to an image, buffer view or material at the first
+	// identical one and drops the duplicate images and materials.
+	void deduplicateScene(tinygltf::Model& model, std::vector<std::vector<std::pair<size_t, size_t>>>& uploadRanges, DedupStats& stats);
+	static ContentHash materialHash(const tinygltf::Material& gltfMaterial);
+	void loadAnimations();
+	void updateNode(uint64_t nodeIndex, DirectX::FXMMATRIX parent);
+	void updateNodes();
+	std::vector<uint16_t> readJoints(const tinygltf::Accessor& accessor);
+	void loadDeformations();
+	void deformMeshes();
+	void loadRayTracing();
+	void updateRayTracingInstances();
+	HRESULT createCommittedResource(const D3D12_HEAP_PROPERTIES& heapProperties, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clearValue, MemoryCategory category, uint32_t scene, ComPtr<ID3D12Resource>& resource);
+	void checkVideoMemory();
+	void requestTextureMips();
+	void updateTextureResidency();
+	// Draws the largest occluders into the occlusion buffer and tests every
+	// drawn primitive's bounds against it.
+	void updateOcclusion();
 
 	struct RenderTarget {
 		ComPtr<ID3D12Resource> texture;
@@ -45,6 +162,8 @@ private:
 		ComPtr<ID3D12Resource> depthTexture;
 		D3D12_CPU_DESCRIPTOR_HANDLE dsvDescriptor = {};
 		ComPtr<ID3D12Resource> dest;
+		// Persistently mapped; rows are footprint.Footprint.RowPitch apart.
+		uint8_t* destData = nullptr;
 		D3D12_CLEAR_VALUE clearValue = {};
 		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
 		UINT rowCount = 0;
@@ -69,22 +188,29 @@ private:
 
 	struct Material {
 		std::string name;
+		bool doubleSided;
 		D3D12_BLEND_DESC blendDesc;
 		D3D12_RASTERIZER_DESC rasterizerDesc;
-		ComPtr<ID3D12Resource> buffer;
-		void* bufferData;
+		// Copied into each submission's constants by the draws that use it.
+		PBRMetallicRoughness constants;
 		ComPtr<ID3D12DescriptorHeap> SRVDescriptorHeap;
 		ComPtr<ID3D12DescriptorHeap> samplerDescriptorHeap;
+		// glTF images behind the base color and metallic roughness SRVs, -1 for none.
+		int32_t textureSources[2];
 	};
 
 	struct Attribute {
-		std::string name;
+		// Points into m_scene, null terminated.
+		std::string_view name;
 		DXGI_FORMAT format;
 		D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
 	};
 
 	struct Primitive {
 		std::vector<Attribute> attributes;
+		// Indices into m_shaderVariants.
+		uint32_t vertexShader;
+		uint32_t pixelShader;
 		uint32_t vertexCount;
 		D3D12_PRIMITIVE_TOPOLOGY primitiveTopology;
 		D3D12_INDEX_BUFFER_VIEW indexBufferView;
@@ -92,6 +218,17 @@ private:
 		Material* material;
 		ComPtr<ID3D12RootSignature> rootSignature;
 		ComPtr<ID3D12PipelineState> pipelineState;
+		std::vector<Lod> lods;
+		DirectX::XMFLOAT3 boundsCenter;
+		float boundsRadius;
+		ComPtr<ID3D12Resource> lodIndexBuffer;
+		bool coneCulling;
+		// Texture coordinate units per object space unit, 0 without TEXCOORD_0.
+		float textureDensity = 0.0f;
+		// LOD level drawn into the occlusion buffer and the positions it indexes,
+		// three floats per vertex. Empty for primitives that cannot occlude.
+		std::vector<uint32_t> occluderIndices;
+		std::vector<float> occluderPositions;
 	};
 
 	struct Mesh {
@@ -100,7 +237,62 @@ private:
 	};
 
 	struct Node {
+		// World matrix, the product of the local transforms up to the root.
 		DirectX::XMFLOAT4X4 M;
+		// Nodes given as a matrix cannot be animated and keep it as their local transform.
+		DirectX::XMFLOAT4X4 matrix;
+		bool hasMatrix;
+		int32_t skin;
+		uint32_t jointOffset;
+		// First of the node's entries in m_deformedPrimitives, one per mesh primitive, or -1.
+		int32_t deformedPrimitives;
+		// First of the node's entries in m_primitiveVisible, one per mesh primitive.
+		uint32_t primitiveOffset;
+	};
+
+	struct Skin {
+		std::vector<uint32_t> joints;
+		std::vector<DirectX::XMFLOAT4X4> inverseBindMatrices;
+	};
+
+	// Per frame vertex streams of one primitive drawn by one node. The buffer
+	// holds FrameCount copies of the streams, written one frame each in turn.
+	struct DeformedPrimitive {
+		uint64_t nodeIndex;
+		// Index into m_deformableMeshes, UINT32_MAX for primitives drawn from their glTF buffers.
+		uint32_t mesh;
+		ComPtr<ID3D12Resource> buffer;
+		DeformedStreams streams[FrameCount];
+		std::vector<D3D12_VERTEX_BUFFER_VIEW> vertexBufferViews[FrameCount];
+	};
+
+	struct DedupStats {
+		uint64_t images = 0;
+		uint64_t imageBytes = 0;
+		uint64_t bufferViews = 0;
+		uint64_t bufferViewBytes = 0;
+		uint64_t materials = 0;
+		// Bytes of the buffers, of the ranges accessors read before duplicates
+		// were dropped, and of those they still read, which are uploaded.
+		uint64_t bufferBytes = 0;
+		uint64_t readBufferBytes = 0;
+		uint64_t uploadBufferBytes = 0;
+		double hashMicroseconds = 0.0;
+	};
+
+	struct PendingTile {
+		UINT slot;
+		LONG x;
+		LONG y;
+		UINT width;
+		UINT height;
+		uint64_t frame;
+	};
+
+	struct DeformChunk {
+		uint32_t deformedPrimitive;
+		uint32_t first;
+		uint32_t count;
 	};
 
 	struct Camera {
@@ -109,7 +301,87 @@ private:
 		DirectX::XMFLOAT4X4 VP;
 	};
 
+	// One compile per shader, target and attribute set, shared by every
+	// primitive that uses it.
+	struct ShaderVariant {
+		std::string path;
+		const char* target;
+		std::vector<std::string> defines;
+		ComPtr<ID3DBlob> shader;
+	};
+
+	// Hashes a reload compares. Scenes with the same structure differ only in
+	// what can be rebuilt in place: image pixels, buffer contents, mesh data,
+	// material parameters and node transforms.
+	struct SceneSignature {
+		ContentHash structure;
+		std::vector<ContentHash> images;
+		std::vector<ContentHash> buffers;
+		std::vector<ContentHash> meshes;
+		std::vector<ContentHash> materials;
+		std::vector<ContentHash> nodes;
+	};
+
+	// A replaced GPU object, released once the direct queue passes fenceValue.
+	struct RetiredObject {
+		ComPtr<IUnknown> object;
+		uint64_t fenceValue;
+	};
+
+	// Steps of Init, each run as one task of its graph.
+	void initDevice();
+	void initRenderTarget(UINT slot);
+	void uploadBuffers();
+	ComPtr<ID3D12Resource> uploadBuffer(size_t bufferIndex);
+	void uploadTextures(const std::vector<std::vector<TextureMipLevel>>& tailLevels);
+	ComPtr<ID3D12Resource> uploadTexture(const std::vector<TextureMipLevel>& levels);
+	void buildLods(size_t meshIndex, std::vector<std::vector<uint32_t>>& lodIndices);
+	void uploadLodIndices(size_t meshIndex, const std::vector<std::vector<uint32_t>>& lodIndices);
+	void initSamplers();
+	void initMaterial(size_t materialIndex);
+	void initPrimitiveViews(size_t meshIndex);
+	void initPipeline(size_t meshIndex, size_t primitiveIndex, ID3DBlob* vertexShader, ID3DBlob* pixelShader);
+	void initNodes();
+	static void readNodeTransform(const tinygltf::Node& gltfNode, Node& node, NodeTransform& transform);
+	void readNodeWeights(size_t nodeIndex);
+	void initConstantAllocator();
+	// Points m_textureDescriptors at every material's texture SRVs.
+	void collectTextureDescriptors();
+	// Frees the tinygltf model's buffers and the pixels no texture streams from anymore.
+	void releaseSceneSource();
+	bool streamsFromSource(size_t imageIndex) const;
+	uint64_t sceneSourceBytes() const;
+	uint64_t occlusionBytes() const;
+	std::vector<Attribute> vertexAttributes(const tinygltf::Primitive& gltfPrimitive) const;
+	static std::vector<std::string> shaderDefines(const std::vector<Attribute>& attributes);
+	static D3D_PRIMITIVE_TOPOLOGY primitiveTopology(int mode);
+	static void compileShader(const std::string& path, const std::vector<std::string>& defines, const char* target, ID3DBlob** shader);
+	void createRootSignature(const D3D12_ROOT_SIGNATURE_DESC& rootSignatureDesc, ComPtr<ID3D12RootSignature>& rootSignature);
+	static std::vector<D3D12_INPUT_ELEMENT_DESC> buildInputElementDescs(const std::vector<Attribute>& attributes);
+
+	// Hot reload, applied at the start of Update.
+	void retire(ComPtr<IUnknown> object);
+	void releaseRetired();
+	void applyReloads();
+	void reloadShaders(const std::vector<std::string>& paths);
+	void reloadScene();
+	// Retires the primitives' pipelines and builds them from the current shaders.
+	void rebuildPipelines(const std::vector<std::pair<size_t, size_t>>& primitives);
+	SceneSignature signScene(const tinygltf::Model& model, const std::vector<std::vector<std::pair<size_t, size_t>>>& uploadRanges) const;
+
+	// Only needed until the scene is on the GPU; see releaseSceneSource.
 	tinygltf::Model m_gltfModel;
+	SceneModel m_scene;
+
+	// Declared ahead of every resource: destruction callbacks report to it
+	// until the last one is released.
+	MemoryTracker m_memoryTracker;
+	uint32_t m_memoryScene = 0;
+	MemoryAllocation m_sceneSourceMemory = {};
+	MemoryAllocation m_rayTracingMemory = {};
+	MemoryAllocation m_occlusionMemory = {};
+	UINT m_memoryReportInterval = 0;
+	bool m_videoMemoryWarned = false;
 
 	ComPtr<IDXGIFactory7> m_factory;
 	ComPtr<IDXGIAdapter4> m_adapter;
@@ -117,40 +389,117 @@ private:
 	RenderTarget m_renderTargets[FrameCount];
 
 	ComPtr<ID3D12CommandQueue> m_directCommandQueue;
-	ComPtr<ID3D12Fence1> m_directFence;
 	ComPtr<ID3D12CommandAllocator> m_directCommandAllocators[FrameCount];
 	ComPtr<ID3D12GraphicsCommandList4> m_directCommandList;
-	UINT64 m_directFenceValue = 0;
-	HANDLE m_directFenceEvent = 0;
 
 	ComPtr<ID3D12CommandQueue> m_copyCommandQueue;
-	ComPtr<ID3D12Fence1> m_copyFence;
 	ComPtr<ID3D12CommandAllocator> m_copyCommandAllocator[FrameCount];
 	ComPtr<ID3D12GraphicsCommandList> m_copyCommandList;
-	UINT64 m_copyFenceValue = 0;
-	HANDLE m_copyFenceEvent = 0;
+
+	// Owns the fences of both queues; slots index the per frame allocators,
+	// render targets and camera buffers.
+	FrameScheduler m_frameScheduler;
+	// Tiles submitted but not yet written out, oldest first.
+	std::deque<PendingTile> m_pendingTiles;
+	// Scene and streamed texture uploads share one staging ring.
+	UploadManager m_uploadManager;
+	UINT64 m_uploadRingSize = 0;
 
 	UINT m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 	ComPtr<ID3D12DescriptorHeap> m_rtvDescriptorHeaps[FrameCount];
 	ComPtr<ID3D12DescriptorHeap> m_dsvDescriptorHeaps[FrameCount];
 	D3D12_DEPTH_STENCIL_DESC dsDesc;
 
+	// Null for glTF buffers no accessor reads after deduplication.
 	std::vector<ComPtr<ID3D12Resource>> m_buffers;
+	// Merged [begin, end) byte ranges of each glTF buffer that are uploaded.
+	std::vector<std::vector<std::pair<size_t, size_t>>> m_bufferUploadRanges;
+	DedupStats m_dedupStats;
+	// One per glTF image, holding mips [m_textureResidentMips[i], mip count).
 	std::vector<ComPtr<ID3D12Resource>> m_textures;
+	std::vector<uint32_t> m_textureResidentMips;
+	// Material SRVs to rewrite when a texture is rebuilt.
+	std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>> m_textureDescriptors;
+	TextureResidency m_textureResidency;
+	TextureStreamer m_textureStreamer;
+	std::vector<TextureResidencyChange> m_textureStreams;
+	std::vector<TextureResidencyChange> m_textureEvictions;
+	double_t m_textureResidencyMicroseconds = 0.0;
 	std::vector<D3D12_SAMPLER_DESC> m_samplerDescs;
 	std::vector<Material> m_materials;
 	std::vector<Mesh> m_meshes;
-	std::vector<ComPtr<ID3D12Resource>> m_nodeBuffers;
-	ComPtr<ID3D12Resource> m_cameraBuffer;
+	std::vector<Node> m_nodes;
+	std::vector<NodeTransform> m_nodeTransforms;
+	std::vector<std::vector<float>> m_nodeWeights;
+	AnimationSet m_animations;
+	int m_animation = -1;
+	double_t m_animationTime = 0.0;
+	// Sum of every Update's deltaTime; the camera orbit is a function of it.
+	double_t m_sceneTime = 0.0;
+	double_t m_animationMicroseconds = 0.0;
+	AnimationStats m_animationStats;
+
+	std::unique_ptr<ThreadPool> m_threadPool;
+	std::vector<Skin> m_skins;
+	std::vector<DirectX::XMFLOAT4X4> m_jointMatrices;
+	std::vector<DeformableMesh> m_deformableMeshes;
+	std::vector<DeformedPrimitive> m_deformedPrimitives;
+	std::vector<DeformChunk> m_deformChunks;
+	// Copy of the deformed streams this frame writes and draws, and the direct
+	// fence value of the last submission that drew each copy.
+	uint32_t m_deformedCopy = 0;
+	uint64_t m_deformedCopyFences[FrameCount] = {};
+	uint64_t m_deformedVertices = 0;
+	double_t m_deformMicroseconds = 0.0;
+	// Traced meshes keep their bind pose; skinning and morphing only reach the rasterizer.
+	std::unique_ptr<RayTracer> m_rayTracer;
+	std::vector<uint32_t> m_rayTracingMeshes;
+	UINT m_occlusionSamples = 8;
+	RayTracingStats m_rayTracingStats;
+	double_t m_rayTracingMicroseconds = 0.0;
+	double_t m_instanceBuildMicroseconds = 0.0;
+	// Camera, node and material constants of the submissions in flight.
+	ConstantAllocator m_constantAllocator;
+	D3D12_GPU_VIRTUAL_ADDRESS m_cameraConstants = 0;
+	// Each material's constants in the current submission, 0 until a draw uses it.
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> m_materialConstants;
+
+	Camera m_camera = {};
+	DirectX::XMFLOAT3 m_cameraPosition = {};
+	CullingView m_cullingView = {};
+	MeshletStats m_meshletStats;
+	LodStats m_lodStats;
+	float m_lodProjectionScale = 1.0f;
+	std::vector<IndexRange> m_drawRanges;
+
+	// Rebuilt once per frame and shared by all of its tiles.
+	OcclusionBuffer m_occlusionBuffer;
+	std::vector<Occluder> m_occluders;
+	std::vector<std::pair<float, Occluder>> m_occluderCandidates;
+	// 0 for primitives the occlusion buffer hides this frame.
+	std::vector<uint8_t> m_primitiveVisible;
+	OcclusionStats m_occlusionStats;
+	UINT m_maxOccluders = 0;
+	UINT m_occlusionDumpInterval = 0;
 
 	D3D12_VIEWPORT m_viewport;
 	D3D12_RECT m_scissorRect;
 
-	float_t* outputFloatImage = nullptr;
-	uint8_t* outputCharImage = nullptr;
+	// One band of 8 bit rows, only allocated when tiles need converting or stitching.
+	std::vector<uint8_t> m_bandImage;
+	bool m_encodeFromReadback = false;
+	// Images are encoded in memory a band at a time and written by m_frameWriter.
+	PngWriter m_pngWriter;
+	std::unique_ptr<FrameWriter> m_frameWriter;
+	std::vector<uint8_t> m_encodedBytes;
+	SequenceEncoder m_sequenceEncoder;
+	bool m_writeSequence = false;
 
 	LONG m_width;
 	LONG m_height;
+	LONG m_tileWidth;
+	LONG m_tileHeight;
+	DXGI_FORMAT m_renderTargetFormat;
 	FLOAT m_aspectRatio;
 	std::string m_title;
 	std::chrono::milliseconds currentFrameTime;
@@ -158,4 +507,19 @@ private:
 	std::string m_vertexShaderPath;
 	std::string m_pixelShaderPath;
 	std::string m_grayPixelShaderPath;
+	std::vector<ShaderVariant> m_shaderVariants;
+
+	std::string m_scenePath;
+	UINT m_assetQueueDepth = 64;
+	bool m_hotReload = false;
+	FileWatcher m_fileWatcher;
+	SceneSignature m_sceneSignature;
+	std::deque<RetiredObject> m_retiredObjects;
+	// Pixels of images a reload replaced, kept while streams may still read
+	// them, and the images whose streams in flight are building stale mips.
+	std::vector<std::vector<unsigned char>> m_retiredImagePixels;
+	std::vector<uint8_t> m_staleTextureStreams;
+	// Images whose source could not be decoded again; their textures keep the
+	// mips they have until a reload changes the image.
+	std::vector<uint8_t> m_lostTextureSources;
 };
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct SceneParameters {
+	uint32_t nodes = 64;
+	// Levels of the node hierarchy, 1 puts every node at the root.
+	uint32_t depth = 4;
+	// Nodes sharing each mesh, 1 gives every node a mesh of its own.
+	uint32_t instancing = 4;
+	uint32_t materials = 8;
+	// Base color textures shared round robin by the materials, 0 for none.
+	uint32_t textures = 4;
+	uint32_t textureSize = 256;
+	// Triangles per mesh, rounded to the nearest sphere tessellation.
+	uint32_t triangles = 2048;
+	uint32_t seed = 1;
+};
+
+struct SceneStats {
+	uint32_t meshes = 0;
+	// Depth of the hierarchy actually built.
+	uint32_t depth = 0;
+	uint32_t trianglesPerMesh = 0;
+	// Triangles drawn per frame, every instance counted.
+	uint64_t sceneTriangles = 0;
+	uint64_t bufferBytes = 0;
+	// Decoded bytes of all textures.
+	uint64_t textureBytes = 0;
+	// Bytes written, texture files included.
+	uint64_t fileBytes = 0;
+};
+
+// Writes a procedural scene: a grid of bumpy spheres fitting the renderer's
+// default view, every mesh and texture different so that none of them are
+// deduplicated at load. The scene is a .glb when path ends in ".glb" and a
+// .gltf with a .bin next to it otherwise; textures are PNG files next to it
+// either way.
+bool GenerateScene(const std::string& path, const SceneParameters& parameters, SceneStats& stats);
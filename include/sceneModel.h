@@ -0,0 +1,63 @@
+#pragma once
+#include "arena.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tinygltf {
+class Model;
+}
+
+struct SceneNode {
+	// -1 for nodes without a mesh.
+	int32_t mesh = -1;
+	std::span<const uint32_t> children;
+};
+
+struct SceneImage {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t components = 0;
+	uint32_t bits = 0;
+	// Decoded pixels, empty once nothing needs them anymore.
+	std::vector<unsigned char> pixels;
+	// Where the encoded image can be read again once its pixels are released:
+	// its file, or a copy of its bytes when they are in a buffer view. Neither
+	// is set for data URIs.
+	std::string sourcePath;
+	std::shared_ptr<const std::vector<unsigned char>> sourceBytes;
+};
+
+// What drawing and streaming need of a glTF scene once it is on the GPU, so
+// the tinygltf model can be released. The node hierarchy and attribute names
+// live in one arena; image pixels are kept one buffer per image, since each
+// is released on its own once its texture no longer streams from it.
+class SceneModel {
+public:
+	// Copies the default scene's hierarchy and takes over the model's pixels.
+	void Build(tinygltf::Model& model);
+
+	std::span<const SceneNode> Nodes() const { return m_nodes; }
+	// Nodes of the default scene.
+	std::span<const uint32_t> Roots() const { return m_roots; }
+	// The copy of a vertex attribute name of the model Build saw, which stays
+	// valid until the next Build; empty for names it did not see.
+	std::string_view AttributeName(std::string_view name) const;
+
+	std::vector<SceneImage>& Images() { return m_images; }
+	const std::vector<SceneImage>& Images() const { return m_images; }
+	void ReleasePixels(size_t imageIndex);
+
+	// Arena, pixel and kept encoded image bytes held.
+	uint64_t Bytes() const;
+
+private:
+	Arena m_arena;
+	std::span<const SceneNode> m_nodes;
+	std::span<const uint32_t> m_roots;
+	std::span<const std::string_view> m_attributeNames;
+	std::vector<SceneImage> m_images;
+};
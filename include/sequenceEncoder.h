@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Tile size of the sequence format, in pixels.
+constexpr uint32_t kSequenceTileSize = 64;
+
+struct SequenceStats {
+	uint64_t frames = 0;
+	uint64_t tiles = 0;
+	uint64_t skippedTiles = 0;
+	uint64_t rawBytes = 0;
+	uint64_t encodedBytes = 0;
+};
+
+// Writes a sequence of 8 bit RGBA frames to a single file. Frames are split
+// into 64x64 tiles; tiles whose hash matches the previous frame are skipped
+// and changed tiles are stored as a zero run length coded XOR against the
+// previous frame. Every keyframeInterval frames all tiles are stored in full,
+// so a decoder can start from any keyframe.
+class SequenceEncoder {
+public:
+	bool Open(const std::string& path, uint32_t width, uint32_t height, uint32_t keyframeInterval);
+	// Rows of the current frame, top to bottom, in bands of any height.
+	void WriteRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount);
+	bool EndFrame();
+	bool Close();
+	const SequenceStats& Stats() const { return m_stats; }
+
+private:
+	struct TileHash {
+		uint64_t low;
+		uint64_t high;
+	};
+
+	void encodeStrip(const uint8_t* rows, size_t rowPitch, uint32_t rowCount);
+
+	std::ofstream m_file;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_keyframeInterval = 1;
+	uint32_t m_tileColumns = 0;
+	uint64_t m_frameIndex = 0;
+	bool m_keyframe = true;
+
+	// Rows of the strip of tiles being filled, only used when bands do not
+	// line up with tile rows.
+	std::vector<uint8_t> m_strip;
+	uint32_t m_stripRows = 0;
+	uint32_t m_stripY = 0;
+
+	std::vector<uint8_t> m_previous;
+	std::vector<TileHash> m_tileHashes;
+	std::vector<uint8_t> m_delta;
+	std::vector<uint8_t> m_coded;
+	std::vector<uint8_t> m_payload;
+	SequenceStats m_stats;
+};
+
+// Reads files written by SequenceEncoder. Frames decode fastest in order;
+// seeking backwards restarts from the closest keyframe.
+class SequenceDecoder {
+public:
+	bool Open(const std::string& path);
+	uint32_t Width() const { return m_width; }
+	uint32_t Height() const { return m_height; }
+	uint32_t FrameCount() const { return static_cast<uint32_t>(m_frames.size()); }
+	// Reconstructs frame frameIndex as tightly packed 8 bit RGBA rows.
+	bool ReadFrame(uint32_t frameIndex, std::vector<uint8_t>& pixels);
+
+private:
+	struct FrameRecord {
+		uint64_t offset;
+		uint32_t size;
+		bool keyframe;
+	};
+
+	bool applyFrame(const FrameRecord& frame);
+
+	std::ifstream m_file;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	std::vector<FrameRecord> m_frames;
+	std::vector<uint8_t> m_frame;
+	int64_t m_decodedFrame = -1;
+	std::vector<uint8_t> m_payload;
+	std::vector<uint8_t> m_delta;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ShardCoordinatorOptions {
+	// Frames [firstFrame, endFrame) are split across the workers.
+	uint64_t firstFrame = 0;
+	uint64_t endFrame = 0;
+	uint32_t workerCount = 1;
+	// Smallest range handed out. Ranges start at an eighth of a worker's share
+	// and shrink towards this as frames run out.
+	uint64_t minRange = 1;
+	// Worker command line, speaking the ShardWorker protocol on stdin and
+	// stdout. {worker}, {node} and {threads} are replaced in every argument.
+	std::vector<std::string> command;
+	// Pins worker i to the CPUs of NUMA node i % nodes before it starts. Its
+	// memory then comes from that node too, as pages go to the node of the
+	// CPU that first touches them.
+	bool pinToNumaNodes = true;
+};
+
+struct ShardWorkerReport {
+	uint32_t node = 0;
+	uint32_t threads = 0;
+	double startupMilliseconds = 0.0;
+	uint64_t frames = 0;
+	uint64_t ranges = 0;
+	// Frames taken from stragglers, and frames given up to other workers.
+	uint64_t stolenFrames = 0;
+	uint64_t lostFrames = 0;
+	// Sum of the frame times the worker reported.
+	double busyMilliseconds = 0.0;
+	// Global frame indices in the order the worker rendered them, which is the
+	// order they appear in its output.
+	std::vector<uint64_t> frameOrder;
+	bool failed = false;
+};
+
+struct ShardReport {
+	double wallMilliseconds = 0.0;
+	uint64_t frames = 0;
+	uint64_t steals = 0;
+	// Frames handed out again after their worker failed, whether it had
+	// reported them or not.
+	uint64_t requeuedFrames = 0;
+	// Frame times indexed by frame - firstFrame.
+	std::vector<double> frameMilliseconds;
+	std::vector<ShardWorkerReport> workers;
+	// Stats from every worker's done lines, summed.
+	std::map<std::string, double> stats;
+};
+
+// CPUs of every NUMA node with any, by node. A machine without NUMA
+// information is one node holding the CPUs this process may run on.
+std::vector<std::vector<int>> NumaNodeCpus();
+
+// Starts the workers, hands out frame ranges as workers become free and, once
+// none are left, steals the back half of the unstarted frames of the busiest
+// worker for each idle one. A worker that fails has every frame it was given
+// handed out again, as its output cannot be trusted. Returns false when a
+// worker cannot be started or frames remain after every worker has failed.
+bool RunShards(const ShardCoordinatorOptions& options, ShardReport& report);
+
+// Writes one sequence holding every frame of the run in order, read from the
+// per worker sequences at shardPaths[worker].
+bool MergeShardSequences(const ShardReport& report, uint64_t firstFrame, const std::vector<std::string>& shardPaths, const std::string& path, uint32_t keyframeInterval);
@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Line protocol between renderlab-shard and its workers. Frame ranges are half
+// open and use global frame indices.
+//
+//   coordinator to worker:
+//     render <first> <end>    render frames [first, end)
+//     steal <end>             stop the current range at end or as early after
+//                             it as frames already started allow
+//     quit
+//   worker to coordinator:
+//     ready
+//     frame <index> <ms>      a frame finished, in the order rendered
+//     stolen <end>            the range now ends at end
+//     done <first> <end> [name=value ...]
+//                             the range is finished, with stats summed over it
+//
+// Only the two streams are used, so a worker can be started through ssh or
+// any other remote shell just as well as locally.
+class ShardWorker {
+public:
+	ShardWorker(std::istream& input, std::ostream& output);
+	~ShardWorker();
+	ShardWorker(const ShardWorker&) = delete;
+	ShardWorker& operator=(const ShardWorker&) = delete;
+
+	// Next frame to render. Blocks for a new range once the current one is
+	// done and returns false when told to quit or the input closes.
+	bool NextFrame(uint64_t& frame);
+	void FrameDone(uint64_t frame, double milliseconds);
+	// Adds to a stat reported with the current range.
+	void AddStat(const std::string& name, double value);
+
+private:
+	void readLoop();
+	// Applies one command; returns false for quit.
+	bool apply(const std::string& command);
+	void finishRange();
+	void send(const std::string& line);
+
+	std::istream& m_input;
+	std::ostream& m_output;
+	std::thread m_reader;
+	std::mutex m_mutex;
+	std::condition_variable m_received;
+	std::deque<std::string> m_commands;
+
+	bool m_active = false;
+	uint64_t m_first = 0;
+	uint64_t m_next = 0;
+	uint64_t m_end = 0;
+	std::map<std::string, double> m_stats;
+};
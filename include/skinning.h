@@ -0,0 +1,39 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Offsets of one morph target. Empty arrays leave that attribute untouched.
+struct MorphTarget {
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<DirectX::XMFLOAT3> tangents;
+};
+
+// Bind pose vertex data of a skinned or morphed primitive, decoded once at load.
+struct DeformableMesh {
+	uint32_t vertexCount = 0;
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<DirectX::XMFLOAT4> tangents;
+	// Four joint indices and weights per vertex, empty when the primitive is not skinned.
+	std::vector<uint16_t> joints;
+	// Largest of joints, checked against the skin of every node drawing the mesh.
+	uint16_t maxJoint = 0;
+	std::vector<DirectX::XMFLOAT4> weights;
+	std::vector<MorphTarget> targets;
+};
+
+// Destination streams, tightly packed. normals and tangents may be null when
+// the mesh has none.
+struct DeformedStreams {
+	DirectX::XMFLOAT3* positions;
+	DirectX::XMFLOAT3* normals;
+	DirectX::XMFLOAT4* tangents;
+};
+
+// Blends morph targets by morphWeights, then skins by the four weighted joint
+// matrices of each vertex, for vertices [first, first + count). jointMatrices
+// may be null for morph only primitives. Streams are written front to back
+// only, so they can point into write combined upload memory.
+void DeformVertices(const DeformableMesh& mesh, const DirectX::XMFLOAT4X4* jointMatrices, const float* morphWeights, uint32_t morphWeightCount, uint32_t first, uint32_t count, const DeformedStreams& streams);
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct TaskGraphStats {
+	uint32_t threads = 0;
+	double wallMilliseconds = 0.0;
+	// Sum of every task's run time.
+	double workMilliseconds = 0.0;
+	// Longest chain of dependent tasks by run time, which bounds the wall time
+	// however many threads there are.
+	double criticalPathMilliseconds = 0.0;
+	std::vector<uint32_t> criticalPath;
+	uint64_t steals = 0;
+};
+
+// Tasks with dependencies, run once each on a thread pool's threads. Every
+// thread keeps a deque of ready tasks: it pushes the tasks its own work made
+// ready and pops them newest first, and once its deque is empty it steals the
+// oldest task of another thread. Tasks must not call ThreadPool::ParallelFor,
+// since the graph occupies the pool while it runs.
+class TaskGraph {
+public:
+	TaskGraph() = default;
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	uint32_t Add(std::string name, std::function<void()> work, const std::vector<uint32_t>& dependencies = {});
+	// task runs only once dependency has finished.
+	void Depend(uint32_t task, uint32_t dependency);
+
+	// Runs every task and returns once all are done. Dependencies must not form
+	// a cycle.
+	void Run(ThreadPool& threadPool);
+
+	const TaskGraphStats& Stats() const { return m_stats; }
+	const std::string& Name(uint32_t task) const { return m_tasks[task].name; }
+	double Milliseconds(uint32_t task) const { return m_tasks[task].milliseconds; }
+	// The critical path task by task, then the slowest tasks.
+	std::string Report(size_t slowest = 5) const;
+
+private:
+	struct Task {
+		std::string name;
+		std::function<void()> work;
+		std::vector<uint32_t> dependencies;
+		std::vector<uint32_t> successors;
+		std::atomic<uint32_t> pending = 0;
+		double milliseconds = 0.0;
+	};
+
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<uint32_t> tasks;
+	};
+
+	void workerLoop(uint32_t worker);
+	bool pop(uint32_t worker, uint32_t& task);
+	bool steal(uint32_t worker, uint32_t& task);
+	void push(uint32_t worker, uint32_t task);
+	void execute(uint32_t worker, uint32_t task);
+	void findCriticalPath();
+
+	std::deque<Task> m_tasks;
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	// Tasks in finishing order, which is a topological order.
+	std::vector<uint32_t> m_finished;
+	std::mutex m_finishedMutex;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::atomic<uint64_t> m_queued = 0;
+	std::atomic<uint64_t> m_remaining = 0;
+	std::atomic<uint32_t> m_sleeping = 0;
+	std::atomic<uint64_t> m_steals = 0;
+	TaskGraphStats m_stats;
+};
@@ -0,0 +1,166 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Mips whose larger edge is at most this many texels form a texture's tail,
+// which is resident from the start so every texture can be sampled at once.
+constexpr uint32_t kTextureTailSize = 64;
+
+constexpr uint32_t kNoTextureMip = UINT32_MAX;
+
+uint32_t TextureMipCount(uint32_t width, uint32_t height);
+// Bytes of mips [firstMip, endMip), tightly packed.
+uint64_t TextureMipBytes(uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t firstMip, uint32_t endMip);
+// Finest mip worth sampling where one screen pixel spans uvPerPixel texture
+// coordinates, judged by the texture's larger edge.
+uint32_t TextureMipForFootprint(float uvPerPixel, uint32_t width, uint32_t height);
+// Texture coordinate units per world unit of an indexed triangle list, the
+// square root of its total UV area over its total surface area. positions are
+// three floats and texcoords two floats per vertex. 0 when either area is empty.
+float TextureCoordinateDensity(const float* positions, const float* texcoords, const uint32_t* indices, size_t indexCount);
+
+struct TextureMipLevel {
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> pixels;
+};
+
+// Box filters source down mip by mip and keeps levels [firstMip, endMip).
+// Channels are averaged as stored, sRGB included.
+void BuildTextureMips(const uint8_t* source, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t firstMip, uint32_t endMip, std::vector<TextureMipLevel>& levels);
+
+// A change of a texture's resident range: mips [mip, mipCount) are to be resident.
+struct TextureResidencyChange {
+	uint32_t texture;
+	uint32_t mip;
+};
+
+struct TextureResidencyStats {
+	uint64_t residentBytes = 0;
+	uint64_t pendingBytes = 0;
+	uint64_t budgetBytes = 0;
+	// Of the last Update.
+	uint32_t requested = 0;
+	uint32_t streamed = 0;
+	uint32_t evicted = 0;
+	// Textures left coarser than wanted because the budget could not fit them.
+	uint32_t deferred = 0;
+	uint64_t streamedBytes = 0;
+	uint64_t evictedBytes = 0;
+};
+
+// Decides which mips of each texture are resident. Every frame the renderer
+// requests the mip each visible texture needs; Update then streams in the
+// missing finer mips, largest shortfall first, and makes room for them by
+// evicting the finer mips of the least recently used textures that hold more
+// than they currently want. Tail mips are never evicted. Nothing here touches
+// the GPU: streams and evictions are handed back to the caller to carry out.
+class TextureResidency {
+public:
+	// 0 for an unlimited budget.
+	void SetBudget(uint64_t bytes) { m_stats.budgetBytes = bytes; }
+
+	// Returns the texture's index; its tail mips count as resident from here on.
+	uint32_t AddTexture(uint32_t width, uint32_t height, uint32_t bytesPerPixel);
+	uint32_t TextureCount() const { return static_cast<uint32_t>(m_textures.size()); }
+	uint32_t MipCount(uint32_t texture) const { return m_textures[texture].mipCount; }
+	uint32_t TailMip(uint32_t texture) const { return m_textures[texture].tailMip; }
+	uint32_t ResidentMip(uint32_t texture) const { return m_textures[texture].residentMip; }
+	// Whether a stream Update asked for has not been completed or cancelled yet.
+	bool Pending(uint32_t texture) const { return m_textures[texture].pendingMip != kNoTextureMip; }
+
+	// Starts collecting this frame's requests.
+	void BeginFrame();
+	void Request(uint32_t texture, uint32_t mip);
+	void RequestFootprint(uint32_t texture, float uvPerPixel);
+
+	// streams receives the textures to stream finer mips for, evictions the
+	// textures to shrink. Textures with a stream in flight are left alone until
+	// it completes.
+	void Update(std::vector<TextureResidencyChange>& streams, std::vector<TextureResidencyChange>& evictions);
+	// The stream Update asked for has been made resident.
+	void Complete(uint32_t texture);
+	// The stream Update asked for was dropped; the texture keeps the mips it
+	// had and may be streamed again.
+	void Cancel(uint32_t texture);
+
+	const TextureResidencyStats& Stats() const { return m_stats; }
+
+private:
+	struct Texture {
+		uint32_t width;
+		uint32_t height;
+		uint32_t bytesPerPixel;
+		uint32_t mipCount;
+		uint32_t tailMip;
+		uint32_t residentMip;
+		// Finest mip requested this frame, the tail when unused.
+		uint32_t wantedMip;
+		uint32_t pendingMip = kNoTextureMip;
+		uint64_t lastUsedFrame = 0;
+	};
+
+	uint64_t bytes(const Texture& texture, uint32_t firstMip, uint32_t endMip) const;
+	bool fits(uint64_t bytes) const;
+	// Evicts unwanted mips of other textures, least recently used first, until
+	// bytes fit. Evicts nothing and returns false when they cannot.
+	bool makeRoom(uint64_t bytes, uint32_t requester, std::vector<TextureResidencyChange>& evictions);
+
+	std::vector<Texture> m_textures;
+	uint64_t m_frame = 0;
+	TextureResidencyStats m_stats;
+};
+
+struct TextureStreamJob {
+	uint32_t texture;
+	// Mips [firstMip, endMip) are built from the full resolution source.
+	uint32_t firstMip;
+	uint32_t endMip;
+	const uint8_t* source;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerPixel;
+	// Without a source, fills in the full resolution pixels on the streaming
+	// thread, returning false when they cannot be had.
+	std::function<bool(std::vector<uint8_t>& pixels)> load;
+};
+
+struct TextureStreamResult {
+	uint32_t texture;
+	uint32_t firstMip;
+	std::vector<TextureMipLevel> levels;
+};
+
+// Builds streamed mips on a background thread. Sources must stay alive until
+// their job's result has been taken. A job whose pixels could not be loaded
+// gives a result without levels.
+class TextureStreamer {
+public:
+	TextureStreamer();
+	~TextureStreamer();
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	void Submit(const TextureStreamJob& job);
+	// Moves every finished result into results.
+	void TakeCompleted(std::vector<TextureStreamResult>& results);
+	// Jobs submitted whose results have not been taken yet.
+	size_t Outstanding() const;
+
+private:
+	void workerLoop();
+
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<TextureStreamJob> m_jobs;
+	std::vector<TextureStreamResult> m_results;
+	size_t m_outstanding = 0;
+	bool m_stop = false;
+};
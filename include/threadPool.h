@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops. The calling thread
+// takes part in every loop, so a pool of one thread runs everything inline.
+class ThreadPool {
+public:
+	// 0 uses every hardware thread.
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Threads taking part in a loop, the caller included.
+	uint32_t ThreadCount() const { return static_cast<uint32_t>(m_threads.size()) + 1; }
+
+	// Calls function(begin, end) for chunks of at most grain items covering
+	// [0, count) and returns once every chunk is done.
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& function);
+
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(size_t, size_t)>* m_function = nullptr;
+	size_t m_count = 0;
+	size_t m_grain = 1;
+	std::atomic<size_t> m_next = 0;
+	size_t m_active = 0;
+	uint64_t m_generation = 0;
+	bool m_stop = false;
+};
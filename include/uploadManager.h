@@ -0,0 +1,106 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct UploadStats {
+	uint64_t bytes = 0;
+	uint64_t chunks = 0;
+	uint64_t batches = 0;
+	// Most ring bytes in use at once, alignment and wrap padding included.
+	uint64_t peakRingBytes = 0;
+	// Time spent waiting for the GPU to free ring space.
+	double stallMicroseconds = 0.0;
+	// Time spent in upload calls, staging copies and waits for the GPU
+	// included. Copies the GPU finishes while the caller does other work
+	// are not in it.
+	double busyMicroseconds = 0.0;
+};
+
+// One subresource's source rows, rowPitch bytes apart.
+struct UploadSubresource {
+	const void* data;
+	size_t rowPitch;
+};
+
+// Streams data to default heap resources through one persistently mapped
+// staging ring of fixed size. Copies are split into chunks of at most a
+// quarter of the ring, recorded into the open batch, and the batch is
+// submitted to the copy queue whenever the ring runs out of space. Space is
+// reclaimed from the oldest batch once its fence value has been reached, so
+// the CPU keeps filling the ring while the GPU copies earlier batches.
+class UploadManager {
+public:
+	UploadManager() = default;
+	~UploadManager();
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+
+	// ring must be a mappable upload heap buffer; its size is the ring size.
+	HRESULT Init(ID3D12Device* device, ID3D12CommandQueue* copyQueue, Microsoft::WRL::ComPtr<ID3D12Resource> ring);
+
+	void UploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size);
+	// Subresources [firstSubresource, firstSubresource + count) of a texture,
+	// split into row ranges.
+	void UploadTexture(ID3D12Resource* destination, UINT firstSubresource, UINT count, const UploadSubresource* sources);
+	// Records a GPU side copy between two textures' subresources in the open batch.
+	void CopySubresource(ID3D12Resource* destination, UINT destinationSubresource, ID3D12Resource* source, UINT sourceSubresource);
+
+	// Submits the open batch, if it holds any copies.
+	void Flush();
+	// Flushes and blocks until every batch has finished.
+	void WaitIdle();
+
+	const UploadStats& Stats() const { return m_stats; }
+
+private:
+	struct Batch {
+		uint64_t fenceValue;
+		// Ring bytes the batch allocated, returned once it completes.
+		uint64_t ringBytes;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+	};
+
+	// Returns the ring offset of size bytes aligned to alignment, submitting
+	// the open batch and waiting on older ones when the ring is full.
+	uint64_t allocate(uint64_t size, uint64_t alignment);
+	void openBatch();
+	void retireOldest();
+
+	// Adds the time of the outermost upload call to the busy time.
+	class BusyScope {
+	public:
+		explicit BusyScope(UploadManager& manager);
+		~BusyScope();
+	private:
+		UploadManager& m_manager;
+		std::chrono::high_resolution_clock::time_point m_start;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+	ID3D12CommandQueue* m_copyQueue = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_ring;
+	uint8_t* m_ringData = nullptr;
+	uint64_t m_ringSize = 0;
+	uint64_t m_chunkSize = 0;
+	uint64_t m_head = 0;
+	uint64_t m_used = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_commandList;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_allocator;
+	bool m_open = false;
+	uint64_t m_openCopies = 0;
+	uint64_t m_openRingBytes = 0;
+	std::deque<Batch> m_inFlight;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> m_freeAllocators;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
+	uint64_t m_fenceValue = 0;
+	HANDLE m_event = nullptr;
+
+	UploadStats m_stats;
+	uint32_t m_busyDepth = 0;
+};
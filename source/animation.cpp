@@ -0,0 +1,214 @@
+#include "animation.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace {
+	template <AnimationPath path>
+	XMVECTOR loadValue(const float* value) {
+		if constexpr (path == AnimationPath::Rotation) {
+			return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(value));
+		}
+		else {
+			return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(value));
+		}
+	}
+
+	float hermite(float p0, float m0, float p1, float m1, float t) {
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return (2.0f * t3 - 3.0f * t2 + 1.0f) * p0 + (t3 - 2.0f * t2 + t) * m0 + (-2.0f * t3 + 3.0f * t2) * p1 + (t3 - t2) * m1;
+	}
+}
+
+uint32_t AnimationSet::AddAnimation() {
+	m_animations.emplace_back();
+	return static_cast<uint32_t>(m_animations.size() - 1);
+}
+
+void AnimationSet::AddChannel(uint32_t animation, uint32_t node, AnimationPath path, Interpolation interpolation, const float* times, uint32_t keyCount, const float* values, uint32_t components) {
+	if (keyCount == 0 || components == 0) {
+		return;
+	}
+	Channel channel = {};
+	channel.node = node;
+	channel.path = path;
+	channel.interpolation = interpolation;
+	channel.components = components;
+	channel.keyOffset = static_cast<uint32_t>(m_times.size());
+	channel.keyCount = keyCount;
+	channel.valueOffset = static_cast<uint32_t>(m_values.size());
+	m_times.insert(m_times.end(), times, times + keyCount);
+	size_t valueCount = static_cast<size_t>(keyCount) * components * (interpolation == Interpolation::CubicSpline ? 3 : 1);
+	m_values.insert(m_values.end(), values, values + valueCount);
+
+	auto& target = m_animations[animation];
+	target.channels.push_back(static_cast<uint32_t>(m_channels.size()));
+	target.sorted = false;
+	target.duration = std::max(target.duration, times[keyCount - 1]);
+	m_channels.push_back(channel);
+	m_cursors.push_back(0);
+}
+
+void AnimationSet::Sample(uint32_t animation, float time, std::vector<NodeTransform>& transforms, std::vector<std::vector<float>>& weights, AnimationStats& stats) {
+	auto& target = m_animations[animation];
+	if (!target.sorted) {
+		std::stable_sort(target.channels.begin(), target.channels.end(), [this](uint32_t a, uint32_t b) {
+			const auto& channelA = m_channels[a];
+			const auto& channelB = m_channels[b];
+			if (channelA.interpolation != channelB.interpolation) {
+				return channelA.interpolation < channelB.interpolation;
+			}
+			return channelA.path < channelB.path;
+		});
+		target.kindEnds.fill(0);
+		for (uint32_t channelIndex : target.channels) {
+			const auto& channel = m_channels[channelIndex];
+			++target.kindEnds[static_cast<uint32_t>(channel.interpolation) * kAnimationPathCount + static_cast<uint32_t>(channel.path)];
+		}
+		for (size_t kind = 1; kind < target.kindEnds.size(); ++kind) {
+			target.kindEnds[kind] += target.kindEnds[kind - 1];
+		}
+		target.sorted = true;
+	}
+	if (target.duration > 0.0f) {
+		time = std::fmod(time, target.duration);
+		if (time < 0.0f) {
+			time += target.duration;
+		}
+	}
+
+	// Pass one finds the keys of every channel, pass two interpolates them in a
+	// loop for each kind.
+	const size_t channelCount = target.channels.size();
+	m_keys.resize(channelCount);
+	m_factors.resize(channelCount);
+	for (size_t i = 0; i < channelCount; ++i) {
+		const uint32_t channelIndex = target.channels[i];
+		const auto& channel = m_channels[channelIndex];
+		const float* times = m_times.data() + channel.keyOffset;
+		const uint32_t last = channel.keyCount - 1;
+		uint32_t& cursor = m_cursors[channelIndex];
+		if (time <= times[0] || last == 0) {
+			m_keys[i] = 0;
+			m_factors[i] = 0.0f;
+			continue;
+		}
+		if (time >= times[last]) {
+			m_keys[i] = last;
+			m_factors[i] = 0.0f;
+			continue;
+		}
+		if (times[cursor] <= time && time < times[cursor + 1]) {
+			++stats.cursorHits;
+		}
+		else if (cursor + 2 <= last && times[cursor + 1] <= time && time < times[cursor + 2]) {
+			++cursor;
+			++stats.cursorHits;
+		}
+		else {
+			cursor = static_cast<uint32_t>(std::upper_bound(times, times + channel.keyCount, time) - times) - 1;
+			++stats.binarySearches;
+		}
+		m_keys[i] = cursor;
+		m_factors[i] = (time - times[cursor]) / (times[cursor + 1] - times[cursor]);
+	}
+
+	using SampleKind = void (AnimationSet::*)(const Animation&, size_t, size_t, std::vector<NodeTransform>&, std::vector<std::vector<float>>&) const;
+	static constexpr SampleKind kSampleKinds[] = {
+		&AnimationSet::sampleKind<Interpolation::Step, AnimationPath::Translation>,
+		&AnimationSet::sampleKind<Interpolation::Step, AnimationPath::Rotation>,
+		&AnimationSet::sampleKind<Interpolation::Step, AnimationPath::Scale>,
+		&AnimationSet::sampleKind<Interpolation::Step, AnimationPath::Weights>,
+		&AnimationSet::sampleKind<Interpolation::Linear, AnimationPath::Translation>,
+		&AnimationSet::sampleKind<Interpolation::Linear, AnimationPath::Rotation>,
+		&AnimationSet::sampleKind<Interpolation::Linear, AnimationPath::Scale>,
+		&AnimationSet::sampleKind<Interpolation::Linear, AnimationPath::Weights>,
+		&AnimationSet::sampleKind<Interpolation::CubicSpline, AnimationPath::Translation>,
+		&AnimationSet::sampleKind<Interpolation::CubicSpline, AnimationPath::Rotation>,
+		&AnimationSet::sampleKind<Interpolation::CubicSpline, AnimationPath::Scale>,
+		&AnimationSet::sampleKind<Interpolation::CubicSpline, AnimationPath::Weights>,
+	};
+	static_assert(std::size(kSampleKinds) == kInterpolationCount * kAnimationPathCount);
+	size_t begin = 0;
+	for (size_t kind = 0; kind < target.kindEnds.size(); ++kind) {
+		const size_t end = target.kindEnds[kind];
+		if (begin < end) {
+			(this->*kSampleKinds[kind])(target, begin, end, transforms, weights);
+		}
+		begin = end;
+	}
+	stats.sampledChannels += channelCount;
+}
+
+template <Interpolation interpolation, AnimationPath path>
+void AnimationSet::sampleKind(const Animation& target, size_t begin, size_t end, std::vector<NodeTransform>& transforms, std::vector<std::vector<float>>& weights) const {
+	for (size_t i = begin; i < end; ++i) {
+		const auto& channel = m_channels[target.channels[i]];
+		const uint32_t key = m_keys[i];
+		const uint32_t next = std::min(key + 1, channel.keyCount - 1);
+		const float factor = m_factors[i];
+		const float* values = m_values.data() + channel.valueOffset;
+		const uint32_t components = channel.components;
+		// glTF stores in tangent, value and out tangent per key; tangents are
+		// scaled by the key interval.
+		float delta = 0.0f;
+		if constexpr (interpolation == Interpolation::CubicSpline) {
+			delta = m_times[channel.keyOffset + next] - m_times[channel.keyOffset + key];
+		}
+
+		if constexpr (path == AnimationPath::Weights) {
+			auto& nodeWeights = weights[channel.node];
+			nodeWeights.resize(components);
+			for (uint32_t c = 0; c < components; ++c) {
+				if constexpr (interpolation == Interpolation::Step) {
+					nodeWeights[c] = values[key * components + c];
+				}
+				else if constexpr (interpolation == Interpolation::Linear) {
+					nodeWeights[c] = values[key * components + c] + (values[next * components + c] - values[key * components + c]) * factor;
+				}
+				else {
+					nodeWeights[c] = hermite(values[(key * 3 + 1) * components + c], values[(key * 3 + 2) * components + c] * delta,
+						values[(next * 3 + 1) * components + c], values[next * 3 * components + c] * delta, factor);
+				}
+			}
+		}
+		else {
+			XMVECTOR value;
+			if constexpr (interpolation == Interpolation::Step) {
+				value = loadValue<path>(values + key * components);
+			}
+			else if constexpr (interpolation == Interpolation::Linear) {
+				if constexpr (path == AnimationPath::Rotation) {
+					value = XMQuaternionSlerp(loadValue<path>(values + key * components), loadValue<path>(values + next * components), factor);
+				}
+				else {
+					value = XMVectorLerp(loadValue<path>(values + key * components), loadValue<path>(values + next * components), factor);
+				}
+			}
+			else {
+				value = XMVectorHermite(
+					loadValue<path>(values + (key * 3 + 1) * components),
+					loadValue<path>(values + (key * 3 + 2) * components) * delta,
+					loadValue<path>(values + (next * 3 + 1) * components),
+					loadValue<path>(values + next * 3 * components) * delta,
+					factor);
+				if constexpr (path == AnimationPath::Rotation) {
+					value = XMQuaternionNormalize(value);
+				}
+			}
+
+			auto& transform = transforms[channel.node];
+			if constexpr (path == AnimationPath::Translation) {
+				XMStoreFloat3(&transform.translation, value);
+			}
+			else if constexpr (path == AnimationPath::Rotation) {
+				XMStoreFloat4(&transform.rotation, value);
+			}
+			else {
+				XMStoreFloat3(&transform.scale, value);
+			}
+		}
+	}
+}
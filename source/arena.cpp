@@ -0,0 +1,46 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstring>
+
+Arena::Arena(size_t blockSize) :
+	m_blockSize(blockSize)
+{
+}
+
+namespace {
+	// Offset from base of the first address at or after base + used that is
+	// aligned; blocks themselves are only aligned for fundamental types.
+	size_t alignedOffset(const std::byte* base, size_t used, size_t alignment) {
+		const uintptr_t address = reinterpret_cast<uintptr_t>(base) + used;
+		return ((address + alignment - 1) & ~(alignment - 1)) - reinterpret_cast<uintptr_t>(base);
+	}
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+	size_t offset = m_blocks.empty() ? 0 : alignedOffset(m_blocks.back().get(), m_blockUsed, alignment);
+	if (m_blocks.empty() || offset + size > m_blockCapacity) {
+		// Allocations larger than a block get a block of their own.
+		m_blockCapacity = std::max(m_blockSize, size + alignment);
+		m_blocks.push_back(std::make_unique<std::byte[]>(m_blockCapacity));
+		m_bytes += m_blockCapacity;
+		m_blockUsed = 0;
+		offset = alignedOffset(m_blocks.back().get(), 0, alignment);
+	}
+	void* data = m_blocks.back().get() + offset;
+	m_blockUsed = offset + size;
+	return data;
+}
+
+std::string_view Arena::CopyString(std::string_view value) {
+	char* data = static_cast<char*>(Allocate(value.size() + 1, 1));
+	std::memcpy(data, value.data(), value.size());
+	data[value.size()] = '\0';
+	return { data, value.size() };
+}
+
+void Arena::Reset() {
+	m_blocks.clear();
+	m_blockCapacity = 0;
+	m_blockUsed = 0;
+	m_bytes = 0;
+}
@@ -0,0 +1,377 @@
+#include "assetReader.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "ioRing.h"
+#include "json.hpp"
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono;
+
+namespace {
+	// Reads per file with io_uring are at most this long, so one large buffer
+	// keeps several requests in flight.
+	constexpr uint32_t kChunkBytes = 1u << 20;
+
+	std::string decodeUri(const std::string& uri) {
+		std::string decoded;
+		for (size_t i = 0; i < uri.size(); ++i) {
+			unsigned int value;
+			if (uri[i] == '%' && i + 2 < uri.size() && sscanf(uri.c_str() + i + 1, "%2x", &value) == 1) {
+				decoded += static_cast<char>(value);
+				i += 2;
+			}
+			else {
+				decoded += uri[i];
+			}
+		}
+		return decoded;
+	}
+}
+
+
+AssetReader::AssetReader(uint32_t queueDepth, bool forceThreads) :
+	m_queueDepth(std::clamp(queueDepth, 1u, 4096u))
+{
+	if (!forceThreads) {
+		m_ring = std::make_unique<IoRing>();
+		if (!m_ring->setup(m_queueDepth)) {
+			m_ring.reset();
+		}
+	}
+	m_stats.backend = m_ring ? "io_uring" : "threads";
+}
+
+AssetReader::~AssetReader() {
+}
+
+uint32_t AssetReader::Add(std::string path) {
+	m_files.push_back({ std::move(path), {}, false });
+	return static_cast<uint32_t>(m_files.size() - 1);
+}
+
+void AssetReader::Run(const std::function<void(uint32_t file)>& completion) {
+	if (m_nextFile == m_files.size()) {
+		return;
+	}
+	auto start = high_resolution_clock::now();
+	if (m_ring) {
+		runRing(completion);
+	}
+	else {
+		runThreads(completion);
+	}
+	for (uint32_t file = m_nextFile; file < m_files.size(); ++file) {
+		++m_stats.files;
+		if (m_files[file].succeeded) {
+			m_stats.bytes += m_files[file].data.size();
+		}
+		else {
+			++m_stats.failedFiles;
+		}
+	}
+	m_nextFile = static_cast<uint32_t>(m_files.size());
+	m_stats.wallMilliseconds += duration<double, std::milli>(high_resolution_clock::now() - start).count();
+	m_stats.meanQueueDepth = m_stats.wallMilliseconds > 0.0 ? m_latencyMilliseconds / m_stats.wallMilliseconds : 0.0;
+}
+
+#if defined(__linux__)
+void AssetReader::runRing(const std::function<void(uint32_t)>& completion) {
+	struct Read {
+		uint32_t file;
+		uint64_t offset;
+		uint32_t length;
+		iovec vector;
+		high_resolution_clock::time_point issued;
+	};
+	struct Pending {
+		int fd = -1;
+		uint32_t reads = 0;
+		int bufferIndex = -1;
+		bool failed = false;
+	};
+	const uint32_t first = m_nextFile;
+	const uint32_t count = static_cast<uint32_t>(m_files.size()) - first;
+	std::vector<Pending> pending(count);
+	std::vector<Read> reads;
+	auto finishRead = [&](uint32_t file) {
+		Pending& state = pending[file - first];
+		if (--state.reads == 0) {
+			if (state.fd >= 0) {
+				close(state.fd);
+			}
+			m_files[file].succeeded = !state.failed;
+			if (state.failed) {
+				m_files[file].data.clear();
+			}
+			if (completion) {
+				completion(file);
+			}
+		}
+	};
+
+	// Sizes first, so that every destination exists before the first read and
+	// can be registered with the ring.
+	std::vector<iovec> buffers;
+	bool registrable = true;
+	for (uint32_t file = first; file < m_files.size(); ++file) {
+		struct stat status;
+		if (stat(m_files[file].path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+			if (completion) {
+				completion(file);
+			}
+			continue;
+		}
+		auto& data = m_files[file].data;
+		data.resize(static_cast<size_t>(status.st_size));
+		if (data.empty()) {
+			m_files[file].succeeded = true;
+			if (completion) {
+				completion(file);
+			}
+			continue;
+		}
+		Pending& state = pending[file - first];
+		for (uint64_t offset = 0; offset < data.size(); offset += kChunkBytes) {
+			reads.push_back({ file, offset, static_cast<uint32_t>(std::min<uint64_t>(kChunkBytes, data.size() - offset)), {}, {} });
+			++state.reads;
+		}
+		// Registered buffers are limited to 1 GiB each.
+		registrable = registrable && data.size() <= (1ull << 30);
+		state.bufferIndex = static_cast<int>(buffers.size());
+		buffers.push_back({ data.data(), data.size() });
+	}
+	// Registration pins the pages and may exceed RLIMIT_MEMLOCK on older
+	// kernels, in which case reads go to the unregistered buffers instead.
+	bool registered = registrable && !buffers.empty() && buffers.size() <= 1024 &&
+		syscall(__NR_io_uring_register, m_ring->fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+	m_stats.registeredBuffers = registered;
+
+	std::vector<uint32_t> retries;
+	size_t next = 0;
+	uint32_t inFlight = 0;
+	while (next < reads.size() || !retries.empty() || inFlight > 0) {
+		unsigned submit = 0;
+		while (inFlight + submit < m_queueDepth && (!retries.empty() || next < reads.size())) {
+			uint32_t index;
+			if (!retries.empty()) {
+				index = retries.back();
+				retries.pop_back();
+			}
+			else {
+				index = static_cast<uint32_t>(next++);
+				reads[index].issued = high_resolution_clock::now();
+			}
+			Read& read = reads[index];
+			Pending& state = pending[read.file - first];
+			if (state.fd < 0 && !state.failed) {
+				// Opened on their first read, so that only the files being read
+				// hold descriptors.
+				state.fd = open(m_files[read.file].path.c_str(), O_RDONLY | O_CLOEXEC);
+				state.failed = state.fd < 0;
+			}
+			if (state.failed) {
+				finishRead(read.file);
+				continue;
+			}
+			io_uring_sqe* entry = m_ring->nextEntry();
+			unsigned char* destination = m_files[read.file].data.data() + read.offset;
+			entry->fd = state.fd;
+			entry->off = read.offset;
+			entry->user_data = index;
+			if (registered) {
+				entry->opcode = IORING_OP_READ_FIXED;
+				entry->addr = reinterpret_cast<uint64_t>(destination);
+				entry->len = read.length;
+				entry->buf_index = static_cast<uint16_t>(state.bufferIndex);
+			}
+			else {
+				read.vector = { destination, read.length };
+				entry->opcode = IORING_OP_READV;
+				entry->addr = reinterpret_cast<uint64_t>(&read.vector);
+				entry->len = 1;
+			}
+			++submit;
+			++m_stats.reads;
+		}
+		if (submit == 0 && inFlight == 0) {
+			continue;
+		}
+		if (m_ring->enter(submit, 1) < 0) {
+			// The ring itself failed; what has not completed is lost.
+			for (auto& state : pending) {
+				state.failed = true;
+			}
+			break;
+		}
+		inFlight += submit;
+		m_stats.peakQueueDepth = std::max(m_stats.peakQueueDepth, inFlight);
+
+		unsigned head = *m_ring->cqHead;
+		const unsigned tail = __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			const io_uring_cqe& completed = m_ring->cqes[head & m_ring->cqMask];
+			const uint32_t index = static_cast<uint32_t>(completed.user_data);
+			const int result = completed.res;
+			--inFlight;
+			Read& read = reads[index];
+			if (result == -EAGAIN || result == -EINTR) {
+				retries.push_back(index);
+				continue;
+			}
+			if (result > 0 && static_cast<uint32_t>(result) < read.length) {
+				read.offset += result;
+				read.length -= result;
+				retries.push_back(index);
+				continue;
+			}
+			if (result <= 0) {
+				pending[read.file - first].failed = true;
+			}
+			m_latencyMilliseconds += duration<double, std::milli>(high_resolution_clock::now() - read.issued).count();
+			finishRead(read.file);
+		}
+		__atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+	if (registered) {
+		syscall(__NR_io_uring_register, m_ring->fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+	}
+	for (uint32_t file = first; file < m_files.size(); ++file) {
+		Pending& state = pending[file - first];
+		if (state.reads > 0) {
+			if (state.fd >= 0) {
+				close(state.fd);
+			}
+			m_files[file].data.clear();
+			if (completion) {
+				completion(file);
+			}
+		}
+	}
+}
+#else
+void AssetReader::runRing(const std::function<void(uint32_t)>& completion) {
+	runThreads(completion);
+}
+#endif
+
+void AssetReader::runThreads(const std::function<void(uint32_t)>& completion) {
+	const uint32_t first = m_nextFile;
+	std::atomic<uint32_t> next = first;
+	std::atomic<uint32_t> inFlight = 0;
+	std::atomic<uint32_t> peak = 0;
+	std::mutex mutex;
+	auto readFiles = [&] {
+		double latency = 0.0;
+		for (uint32_t file = next++; file < m_files.size(); file = next++) {
+			uint32_t depth = ++inFlight;
+			for (uint32_t seen = peak; depth > seen && !peak.compare_exchange_weak(seen, depth);) {
+			}
+			auto issued = high_resolution_clock::now();
+			auto& data = m_files[file].data;
+			std::ifstream stream(m_files[file].path, std::ios::binary | std::ios::ate);
+			if (stream) {
+				data.resize(static_cast<size_t>(stream.tellg()));
+				stream.seekg(0);
+				stream.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+				m_files[file].succeeded = static_cast<bool>(stream);
+			}
+			if (!m_files[file].succeeded) {
+				data.clear();
+			}
+			--inFlight;
+			latency += duration<double, std::milli>(high_resolution_clock::now() - issued).count();
+			if (completion) {
+				completion(file);
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		m_latencyMilliseconds += latency;
+	};
+
+	const uint32_t threadCount = std::min<uint32_t>(m_queueDepth, static_cast<uint32_t>(m_files.size()) - first);
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; ++i) {
+		threads.emplace_back(readFiles);
+	}
+	readFiles();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	m_stats.reads += m_files.size() - first;
+	m_stats.peakQueueDepth = std::max(m_stats.peakQueueDepth, peak.load());
+}
+
+std::string AssetReader::Report() const {
+	char line[256];
+	const double mebibytes = m_stats.bytes / 1048576.0;
+	snprintf(line, sizeof(line), "read %llu files, %.1f MiB in %.1f ms (%.1f MiB/s) with %s%s, %llu reads, queue depth peak %u mean %.1f of %u",
+		static_cast<unsigned long long>(m_stats.files), mebibytes, m_stats.wallMilliseconds,
+		m_stats.wallMilliseconds > 0.0 ? mebibytes * 1000.0 / m_stats.wallMilliseconds : 0.0,
+		m_stats.backend, m_stats.registeredBuffers ? " and registered buffers" : "",
+		static_cast<unsigned long long>(m_stats.reads), m_stats.peakQueueDepth, m_stats.meanQueueDepth, m_queueDepth);
+	std::string report = line;
+	if (m_stats.failedFiles) {
+		snprintf(line, sizeof(line), ", %llu failed", static_cast<unsigned long long>(m_stats.failedFiles));
+		report += line;
+	}
+	return report + "\n";
+}
+
+std::string SceneFilePath(const std::string& scenePath, const std::string& uri) {
+	return (std::filesystem::path(scenePath).parent_path() / decodeUri(uri)).lexically_normal().string();
+}
+
+bool ListSceneFiles(const std::string& scenePath, const std::vector<unsigned char>& scene, std::vector<SceneFile>& files) {
+	// A GLB starts with a 12 byte header and its JSON chunk, whose length and
+	// type take the next 8 bytes.
+	const unsigned char* json = scene.data();
+	size_t jsonSize = scene.size();
+	if (scene.size() >= 20 && memcmp(scene.data(), "glTF", 4) == 0) {
+		uint32_t chunkLength;
+		memcpy(&chunkLength, scene.data() + 12, sizeof(chunkLength));
+		if (memcmp(scene.data() + 16, "JSON", 4) != 0 || chunkLength > scene.size() - 20) {
+			return false;
+		}
+		json = scene.data() + 20;
+		jsonSize = chunkLength;
+	}
+	nlohmann::json document = nlohmann::json::parse(json, json + jsonSize, nullptr, false);
+	if (!document.is_object()) {
+		return false;
+	}
+
+	auto addFiles = [&](const char* key, bool image) {
+		auto entries = document.find(key);
+		if (entries == document.end() || !entries->is_array()) {
+			return;
+		}
+		for (const auto& entry : *entries) {
+			auto uri = entry.find("uri");
+			if (uri == entry.end() || !uri->is_string() || uri->get_ref<const std::string&>().rfind("data:", 0) == 0) {
+				continue;
+			}
+			std::string path = SceneFilePath(scenePath, uri->get<std::string>());
+			if (std::none_of(files.begin(), files.end(), [&](const SceneFile& file) { return file.path == path; })) {
+				files.push_back({ path, image });
+			}
+		}
+	};
+	addFiles("buffers", false);
+	addFiles("images", true);
+	return true;
+}
@@ -0,0 +1,306 @@
+// renderlab-bench: generates synthetic scenes and measures the renderer on
+// them.
+//
+//   renderlab-bench generate [scene options] OUT
+//
+// Writes one scene to OUT, a .glb or a .gltf with a .bin next to it.
+//
+//   renderlab-bench sweep [scene options] [sweep options] -- <renderer command>
+//
+// Generates a scene for every combination of the swept values and runs the
+// renderer command on it, for example
+// "RenderLab --scene {scene} --benchmark {frames} --benchmark-report {report}".
+// {scene}, {report} and {frames} are replaced in every argument, and the
+// renderer is expected to write its measurements as JSON to {report}.
+//
+//   renderlab-bench read [--queue-depth N] [--threads] SCENE
+//
+// Reads SCENE and every buffer and image it references the way RenderLab
+// loads them and reports the read bandwidth and queue depth. --threads uses
+// the blocking thread fallback instead of io_uring.
+//
+// Scene options, with their defaults:
+//   --nodes N              nodes, each drawing one mesh (64)
+//   --depth N              levels of the node hierarchy (4)
+//   --instancing N         nodes sharing each mesh (4)
+//   --materials N          materials (8)
+//   --textures N           base color textures (4)
+//   --texture-size N       texture edge length (256)
+//   --triangles N          triangles per mesh (2048)
+//   --seed N               random seed (1)
+//
+// Sweep options:
+//   --sweep NAME V1,V2,..  values of one scene option, without the dashes;
+//                          several sweeps run every combination
+//   --frames N             frames rendered after the first (120)
+//   --dir DIR              where scenes and reports go (bench)
+//   --csv FILE             write one row per run
+//   --json FILE            write every run as a JSON array
+//
+// Exits with 0 when every run succeeded and 1 otherwise.
+#include "sceneGenerator.h"
+#include "assetReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+using namespace std::chrono;
+
+namespace {
+	uint32_t* sceneParameter(SceneParameters& parameters, const std::string& name) {
+		const std::map<std::string, uint32_t SceneParameters::*> fields = {
+			{ "nodes", &SceneParameters::nodes },
+			{ "depth", &SceneParameters::depth },
+			{ "instancing", &SceneParameters::instancing },
+			{ "materials", &SceneParameters::materials },
+			{ "textures", &SceneParameters::textures },
+			{ "texture-size", &SceneParameters::textureSize },
+			{ "triangles", &SceneParameters::triangles },
+			{ "seed", &SceneParameters::seed },
+		};
+		auto field = fields.find(name);
+		return field == fields.end() ? nullptr : &(parameters.*(field->second));
+	}
+
+	nlohmann::json sceneJson(const SceneParameters& parameters, const SceneStats& stats) {
+		return {
+			{ "nodes", parameters.nodes }, { "depth", stats.depth }, { "instancing", parameters.instancing },
+			{ "materials", parameters.materials }, { "textures", parameters.textures }, { "textureSize", parameters.textureSize },
+			{ "meshes", stats.meshes }, { "trianglesPerMesh", stats.trianglesPerMesh }, { "sceneTriangles", stats.sceneTriangles },
+			{ "bufferBytes", stats.bufferBytes }, { "textureBytes", stats.textureBytes }, { "fileBytes", stats.fileBytes } };
+	}
+
+	double percentile(std::vector<double> values, double fraction) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+		std::nth_element(values.begin(), values.begin() + index, values.end());
+		return values[index];
+	}
+
+	std::string substitute(std::string argument, const std::map<std::string, std::string>& values) {
+		for (const auto& [key, value] : values) {
+			for (size_t position = argument.find(key); position != std::string::npos; position = argument.find(key, position + value.size())) {
+				argument.replace(position, key.size(), value);
+			}
+		}
+		return argument;
+	}
+
+	std::string quote(const std::string& argument) {
+		return argument.find_first_of(" \t\"") == std::string::npos ? argument : "\"" + argument + "\"";
+	}
+
+	// Columns of the CSV, in order; every one is a key of a run's JSON.
+	const char* const kColumns[] = {
+		"nodes", "depth", "instancing", "materials", "textures", "textureSize", "meshes", "sceneTriangles", "fileBytes",
+		"generateMilliseconds", "parseMilliseconds", "initMilliseconds", "loadMilliseconds", "firstFrameMilliseconds",
+		"framesPerSecond", "frameMillisecondsP50", "frameMillisecondsP95", "peakTrackedBytes", "peakLocalBytes",
+		"peakWorkingSetBytes", "pass" };
+
+	int readScene(int argc, char* argv[]) {
+		uint32_t queueDepth = 64;
+		bool forceThreads = false;
+		std::string scenePath;
+		for (int i = 2; i < argc; ++i) {
+			if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+				queueDepth = static_cast<uint32_t>(atoi(argv[++i]));
+			}
+			else if (strcmp(argv[i], "--threads") == 0) {
+				forceThreads = true;
+			}
+			else if (scenePath.empty() && argv[i][0] != '-') {
+				scenePath = argv[i];
+			}
+			else {
+				fprintf(stderr, "renderlab-bench: unknown option %s\n", argv[i]);
+				return 1;
+			}
+		}
+		if (scenePath.empty()) {
+			fprintf(stderr, "usage: renderlab-bench read [--queue-depth N] [--threads] SCENE\n");
+			return 1;
+		}
+
+		AssetReader reader(queueDepth, forceThreads);
+		const uint32_t scene = reader.Add(scenePath);
+		reader.Run();
+		std::vector<SceneFile> files;
+		if (!reader.Succeeded(scene) || !ListSceneFiles(scenePath, reader.Data(scene), files)) {
+			fprintf(stderr, "renderlab-bench: cannot read %s\n", scenePath.c_str());
+			return 1;
+		}
+		for (const auto& file : files) {
+			reader.Add(file.path);
+		}
+		reader.Run();
+		printf("%s: %s", scenePath.c_str(), reader.Report().c_str());
+		return reader.Stats().failedFiles ? 1 : 0;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc >= 2 && strcmp(argv[1], "read") == 0) {
+		return readScene(argc, argv);
+	}
+	if (argc < 2 || (strcmp(argv[1], "generate") != 0 && strcmp(argv[1], "sweep") != 0)) {
+		fprintf(stderr, "usage: renderlab-bench generate [options] OUT | sweep [options] -- <renderer command> | read SCENE\n");
+		return 1;
+	}
+	const bool sweep = strcmp(argv[1], "sweep") == 0;
+
+	SceneParameters base;
+	std::vector<std::pair<std::string, std::vector<uint32_t>>> sweeps;
+	uint32_t frames = 120;
+	std::string directory = "bench";
+	std::string csvPath;
+	std::string jsonPath;
+	std::string outputPath;
+	int i = 2;
+	for (; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+		uint32_t* parameter = strncmp(argv[i], "--", 2) == 0 ? sceneParameter(base, argv[i] + 2) : nullptr;
+		if (parameter && i + 1 < argc) {
+			*parameter = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--sweep") == 0 && i + 2 < argc) {
+			SceneParameters probe;
+			if (!sceneParameter(probe, argv[i + 1])) {
+				fprintf(stderr, "renderlab-bench: cannot sweep %s\n", argv[i + 1]);
+				return 1;
+			}
+			std::vector<uint32_t> values;
+			for (char* value = argv[i + 2]; *value;) {
+				char* end;
+				values.push_back(static_cast<uint32_t>(strtoul(value, &end, 10)));
+				value = *end == ',' ? end + 1 : end + strlen(end);
+			}
+			sweeps.push_back({ argv[i + 1], values });
+			i += 2;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+			directory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+			csvPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonPath = argv[++i];
+		}
+		else if (!sweep && outputPath.empty() && argv[i][0] != '-') {
+			outputPath = argv[i];
+		}
+		else {
+			fprintf(stderr, "renderlab-bench: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!sweep) {
+		if (outputPath.empty()) {
+			fprintf(stderr, "usage: renderlab-bench generate [options] OUT\n");
+			return 1;
+		}
+		SceneStats stats;
+		auto start = high_resolution_clock::now();
+		if (!GenerateScene(outputPath, base, stats)) {
+			fprintf(stderr, "renderlab-bench: cannot write %s\n", outputPath.c_str());
+			return 1;
+		}
+		printf("%s: %u nodes over %u levels, %u meshes of %u triangles, %.1f MiB on disk in %.1f ms\n", outputPath.c_str(), base.nodes, stats.depth,
+			stats.meshes, stats.trianglesPerMesh, stats.fileBytes / 1048576.0, duration<double, std::milli>(high_resolution_clock::now() - start).count());
+		return 0;
+	}
+
+	std::vector<std::string> command(argv + std::min(i + 1, argc), argv + argc);
+	if (command.empty()) {
+		fprintf(stderr, "usage: renderlab-bench sweep [options] -- <renderer command>\n");
+		return 1;
+	}
+	std::filesystem::create_directories(directory);
+
+	// Every combination of the swept values, the last sweep varying fastest.
+	size_t runCount = 1;
+	for (const auto& [name, values] : sweeps) {
+		runCount *= values.size();
+	}
+	nlohmann::json runs = nlohmann::json::array();
+	bool success = true;
+	for (size_t run = 0; run < runCount; ++run) {
+		SceneParameters parameters = base;
+		for (size_t remaining = run, sweepIndex = sweeps.size(); sweepIndex-- > 0;) {
+			const auto& values = sweeps[sweepIndex].second;
+			*sceneParameter(parameters, sweeps[sweepIndex].first) = values[remaining % values.size()];
+			remaining /= values.size();
+		}
+
+		const std::string scenePath = (std::filesystem::path(directory) / ("scene" + std::to_string(run) + ".glb")).string();
+		const std::string reportPath = (std::filesystem::path(directory) / ("report" + std::to_string(run) + ".json")).string();
+		SceneStats stats;
+		auto start = high_resolution_clock::now();
+		if (!GenerateScene(scenePath, parameters, stats)) {
+			fprintf(stderr, "renderlab-bench: cannot write %s\n", scenePath.c_str());
+			return 1;
+		}
+		nlohmann::json result = sceneJson(parameters, stats);
+		result["generateMilliseconds"] = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+		std::string line;
+		const std::map<std::string, std::string> values = { { "{scene}", scenePath }, { "{report}", reportPath }, { "{frames}", std::to_string(frames) } };
+		for (const auto& argument : command) {
+			line += (line.empty() ? "" : " ") + quote(substitute(argument, values));
+		}
+		std::filesystem::remove(reportPath);
+		const int status = std::system(line.c_str());
+
+		nlohmann::json report;
+		std::ifstream reportFile(reportPath);
+		if (status == 0 && reportFile) {
+			report = nlohmann::json::parse(reportFile, nullptr, false);
+		}
+		result["pass"] = status == 0 && report.is_object();
+		if (report.is_object()) {
+			std::vector<double> frameMilliseconds = report.value("frameMilliseconds", std::vector<double>());
+			result.update(report);
+			result["frameMillisecondsP50"] = percentile(frameMilliseconds, 0.5);
+			result["frameMillisecondsP95"] = percentile(frameMilliseconds, 0.95);
+		}
+		success = success && result["pass"].get<bool>();
+		printf("run %zu of %zu: %u nodes, %u meshes, %llu triangles: %s, load %.1f ms, first frame %.1f ms, %.2f frames/s, peak %.1f MiB\n",
+			run + 1, runCount, parameters.nodes, stats.meshes, static_cast<unsigned long long>(stats.sceneTriangles),
+			result["pass"].get<bool>() ? "ok" : "failed", result.value("loadMilliseconds", 0.0), result.value("firstFrameMilliseconds", 0.0),
+			result.value("framesPerSecond", 0.0), result.value("peakWorkingSetBytes", 0.0) / 1048576.0);
+		runs.push_back(result);
+	}
+
+	if (!csvPath.empty()) {
+		std::ofstream csv(csvPath);
+		for (const char* column : kColumns) {
+			csv << column << (column == kColumns[std::size(kColumns) - 1] ? "\n" : ",");
+		}
+		for (const auto& result : runs) {
+			for (const char* column : kColumns) {
+				csv << (result.contains(column) ? result[column].dump() : "") << (column == kColumns[std::size(kColumns) - 1] ? "\n" : ",");
+			}
+		}
+	}
+	if (!jsonPath.empty()) {
+		nlohmann::json json;
+		json["pass"] = success;
+		json["frames"] = frames;
+		json["runs"] = runs;
+		std::ofstream(jsonPath) << json.dump(2) << "\n";
+	}
+	return success ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+namespace {
+	struct Box {
+		float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void grow(const float* point) {
+			for (int a = 0; a < 3; ++a) {
+				min[a] = std::min(min[a], point[a]);
+				max[a] = std::max(max[a], point[a]);
+			}
+		}
+
+		void grow(const Box& box) {
+			for (int a = 0; a < 3; ++a) {
+				min[a] = std::min(min[a], box.min[a]);
+				max[a] = std::max(max[a], box.max[a]);
+			}
+		}
+
+		float area() const {
+			float dx = max[0] - min[0];
+			float dy = max[1] - min[1];
+			float dz = max[2] - min[2];
+			return dx < 0.0f ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+
+	struct Bin {
+		Box bounds;
+		uint32_t count = 0;
+	};
+
+	struct Task {
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+		uint32_t depth;
+	};
+
+	// Ranges above this many primitives are measured and binned in parallel.
+	constexpr uint32_t kParallelBinning = 1 << 16;
+	constexpr uint32_t kBinningGrain = 1 << 14;
+	// Subtrees below this size are not worth a task of their own.
+	constexpr uint32_t kMinSubtreeSize = 1024;
+	// Cost of a traversal step relative to one primitive test.
+	constexpr float kTraversalCost = 1.0f;
+
+	class Builder {
+	public:
+		Builder(const std::vector<BvhBounds>& bounds, std::vector<uint32_t>& primitives, ThreadPool* pool) :
+			m_primitives(primitives),
+			m_pool(pool)
+		{
+			m_boxes.resize(bounds.size());
+			m_centroids.resize(bounds.size() * 3);
+			for (size_t i = 0; i < bounds.size(); ++i) {
+				const float* min = &bounds[i].min.x;
+				const float* max = &bounds[i].max.x;
+				m_boxes[i].grow(min);
+				m_boxes[i].grow(max);
+				for (int a = 0; a < 3; ++a) {
+					m_centroids[i * 3 + a] = 0.5f * (min[a] + max[a]);
+				}
+			}
+		}
+
+		// Fills node from [begin, end) and returns true with middle set when the
+		// range is worth splitting. Children are left for the caller to allocate.
+		bool split(BvhNode& node, uint32_t begin, uint32_t end, uint32_t depth, bool parallel, uint32_t& middle) {
+			parallel = parallel && m_pool && end - begin >= kParallelBinning;
+			Box bounds;
+			Box centroidBounds;
+			measure(begin, end, parallel, bounds, centroidBounds);
+			node.min = { bounds.min[0], bounds.min[1], bounds.min[2] };
+			node.max = { bounds.max[0], bounds.max[1], bounds.max[2] };
+			node.first = begin;
+			node.count = end - begin;
+
+			const uint32_t count = end - begin;
+			if (count <= 1 || depth + 1 >= kBvhMaxDepth) {
+				return false;
+			}
+
+			int axis = -1;
+			uint32_t splitBin = 0;
+			float bestCost = FLT_MAX;
+			Bin bins[3][kBvhBinCount];
+			bin(begin, end, parallel, centroidBounds, bins);
+			for (int a = 0; a < 3; ++a) {
+				if (centroidBounds.max[a] <= centroidBounds.min[a]) {
+					continue;
+				}
+				// Sweep from the right to collect suffix costs, then from the left.
+				float rightCost[kBvhBinCount];
+				Box right;
+				uint32_t rightCount = 0;
+				for (uint32_t b = kBvhBinCount - 1; b > 0; --b) {
+					right.grow(bins[a][b].bounds);
+					rightCount += bins[a][b].count;
+					rightCost[b] = right.area() * rightCount;
+				}
+				Box left;
+				uint32_t leftCount = 0;
+				for (uint32_t b = 1; b < kBvhBinCount; ++b) {
+					left.grow(bins[a][b - 1].bounds);
+					leftCount += bins[a][b - 1].count;
+					if (leftCount == 0 || leftCount == count) {
+						continue;
+					}
+					float cost = left.area() * leftCount + rightCost[b];
+					if (cost < bestCost) {
+						bestCost = cost;
+						axis = a;
+						splitBin = b;
+					}
+				}
+			}
+
+			if (axis < 0) {
+				// Every centroid coincides; split by count so leaves stay small.
+				if (count <= kBvhMaxLeafSize) {
+					return false;
+				}
+				middle = begin + count / 2;
+				return true;
+			}
+			const float area = bounds.area();
+			const float splitCost = kTraversalCost + (area > 0.0f ? bestCost / area : 0.0f);
+			if (splitCost >= static_cast<float>(count) && count <= kBvhMaxLeafSize) {
+				return false;
+			}
+
+			const float scale = kBvhBinCount / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+			const float origin = centroidBounds.min[axis];
+			auto* first = m_primitives.data() + begin;
+			auto* partition = std::partition(first, m_primitives.data() + end, [&](uint32_t primitive) {
+				return binIndex(m_centroids[primitive * 3 + axis], origin, scale) < splitBin;
+			});
+			middle = static_cast<uint32_t>(partition - m_primitives.data());
+			return true;
+		}
+
+		// Depth first build of [begin, end) into nodes, whose element 0 is the
+		// subtree root. Child indices are local to nodes.
+		void buildSubtree(std::vector<BvhNode>& nodes, uint32_t begin, uint32_t end, uint32_t depth) {
+			nodes.resize(1);
+			Task stack[kBvhMaxDepth * 2];
+			uint32_t size = 0;
+			stack[size++] = { 0, begin, end, depth };
+			while (size) {
+				Task task = stack[--size];
+				BvhNode node;
+				uint32_t middle;
+				bool interior = split(node, task.begin, task.end, task.depth, false, middle);
+				if (interior) {
+					node.first = static_cast<uint32_t>(nodes.size());
+					node.count = 0;
+					nodes.resize(nodes.size() + 2);
+					stack[size++] = { node.first + 1, middle, task.end, task.depth + 1 };
+					stack[size++] = { node.first, task.begin, middle, task.depth + 1 };
+				}
+				nodes[task.node] = node;
+			}
+		}
+
+	private:
+		static uint32_t binIndex(float centroid, float origin, float scale) {
+			return std::min(kBvhBinCount - 1, static_cast<uint32_t>(std::max(0.0f, (centroid - origin) * scale)));
+		}
+
+		void measure(uint32_t begin, uint32_t end, bool parallel, Box& bounds, Box& centroidBounds) {
+			auto measureRange = [this](size_t rangeBegin, size_t rangeEnd, Box& rangeBounds, Box& rangeCentroids) {
+				for (size_t i = rangeBegin; i < rangeEnd; ++i) {
+					uint32_t primitive = m_primitives[i];
+					rangeBounds.grow(m_boxes[primitive]);
+					rangeCentroids.grow(&m_centroids[primitive * 3]);
+				}
+			};
+			if (!parallel) {
+				measureRange(begin, end, bounds, centroidBounds);
+				return;
+			}
+			const size_t count = end - begin;
+			std::vector<Box> partial((count + kBinningGrain - 1) / kBinningGrain * 2);
+			m_pool->ParallelFor(count, kBinningGrain, [&](size_t chunkBegin, size_t chunkEnd) {
+				size_t chunk = chunkBegin / kBinningGrain;
+				measureRange(begin + chunkBegin, begin + chunkEnd, partial[chunk * 2], partial[chunk * 2 + 1]);
+			});
+			for (size_t chunk = 0; chunk < partial.size(); chunk += 2) {
+				bounds.grow(partial[chunk]);
+				centroidBounds.grow(partial[chunk + 1]);
+			}
+		}
+
+		void bin(uint32_t begin, uint32_t end, bool parallel, const Box& centroidBounds, Bin (&bins)[3][kBvhBinCount]) {
+			float origin[3];
+			float scale[3];
+			for (int a = 0; a < 3; ++a) {
+				float extent = centroidBounds.max[a] - centroidBounds.min[a];
+				origin[a] = centroidBounds.min[a];
+				scale[a] = extent > 0.0f ? kBvhBinCount / extent : 0.0f;
+			}
+			auto binRange = [&](size_t rangeBegin, size_t rangeEnd, Bin (&rangeBins)[3][kBvhBinCount]) {
+				for (size_t i = rangeBegin; i < rangeEnd; ++i) {
+					uint32_t primitive = m_primitives[i];
+					for (int a = 0; a < 3; ++a) {
+						Bin& target = rangeBins[a][binIndex(m_centroids[primitive * 3 + a], origin[a], scale[a])];
+						target.bounds.grow(m_boxes[primitive]);
+						++target.count;
+					}
+				}
+			};
+			if (!parallel) {
+				binRange(begin, end, bins);
+				return;
+			}
+			const size_t count = end - begin;
+			struct Partial {
+				Bin bins[3][kBvhBinCount];
+			};
+			std::vector<Partial> partial((count + kBinningGrain - 1) / kBinningGrain);
+			m_pool->ParallelFor(count, kBinningGrain, [&](size_t chunkBegin, size_t chunkEnd) {
+				binRange(begin + chunkBegin, begin + chunkEnd, partial[chunkBegin / kBinningGrain].bins);
+			});
+			for (const auto& chunk : partial) {
+				for (int a = 0; a < 3; ++a) {
+					for (uint32_t b = 0; b < kBvhBinCount; ++b) {
+						bins[a][b].bounds.grow(chunk.bins[a][b].bounds);
+						bins[a][b].count += chunk.bins[a][b].count;
+					}
+				}
+			}
+		}
+
+		std::vector<Box> m_boxes;
+		std::vector<float> m_centroids;
+		std::vector<uint32_t>& m_primitives;
+		ThreadPool* m_pool;
+	};
+}
+
+Bvh BuildBvh(const std::vector<BvhBounds>& bounds, ThreadPool* pool) {
+	Bvh bvh;
+	const uint32_t primitiveCount = static_cast<uint32_t>(bounds.size());
+	bvh.primitives.resize(primitiveCount);
+	std::iota(bvh.primitives.begin(), bvh.primitives.end(), 0u);
+	if (primitiveCount == 0) {
+		return bvh;
+	}
+	bvh.nodes.reserve(static_cast<size_t>(primitiveCount) * 2);
+	bvh.nodes.resize(1);
+
+	Builder builder(bounds, bvh.primitives, pool);
+	const uint32_t threadCount = pool ? pool->ThreadCount() : 1;
+	const uint32_t subtreeSize = std::max(kMinSubtreeSize, primitiveCount / (threadCount * 4));
+
+	// Split the top of the tree breadth first until every open range is small
+	// enough to be one task; those ranges share no nodes or primitives.
+	std::vector<Task> open = { { 0, 0, primitiveCount, 0 } };
+	std::vector<Task> subtrees;
+	for (size_t i = 0; i < open.size(); ++i) {
+		Task task = open[i];
+		if (!pool || task.end - task.begin <= subtreeSize) {
+			subtrees.push_back(task);
+			continue;
+		}
+		BvhNode node;
+		uint32_t middle;
+		if (builder.split(node, task.begin, task.end, task.depth, true, middle)) {
+			node.first = static_cast<uint32_t>(bvh.nodes.size());
+			node.count = 0;
+			bvh.nodes.resize(bvh.nodes.size() + 2);
+			open.push_back({ node.first, task.begin, middle, task.depth + 1 });
+			open.push_back({ node.first + 1, middle, task.end, task.depth + 1 });
+		}
+		bvh.nodes[task.node] = node;
+	}
+
+	std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+	auto buildSubtrees = [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; ++s) {
+			builder.buildSubtree(subtreeNodes[s], subtrees[s].begin, subtrees[s].end, subtrees[s].depth);
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(subtrees.size(), 1, buildSubtrees);
+	}
+	else {
+		buildSubtrees(0, subtrees.size());
+	}
+
+	// Stitch: each subtree root replaces its placeholder, the rest is appended
+	// with child indices rebased.
+	for (size_t s = 0; s < subtrees.size(); ++s) {
+		auto& nodes = subtreeNodes[s];
+		const uint32_t base = static_cast<uint32_t>(bvh.nodes.size()) - 1;
+		for (auto& node : nodes) {
+			if (node.count == 0) {
+				node.first += base;
+			}
+		}
+		bvh.nodes[subtrees[s].node] = nodes[0];
+		bvh.nodes.insert(bvh.nodes.end(), nodes.begin() + 1, nodes.end());
+	}
+	return bvh;
+}
@@ -0,0 +1,301 @@
+// renderlab-compare: checks rendered frames against golden images.
+//
+//   renderlab-compare <output> <golden> [options]
+//
+// <output> and <golden> are two PNG files, two directories of PNGs matched by
+// file name, or two .rlsq sequences compared frame by frame.
+//
+//   --tile N         tile size for per tile metrics (64)
+//   --threads N      worker threads, 0 for all hardware threads (0)
+//   --max-abs N      largest allowed channel difference (255)
+//   --min-psnr X     smallest allowed PSNR in dB (40)
+//   --min-ssim X     smallest allowed SSIM (0.99)
+//   --heatmap DIR    write a heatmap for every frame that differs
+//   --gain X         heatmap gain (8)
+//   --report FILE    write a JSON report
+//
+// Exits with 0 when every frame passes, 1 when any fails and 2 on errors.
+#include "imageCompare.h"
+#include "pngWriter.h"
+#include "sequenceEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "json.hpp"
+
+namespace {
+	struct Thresholds {
+		uint32_t maxAbs = 255;
+		double minPsnr = 40.0;
+		double minSsim = 0.99;
+	};
+
+	struct Image {
+		std::vector<uint8_t> pixels;
+		uint32_t width = 0;
+		uint32_t height = 0;
+
+		ImageView View() const {
+			return { pixels.data(), width, height, static_cast<size_t>(width) * 4 };
+		}
+	};
+
+	bool loadPng(const std::string& path, Image& image) {
+		int width, height, components;
+		stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+		if (!pixels) {
+			fprintf(stderr, "renderlab-compare: cannot read %s: %s\n", path.c_str(), stbi_failure_reason());
+			return false;
+		}
+		image.width = static_cast<uint32_t>(width);
+		image.height = static_cast<uint32_t>(height);
+		image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+		return true;
+	}
+
+	bool tilePasses(const TileComparison& tile, const Thresholds& thresholds) {
+		return tile.maxAbs <= thresholds.maxAbs && tile.psnr >= thresholds.minPsnr && tile.ssim >= thresholds.minSsim;
+	}
+
+	class Checker {
+	public:
+		Checker(const CompareOptions& options, const Thresholds& thresholds, std::string heatmapDirectory, float gain) :
+			m_options(options),
+			m_thresholds(thresholds),
+			m_heatmapDirectory(std::move(heatmapDirectory)),
+			m_gain(gain)
+		{
+		}
+
+		void Check(const std::string& name, const Image& output, const Image& golden) {
+			nlohmann::json frame;
+			frame["name"] = name;
+			ImageComparison comparison;
+			if (!CompareImages(output.View(), golden.View(), m_options, comparison)) {
+				frame["pass"] = false;
+				frame["error"] = "size mismatch";
+				fprintf(stderr, "%s: size %ux%u does not match golden %ux%u\n", name.c_str(), output.width, output.height, golden.width, golden.height);
+				++m_failed;
+				m_frames.push_back(frame);
+				return;
+			}
+
+			bool pass = comparison.maxAbs <= m_thresholds.maxAbs && comparison.psnr >= m_thresholds.minPsnr && comparison.ssim >= m_thresholds.minSsim;
+			frame["pass"] = pass;
+			frame["maxAbs"] = comparison.maxAbs;
+			frame["psnr"] = comparison.psnr;
+			frame["ssim"] = comparison.ssim;
+			// Only tiles outside the thresholds are listed, which keeps reports
+			// for long sequences small.
+			nlohmann::json tiles = nlohmann::json::array();
+			for (const auto& tile : comparison.tiles) {
+				if (!tilePasses(tile, m_thresholds)) {
+					tiles.push_back({ { "x", tile.x }, { "y", tile.y }, { "width", tile.width }, { "height", tile.height },
+						{ "maxAbs", tile.maxAbs }, { "psnr", tile.psnr }, { "ssim", tile.ssim } });
+				}
+			}
+			frame["failedTiles"] = tiles;
+
+			if (comparison.maxAbs > 0 && !m_heatmapDirectory.empty()) {
+				std::string heatmapPath = (std::filesystem::path(m_heatmapDirectory) / (std::filesystem::path(name).stem().string() + "_heatmap.png")).string();
+				writeHeatmap(heatmapPath, output.View(), golden.View());
+				frame["heatmap"] = heatmapPath;
+			}
+
+			printf("%s %s max abs %u psnr %.2f ssim %.5f\n", pass ? "pass" : "FAIL", name.c_str(), comparison.maxAbs, comparison.psnr, comparison.ssim);
+			if (!pass) {
+				++m_failed;
+			}
+			m_frames.push_back(frame);
+		}
+
+		void Error(const std::string& name, const std::string& message) {
+			fprintf(stderr, "%s: %s\n", name.c_str(), message.c_str());
+			m_frames.push_back({ { "name", name }, { "pass", false }, { "error", message } });
+			++m_failed;
+		}
+
+		nlohmann::json Report(double seconds) const {
+			nlohmann::json report;
+			report["thresholds"] = { { "maxAbs", m_thresholds.maxAbs }, { "minPsnr", m_thresholds.minPsnr }, { "minSsim", m_thresholds.minSsim } };
+			report["tileSize"] = m_options.tileSize;
+			report["frames"] = m_frames;
+			report["failed"] = m_failed;
+			report["seconds"] = seconds;
+			return report;
+		}
+
+		size_t FrameCount() const { return m_frames.size(); }
+		size_t Failed() const { return m_failed; }
+
+	private:
+		void writeHeatmap(const std::string& path, const ImageView& output, const ImageView& golden) {
+			constexpr uint32_t kBandHeight = 64;
+			std::vector<uint8_t> band(static_cast<size_t>(output.width) * kBandHeight * 4);
+			PngWriter writer;
+			if (!writer.Open(path, output.width, output.height)) {
+				fprintf(stderr, "renderlab-compare: cannot write %s\n", path.c_str());
+				return;
+			}
+			for (uint32_t y = 0; y < output.height; y += kBandHeight) {
+				uint32_t rowCount = std::min(kBandHeight, output.height - y);
+				BuildHeatmapRows(output, golden, y, rowCount, m_gain, band.data());
+				writer.WriteRows(band.data(), static_cast<size_t>(output.width) * 4, rowCount);
+			}
+			writer.Close();
+		}
+
+		CompareOptions m_options;
+		Thresholds m_thresholds;
+		std::string m_heatmapDirectory;
+		float m_gain;
+		std::vector<nlohmann::json> m_frames;
+		size_t m_failed = 0;
+	};
+
+	bool hasExtension(const std::string& path, const char* extension) {
+		return std::filesystem::path(path).extension() == extension;
+	}
+
+	void checkSequences(Checker& checker, const std::string& outputPath, const std::string& goldenPath) {
+		SequenceDecoder output;
+		SequenceDecoder golden;
+		if (!output.Open(outputPath) || !golden.Open(goldenPath)) {
+			checker.Error(outputPath, "cannot read sequence");
+			return;
+		}
+		if (output.FrameCount() != golden.FrameCount()) {
+			checker.Error(outputPath, "frame count " + std::to_string(output.FrameCount()) + " does not match golden " + std::to_string(golden.FrameCount()));
+		}
+		Image outputFrame = { {}, output.Width(), output.Height() };
+		Image goldenFrame = { {}, golden.Width(), golden.Height() };
+		uint32_t frameCount = std::min(output.FrameCount(), golden.FrameCount());
+		for (uint32_t frame = 0; frame < frameCount; ++frame) {
+			std::string name = "frame" + std::to_string(frame);
+			if (!output.ReadFrame(frame, outputFrame.pixels) || !golden.ReadFrame(frame, goldenFrame.pixels)) {
+				checker.Error(name, "cannot decode frame");
+				continue;
+			}
+			checker.Check(name, outputFrame, goldenFrame);
+		}
+	}
+
+	void checkDirectories(Checker& checker, const std::string& outputPath, const std::string& goldenPath) {
+		std::vector<std::filesystem::path> goldenFiles;
+		for (const auto& entry : std::filesystem::directory_iterator(goldenPath)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".png") {
+				goldenFiles.push_back(entry.path());
+			}
+		}
+		std::sort(goldenFiles.begin(), goldenFiles.end());
+		Image output;
+		Image golden;
+		for (const auto& goldenFile : goldenFiles) {
+			std::string name = goldenFile.filename().string();
+			auto outputFile = std::filesystem::path(outputPath) / name;
+			if (!std::filesystem::exists(outputFile)) {
+				checker.Error(name, "missing output");
+				continue;
+			}
+			if (!loadPng(outputFile.string(), output) || !loadPng(goldenFile.string(), golden)) {
+				checker.Error(name, "cannot read image");
+				continue;
+			}
+			checker.Check(name, output, golden);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> paths;
+	CompareOptions options;
+	Thresholds thresholds;
+	std::string heatmapDirectory;
+	std::string reportPath;
+	float gain = 8.0f;
+	for (int i = 1; i < argc; ++i) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--tile") == 0 && hasValue) {
+			options.tileSize = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+			options.threadCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--max-abs") == 0 && hasValue) {
+			thresholds.maxAbs = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--min-psnr") == 0 && hasValue) {
+			thresholds.minPsnr = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--min-ssim") == 0 && hasValue) {
+			thresholds.minSsim = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--heatmap") == 0 && hasValue) {
+			heatmapDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--gain") == 0 && hasValue) {
+			gain = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--report") == 0 && hasValue) {
+			reportPath = argv[++i];
+		}
+		else if (argv[i][0] != '-') {
+			paths.push_back(argv[i]);
+		}
+		else {
+			fprintf(stderr, "renderlab-compare: unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (paths.size() != 2) {
+		fprintf(stderr, "usage: renderlab-compare <output> <golden> [--tile N] [--threads N] [--max-abs N] [--min-psnr X] [--min-ssim X] [--heatmap DIR] [--gain X] [--report FILE]\n");
+		return 2;
+	}
+	if (!heatmapDirectory.empty()) {
+		std::filesystem::create_directories(heatmapDirectory);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Checker checker(options, thresholds, heatmapDirectory, gain);
+	if (std::filesystem::is_directory(paths[0]) && std::filesystem::is_directory(paths[1])) {
+		checkDirectories(checker, paths[0], paths[1]);
+	}
+	else if (hasExtension(paths[0], ".rlsq") && hasExtension(paths[1], ".rlsq")) {
+		checkSequences(checker, paths[0], paths[1]);
+	}
+	else {
+		Image output;
+		Image golden;
+		if (!loadPng(paths[0], output) || !loadPng(paths[1], golden)) {
+			return 2;
+		}
+		checker.Check(std::filesystem::path(paths[0]).filename().string(), output, golden);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%zu of %zu frames failed in %.3f s\n", checker.Failed(), checker.FrameCount(), seconds);
+
+	if (!reportPath.empty()) {
+		std::ofstream report(reportPath);
+		report << checker.Report(seconds).dump(2) << "\n";
+		if (!report) {
+			fprintf(stderr, "renderlab-compare: cannot write %s\n", reportPath.c_str());
+			return 2;
+		}
+	}
+	if (checker.FrameCount() == 0) {
+		fprintf(stderr, "renderlab-compare: nothing to compare\n");
+		return 2;
+	}
+	return checker.Failed() ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+#define NOMINMAX
+#include "constantAllocator.h"
+#include <algorithm>
+
+using namespace Microsoft::WRL;
+
+ConstantAllocator::~ConstantAllocator() {
+	if (m_data) {
+		m_buffer->Unmap(0, nullptr);
+	}
+}
+
+HRESULT ConstantAllocator::Init(ComPtr<ID3D12Resource> buffer, uint32_t slotCount) {
+	m_buffer = buffer;
+	m_slotCount = std::max(1u, slotCount);
+	// Pages start on an alignment boundary so every allocation does.
+	m_pageSize = (m_buffer->GetDesc().Width / m_slotCount) & ~(kAlignment - 1);
+	m_address = m_buffer->GetGPUVirtualAddress();
+
+	// Write only from the CPU, so no range is read.
+	D3D12_RANGE readRange = { 0, 0 };
+	void* data;
+	HRESULT result = m_buffer->Map(0, &readRange, &data);
+	if (FAILED(result)) {
+		return result;
+	}
+	m_data = static_cast<uint8_t*>(data);
+	return S_OK;
+}
+
+void ConstantAllocator::BeginSlot(uint32_t slot) {
+	m_pageOffset = static_cast<uint64_t>(slot % m_slotCount) * m_pageSize;
+	m_head = 0;
+}
+
+ConstantAllocation ConstantAllocator::Allocate(uint64_t size) {
+	const uint64_t alignedSize = Align(size);
+	if (!m_data || m_head + alignedSize > m_pageSize) {
+		++m_stats.failures;
+		return {};
+	}
+	ConstantAllocation allocation;
+	allocation.data = m_data + m_pageOffset + m_head;
+	allocation.address = m_address + m_pageOffset + m_head;
+	m_head += alignedSize;
+	++m_stats.allocations;
+	m_stats.peakSlotBytes = std::max(m_stats.peakSlotBytes, m_head);
+	return allocation;
+}
+
+ConstantAllocatorStats ConstantAllocator::TakeStats() {
+	ConstantAllocatorStats stats = m_stats;
+	m_stats = {};
+	return stats;
+}
@@ -0,0 +1,82 @@
+#include "contentHash.h"
+#include <cstring>
+
+namespace {
+	constexpr uint64_t kPrime1 = 11400714785074694791ull;
+	constexpr uint64_t kPrime2 = 14029467366897019727ull;
+	constexpr uint64_t kPrime3 = 1609587929392839161ull;
+	constexpr uint64_t kPrime4 = 9650029242287828579ull;
+	constexpr uint64_t kPrime5 = 2870177450012600261ull;
+
+	uint64_t rotateLeft(uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	uint64_t read64(const uint8_t* data) {
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint32_t read32(const uint8_t* data) {
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint64_t round(uint64_t accumulator, uint64_t value) {
+		accumulator += value * kPrime2;
+		return rotateLeft(accumulator, 31) * kPrime1;
+	}
+
+	uint64_t merge(uint64_t hash, uint64_t lane) {
+		return (hash ^ round(0, lane)) * kPrime1 + kPrime4;
+	}
+
+	uint64_t avalanche(uint64_t hash) {
+		hash ^= hash >> 33;
+		hash *= kPrime2;
+		hash ^= hash >> 29;
+		hash *= kPrime3;
+		return hash ^ (hash >> 32);
+	}
+}
+
+ContentHash HashContent(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const uint8_t* end = bytes + size;
+	uint64_t lanes[4] = { seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1 };
+	for (; end - bytes >= 32; bytes += 32) {
+		for (int lane = 0; lane < 4; ++lane) {
+			lanes[lane] = round(lanes[lane], read64(bytes + 8 * lane));
+		}
+	}
+
+	uint64_t low = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+	uint64_t high = rotateLeft(lanes[3], 1) + rotateLeft(lanes[2], 7) + rotateLeft(lanes[1], 12) + rotateLeft(lanes[0], 18) + kPrime5;
+	for (int lane = 0; lane < 4; ++lane) {
+		low = merge(low, lanes[lane]);
+		high = merge(high, lanes[3 - lane]);
+	}
+	low += size;
+	high += size * kPrime3;
+
+	// The tail goes into both halves, with the high half seeing each word
+	// rotated so the two do not stay correlated.
+	for (; end - bytes >= 8; bytes += 8) {
+		const uint64_t value = read64(bytes);
+		low = rotateLeft(low ^ round(0, value), 27) * kPrime1 + kPrime4;
+		high = rotateLeft(high ^ round(0, rotateLeft(value, 32)), 27) * kPrime1 + kPrime4;
+	}
+	if (end - bytes >= 4) {
+		const uint64_t value = read32(bytes);
+		low = rotateLeft(low ^ value * kPrime1, 23) * kPrime2 + kPrime3;
+		high = rotateLeft(high ^ value * kPrime2, 23) * kPrime1 + kPrime3;
+		bytes += 4;
+	}
+	for (; bytes < end; ++bytes) {
+		low = rotateLeft(low ^ *bytes * kPrime5, 11) * kPrime1;
+		high = rotateLeft(high ^ *bytes * kPrime1, 11) * kPrime5;
+	}
+	return { avalanche(low), avalanche(high ^ rotateLeft(low, 17)) };
+}
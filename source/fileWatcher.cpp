@@ -0,0 +1,51 @@
+#include "fileWatcher.h"
+#include <algorithm>
+
+using namespace std::chrono;
+
+FileWatcher::FileWatcher(milliseconds interval, milliseconds settle) :
+	m_interval(interval),
+	m_settle(settle)
+{
+}
+
+void FileWatcher::Watch(const std::string& path) {
+	if (std::any_of(m_files.begin(), m_files.end(), [&](const File& file) { return file.path == path; })) {
+		return;
+	}
+	State current = state(path);
+	m_files.push_back({ path, current, current, steady_clock::now() });
+}
+
+FileWatcher::State FileWatcher::state(const std::string& path) {
+	State current;
+	std::error_code error;
+	current.time = std::filesystem::last_write_time(path, error);
+	if (error) {
+		return {};
+	}
+	current.size = std::filesystem::file_size(path, error);
+	current.exists = !error;
+	return current;
+}
+
+std::vector<std::string> FileWatcher::Poll() {
+	std::vector<std::string> changed;
+	const auto now = steady_clock::now();
+	if (now - m_lastPoll < m_interval) {
+		return changed;
+	}
+	m_lastPoll = now;
+	for (auto& file : m_files) {
+		State current = state(file.path);
+		if (!(current == file.seen)) {
+			file.seen = current;
+			file.seenAt = now;
+		}
+		else if (current.exists && !(current == file.reported) && now - file.seenAt >= m_settle) {
+			file.reported = current;
+			changed.push_back(file.path);
+		}
+	}
+	return changed;
+}
@@ -0,0 +1,118 @@
+#include "formatConversion.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	uint8_t unitToByte(float value) {
+		// NaN fails both comparisons and ends up as 0.
+		return static_cast<uint8_t>(value > 0.0f ? (value < 1.0f ? value * 255.0f : 255.0f) : 0.0f);
+	}
+
+	// Small float with no sign bit, a 5 bit exponent and mantissaBits of mantissa
+	// as used by half, R11 and B10 channels.
+	float smallFloatToFloat(uint32_t exponent, uint32_t mantissa, uint32_t mantissaBits) {
+		if (exponent == 0) {
+			return std::ldexp(static_cast<float>(mantissa), -14 - static_cast<int>(mantissaBits));
+		}
+		if (exponent == 31) {
+			return mantissa ? NAN : INFINITY;
+		}
+		return std::ldexp(1.0f + std::ldexp(static_cast<float>(mantissa), -static_cast<int>(mantissaBits)), static_cast<int>(exponent) - 15);
+	}
+
+	// Every small float bit pattern is converted once; rows then cost one
+	// table lookup per channel.
+	const std::vector<uint8_t>& halfTable() {
+		static const auto table = [] {
+			std::vector<uint8_t> table(1 << 16);
+			for (uint32_t bits = 0; bits < table.size(); ++bits) {
+				float value = smallFloatToFloat((bits >> 10) & 0x1f, bits & 0x3ff, 10);
+				table[bits] = (bits & 0x8000) ? 0 : unitToByte(value);
+			}
+			return table;
+		}();
+		return table;
+	}
+
+	const std::vector<uint8_t>& float11Table() {
+		static const auto table = [] {
+			std::vector<uint8_t> table(1 << 11);
+			for (uint32_t bits = 0; bits < table.size(); ++bits) {
+				table[bits] = unitToByte(smallFloatToFloat(bits >> 6, bits & 0x3f, 6));
+			}
+			return table;
+		}();
+		return table;
+	}
+
+	const std::vector<uint8_t>& float10Table() {
+		static const auto table = [] {
+			std::vector<uint8_t> table(1 << 10);
+			for (uint32_t bits = 0; bits < table.size(); ++bits) {
+				table[bits] = unitToByte(smallFloatToFloat(bits >> 5, bits & 0x1f, 5));
+			}
+			return table;
+		}();
+		return table;
+	}
+}
+
+bool IsSupportedRenderTargetFormat(DXGI_FORMAT format) {
+	return BytesPerPixel(format) != 0;
+}
+
+uint32_t BytesPerPixel(DXGI_FORMAT format) {
+	switch (format) {
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+void ConvertRowToRGBA8(DXGI_FORMAT format, const void* source, uint8_t* destination, uint32_t width) {
+	switch (format) {
+	case DXGI_FORMAT_R32G32B32A32_FLOAT: {
+		const float* src = static_cast<const float*>(source);
+		for (uint32_t i = 0; i < width * 4; ++i) {
+			destination[i] = unitToByte(src[i]);
+		}
+		break;
+	}
+	case DXGI_FORMAT_R16G16B16A16_FLOAT: {
+		const uint16_t* src = static_cast<const uint16_t*>(source);
+		const uint8_t* table = halfTable().data();
+		for (uint32_t i = 0; i < width * 4; ++i) {
+			destination[i] = table[src[i]];
+		}
+		break;
+	}
+	case DXGI_FORMAT_R11G11B10_FLOAT: {
+		const uint32_t* src = static_cast<const uint32_t*>(source);
+		const uint8_t* table11 = float11Table().data();
+		const uint8_t* table10 = float10Table().data();
+		for (uint32_t i = 0; i < width; ++i) {
+			uint32_t packed = src[i];
+			destination[i * 4 + 0] = table11[packed & 0x7ff];
+			destination[i * 4 + 1] = table11[(packed >> 11) & 0x7ff];
+			destination[i * 4 + 2] = table10[packed >> 22];
+			destination[i * 4 + 3] = 255;
+		}
+		break;
+	}
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		// Already sRGB encoded by the output merger.
+		memcpy(destination, source, static_cast<size_t>(width) * 4);
+		break;
+	default:
+		memset(destination, 0, static_cast<size_t>(width) * 4);
+		break;
+	}
+}
@@ -0,0 +1,159 @@
+#include "frameScheduler.h"
+#include <chrono>
+
+using namespace std::chrono;
+
+FrameScheduler::~FrameScheduler() {
+	if (m_directEvent) {
+		CloseHandle(m_directEvent);
+	}
+	if (m_copyEvent) {
+		CloseHandle(m_copyEvent);
+	}
+}
+
+HRESULT FrameScheduler::Init(ID3D12Device* device, ID3D12CommandQueue* directQueue, ID3D12CommandQueue* copyQueue, uint32_t slotCount) {
+	m_directQueue = directQueue;
+	m_copyQueue = copyQueue;
+	m_slots.assign(slotCount, {});
+
+	HRESULT result = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_directFence));
+	if (SUCCEEDED(result)) {
+		result = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_copyFence));
+	}
+	if (FAILED(result)) {
+		return result;
+	}
+	m_directEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	m_copyEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if (!m_directEvent || !m_copyEvent) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = 2 * slotCount;
+	result = device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_timestampHeap));
+	if (FAILED(result)) {
+		return result;
+	}
+
+	D3D12_HEAP_PROPERTIES heapProperties = {};
+	heapProperties.Type = D3D12_HEAP_TYPE_READBACK;
+	D3D12_RESOURCE_DESC resourceDesc = {};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Width = sizeof(uint64_t) * queryHeapDesc.Count;
+	resourceDesc.Height = 1;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.SampleDesc = { 1, 0 };
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	result = device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_timestampBuffer));
+	if (FAILED(result)) {
+		return result;
+	}
+	void* data;
+	result = m_timestampBuffer->Map(0, nullptr, &data);
+	if (FAILED(result)) {
+		return result;
+	}
+	m_timestamps = static_cast<const uint64_t*>(data);
+	return m_directQueue->GetTimestampFrequency(&m_timestampFrequency);
+}
+
+void FrameScheduler::wait(ID3D12Fence* fence, uint64_t value, HANDLE event) {
+	if (fence->GetCompletedValue() >= value) {
+		return;
+	}
+	auto start = high_resolution_clock::now();
+	fence->SetEventOnCompletion(value, event);
+	WaitForSingleObject(event, INFINITE);
+	m_stats.cpuStallMicroseconds += duration<double, std::micro>(high_resolution_clock::now() - start).count();
+}
+
+// Submissions retire in the order they were made, so the gap between one's
+// start and the previous one's end is time the direct queue sat idle.
+void FrameScheduler::retire(Slot& slot, uint32_t slotIndex) {
+	slot.pending = false;
+	if (!slot.timed || m_timestampFrequency == 0) {
+		return;
+	}
+	slot.timed = false;
+	const uint64_t start = m_timestamps[2 * slotIndex];
+	const uint64_t end = m_timestamps[2 * slotIndex + 1];
+	const double microsecondsPerTick = 1e6 / static_cast<double>(m_timestampFrequency);
+	if (m_lastTimestamp && start > m_lastTimestamp) {
+		m_stats.gpuIdleMicroseconds += (start - m_lastTimestamp) * microsecondsPerTick;
+	}
+	if (end > start) {
+		m_stats.gpuBusyMicroseconds += (end - start) * microsecondsPerTick;
+	}
+	if (end > m_lastTimestamp) {
+		m_lastTimestamp = end;
+	}
+}
+
+uint32_t FrameScheduler::AcquireSlot() {
+	uint32_t slot = m_nextSlot;
+	m_nextSlot = (m_nextSlot + 1) % SlotCount();
+	WaitForSlot(slot);
+	return slot;
+}
+
+void FrameScheduler::BeginTimestamp(ID3D12GraphicsCommandList* commandList, uint32_t slot) {
+	commandList->EndQuery(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * slot);
+}
+
+void FrameScheduler::EndTimestamp(ID3D12GraphicsCommandList* commandList, uint32_t slot) {
+	commandList->EndQuery(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * slot + 1);
+	commandList->ResolveQueryData(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * slot, 2, m_timestampBuffer.Get(), sizeof(uint64_t) * 2 * slot);
+	m_slots[slot].timed = true;
+}
+
+void FrameScheduler::Submit(uint32_t slot, ID3D12CommandList* directCommandList, ID3D12CommandList* copyCommandList) {
+	Slot& submission = m_slots[slot];
+	m_directQueue->ExecuteCommandLists(1, &directCommandList);
+	m_directQueue->Signal(m_directFence.Get(), ++m_directFenceValue);
+	submission.directFenceValue = m_directFenceValue;
+
+	// The copy queue waits on the GPU, leaving the CPU free to record the next slot.
+	m_copyQueue->Wait(m_directFence.Get(), m_directFenceValue);
+	m_copyQueue->ExecuteCommandLists(1, &copyCommandList);
+	m_copyQueue->Signal(m_copyFence.Get(), ++m_copyFenceValue);
+	submission.copyFenceValue = m_copyFenceValue;
+	submission.pending = true;
+	++m_stats.submissions;
+}
+
+void FrameScheduler::WaitForSlot(uint32_t slot) {
+	Slot& submission = m_slots[slot];
+	if (!submission.pending) {
+		return;
+	}
+	wait(m_copyFence.Get(), submission.copyFenceValue, m_copyEvent);
+	retire(submission, slot);
+}
+
+void FrameScheduler::WaitForDirectQueue() {
+	wait(m_directFence.Get(), m_directFenceValue, m_directEvent);
+}
+
+void FrameScheduler::WaitForDirectValue(uint64_t value) {
+	wait(m_directFence.Get(), value, m_directEvent);
+}
+
+void FrameScheduler::WaitIdle() {
+	// Oldest first, so the idle time between them is accounted in order.
+	for (uint32_t i = 0; i < SlotCount(); ++i) {
+		WaitForSlot((m_nextSlot + i) % SlotCount());
+	}
+	wait(m_directFence.Get(), m_directFenceValue, m_directEvent);
+	wait(m_copyFence.Get(), m_copyFenceValue, m_copyEvent);
+}
+
+FrameSchedulerStats FrameScheduler::TakeStats() {
+	FrameSchedulerStats stats = m_stats;
+	m_stats = {};
+	return stats;
+}
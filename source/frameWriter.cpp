@@ -0,0 +1,531 @@
+#include "frameWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include "ioRing.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono;
+
+namespace {
+	// Direct I/O wants buffers, offsets and lengths aligned to the device's
+	// logical block; 4 KiB covers both 512 byte and 4K sectors.
+	constexpr uint32_t kAlignment = 4096;
+	constexpr uint32_t kBlockBytes = 1u << 20;
+
+	uint64_t alignUp(uint64_t value) {
+		return (value + kAlignment - 1) & ~static_cast<uint64_t>(kAlignment - 1);
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction) {
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+	}
+
+#ifdef _WIN32
+	using FileHandle = HANDLE;
+	const FileHandle kInvalidFile = INVALID_HANDLE_VALUE;
+
+	// Unbuffered handles are the counterpart of O_DIRECT.
+	FileHandle openFile(const std::string& path, bool& direct) {
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+		direct = file != INVALID_HANDLE_VALUE;
+		if (!direct) {
+			file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		}
+		return file;
+	}
+
+	bool preallocate(FileHandle file, uint64_t bytes) {
+		FILE_ALLOCATION_INFO info = {};
+		info.AllocationSize.QuadPart = static_cast<LONGLONG>(bytes);
+		return SetFileInformationByHandle(file, FileAllocationInfo, &info, sizeof(info)) != 0;
+	}
+
+	int64_t writeAt(FileHandle file, const uint8_t* data, uint32_t length, uint64_t offset) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD written = 0;
+		return WriteFile(file, data, length, &written, &overlapped) ? static_cast<int64_t>(written) : -1;
+	}
+
+	bool disableDirect(FileHandle) {
+		return false;
+	}
+
+	// Trims the padding of the tail block and, with it, what was
+	// preallocated beyond the file.
+	bool finishFile(FileHandle file, uint64_t bytes) {
+		FILE_END_OF_FILE_INFO info = {};
+		info.EndOfFile.QuadPart = static_cast<LONGLONG>(bytes);
+		const bool trimmed = SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+		return CloseHandle(file) && trimmed;
+	}
+#else
+	using FileHandle = int;
+	const FileHandle kInvalidFile = -1;
+
+	FileHandle openFile(const std::string& path, bool& direct) {
+		direct = false;
+#if defined(__linux__)
+		// tmpfs and some network file systems refuse O_DIRECT at open.
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+		if (fd >= 0) {
+			direct = true;
+			return fd;
+		}
+#endif
+		return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+
+	// Reserves the extents without changing the file's size, so a file that
+	// turns out shorter is trimmed like any other.
+	bool preallocate(FileHandle fd, uint64_t bytes) {
+#if defined(__linux__)
+		return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes)) == 0;
+#else
+		(void)fd;
+		(void)bytes;
+		return false;
+#endif
+	}
+
+	int64_t writeAt(FileHandle fd, const uint8_t* data, uint32_t length, uint64_t offset) {
+		ssize_t written;
+		do {
+			written = pwrite(fd, data, length, static_cast<off_t>(offset));
+		} while (written < 0 && errno == EINTR);
+		return written;
+	}
+
+	// Some file systems accept O_DIRECT at open and refuse the writes.
+	bool disableDirect(FileHandle fd) {
+#if defined(__linux__)
+		const int flags = fcntl(fd, F_GETFL);
+		return flags >= 0 && (flags & O_DIRECT) && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+#else
+		(void)fd;
+		return false;
+#endif
+	}
+
+	bool finishFile(FileHandle fd, uint64_t bytes) {
+		const bool trimmed = ftruncate(fd, static_cast<off_t>(bytes)) == 0;
+		return close(fd) == 0 && trimmed;
+	}
+#endif
+}
+
+struct FrameWriter::File {
+	uint64_t frame = 0;
+	std::string path;
+	FileHandle handle = kInvalidFile;
+	// Set by the caller when it closes the file.
+	uint64_t bytes = 0;
+
+	// Writer side.
+	bool direct = false;
+	bool closing = false;
+	bool failed = false;
+	uint32_t inFlight = 0;
+	high_resolution_clock::time_point busyStart;
+	double busyMilliseconds = 0.0;
+	std::vector<double> latencies;
+};
+
+void FrameWriter::AlignedDelete::operator()(uint8_t* data) const {
+	::operator delete[](data, std::align_val_t(kAlignment));
+}
+
+FrameWriter::FrameWriter(uint32_t maxOutstanding, bool forceThreads) :
+	m_maxOutstanding(std::clamp(maxOutstanding, 1u, 256u))
+{
+	for (uint32_t i = 0; i < m_maxOutstanding; ++i) {
+		m_blocks.emplace_back(static_cast<uint8_t*>(::operator new[](kBlockBytes, std::align_val_t(kAlignment))));
+		m_freeBlocks.push_back(m_blocks.back().get());
+	}
+	if (!forceThreads) {
+		m_ring = std::make_unique<IoRing>();
+		if (!m_ring->setup(m_maxOutstanding)) {
+			m_ring.reset();
+		}
+	}
+	m_stats.backend = m_ring ? "io_uring" : "threads";
+	m_thread = std::thread([this] { run(); });
+}
+
+FrameWriter::~FrameWriter() {
+	Close();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_queued.notify_one();
+	m_thread.join();
+}
+
+bool FrameWriter::Open(const std::string& path, uint64_t frame) {
+	Close();
+	bool direct;
+	FileHandle handle = openFile(path, direct);
+	if (handle == kInvalidFile) {
+		return false;
+	}
+	auto file = std::make_unique<File>();
+	file->frame = frame;
+	file->path = path;
+	file->handle = handle;
+	file->direct = direct;
+	// Frames of a run are about the same size, so the previous one is the
+	// best guess at this one's.
+	const uint64_t preallocated = m_previousBytes > 0 && preallocate(handle, alignUp(m_previousBytes)) ? alignUp(m_previousBytes) : 0;
+
+	m_file = file.get();
+	m_direct = direct;
+	m_fileOffset = 0;
+	m_fileBytes = 0;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files.push_back(std::move(file));
+	m_stats.preallocatedBytes += preallocated;
+	return true;
+}
+
+void FrameWriter::Write(const uint8_t* data, size_t size) {
+	if (!m_file) {
+		return;
+	}
+	while (size > 0) {
+		if (!m_block) {
+			m_block = acquireBlock();
+			m_blockUsed = 0;
+		}
+		const uint32_t copy = static_cast<uint32_t>(std::min<size_t>(size, kBlockBytes - m_blockUsed));
+		memcpy(m_block + m_blockUsed, data, copy);
+		m_blockUsed += copy;
+		m_fileBytes += copy;
+		data += copy;
+		size -= copy;
+		if (m_blockUsed == kBlockBytes) {
+			queue({ m_file, m_block, m_fileOffset, kBlockBytes, {} });
+			m_fileOffset += kBlockBytes;
+			m_block = nullptr;
+		}
+	}
+}
+
+void FrameWriter::Close() {
+	if (!m_file) {
+		return;
+	}
+	if (m_block) {
+		uint32_t length = m_blockUsed;
+		if (m_direct) {
+			length = static_cast<uint32_t>(alignUp(length));
+			memset(m_block + m_blockUsed, 0, length - m_blockUsed);
+		}
+		queue({ m_file, m_block, m_fileOffset, length, {} });
+		m_block = nullptr;
+	}
+	m_file->bytes = m_fileBytes;
+	m_previousBytes = m_fileBytes;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_closedFiles;
+	}
+	queue({ m_file, nullptr, 0, 0, {} });
+	m_file = nullptr;
+}
+
+void FrameWriter::Flush() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_returned.wait(lock, [this] { return m_closedFiles == 0; });
+}
+
+void FrameWriter::TakeCompleted(std::vector<FrameWriteReport>& reports) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	reports.insert(reports.end(), std::make_move_iterator(m_reports.begin()), std::make_move_iterator(m_reports.end()));
+	m_reports.clear();
+}
+
+FrameWriteStats FrameWriter::Stats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+uint8_t* FrameWriter::acquireBlock() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_freeBlocks.empty()) {
+		auto start = high_resolution_clock::now();
+		m_returned.wait(lock, [this] { return !m_freeBlocks.empty(); });
+		m_stats.stallMilliseconds += duration<double, std::milli>(high_resolution_clock::now() - start).count();
+	}
+	uint8_t* block = m_freeBlocks.back();
+	m_freeBlocks.pop_back();
+	m_stats.peakOutstanding = std::max(m_stats.peakOutstanding, m_maxOutstanding - static_cast<uint32_t>(m_freeBlocks.size()));
+	return block;
+}
+
+void FrameWriter::queue(Block block) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(block);
+	}
+	m_queued.notify_one();
+}
+
+void FrameWriter::run() {
+	if (m_ring) {
+		runRing();
+	}
+	else {
+		runThreads();
+	}
+}
+
+#if defined(__linux__)
+void FrameWriter::runRing() {
+	// One slot per block, so a slot is free for every block that can be queued.
+	struct Write {
+		Block block;
+		uint32_t written = 0;
+		iovec vector = {};
+	};
+	std::vector<Write> writes(m_maxOutstanding);
+	std::vector<uint32_t> freeSlots(m_maxOutstanding);
+	for (uint32_t slot = 0; slot < m_maxOutstanding; ++slot) {
+		freeSlots[slot] = m_maxOutstanding - 1 - slot;
+	}
+	std::vector<uint32_t> resubmits;
+	std::vector<Block> blocks;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_inFlight == 0 && resubmits.empty()) {
+				m_queued.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+				if (m_queue.empty()) {
+					return;
+				}
+			}
+			blocks.assign(m_queue.begin(), m_queue.end());
+			m_queue.clear();
+		}
+
+		unsigned submit = 0;
+		auto submitWrite = [&](uint32_t slot) {
+			Write& write = writes[slot];
+			write.vector = { write.block.data + write.written, write.block.length - write.written };
+			io_uring_sqe* entry = m_ring->nextEntry();
+			entry->opcode = IORING_OP_WRITEV;
+			entry->fd = write.block.file->handle;
+			entry->off = write.block.offset + write.written;
+			entry->addr = reinterpret_cast<uint64_t>(&write.vector);
+			entry->len = 1;
+			entry->user_data = slot;
+			++submit;
+		};
+		for (uint32_t slot : resubmits) {
+			submitWrite(slot);
+		}
+		resubmits.clear();
+		for (const Block& block : blocks) {
+			File& file = *block.file;
+			if (!block.data) {
+				file.closing = true;
+				if (file.inFlight == 0) {
+					finish(file);
+				}
+				continue;
+			}
+			const uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			writes[slot] = { block, 0, {} };
+			writes[slot].block.issued = high_resolution_clock::now();
+			beginWrite(file);
+			submitWrite(slot);
+		}
+		if (m_inFlight == 0) {
+			continue;
+		}
+
+		if (m_ring->enter(submit, 1) < 0) {
+			// The ring itself failed; what is in flight is lost.
+			for (uint32_t slot = 0; slot < m_maxOutstanding; ++slot) {
+				if (std::find(freeSlots.begin(), freeSlots.end(), slot) == freeSlots.end()) {
+					endWrite(*writes[slot].block.file);
+					complete(writes[slot].block, false);
+					freeSlots.push_back(slot);
+				}
+			}
+			continue;
+		}
+
+		unsigned head = *m_ring->cqHead;
+		const unsigned tail = __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE);
+		std::vector<uint32_t> completed;
+		for (; head != tail; ++head) {
+			const io_uring_cqe& entry = m_ring->cqes[head & m_ring->cqMask];
+			const uint32_t slot = static_cast<uint32_t>(entry.user_data);
+			const int result = entry.res;
+			Write& write = writes[slot];
+			File& file = *write.block.file;
+			if (result == -EAGAIN || result == -EINTR) {
+				resubmits.push_back(slot);
+				continue;
+			}
+			if (result == -EINVAL && file.direct && disableDirect(file.handle)) {
+				file.direct = false;
+				resubmits.push_back(slot);
+				continue;
+			}
+			if (result > 0 && write.written + static_cast<uint32_t>(result) < write.block.length) {
+				write.written += static_cast<uint32_t>(result);
+				resubmits.push_back(slot);
+				continue;
+			}
+			completed.push_back(slot);
+			file.failed = file.failed || result <= 0;
+		}
+		__atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+		for (uint32_t slot : completed) {
+			endWrite(*writes[slot].block.file);
+			complete(writes[slot].block, !writes[slot].block.file->failed);
+			freeSlots.push_back(slot);
+		}
+	}
+}
+#else
+void FrameWriter::runRing() {
+	runThreads();
+}
+#endif
+
+void FrameWriter::runThreads() {
+	for (;;) {
+		Block block;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty()) {
+				return;
+			}
+			block = m_queue.front();
+			m_queue.pop_front();
+		}
+		File& file = *block.file;
+		if (!block.data) {
+			finish(file);
+			continue;
+		}
+		block.issued = high_resolution_clock::now();
+		beginWrite(file);
+		uint32_t written = 0;
+		while (written < block.length) {
+			const int64_t result = writeAt(file.handle, block.data + written, block.length - written, block.offset + written);
+			if (result < 0 && file.direct && disableDirect(file.handle)) {
+				file.direct = false;
+				continue;
+			}
+			if (result <= 0) {
+				file.failed = true;
+				break;
+			}
+			written += static_cast<uint32_t>(result);
+		}
+		endWrite(file);
+		complete(block, written == block.length);
+	}
+}
+
+void FrameWriter::beginWrite(File& file) {
+	auto now = high_resolution_clock::now();
+	if (file.inFlight++ == 0) {
+		file.busyStart = now;
+	}
+	if (m_inFlight++ == 0) {
+		m_busyStart = now;
+	}
+}
+
+void FrameWriter::endWrite(File& file) {
+	auto now = high_resolution_clock::now();
+	if (--file.inFlight == 0) {
+		file.busyMilliseconds += duration<double, std::milli>(now - file.busyStart).count();
+	}
+	if (--m_inFlight == 0) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.busyMilliseconds += duration<double, std::milli>(now - m_busyStart).count();
+	}
+}
+
+void FrameWriter::complete(const Block& block, bool succeeded) {
+	File& file = *block.file;
+	file.failed = file.failed || !succeeded;
+	file.latencies.push_back(duration<double, std::milli>(high_resolution_clock::now() - block.issued).count());
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeBlocks.push_back(block.data);
+		++m_stats.writes;
+	}
+	m_returned.notify_all();
+	if (file.closing && file.inFlight == 0) {
+		finish(file);
+	}
+}
+
+void FrameWriter::finish(File& file) {
+	const bool succeeded = finishFile(file.handle, file.bytes) && !file.failed;
+	FrameWriteReport report;
+	report.frame = file.frame;
+	report.path = file.path;
+	report.succeeded = succeeded;
+	report.bytes = file.bytes;
+	report.writes = static_cast<uint32_t>(file.latencies.size());
+	report.busyMilliseconds = file.busyMilliseconds;
+	std::sort(file.latencies.begin(), file.latencies.end());
+	report.p50Milliseconds = percentile(file.latencies, 0.5);
+	report.p99Milliseconds = percentile(file.latencies, 0.99);
+	report.maxMilliseconds = file.latencies.empty() ? 0.0 : file.latencies.back();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_stats.files;
+		m_stats.failedFiles += succeeded ? 0 : 1;
+		m_stats.directFiles += file.direct ? 1 : 0;
+		m_stats.bytes += file.bytes;
+		m_latencies.insert(m_latencies.end(), file.latencies.begin(), file.latencies.end());
+		m_reports.push_back(std::move(report));
+		m_files.erase(std::find_if(m_files.begin(), m_files.end(), [&](const std::unique_ptr<File>& open) { return open.get() == &file; }));
+		--m_closedFiles;
+	}
+	m_returned.notify_all();
+}
+
+std::string FrameWriter::Report() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<double> latencies = m_latencies;
+	std::sort(latencies.begin(), latencies.end());
+	char line[320];
+	const double mebibytes = m_stats.bytes / 1048576.0;
+	snprintf(line, sizeof(line), "wrote %llu files, %.1f MiB with %s, %llu direct, %llu writes, %.1f MiB/s while busy %.1f ms, write latency p50 %.2f p99 %.2f max %.2f ms, outstanding peak %u of %u, stalled %.1f ms, preallocated %.1f MiB",
+		static_cast<unsigned long long>(m_stats.files), mebibytes, m_stats.backend, static_cast<unsigned long long>(m_stats.directFiles),
+		static_cast<unsigned long long>(m_stats.writes), m_stats.busyMilliseconds > 0.0 ? mebibytes * 1000.0 / m_stats.busyMilliseconds : 0.0,
+		m_stats.busyMilliseconds, percentile(latencies, 0.5), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back(),
+		m_stats.peakOutstanding, m_maxOutstanding, m_stats.stallMilliseconds, m_stats.preallocatedBytes / 1048576.0);
+	std::string report = line;
+	if (m_stats.failedFiles) {
+		snprintf(line, sizeof(line), ", %llu failed", static_cast<unsigned long long>(m_stats.failedFiles));
+		report += line;
+	}
+	return report + "\n";
+}
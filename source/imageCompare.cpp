@@ -0,0 +1,229 @@
+#include "imageCompare.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define COMPARE_SSE2 1
+#endif
+
+namespace {
+	constexpr uint32_t kBytesPerPixel = 4;
+	constexpr uint32_t kWindowSize = 8;
+	constexpr double kC1 = (0.01 * 255.0) * (0.01 * 255.0);
+	constexpr double kC2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+	double psnrFromMse(double mse) {
+		if (mse <= 0.0) {
+			return kIdenticalPsnr;
+		}
+		return std::min(kIdenticalPsnr, 10.0 * std::log10(255.0 * 255.0 / mse));
+	}
+
+	void diffRows(const uint8_t* a, size_t pitchA, const uint8_t* b, size_t pitchB, uint32_t width, uint32_t height, uint32_t& maxAbs, uint64_t& squaredError) {
+		maxAbs = 0;
+		squaredError = 0;
+#ifdef COMPARE_SSE2
+		const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i maxDiff = zero;
+#endif
+		for (uint32_t row = 0; row < height; ++row) {
+			const uint8_t* rowA = a + row * pitchA;
+			const uint8_t* rowB = b + row * pitchB;
+			uint32_t x = 0;
+#ifdef COMPARE_SSE2
+			// Lanes hold at most width / 4 * 2 * 255^2 per row, well inside 32 bits.
+			__m128i sum = zero;
+			for (; x + 4 <= width; x += 4) {
+				__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowA + x * kBytesPerPixel));
+				__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowB + x * kBytesPerPixel));
+				__m128i diff = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)), colorMask);
+				maxDiff = _mm_max_epu8(maxDiff, diff);
+				__m128i low = _mm_unpacklo_epi8(diff, zero);
+				__m128i high = _mm_unpackhi_epi8(diff, zero);
+				sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+			}
+			alignas(16) uint32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum);
+			squaredError += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#endif
+			for (; x < width; ++x) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					int diff = std::abs(int(rowA[x * kBytesPerPixel + c]) - int(rowB[x * kBytesPerPixel + c]));
+					maxAbs = std::max(maxAbs, static_cast<uint32_t>(diff));
+					squaredError += static_cast<uint64_t>(diff * diff);
+				}
+			}
+		}
+#ifdef COMPARE_SSE2
+		alignas(16) uint8_t bytes[16];
+		_mm_store_si128(reinterpret_cast<__m128i*>(bytes), maxDiff);
+		for (auto byte : bytes) {
+			maxAbs = std::max<uint32_t>(maxAbs, byte);
+		}
+#endif
+	}
+
+	void lumaRows(const uint8_t* pixels, size_t pitch, uint32_t width, uint32_t height, uint8_t* luma) {
+		for (uint32_t row = 0; row < height; ++row) {
+			const uint8_t* p = pixels + row * pitch;
+			for (uint32_t x = 0; x < width; ++x, p += kBytesPerPixel) {
+				*luma++ = static_cast<uint8_t>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+			}
+		}
+	}
+
+	struct WindowSums {
+		uint32_t x;
+		uint32_t y;
+		uint32_t xx;
+		uint32_t yy;
+		uint32_t xy;
+	};
+
+	WindowSums windowSums(const uint8_t* lumaA, const uint8_t* lumaB, uint32_t pitch, uint32_t width, uint32_t height) {
+		WindowSums sums = {};
+#ifdef COMPARE_SSE2
+		if (width == kWindowSize) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i ones = _mm_set1_epi16(1);
+			__m128i sumX = zero, sumY = zero, sumXX = zero, sumYY = zero, sumXY = zero;
+			for (uint32_t row = 0; row < height; ++row) {
+				__m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lumaA + row * pitch)), zero);
+				__m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lumaB + row * pitch)), zero);
+				sumX = _mm_add_epi32(sumX, _mm_madd_epi16(x, ones));
+				sumY = _mm_add_epi32(sumY, _mm_madd_epi16(y, ones));
+				sumXX = _mm_add_epi32(sumXX, _mm_madd_epi16(x, x));
+				sumYY = _mm_add_epi32(sumYY, _mm_madd_epi16(y, y));
+				sumXY = _mm_add_epi32(sumXY, _mm_madd_epi16(x, y));
+			}
+			auto horizontalSum = [](__m128i v) {
+				alignas(16) uint32_t lanes[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+				return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			};
+			return { horizontalSum(sumX), horizontalSum(sumY), horizontalSum(sumXX), horizontalSum(sumYY), horizontalSum(sumXY) };
+		}
+#endif
+		for (uint32_t row = 0; row < height; ++row) {
+			for (uint32_t i = 0; i < width; ++i) {
+				uint32_t x = lumaA[row * pitch + i];
+				uint32_t y = lumaB[row * pitch + i];
+				sums.x += x;
+				sums.y += y;
+				sums.xx += x * x;
+				sums.yy += y * y;
+				sums.xy += x * y;
+			}
+		}
+		return sums;
+	}
+
+	double ssimTile(const uint8_t* lumaA, const uint8_t* lumaB, uint32_t width, uint32_t height) {
+		double total = 0.0;
+		uint32_t windows = 0;
+		for (uint32_t y = 0; y < height; y += kWindowSize) {
+			for (uint32_t x = 0; x < width; x += kWindowSize) {
+				uint32_t w = std::min(kWindowSize, width - x);
+				uint32_t h = std::min(kWindowSize, height - y);
+				WindowSums sums = windowSums(lumaA + y * width + x, lumaB + y * width + x, width, w, h);
+				double n = static_cast<double>(w * h);
+				double meanX = sums.x / n;
+				double meanY = sums.y / n;
+				double varianceX = sums.xx / n - meanX * meanX;
+				double varianceY = sums.yy / n - meanY * meanY;
+				double covariance = sums.xy / n - meanX * meanY;
+				total += ((2.0 * meanX * meanY + kC1) * (2.0 * covariance + kC2)) /
+					((meanX * meanX + meanY * meanY + kC1) * (varianceX + varianceY + kC2));
+				++windows;
+			}
+		}
+		return windows ? total / windows : 1.0;
+	}
+}
+
+bool CompareImages(const ImageView& output, const ImageView& golden, const CompareOptions& options, ImageComparison& result) {
+	if (output.width != golden.width || output.height != golden.height) {
+		return false;
+	}
+	const uint32_t tileSize = std::max(kWindowSize, (options.tileSize + kWindowSize - 1) / kWindowSize * kWindowSize);
+	result = {};
+	result.tileSize = tileSize;
+	result.tileColumns = (output.width + tileSize - 1) / tileSize;
+	result.tileRows = (output.height + tileSize - 1) / tileSize;
+	const uint32_t tileCount = result.tileColumns * result.tileRows;
+	result.tiles.resize(tileCount);
+
+	std::vector<uint64_t> squaredErrors(tileCount);
+	std::atomic<uint32_t> nextTile = 0;
+	auto worker = [&]() {
+		std::vector<uint8_t> lumaA(static_cast<size_t>(tileSize) * tileSize);
+		std::vector<uint8_t> lumaB(lumaA.size());
+		for (uint32_t index = nextTile++; index < tileCount; index = nextTile++) {
+			auto& tile = result.tiles[index];
+			tile.x = index % result.tileColumns * tileSize;
+			tile.y = index / result.tileColumns * tileSize;
+			tile.width = std::min(tileSize, output.width - tile.x);
+			tile.height = std::min(tileSize, output.height - tile.y);
+			const uint8_t* a = output.pixels + tile.y * output.rowPitch + tile.x * kBytesPerPixel;
+			const uint8_t* b = golden.pixels + tile.y * golden.rowPitch + tile.x * kBytesPerPixel;
+
+			diffRows(a, output.rowPitch, b, golden.rowPitch, tile.width, tile.height, tile.maxAbs, squaredErrors[index]);
+			tile.mse = static_cast<double>(squaredErrors[index]) / (static_cast<double>(tile.width) * tile.height * 3);
+			tile.psnr = psnrFromMse(tile.mse);
+			if (tile.maxAbs == 0) {
+				tile.ssim = 1.0;
+				continue;
+			}
+			lumaRows(a, output.rowPitch, tile.width, tile.height, lumaA.data());
+			lumaRows(b, golden.rowPitch, tile.width, tile.height, lumaB.data());
+			tile.ssim = ssimTile(lumaA.data(), lumaB.data(), tile.width, tile.height);
+		}
+	};
+
+	uint32_t threadCount = options.threadCount ? options.threadCount : std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, tileCount);
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	uint64_t squaredError = 0;
+	double ssimSum = 0.0;
+	for (uint32_t index = 0; index < tileCount; ++index) {
+		const auto& tile = result.tiles[index];
+		result.maxAbs = std::max(result.maxAbs, tile.maxAbs);
+		squaredError += squaredErrors[index];
+		ssimSum += tile.ssim * tile.width * tile.height;
+	}
+	const double pixelCount = static_cast<double>(output.width) * output.height;
+	if (pixelCount > 0.0) {
+		result.mse = static_cast<double>(squaredError) / (pixelCount * 3);
+		result.psnr = psnrFromMse(result.mse);
+		result.ssim = ssimSum / pixelCount;
+	}
+	return true;
+}
+
+void BuildHeatmapRows(const ImageView& output, const ImageView& golden, uint32_t firstRow, uint32_t rowCount, float gain, uint8_t* rows) {
+	for (uint32_t row = 0; row < rowCount; ++row) {
+		const uint8_t* a = output.pixels + (firstRow + row) * output.rowPitch;
+		const uint8_t* b = golden.pixels + (firstRow + row) * golden.rowPitch;
+		for (uint32_t x = 0; x < output.width; ++x, a += kBytesPerPixel, b += kBytesPerPixel, rows += kBytesPerPixel) {
+			int diff = std::max({ std::abs(a[0] - b[0]), std::abs(a[1] - b[1]), std::abs(a[2] - b[2]) });
+			// Three 255 steps: red ramps up first, then green, then blue.
+			int heat = std::min(765, static_cast<int>(diff * gain * 3.0f));
+			rows[0] = static_cast<uint8_t>(std::min(heat, 255));
+			rows[1] = static_cast<uint8_t>(std::clamp(heat - 255, 0, 255));
+			rows[2] = static_cast<uint8_t>(std::clamp(heat - 510, 0, 255));
+			rows[3] = 255;
+		}
+	}
+}
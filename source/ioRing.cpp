@@ -0,0 +1,83 @@
+#include "ioRing.h"
+#if defined(__linux__)
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+IoRing::~IoRing() {
+	if (sqes) {
+		munmap(sqes, sqesSize);
+	}
+	if (cqRing && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing) {
+		munmap(sqRing, sqRingSize);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+bool IoRing::setup(uint32_t entries) {
+	io_uring_params params = {};
+	fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+	if (fd < 0) {
+		return false;
+	}
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap) {
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+	// Mappings that failed are left null, so the destructor skips them.
+	auto map = [this](size_t size, uint64_t offset) -> void* {
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, static_cast<off_t>(offset));
+		return mapping == MAP_FAILED ? nullptr : mapping;
+	};
+	sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+	if (!sqRing) {
+		return false;
+	}
+	cqRing = singleMap ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+	if (!cqRing) {
+		return false;
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = static_cast<io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+	if (!sqes) {
+		return false;
+	}
+	uint8_t* sq = static_cast<uint8_t*>(sqRing);
+	sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	uint8_t* cq = static_cast<uint8_t*>(cqRing);
+	cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	return true;
+}
+
+io_uring_sqe* IoRing::nextEntry() {
+	const unsigned tail = *sqTail;
+	io_uring_sqe* entry = &sqes[tail & sqMask];
+	memset(entry, 0, sizeof(*entry));
+	sqArray[tail & sqMask] = tail & sqMask;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	return entry;
+}
+
+int IoRing::enter(unsigned submit, unsigned waitFor) {
+	int result;
+	do {
+		result = static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+	} while (result < 0 && errno == EINTR);
+	return result;
+}
+#endif
@@ -0,0 +1,348 @@
+#include "lod.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace DirectX;
+
+namespace {
+	struct Quadric {
+		double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+		double weight;
+	};
+
+	struct Collapse {
+		double cost;
+		uint32_t from;
+		uint32_t to;
+	};
+
+	const XMFLOAT3& position(const uint8_t* positions, size_t stride, uint32_t index) {
+		return *reinterpret_cast<const XMFLOAT3*>(positions + stride * index);
+	}
+
+	void addPlane(Quadric& q, double a, double b, double c, double d, double weight) {
+		q.xx += weight * a * a;
+		q.xy += weight * a * b;
+		q.xz += weight * a * c;
+		q.xw += weight * a * d;
+		q.yy += weight * b * b;
+		q.yz += weight * b * c;
+		q.yw += weight * b * d;
+		q.zz += weight * c * c;
+		q.zw += weight * c * d;
+		q.ww += weight * d * d;
+		q.weight += weight;
+	}
+
+	void addQuadric(Quadric& q, const Quadric& other) {
+		q.xx += other.xx;
+		q.xy += other.xy;
+		q.xz += other.xz;
+		q.xw += other.xw;
+		q.yy += other.yy;
+		q.yz += other.yz;
+		q.yw += other.yw;
+		q.zz += other.zz;
+		q.zw += other.zw;
+		q.ww += other.ww;
+		q.weight += other.weight;
+	}
+
+	// Mean squared distance from p to the planes accumulated in q.
+	double evaluate(const Quadric& q, const XMFLOAT3& p) {
+		double x = p.x, y = p.y, z = p.z;
+		double error =
+			q.xx * x * x + 2.0 * q.xy * x * y + 2.0 * q.xz * x * z + 2.0 * q.xw * x +
+			q.yy * y * y + 2.0 * q.yz * y * z + 2.0 * q.yw * y +
+			q.zz * z * z + 2.0 * q.zw * z +
+			q.ww;
+		return q.weight > 0.0 ? std::max(error, 0.0) / q.weight : 0.0;
+	}
+
+	XMVECTOR triangleNormal(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c) {
+		XMVECTOR p0 = XMLoadFloat3(&a);
+		return XMVector3Cross(XMLoadFloat3(&b) - p0, XMLoadFloat3(&c) - p0);
+	}
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	struct PositionHash {
+		size_t operator()(const XMFLOAT3& p) const {
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual {
+		bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const {
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+}
+
+float SimplifyMesh(const std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result) {
+	result = indices;
+
+	// Vertices sharing a position with another vertex sit on an attribute seam.
+	std::vector<uint32_t> canonical(vertexCount);
+	std::vector<uint8_t> seam(vertexCount, 0);
+	std::unordered_map<XMFLOAT3, uint32_t, PositionHash, PositionEqual> welded;
+	welded.reserve(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		auto [it, inserted] = welded.emplace(position(positions, positionStride, v), v);
+		canonical[v] = it->second;
+		if (!inserted) {
+			seam[v] = 1;
+			seam[it->second] = 1;
+		}
+	}
+
+	// Open border edges are used by a single triangle once seams are welded.
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		for (size_t k = 0; k < 3; ++k) {
+			edges.push_back(edgeKey(canonical[indices[i + k]], canonical[indices[i + (k + 1) % 3]]));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<uint8_t> locked(seam);
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i]) {
+			++j;
+		}
+		if (j - i == 1) {
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xffffffffu] = 1;
+		}
+		i = j;
+	}
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		if (locked[canonical[v]]) {
+			locked[v] = 1;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t i = 0; i < result.size(); i += 3) {
+		const XMFLOAT3& p0 = position(positions, positionStride, result[i]);
+		XMVECTOR normal = triangleNormal(p0, position(positions, positionStride, result[i + 1]), position(positions, positionStride, result[i + 2]));
+		float area = XMVectorGetX(XMVector3Length(normal));
+		if (area < FLT_MIN) {
+			continue;
+		}
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normal / area);
+		double d = -(double(n.x) * p0.x + double(n.y) * p0.y + double(n.z) * p0.z);
+		for (size_t k = 0; k < 3; ++k) {
+			addPlane(quadrics[result[i + k]], n.x, n.y, n.z, d, area * 0.5);
+		}
+	}
+
+	const double maxCost = double(maxError) * double(maxError);
+	double resultCost = 0.0;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint8_t> touched(vertexCount);
+
+	while (result.size() > targetIndexCount) {
+		edges.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (size_t k = 0; k < 3; ++k) {
+				edges.push_back(edgeKey(result[i + k], result[i + (k + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		// Seam vertices are neither removed nor used as a target, so a collapse
+		// never has to pick between the attribute copies at one position.
+		collapses.clear();
+		for (auto edge : edges) {
+			uint32_t a = static_cast<uint32_t>(edge >> 32);
+			uint32_t b = static_cast<uint32_t>(edge & 0xffffffffu);
+			if (seam[a] || seam[b] || (locked[a] && locked[b])) {
+				continue;
+			}
+			Quadric q = quadrics[a];
+			addQuadric(q, quadrics[b]);
+			double costAB = locked[a] ? DBL_MAX : evaluate(q, position(positions, positionStride, b));
+			double costBA = locked[b] ? DBL_MAX : evaluate(q, position(positions, positionStride, a));
+			if (costAB <= costBA) {
+				collapses.push_back({ costAB, a, b });
+			}
+			else {
+				collapses.push_back({ costBA, b, a });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (auto v : result) {
+			++adjacencyOffsets[v + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t t = 0; t < result.size() / 3; ++t) {
+			for (size_t k = 0; k < 3; ++k) {
+				adjacency[adjacencyFill[result[t * 3 + k]]++] = t;
+			}
+		}
+
+		// Each vertex takes part in one collapse per pass, which keeps the
+		// adjacency of untouched vertices valid while triangles are rewritten.
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t triangleCount = result.size() / 3;
+		size_t applied = 0;
+		for (auto& collapse : collapses) {
+			if (collapse.cost > maxCost || triangleCount * 3 <= targetIndexCount) {
+				break;
+			}
+			const uint32_t from = collapse.from;
+			const uint32_t to = collapse.to;
+			if (touched[from] || touched[to]) {
+				continue;
+			}
+
+			bool flips = false;
+			size_t removed = 0;
+			for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1] && !flips; ++a) {
+				const uint32_t* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) {
+					continue;
+				}
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+					++removed;
+					continue;
+				}
+				const XMFLOAT3* before[3];
+				const XMFLOAT3* after[3];
+				for (size_t k = 0; k < 3; ++k) {
+					before[k] = &position(positions, positionStride, triangle[k]);
+					after[k] = &position(positions, positionStride, triangle[k] == from ? to : triangle[k]);
+				}
+				XMVECTOR n0 = triangleNormal(*before[0], *before[1], *before[2]);
+				XMVECTOR n1 = triangleNormal(*after[0], *after[1], *after[2]);
+				flips = XMVectorGetX(XMVector3Dot(n0, n1)) <= 0.0f;
+			}
+			if (flips) {
+				continue;
+			}
+
+			for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; ++a) {
+				uint32_t* triangle = &result[adjacency[a] * 3];
+				for (size_t k = 0; k < 3; ++k) {
+					if (triangle[k] == from) {
+						triangle[k] = to;
+					}
+				}
+			}
+			addQuadric(quadrics[to], quadrics[from]);
+			touched[from] = 1;
+			touched[to] = 1;
+			triangleCount -= removed;
+			resultCost = std::max(resultCost, collapse.cost);
+			++applied;
+		}
+
+		size_t live = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			if (result[i] == result[i + 1] || result[i + 1] == result[i + 2] || result[i] == result[i + 2]) {
+				continue;
+			}
+			result[live++] = result[i];
+			result[live++] = result[i + 1];
+			result[live++] = result[i + 2];
+		}
+		result.resize(live);
+		if (applied == 0) {
+			break;
+		}
+	}
+
+	return static_cast<float>(std::sqrt(resultCost));
+}
+
+LodChain BuildLodChain(std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount) {
+	LodChain chain = {};
+	if (indices.empty()) {
+		return chain;
+	}
+
+	XMVECTOR minimum = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maximum = XMVectorReplicate(-FLT_MAX);
+	for (auto index : indices) {
+		if (index >= vertexCount) {
+			return chain;
+		}
+		XMVECTOR p = XMLoadFloat3(&position(positions, positionStride, index));
+		minimum = XMVectorMin(minimum, p);
+		maximum = XMVectorMax(maximum, p);
+	}
+	XMVECTOR center = (minimum + maximum) * 0.5f;
+	XMStoreFloat3(&chain.center, center);
+	chain.radius = XMVectorGetX(XMVector3Length(maximum - center));
+	const float maxError = kLodErrorBudget * chain.radius;
+
+	std::vector<uint32_t> concatenated;
+	std::vector<uint32_t> current = indices;
+	std::vector<uint32_t> simplified;
+	float error = 0.0f;
+	while (chain.lods.size() < kMaxLodCount) {
+		Lod lod = {};
+		lod.indexOffset = static_cast<uint32_t>(concatenated.size());
+		lod.error = error;
+		std::vector<uint32_t> lodIndices = current;
+		lod.meshlets = BuildMeshlets(lodIndices, positions, positionStride, vertexCount);
+		if (lod.meshlets.empty()) {
+			break;
+		}
+		for (auto& meshlet : lod.meshlets) {
+			meshlet.indexOffset += lod.indexOffset;
+		}
+		lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+		concatenated.insert(concatenated.end(), lodIndices.begin(), lodIndices.end());
+		chain.lods.push_back(std::move(lod));
+
+		// Errors of successive simplifications add up relative to LOD 0.
+		float remaining = maxError - error;
+		if (remaining <= 0.0f) {
+			break;
+		}
+		float simplifyError = SimplifyMesh(current, positions, positionStride, vertexCount, current.size() / 6 * 3, remaining, simplified);
+		if (simplified.size() * 20 > current.size() * 17) {
+			break;
+		}
+		current.swap(simplified);
+		error += simplifyError;
+	}
+
+	if (chain.lods.empty()) {
+		return chain;
+	}
+	indices.swap(concatenated);
+	return chain;
+}
+
+size_t SelectLod(const std::vector<Lod>& lods, float worldScale, float distance, float projectionScale) {
+	const float pixelsPerUnit = worldScale * projectionScale / std::max(distance, FLT_EPSILON);
+	size_t selected = 0;
+	for (size_t i = 1; i < lods.size(); ++i) {
+		if (lods[i].error * pixelsPerUnit > kLodPixelError) {
+			break;
+		}
+		selected = i;
+	}
+	return selected;
+}
@@ -0,0 +1,636 @@
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std::chrono;
+
+std::atomic<uint8_t> g_logThreshold = static_cast<uint8_t>(LogLevel::Off);
+
+namespace {
+	// Each thread that logs gets a ring of kRingSize bytes. Records are cut
+	// short at kMaxRecordSize, header included.
+	constexpr uint64_t kRingSize = 256 * 1024;
+	constexpr uint32_t kMaxRecordSize = 16 * 1024;
+	constexpr auto kDrainInterval = milliseconds(2);
+	// How long an error waits for room in a full ring before it is dropped.
+	constexpr auto kErrorWait = milliseconds(100);
+
+	struct RecordHeader {
+		// Of the whole record, a multiple of 8 and at most kMaxRecordSize.
+		uint32_t size;
+		uint32_t argumentCount;
+		LogLevel level;
+		uint32_t hresult;
+		int64_t frame;
+		int64_t time;
+		const char* stage;
+		const char* format;
+	};
+
+	// Room for arguments, leaving space to round the record up to 8 bytes.
+	constexpr uint32_t kMaxArgumentBytes = kMaxRecordSize - sizeof(RecordHeader) - 8;
+
+	// A single producer, single consumer byte ring: only its thread writes
+	// records and advances head, only the logging thread reads them and
+	// advances tail.
+	struct Ring {
+		std::unique_ptr<uint8_t[]> bytes = std::make_unique<uint8_t[]>(kRingSize);
+		alignas(64) std::atomic<uint64_t> head = 0;
+		alignas(64) std::atomic<uint64_t> tail = 0;
+		std::atomic<uint64_t> dropped = 0;
+		std::atomic<bool> closed = false;
+		// Logging thread only.
+		uint64_t droppedReported = 0;
+		uint32_t thread = 0;
+		// The record being packed, header first.
+		alignas(8) uint8_t scratch[kMaxRecordSize];
+	};
+
+	void copyIn(Ring& ring, uint64_t position, const uint8_t* data, uint32_t size) {
+		const uint64_t offset = position & (kRingSize - 1);
+		const uint64_t first = std::min<uint64_t>(size, kRingSize - offset);
+		memcpy(ring.bytes.get() + offset, data, first);
+		memcpy(ring.bytes.get(), data + first, size - first);
+	}
+
+	void copyOut(const Ring& ring, uint64_t position, uint8_t* data, uint32_t size) {
+		const uint64_t offset = position & (kRingSize - 1);
+		const uint64_t first = std::min<uint64_t>(size, kRingSize - offset);
+		memcpy(data, ring.bytes.get() + offset, first);
+		memcpy(data + first, ring.bytes.get(), size - first);
+	}
+
+	struct Argument {
+		LogArguments::Type type;
+		uint64_t value;
+		std::string_view text;
+	};
+
+	std::string printfString(const char* format, ...) {
+		va_list arguments;
+		va_start(arguments, format);
+		va_list measure;
+		va_copy(measure, arguments);
+		const int length = vsnprintf(nullptr, 0, format, measure);
+		va_end(measure);
+		std::string text(std::max(length, 0), '\0');
+		if (length > 0) {
+			vsnprintf(text.data(), text.size() + 1, format, arguments);
+		}
+		va_end(arguments);
+		return text;
+	}
+
+	// The shortest %g representation that reads back as the same value.
+	std::string shortestDouble(double value) {
+		std::string text;
+		for (int precision = 1; precision <= 17; ++precision) {
+			text = printfString("%.*g", precision, value);
+			if (strtod(text.c_str(), nullptr) == value) {
+				break;
+			}
+		}
+		return text;
+	}
+
+	// Formats one argument with a std::format style spec, [[fill]align][sign]
+	// [#][0][width][.precision][type], by way of printf. Fills other than
+	// spaces and zeros are not supported and centering aligns right.
+	std::string formatArgument(const Argument& argument, std::string_view spec) {
+		char align = 0;
+		if (spec.size() >= 2 && (spec[1] == '<' || spec[1] == '>' || spec[1] == '^')) {
+			align = spec[1];
+			spec.remove_prefix(2);
+		}
+		else if (!spec.empty() && (spec[0] == '<' || spec[0] == '>' || spec[0] == '^')) {
+			align = spec[0];
+			spec.remove_prefix(1);
+		}
+		std::string flags;
+		while (!spec.empty() && (spec[0] == '+' || spec[0] == ' ' || spec[0] == '-' || spec[0] == '#' || spec[0] == '0')) {
+			if (spec[0] != '-') {
+				flags += spec[0];
+			}
+			spec.remove_prefix(1);
+		}
+		std::string width;
+		while (!spec.empty() && spec[0] >= '0' && spec[0] <= '9') {
+			width += spec[0];
+			spec.remove_prefix(1);
+		}
+		std::string precision;
+		if (!spec.empty() && spec[0] == '.') {
+			precision = ".";
+			spec.remove_prefix(1);
+			while (!spec.empty() && spec[0] >= '0' && spec[0] <= '9') {
+				precision += spec[0];
+				spec.remove_prefix(1);
+			}
+		}
+		const char type = spec.empty() ? 0 : spec[0];
+		// std::format aligns text left and numbers right.
+		const bool text = argument.type == LogArguments::Type::String || argument.type == LogArguments::Type::Bool;
+		if (align == '<' || (!align && text && !width.empty())) {
+			flags += '-';
+		}
+
+		double number = 0.0;
+		int64_t integer = 0;
+		switch (argument.type) {
+		case LogArguments::Type::Float:
+			memcpy(&number, &argument.value, sizeof(number));
+			integer = static_cast<int64_t>(number);
+			break;
+		case LogArguments::Type::Signed:
+		case LogArguments::Type::Bool:
+			integer = static_cast<int64_t>(argument.value);
+			number = static_cast<double>(integer);
+			break;
+		case LogArguments::Type::Unsigned:
+			integer = static_cast<int64_t>(argument.value);
+			number = static_cast<double>(argument.value);
+			break;
+		default:
+			break;
+		}
+
+		const std::string prefix = "%" + flags + width;
+		if (type && strchr("fFeEgGaA", type)) {
+			return printfString((prefix + precision + type).c_str(), number);
+		}
+		if (type && strchr("dxXo", type)) {
+			const char conversion = type == 'd' && argument.type == LogArguments::Type::Unsigned ? 'u' : type;
+			return printfString((prefix + "ll" + conversion).c_str(), static_cast<long long>(integer));
+		}
+		if (type == 'c') {
+			return printfString((prefix + "c").c_str(), static_cast<int>(integer));
+		}
+		switch (argument.type) {
+		case LogArguments::Type::String: {
+			int length = static_cast<int>(argument.text.size());
+			if (precision.size() > 1) {
+				length = std::min(length, atoi(precision.c_str() + 1));
+			}
+			return printfString((prefix + ".*s").c_str(), length, argument.text.data());
+		}
+		case LogArguments::Type::Bool:
+			return printfString((prefix + "s").c_str(), argument.value ? "true" : "false");
+		case LogArguments::Type::Signed:
+			return printfString((prefix + "lld").c_str(), static_cast<long long>(integer));
+		case LogArguments::Type::Unsigned:
+			return printfString((prefix + "llu").c_str(), static_cast<unsigned long long>(argument.value));
+		case LogArguments::Type::Float:
+			if (!precision.empty()) {
+				return printfString((prefix + precision + "g").c_str(), number);
+			}
+			return printfString((prefix + "s").c_str(), shortestDouble(number).c_str());
+		}
+		return {};
+	}
+
+	// Substitutes the record's arguments into its format string. Placeholders
+	// without an argument are left empty.
+	std::string formatMessage(const char* format, const uint8_t* data, uint32_t size, uint32_t count) {
+		std::vector<Argument> arguments;
+		uint32_t offset = 0;
+		for (uint32_t index = 0; index < count && offset < size; ++index) {
+			Argument argument = {};
+			argument.type = static_cast<LogArguments::Type>(data[offset++]);
+			if (argument.type == LogArguments::Type::String) {
+				uint32_t length;
+				memcpy(&length, data + offset, sizeof(length));
+				argument.text = std::string_view(reinterpret_cast<const char*>(data + offset + sizeof(length)), length);
+				offset += sizeof(length) + length;
+			}
+			else {
+				memcpy(&argument.value, data + offset, sizeof(argument.value));
+				offset += sizeof(argument.value);
+			}
+			arguments.push_back(argument);
+		}
+
+		std::string message;
+		size_t next = 0;
+		for (const char* c = format; *c; ++c) {
+			if ((c[0] == '{' && c[1] == '{') || (c[0] == '}' && c[1] == '}')) {
+				message += *c++;
+				continue;
+			}
+			if (*c != '{') {
+				message += *c;
+				continue;
+			}
+			const char* close = strchr(c, '}');
+			if (!close) {
+				message += c;
+				break;
+			}
+			std::string_view spec(c + 1, close - c - 1);
+			if (!spec.empty() && spec[0] == ':') {
+				spec.remove_prefix(1);
+			}
+			if (next < arguments.size()) {
+				message += formatArgument(arguments[next], spec);
+			}
+			++next;
+			c = close;
+		}
+		while (!message.empty() && (message.back() == '\n' || message.back() == '\r')) {
+			message.pop_back();
+		}
+		return message;
+	}
+
+	// UTC, to the millisecond, as 2024-01-31T12:34:56.789Z.
+	std::string formatTime(int64_t time) {
+		const sys_time<nanoseconds> point{ nanoseconds(time) };
+		const auto day = floor<days>(point);
+		const year_month_day date{ day };
+		const hh_mm_ss<milliseconds> clock{ floor<milliseconds>(point - day) };
+		return printfString("%04d-%02u-%02uT%02d:%02d:%02d.%03dZ", static_cast<int>(date.year()), static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+			static_cast<int>(clock.hours().count()), static_cast<int>(clock.minutes().count()), static_cast<int>(clock.seconds().count()),
+			static_cast<int>(clock.subseconds().count()));
+	}
+
+	void appendJsonString(std::string& json, std::string_view text) {
+		json += '"';
+		for (char c : text) {
+			switch (c) {
+			case '"': json += "\\\""; break;
+			case '\\': json += "\\\\"; break;
+			case '\n': json += "\\n"; break;
+			case '\r': json += "\\r"; break;
+			case '\t': json += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					json += printfString("\\u%04x", static_cast<unsigned>(c));
+				}
+				else {
+					json += c;
+				}
+			}
+		}
+		json += '"';
+	}
+
+	class Logger {
+	public:
+		~Logger() { Shutdown(); }
+
+		Ring& ThreadRing();
+		void SetLevel(LogLevel level);
+		void AddSink(std::unique_ptr<LogSink> sink);
+		void Flush();
+		void Shutdown();
+
+	private:
+		void run();
+		// Moves every complete record out of the rings and into the sinks.
+		void drain(const std::vector<std::shared_ptr<Ring>>& rings, bool flush);
+
+		// Guards the rings, the flush counters and the thread's lifetime.
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_flushed;
+		std::vector<std::shared_ptr<Ring>> m_rings;
+		uint32_t m_nextThread = 0;
+		uint64_t m_flushRequested = 0;
+		uint64_t m_flushCompleted = 0;
+		bool m_stop = false;
+		std::thread m_thread;
+		LogLevel m_level = LogLevel::Info;
+
+		// Taken only by the logging thread while writing, and to change sinks.
+		std::mutex m_sinkMutex;
+		std::vector<std::unique_ptr<LogSink>> m_sinks;
+		std::vector<LogEntry> m_entries;
+		std::vector<uint8_t> m_record;
+	};
+
+	Logger& logger() {
+		static Logger instance;
+		return instance;
+	}
+
+	// Marks the thread's ring closed when the thread exits; the logging thread
+	// drains it and lets it go.
+	struct ThreadRingHandle {
+		std::shared_ptr<Ring> ring;
+		~ThreadRingHandle() {
+			if (ring) {
+				ring->closed.store(true, std::memory_order_release);
+			}
+		}
+	};
+	thread_local ThreadRingHandle t_ring;
+
+	Ring& Logger::ThreadRing() {
+		if (!t_ring.ring) {
+			auto ring = std::make_shared<Ring>();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ring->thread = m_nextThread++;
+			m_rings.push_back(ring);
+			t_ring.ring = std::move(ring);
+		}
+		return *t_ring.ring;
+	}
+
+	void Logger::SetLevel(LogLevel level) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_level = level;
+		if (m_thread.joinable()) {
+			g_logThreshold.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+		}
+	}
+
+	void Logger::AddSink(std::unique_ptr<LogSink> sink) {
+		{
+			std::lock_guard<std::mutex> sinkLock(m_sinkMutex);
+			m_sinks.push_back(std::move(sink));
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable()) {
+			m_stop = false;
+			m_thread = std::thread([this] { run(); });
+		}
+		g_logThreshold.store(static_cast<uint8_t>(m_level), std::memory_order_relaxed);
+	}
+
+	void Logger::Flush() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable()) {
+			return;
+		}
+		const uint64_t request = ++m_flushRequested;
+		m_wake.notify_one();
+		m_flushed.wait(lock, [&] { return m_flushCompleted >= request; });
+	}
+
+	void Logger::Shutdown() {
+		g_logThreshold.store(static_cast<uint8_t>(LogLevel::Off), std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_thread.joinable()) {
+				return;
+			}
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+		std::lock_guard<std::mutex> sinkLock(m_sinkMutex);
+		m_sinks.clear();
+	}
+
+	void Logger::run() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_wake.wait_for(lock, kDrainInterval, [this] { return m_stop || m_flushRequested != m_flushCompleted; });
+			// Stopping drains once more, so it flushes like a request does.
+			const bool stop = m_stop;
+			const uint64_t request = m_flushRequested;
+			const bool flush = stop || request != m_flushCompleted;
+			std::vector<std::shared_ptr<Ring>> rings = m_rings;
+			lock.unlock();
+			drain(rings, flush);
+			lock.lock();
+			// A closed ring is empty once the drain after its closing is done.
+			std::erase_if(m_rings, [&rings](const std::shared_ptr<Ring>& ring) {
+				return ring->closed.load(std::memory_order_acquire) && std::find(rings.begin(), rings.end(), ring) != rings.end() &&
+					ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+			});
+			if (flush) {
+				m_flushCompleted = request;
+				m_flushed.notify_all();
+			}
+			if (stop) {
+				return;
+			}
+		}
+	}
+
+	void Logger::drain(const std::vector<std::shared_ptr<Ring>>& rings, bool flush) {
+		m_entries.clear();
+		for (const auto& ring : rings) {
+			uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+			const uint64_t head = ring->head.load(std::memory_order_acquire);
+			while (tail < head) {
+				RecordHeader header;
+				copyOut(*ring, tail, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+				m_record.resize(header.size);
+				copyOut(*ring, tail, m_record.data(), header.size);
+				m_entries.push_back({ header.level, header.time, ring->thread, header.stage, header.frame, header.hresult,
+					formatMessage(header.format, m_record.data() + sizeof(header), header.size - sizeof(header), header.argumentCount) });
+				tail += header.size;
+			}
+			ring->tail.store(tail, std::memory_order_release);
+
+			const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+			if (dropped != ring->droppedReported) {
+				const int64_t now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+				m_entries.push_back({ LogLevel::Warning, now, ring->thread, "log", -1, 0,
+					printfString("%llu messages dropped, the thread's log ring was full", static_cast<unsigned long long>(dropped - ring->droppedReported)) });
+				ring->droppedReported = dropped;
+			}
+		}
+		// Each ring is in order; merged, entries are ordered by time.
+		std::stable_sort(m_entries.begin(), m_entries.end(), [](const LogEntry& a, const LogEntry& b) { return a.time < b.time; });
+		const bool error = std::any_of(m_entries.begin(), m_entries.end(), [](const LogEntry& entry) { return entry.level >= LogLevel::Error; });
+
+		std::lock_guard<std::mutex> sinkLock(m_sinkMutex);
+		for (auto& sink : m_sinks) {
+			for (const auto& entry : m_entries) {
+				sink->Write(entry);
+			}
+			// Errors are flushed right away, in case the process does not survive them.
+			if (flush || error) {
+				sink->Flush();
+			}
+		}
+	}
+}
+
+const char* LogLevelName(LogLevel level) {
+	switch (level) {
+	case LogLevel::Debug: return "debug";
+	case LogLevel::Info: return "info";
+	case LogLevel::Warning: return "warning";
+	case LogLevel::Error: return "error";
+	case LogLevel::Off: return "off";
+	default: return "unknown";
+	}
+}
+
+bool ParseLogLevel(const char* name, LogLevel& level) {
+	for (LogLevel candidate : { LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off }) {
+		if (strcmp(name, LogLevelName(candidate)) == 0) {
+			level = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string FormatLogLine(const LogEntry& entry) {
+	std::string line = formatTime(entry.time) + " " + LogLevelName(entry.level);
+	if (entry.stage) {
+		line += std::string(" [") + entry.stage + "]";
+	}
+	if (entry.frame >= 0) {
+		line += printfString(" frame=%lld", static_cast<long long>(entry.frame));
+	}
+	if (entry.hresult) {
+		line += printfString(" hresult=0x%08X", entry.hresult);
+	}
+	return line + " " + entry.message;
+}
+
+std::string FormatLogJson(const LogEntry& entry) {
+	std::string json = "{\"time\":";
+	appendJsonString(json, formatTime(entry.time));
+	json += std::string(",\"level\":\"") + LogLevelName(entry.level) + "\"";
+	json += printfString(",\"thread\":%u", entry.thread);
+	if (entry.stage) {
+		json += ",\"stage\":";
+		appendJsonString(json, entry.stage);
+	}
+	if (entry.frame >= 0) {
+		json += printfString(",\"frame\":%lld", static_cast<long long>(entry.frame));
+	}
+	if (entry.hresult) {
+		json += printfString(",\"hresult\":\"0x%08X\"", entry.hresult);
+	}
+	json += ",\"message\":";
+	appendJsonString(json, entry.message);
+	return json + "}";
+}
+
+void StderrLogSink::Write(const LogEntry& entry) {
+	std::string line = FormatLogLine(entry) + "\n";
+	fwrite(line.data(), 1, line.size(), stderr);
+}
+
+void StderrLogSink::Flush() {
+	fflush(stderr);
+}
+
+FileLogSink::FileLogSink(const std::string& path, bool json) :
+	m_json(json)
+{
+	m_file = fopen(path.c_str(), "wb");
+}
+
+FileLogSink::~FileLogSink() {
+	if (m_file) {
+		fclose(m_file);
+	}
+}
+
+void FileLogSink::Write(const LogEntry& entry) {
+	if (!m_file) {
+		return;
+	}
+	std::string line = (m_json ? FormatLogJson(entry) : FormatLogLine(entry)) + "\n";
+	fwrite(line.data(), 1, line.size(), m_file);
+}
+
+void FileLogSink::Flush() {
+	if (m_file) {
+		fflush(m_file);
+	}
+}
+
+#ifdef _WIN32
+void DebuggerLogSink::Write(const LogEntry& entry) {
+	OutputDebugStringA((FormatLogLine(entry) + "\n").c_str());
+}
+#endif
+
+void SetLogLevel(LogLevel level) {
+	logger().SetLevel(level);
+}
+
+void AddLogSink(std::unique_ptr<LogSink> sink) {
+	logger().AddSink(std::move(sink));
+}
+
+void FlushLog() {
+	logger().Flush();
+}
+
+void ShutdownLog() {
+	logger().Shutdown();
+}
+
+LogArguments::LogArguments() :
+	m_data(logger().ThreadRing().scratch + sizeof(RecordHeader))
+{
+}
+
+void LogArguments::append(Type type, uint64_t value) {
+	if (m_size + 1 + sizeof(value) > kMaxArgumentBytes) {
+		return;
+	}
+	m_data[m_size] = static_cast<uint8_t>(type);
+	memcpy(m_data + m_size + 1, &value, sizeof(value));
+	m_size += 1 + sizeof(value);
+	++m_count;
+}
+
+void LogArguments::appendString(std::string_view value) {
+	const uint32_t available = kMaxArgumentBytes - m_size;
+	if (available < 1 + sizeof(uint32_t)) {
+		return;
+	}
+	const uint32_t length = static_cast<uint32_t>(std::min<size_t>(value.size(), available - 1 - sizeof(uint32_t)));
+	m_data[m_size] = static_cast<uint8_t>(Type::String);
+	memcpy(m_data + m_size + 1, &length, sizeof(length));
+	memcpy(m_data + m_size + 1 + sizeof(length), value.data(), length);
+	m_size += 1 + sizeof(length) + length;
+	++m_count;
+}
+
+void LogArguments::Submit(LogLevel level, const LogFields& fields, const char* format) {
+	Ring& ring = *t_ring.ring;
+	RecordHeader header = {};
+	header.size = static_cast<uint32_t>((sizeof(RecordHeader) + m_size + 7) & ~7ull);
+	header.argumentCount = m_count;
+	header.level = level;
+	header.hresult = fields.hresult;
+	header.frame = fields.frame;
+	header.time = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+	header.stage = fields.stage;
+	header.format = format;
+	memcpy(ring.scratch, &header, sizeof(header));
+
+	// A full ring drops the message, unless it is an error, which waits a
+	// while for the logging thread to make room.
+	const uint64_t head = ring.head.load(std::memory_order_relaxed);
+	auto deadline = steady_clock::time_point();
+	while (kRingSize - (head - ring.tail.load(std::memory_order_acquire)) < header.size) {
+		if (level < LogLevel::Error) {
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		const auto now = steady_clock::now();
+		if (deadline == steady_clock::time_point()) {
+			deadline = now + kErrorWait;
+		}
+		else if (now > deadline) {
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		std::this_thread::yield();
+	}
+	copyIn(ring, head, ring.scratch, header.size);
+	ring.head.store(head + header.size, std::memory_order_release);
+}
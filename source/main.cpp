@@ -1,6 +1,13 @@
 #include "renderer.h"
+#include "log.h"
+#include "shardWorker.h"
 #include <windows.h>
+#include <psapi.h>
+#include <fstream>
+#include <iostream>
 #include <memory>
+#include <cstdlib>
+#include <cstring>
 
 LRESULT WindowProc(_In_ HWND hWnd, _In_ UINT uMsg, _In_ WPARAM wParam, _In_ LPARAM lParam) {
 	Renderer* renderer = reinterpret_cast<Renderer*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
@@ -29,10 +36,215 @@ LRESULT WindowProc(_In_ HWND hWnd, _In_ UINT uMsg, _In_ WPARAM wParam, _In_ LPAR
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
+// Renders frames [0, frames] as a shard worker would and writes load time,
+// first frame time, the steady frame rate and peak memory as JSON, the report
+// renderlab-bench sweep reads.
+int runBenchmark(Renderer& renderer, UINT frames, const std::string& reportPath, double parseMilliseconds, double initMilliseconds) {
+	using namespace std::chrono;
+	constexpr double_t kFrameRate = 30.0;
+	auto start = high_resolution_clock::now();
+	renderer.RenderFrame(0, kFrameRate);
+	const double firstFrameMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+	std::vector<double> frameMilliseconds;
+	auto steadyStart = high_resolution_clock::now();
+	for (UINT frame = 1; frame <= frames; ++frame) {
+		auto frameStart = high_resolution_clock::now();
+		renderer.RenderFrame(frame, kFrameRate);
+		frameMilliseconds.push_back(duration<double, std::milli>(high_resolution_clock::now() - frameStart).count());
+	}
+	const double steadyMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - steadyStart).count();
+
+	PROCESS_MEMORY_COUNTERS counters = {};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	nlohmann::json report;
+	report["parseMilliseconds"] = parseMilliseconds;
+	report["initMilliseconds"] = initMilliseconds;
+	report["loadMilliseconds"] = parseMilliseconds + initMilliseconds;
+	report["firstFrameMilliseconds"] = firstFrameMilliseconds;
+	report["frames"] = frames;
+	report["framesPerSecond"] = steadyMilliseconds > 0.0 ? frames * 1000.0 / steadyMilliseconds : 0.0;
+	report["frameMilliseconds"] = frameMilliseconds;
+	report["peakTrackedBytes"] = renderer.TrackedMemory().peak;
+	report["peakLocalBytes"] = renderer.TrackedMemory(MemoryDomain::Local).peak;
+	report["peakWorkingSetBytes"] = counters.PeakWorkingSetSize;
+	report["peakCommitBytes"] = counters.PeakPagefileUsage;
+	renderer.Destroy();
+
+	std::ofstream file(reportPath);
+	file << report.dump(2) << "\n";
+	return file ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
-	Renderer renderer = Renderer(4096, 4096, "RenderLab");
+	UINT width = 4096;
+	UINT height = 4096;
+	RendererOptions options;
+	// Frames per second of the animation timeline; set, it makes this process a
+	// renderlab-shard worker rendering the frames it is handed.
+	double_t shardFrameRate = 0.0;
+	// Frames to render after the first in benchmark mode, 0 to run normally.
+	UINT benchmarkFrames = 0;
+	std::string benchmarkReportPath = "benchmark.json";
+	LogLevel logLevel = LogLevel::Info;
+	const char* unknownLogLevel = nullptr;
+	const char* unknownFormat = nullptr;
+	const char* unknownBackend = nullptr;
+	// Text and JSON lines copies of the log, next to stderr and the debugger.
+	std::string logPath;
+	std::string logJsonPath;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--width") == 0) {
+			width = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--height") == 0) {
+			height = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--tile") == 0) {
+			options.tileSize = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--sequence") == 0) {
+			options.sequencePath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--keyframe") == 0) {
+			options.keyframeInterval = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--animation") == 0) {
+			options.animation = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0) {
+			options.workerThreads = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--backend") == 0) {
+			if (strcmp(argv[i + 1], "raytrace") == 0) {
+				options.rayTrace = true;
+			}
+			else if (strcmp(argv[i + 1], "raster") == 0) {
+				options.rayTrace = false;
+			}
+			else {
+				unknownBackend = argv[i + 1];
+			}
+		}
+		else if (strcmp(argv[i], "--occlusion") == 0) {
+			options.occlusionSamples = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--memory-budget") == 0) {
+			options.memoryBudget = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--memory-report") == 0) {
+			options.memoryReportInterval = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--texture-budget") == 0) {
+			options.textureBudget = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--upload-ring") == 0) {
+			options.uploadRingSize = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--occluders") == 0) {
+			options.occluders = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--occlusion-dump") == 0) {
+			options.occlusionDumpInterval = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--scene") == 0) {
+			options.scenePath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--asset-queue-depth") == 0) {
+			options.assetQueueDepth = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--write-queue-depth") == 0) {
+			options.writeQueueDepth = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--hot-reload") == 0) {
+			options.hotReload = atoi(argv[i + 1]) != 0;
+		}
+		else if (strcmp(argv[i], "--benchmark") == 0) {
+			benchmarkFrames = static_cast<UINT>(atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--benchmark-report") == 0) {
+			benchmarkReportPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--shard-worker") == 0) {
+			shardFrameRate = atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--log-level") == 0) {
+			if (!ParseLogLevel(argv[i + 1], logLevel)) {
+				unknownLogLevel = argv[i + 1];
+			}
+		}
+		else if (strcmp(argv[i], "--log-file") == 0) {
+			logPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--log-json") == 0) {
+			logJsonPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--format") == 0) {
+			if (strcmp(argv[i + 1], "rgba16f") == 0) {
+				options.renderTargetFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+			}
+			else if (strcmp(argv[i + 1], "r11g11b10f") == 0) {
+				options.renderTargetFormat = DXGI_FORMAT_R11G11B10_FLOAT;
+			}
+			else if (strcmp(argv[i + 1], "rgba8srgb") == 0) {
+				options.renderTargetFormat = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+			}
+			else if (strcmp(argv[i + 1], "rgba32f") == 0) {
+				options.renderTargetFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			}
+			else {
+				unknownFormat = argv[i + 1];
+			}
+		}
+	}
+
+	SetLogLevel(logLevel);
+	AddLogSink(std::make_unique<StderrLogSink>());
+	AddLogSink(std::make_unique<DebuggerLogSink>());
+	if (!logPath.empty()) {
+		AddLogSink(std::make_unique<FileLogSink>(logPath));
+	}
+	if (!logJsonPath.empty()) {
+		AddLogSink(std::make_unique<FileLogSink>(logJsonPath, true));
+	}
+	if (unknownLogLevel) {
+		Log(LogLevel::Warning, { "options" }, "Unknown log level {}, using {}", unknownLogLevel, LogLevelName(logLevel));
+	}
+	if (unknownBackend) {
+		Log(LogLevel::Error, { "options" }, "Unknown backend {}, expected raster or raytrace", unknownBackend);
+		ShutdownLog();
+		return 1;
+	}
+	if (unknownFormat) {
+		Log(LogLevel::Error, { "options" }, "Unknown format {}, expected rgba32f, rgba16f, r11g11b10f or rgba8srgb", unknownFormat);
+		ShutdownLog();
+		return 1;
+	}
+
+	auto parseStart = std::chrono::high_resolution_clock::now();
+	Renderer renderer = Renderer(width, height, "RenderLab", options);
+	auto initStart = std::chrono::high_resolution_clock::now();
 	renderer.Init();
+	if (benchmarkFrames > 0) {
+		auto initEnd = std::chrono::high_resolution_clock::now();
+		int result = runBenchmark(renderer, benchmarkFrames, benchmarkReportPath,
+			std::chrono::duration<double, std::milli>(initStart - parseStart).count(), std::chrono::duration<double, std::milli>(initEnd - initStart).count());
+		ShutdownLog();
+		return result;
+	}
+	if (shardFrameRate > 0.0) {
+		ShardWorker worker(std::cin, std::cout);
+		uint64_t frame;
+		while (worker.NextFrame(frame)) {
+			auto start = std::chrono::high_resolution_clock::now();
+			renderer.RenderFrame(frame, shardFrameRate);
+			worker.FrameDone(frame, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+		renderer.Destroy();
+		ShutdownLog();
+		return 0;
+	}
 	MSG msg = {};
 	while (true)
 	{
@@ -40,5 +252,6 @@ int main(int argc, char* argv[])
 		renderer.Render();
 	}
 	renderer.Destroy();
+	ShutdownLog();
 	return static_cast<char>(msg.wParam);
 }
@@ -0,0 +1,170 @@
+#include "memoryTracker.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+	constexpr double kMebibyte = 1024.0 * 1024.0;
+}
+
+const char* MemoryCategoryName(MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::Geometry: return "geometry";
+	case MemoryCategory::Textures: return "textures";
+	case MemoryCategory::Staging: return "staging";
+	case MemoryCategory::RenderTargets: return "render targets";
+	case MemoryCategory::Readback: return "readback";
+	case MemoryCategory::Constants: return "constants";
+	case MemoryCategory::OutputImage: return "output image";
+	case MemoryCategory::SceneSource: return "scene source";
+	case MemoryCategory::RayTracing: return "ray tracing";
+	case MemoryCategory::Occlusion: return "occlusion";
+	default: return "unknown";
+	}
+}
+
+const char* MemoryDomainName(MemoryDomain domain) {
+	switch (domain) {
+	case MemoryDomain::Local: return "local";
+	case MemoryDomain::NonLocal: return "non local";
+	case MemoryDomain::Cpu: return "cpu";
+	default: return "unknown";
+	}
+}
+
+MemoryTracker::MemoryTracker() {
+	AddScene("shared");
+}
+
+uint32_t MemoryTracker::AddScene(const std::string& name) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_scenes.push_back(name);
+	m_cells.resize(m_scenes.size() * kCellsPerScene);
+	return static_cast<uint32_t>(m_scenes.size() - 1);
+}
+
+size_t MemoryTracker::cell(MemoryCategory category, MemoryDomain domain) {
+	return static_cast<size_t>(category) * static_cast<size_t>(MemoryDomain::Count) + static_cast<size_t>(domain);
+}
+
+void MemoryTracker::grow(MemoryUsage& usage, uint64_t bytes) {
+	usage.current += bytes;
+	usage.peak = std::max(usage.peak, usage.current);
+}
+
+void MemoryTracker::checkBudget(size_t slot, const MemoryUsage& usage, std::string& warning) {
+	Budget& budget = m_budgets[slot];
+	if (budget.bytes == 0) {
+		return;
+	}
+	const uint64_t warningBytes = static_cast<uint64_t>(budget.bytes * kMemoryWarningFraction);
+	const uint32_t level = usage.current > budget.bytes ? 2 : (usage.current >= warningBytes ? 1 : 0);
+	if (level > budget.level) {
+		const char* name = slot == kProcessSlot ? "process" : MemoryDomainName(static_cast<MemoryDomain>(slot));
+		char line[160];
+		snprintf(line, sizeof(line), "memory %s %s: %.1f MiB of %.1f MiB budget\n", name, level == 2 ? "over budget" : "nearing budget",
+			usage.current / kMebibyte, budget.bytes / kMebibyte);
+		warning += line;
+	}
+	budget.level = level;
+}
+
+void MemoryTracker::Add(const MemoryAllocation& allocation) {
+	std::string warning;
+	std::function<void(const std::string&)> callback;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const size_t domain = static_cast<size_t>(allocation.domain);
+		grow(m_cells[allocation.scene * kCellsPerScene + cell(allocation.category, allocation.domain)], allocation.bytes);
+		grow(m_totals[domain], allocation.bytes);
+		grow(m_totals[kProcessSlot], allocation.bytes);
+		checkBudget(domain, m_totals[domain], warning);
+		checkBudget(kProcessSlot, m_totals[kProcessSlot], warning);
+		callback = m_warning;
+	}
+	// Called without the lock so the callback may query the tracker.
+	if (!warning.empty() && callback) {
+		callback(warning);
+	}
+}
+
+void MemoryTracker::Remove(const MemoryAllocation& allocation) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const size_t domain = static_cast<size_t>(allocation.domain);
+	MemoryUsage* usages[] = { &m_cells[allocation.scene * kCellsPerScene + cell(allocation.category, allocation.domain)], &m_totals[domain], &m_totals[kProcessSlot] };
+	for (MemoryUsage* usage : usages) {
+		usage->current -= std::min(usage->current, allocation.bytes);
+	}
+	// Dropping back re-arms the warnings; nothing is reported on the way down.
+	std::string ignored;
+	checkBudget(domain, m_totals[domain], ignored);
+	checkBudget(kProcessSlot, m_totals[kProcessSlot], ignored);
+}
+
+void MemoryTracker::Resize(MemoryAllocation& allocation, uint64_t bytes) {
+	if (bytes == allocation.bytes) {
+		return;
+	}
+	Remove(allocation);
+	allocation.bytes = bytes;
+	Add(allocation);
+}
+
+void MemoryTracker::SetBudget(MemoryDomain domain, uint64_t bytes) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budgets[static_cast<size_t>(domain)] = { bytes, 0 };
+}
+
+void MemoryTracker::SetProcessBudget(uint64_t bytes) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budgets[kProcessSlot] = { bytes, 0 };
+}
+
+void MemoryTracker::SetWarningCallback(std::function<void(const std::string&)> callback) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_warning = std::move(callback);
+}
+
+MemoryUsage MemoryTracker::Usage(MemoryDomain domain) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totals[static_cast<size_t>(domain)];
+}
+
+MemoryUsage MemoryTracker::ProcessUsage() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totals[kProcessSlot];
+}
+
+MemoryUsage MemoryTracker::Usage(uint32_t scene, MemoryCategory category, MemoryDomain domain) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cells[scene * kCellsPerScene + cell(category, domain)];
+}
+
+std::string MemoryTracker::Report() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::string report = "memory by scene, category and domain, current and peak MiB\n";
+	char line[256];
+	for (size_t scene = 0; scene < m_scenes.size(); ++scene) {
+		for (uint32_t category = 0; category < static_cast<uint32_t>(MemoryCategory::Count); ++category) {
+			for (uint32_t domain = 0; domain < static_cast<uint32_t>(MemoryDomain::Count); ++domain) {
+				const MemoryUsage& usage = m_cells[scene * kCellsPerScene + cell(static_cast<MemoryCategory>(category), static_cast<MemoryDomain>(domain))];
+				if (usage.peak == 0) {
+					continue;
+				}
+				snprintf(line, sizeof(line), "  %-24s %-15s %-10s %10.2f %10.2f\n", m_scenes[scene].c_str(),
+					MemoryCategoryName(static_cast<MemoryCategory>(category)), MemoryDomainName(static_cast<MemoryDomain>(domain)),
+					usage.current / kMebibyte, usage.peak / kMebibyte);
+				report += line;
+			}
+		}
+	}
+	for (size_t slot = 0; slot <= kProcessSlot; ++slot) {
+		const char* name = slot == kProcessSlot ? "process" : MemoryDomainName(static_cast<MemoryDomain>(slot));
+		int length = snprintf(line, sizeof(line), "  total %-10s %10.2f %10.2f", name, m_totals[slot].current / kMebibyte, m_totals[slot].peak / kMebibyte);
+		if (m_budgets[slot].bytes && length > 0) {
+			snprintf(line + length, sizeof(line) - length, " of %.2f budget", m_budgets[slot].bytes / kMebibyte);
+		}
+		report += line;
+		report += "\n";
+	}
+	return report;
+}
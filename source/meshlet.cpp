@@ -0,0 +1,263 @@
+#include "meshlet.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace {
+	XMVECTOR loadPosition(const uint8_t* positions, size_t stride, uint32_t index) {
+		return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(positions + stride * index));
+	}
+
+	XMVECTOR triangleCentroid(const uint32_t* triangle, const uint8_t* positions, size_t stride) {
+		XMVECTOR sum = loadPosition(positions, stride, triangle[0]);
+		sum += loadPosition(positions, stride, triangle[1]);
+		sum += loadPosition(positions, stride, triangle[2]);
+		return sum * (1.0f / 3.0f);
+	}
+
+	void computeBounds(Meshlet& meshlet, const uint32_t* indices, const uint8_t* positions, size_t stride) {
+		const uint32_t* first = indices + meshlet.indexOffset;
+		const uint32_t* last = first + meshlet.indexCount;
+
+		XMVECTOR minimum = XMVectorReplicate(FLT_MAX);
+		XMVECTOR maximum = XMVectorReplicate(-FLT_MAX);
+		XMVECTOR normalSum = XMVectorZero();
+		for (const uint32_t* triangle = first; triangle != last; triangle += 3) {
+			XMVECTOR p0 = loadPosition(positions, stride, triangle[0]);
+			XMVECTOR p1 = loadPosition(positions, stride, triangle[1]);
+			XMVECTOR p2 = loadPosition(positions, stride, triangle[2]);
+			minimum = XMVectorMin(minimum, XMVectorMin(p0, XMVectorMin(p1, p2)));
+			maximum = XMVectorMax(maximum, XMVectorMax(p0, XMVectorMax(p1, p2)));
+			// Area weighted, counter clockwise front faces as in glTF.
+			normalSum += XMVector3Cross(p1 - p0, p2 - p0);
+		}
+
+		XMVECTOR center = (minimum + maximum) * 0.5f;
+		float radius = 0.0f;
+		for (const uint32_t* index = first; index != last; ++index) {
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(loadPosition(positions, stride, *index) - center)));
+		}
+		XMStoreFloat3(&meshlet.center, center);
+		meshlet.radius = radius;
+
+		meshlet.coneAxis = { 0.0f, 0.0f, 0.0f };
+		meshlet.coneCutoff = 1.0f;
+		if (XMVectorGetX(XMVector3LengthSq(normalSum)) < FLT_MIN) {
+			return;
+		}
+		XMVECTOR axis = XMVector3Normalize(normalSum);
+		float minDot = 1.0f;
+		for (const uint32_t* triangle = first; triangle != last; triangle += 3) {
+			XMVECTOR p0 = loadPosition(positions, stride, triangle[0]);
+			XMVECTOR normal = XMVector3Cross(loadPosition(positions, stride, triangle[1]) - p0, loadPosition(positions, stride, triangle[2]) - p0);
+			if (XMVectorGetX(XMVector3LengthSq(normal)) < FLT_MIN) {
+				continue;
+			}
+			minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(XMVector3Normalize(normal), axis)));
+		}
+		XMStoreFloat3(&meshlet.coneAxis, axis);
+		// Cones wider than ~84 degrees never pass the backface test, skip them up front.
+		if (minDot > 0.1f) {
+			meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+	}
+}
+
+std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t>& indices, const uint8_t* positions, size_t positionStride, size_t vertexCount) {
+	std::vector<Meshlet> meshlets;
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || indices.size() % 3 != 0) {
+		return meshlets;
+	}
+	for (auto index : indices) {
+		if (index >= vertexCount) {
+			return meshlets;
+		}
+	}
+
+	// Vertex to triangle adjacency in compressed row form.
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (auto index : indices) {
+		++adjacencyOffsets[index + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			adjacency[adjacencyFill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);
+	std::vector<uint32_t> candidateMeshlet(triangleCount, UINT32_MAX);
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> reordered;
+	reordered.reserve(indices.size());
+
+	uint32_t meshletId = 0;
+	uint32_t meshletVertexCount = 0;
+	uint32_t meshletTriangleCount = 0;
+	XMVECTOR centroidSum = XMVectorZero();
+	size_t seedCursor = 0;
+
+	auto newVertexCount = [&](uint32_t t) {
+		uint32_t count = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			count += vertexMeshlet[indices[t * 3 + k]] != meshletId;
+		}
+		return count;
+	};
+	auto flush = [&]() {
+		Meshlet meshlet = {};
+		meshlet.indexCount = meshletTriangleCount * 3;
+		meshlet.indexOffset = static_cast<uint32_t>(reordered.size()) - meshlet.indexCount;
+		meshlet.vertexCount = meshletVertexCount;
+		meshlets.push_back(meshlet);
+		++meshletId;
+		meshletVertexCount = 0;
+		meshletTriangleCount = 0;
+		centroidSum = XMVectorZero();
+		candidates.clear();
+	};
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+		// Prefer the neighbour adding the fewest new vertices, then the one closest
+		// to the meshlet centroid to keep bounding spheres and cones tight.
+		uint32_t best = UINT32_MAX;
+		uint32_t bestNew = 4;
+		float bestDistance = FLT_MAX;
+		if (meshletTriangleCount > 0) {
+			XMVECTOR centroid = centroidSum / static_cast<float>(meshletTriangleCount);
+			size_t live = 0;
+			for (auto t : candidates) {
+				if (emitted[t]) {
+					continue;
+				}
+				candidates[live++] = t;
+				uint32_t added = newVertexCount(t);
+				if (added > bestNew) {
+					continue;
+				}
+				float distance = XMVectorGetX(XMVector3LengthSq(triangleCentroid(&indices[t * 3], positions, positionStride) - centroid));
+				if (added < bestNew || distance < bestDistance) {
+					best = t;
+					bestNew = added;
+					bestDistance = distance;
+				}
+			}
+			candidates.resize(live);
+		}
+
+		if (best == UINT32_MAX ||
+			meshletTriangleCount == kMaxMeshletTriangles ||
+			meshletVertexCount + bestNew > kMaxMeshletVertices) {
+			if (meshletTriangleCount > 0) {
+				flush();
+			}
+			// A rejected neighbour is still spatially close, so it seeds the next meshlet.
+			if (best == UINT32_MAX) {
+				while (emitted[seedCursor]) {
+					++seedCursor;
+				}
+				best = static_cast<uint32_t>(seedCursor);
+			}
+		}
+
+		emitted[best] = 1;
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = indices[best * 3 + k];
+			reordered.push_back(v);
+			if (vertexMeshlet[v] == meshletId) {
+				continue;
+			}
+			vertexMeshlet[v] = meshletId;
+			++meshletVertexCount;
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+				uint32_t neighbour = adjacency[a];
+				if (!emitted[neighbour] && candidateMeshlet[neighbour] != meshletId) {
+					candidateMeshlet[neighbour] = meshletId;
+					candidates.push_back(neighbour);
+				}
+			}
+		}
+		++meshletTriangleCount;
+		centroidSum += triangleCentroid(&indices[best * 3], positions, positionStride);
+	}
+	if (meshletTriangleCount > 0) {
+		flush();
+	}
+
+	indices.swap(reordered);
+	for (auto& meshlet : meshlets) {
+		computeBounds(meshlet, indices.data(), positions, positionStride);
+	}
+	return meshlets;
+}
+
+CullingView BuildCullingView(FXMMATRIX viewProjection, FXMVECTOR cameraPosition) {
+	CullingView view = {};
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+	XMVECTOR planes[6] = {
+		columns.r[3] + columns.r[0],
+		columns.r[3] - columns.r[0],
+		columns.r[3] + columns.r[1],
+		columns.r[3] - columns.r[1],
+		columns.r[2],
+		columns.r[3] - columns.r[2],
+	};
+	for (int i = 0; i < 6; ++i) {
+		XMStoreFloat4(&view.planes[i], XMPlaneNormalize(planes[i]));
+	}
+	XMStoreFloat3(&view.cameraPosition, cameraPosition);
+	return view;
+}
+
+void CullMeshlets(const std::vector<Meshlet>& meshlets, const XMFLOAT4X4& world, const CullingView& view, bool coneCulling, std::vector<IndexRange>& ranges, MeshletStats& stats) {
+	XMMATRIX M = XMLoadFloat4x4(&world);
+	float scale = std::max({
+		XMVectorGetX(XMVector3Length(M.r[0])),
+		XMVectorGetX(XMVector3Length(M.r[1])),
+		XMVectorGetX(XMVector3Length(M.r[2])) });
+	// Mirroring transforms flip the winding, so the cones point the wrong way.
+	coneCulling = coneCulling && XMVectorGetX(XMMatrixDeterminant(M)) > 0.0f;
+	XMVECTOR eye = XMLoadFloat3(&view.cameraPosition);
+
+	for (auto& meshlet : meshlets) {
+		++stats.tested;
+		XMVECTOR center = XMVector3Transform(XMLoadFloat3(&meshlet.center), M);
+		float radius = meshlet.radius * scale;
+
+		bool visible = true;
+		for (auto& plane : view.planes) {
+			if (XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), center)) < -radius) {
+				visible = false;
+				break;
+			}
+		}
+		if (visible && coneCulling && meshlet.coneCutoff < 1.0f) {
+			XMVECTOR axis = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&meshlet.coneAxis), M));
+			XMVECTOR toCenter = center - eye;
+			float distance = XMVectorGetX(XMVector3Length(toCenter));
+			if (XMVectorGetX(XMVector3Dot(toCenter, axis)) >= meshlet.coneCutoff * distance + radius) {
+				visible = false;
+			}
+		}
+		if (!visible) {
+			++stats.rejected;
+			continue;
+		}
+
+		if (!ranges.empty() && ranges.back().indexOffset + ranges.back().indexCount == meshlet.indexOffset) {
+			ranges.back().indexCount += meshlet.indexCount;
+		}
+		else {
+			ranges.push_back({ meshlet.indexOffset, meshlet.indexCount });
+		}
+	}
+}
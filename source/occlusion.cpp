@@ -0,0 +1,283 @@
+#define NOMINMAX
+#include "occlusion.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+using namespace std::chrono;
+
+namespace {
+	// Rows rasterized per task.
+	constexpr uint32_t kOcclusionBandHeight = 8;
+	// Clip space w below which a vertex counts as behind the eye.
+	constexpr float kOcclusionNearW = 1e-5f;
+}
+
+void OcclusionBuffer::Resize(uint32_t width, uint32_t height) {
+	m_width = (std::max(width, 4u) + 3) & ~3u;
+	m_height = std::max(height, 1u);
+	m_levels.clear();
+	m_levelWidths.clear();
+	m_levelHeights.clear();
+	uint32_t levelWidth = m_width;
+	uint32_t levelHeight = m_height;
+	for (;;) {
+		m_levels.emplace_back(static_cast<size_t>(levelWidth) * levelHeight, 1.0f);
+		m_levelWidths.push_back(levelWidth);
+		m_levelHeights.push_back(levelHeight);
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+uint64_t OcclusionBuffer::ByteSize() const {
+	uint64_t bytes = 0;
+	for (const auto& level : m_levels) {
+		bytes += level.size() * sizeof(float);
+	}
+	return bytes;
+}
+
+void OcclusionBuffer::setupOccluder(const Occluder& occluder, std::vector<Triangle>& triangles) const {
+	triangles.clear();
+	XMMATRIX worldViewProjection = XMMatrixMultiply(XMLoadFloat4x4(&occluder.world), XMLoadFloat4x4(&m_viewProjection));
+	std::vector<XMFLOAT4> clip(occluder.vertexCount);
+	for (uint32_t vertex = 0; vertex < occluder.vertexCount; ++vertex) {
+		const float* position = occluder.positions + 3 * vertex;
+		XMStoreFloat4(&clip[vertex], XMVector3Transform(XMVectorSet(position[0], position[1], position[2], 1.0f), worldViewProjection));
+	}
+
+	const float width = static_cast<float>(m_width);
+	const float height = static_cast<float>(m_height);
+	for (uint32_t index = 0; index + 2 < occluder.indexCount; index += 3) {
+		float x[3], y[3], z[3];
+		bool behind = false;
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			const XMFLOAT4& vertex = clip[occluder.indices[index + corner]];
+			// Triangles crossing the near plane are dropped rather than clipped,
+			// which only ever makes the occluders smaller.
+			if (vertex.w < kOcclusionNearW || vertex.z < 0.0f) {
+				behind = true;
+				break;
+			}
+			const float inverseW = 1.0f / vertex.w;
+			x[corner] = (vertex.x * inverseW * 0.5f + 0.5f) * width;
+			y[corner] = (0.5f - vertex.y * inverseW * 0.5f) * height;
+			z[corner] = std::min(vertex.z * inverseW, 1.0f);
+		}
+		if (behind) {
+			continue;
+		}
+
+		// Pixels whose centre lies inside the bounds.
+		Triangle triangle;
+		triangle.minX = std::max(0, static_cast<int32_t>(std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5f)));
+		triangle.maxX = std::min(static_cast<int32_t>(m_width) - 1, static_cast<int32_t>(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5f)));
+		triangle.minY = std::max(0, static_cast<int32_t>(std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5f)));
+		triangle.maxY = std::min(static_cast<int32_t>(m_height) - 1, static_cast<int32_t>(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5f)));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+			continue;
+		}
+
+		// Edge i is opposite vertex i and evaluates to twice the signed area
+		// there, so dividing by the area gives barycentric weights.
+		for (uint32_t edge = 0; edge < 3; ++edge) {
+			const uint32_t a = (edge + 1) % 3;
+			const uint32_t b = (edge + 2) % 3;
+			triangle.edgeX[edge] = y[b] - y[a];
+			triangle.edgeY[edge] = x[a] - x[b];
+			triangle.edgeC[edge] = -(triangle.edgeX[edge] * x[a] + triangle.edgeY[edge] * y[a]);
+		}
+		const float area = triangle.edgeX[0] * x[0] + triangle.edgeY[0] * y[0] + triangle.edgeC[0];
+		if (std::fabs(area) < 1e-6f) {
+			continue;
+		}
+		const float inverseArea = 1.0f / area;
+		triangle.depthX = (triangle.edgeX[0] * z[0] + triangle.edgeX[1] * z[1] + triangle.edgeX[2] * z[2]) * inverseArea;
+		triangle.depthY = (triangle.edgeY[0] * z[0] + triangle.edgeY[1] * z[1] + triangle.edgeY[2] * z[2]) * inverseArea;
+		triangle.depthC = (triangle.edgeC[0] * z[0] + triangle.edgeC[1] * z[1] + triangle.edgeC[2] * z[2]) * inverseArea;
+		// Both windings are drawn; back facing ones get their edges flipped.
+		if (area < 0.0f) {
+			for (uint32_t edge = 0; edge < 3; ++edge) {
+				triangle.edgeX[edge] = -triangle.edgeX[edge];
+				triangle.edgeY[edge] = -triangle.edgeY[edge];
+				triangle.edgeC[edge] = -triangle.edgeC[edge];
+			}
+		}
+		triangles.push_back(triangle);
+	}
+}
+
+void OcclusionBuffer::rasterizeBand(uint32_t firstRow, uint32_t endRow) {
+	float* depth = m_levels[0].data();
+	std::fill(depth + static_cast<size_t>(firstRow) * m_width, depth + static_cast<size_t>(endRow) * m_width, 1.0f);
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	for (const auto& triangles : m_triangles) {
+		for (const auto& triangle : triangles) {
+			const int32_t minY = std::max(triangle.minY, static_cast<int32_t>(firstRow));
+			const int32_t maxY = std::min(triangle.maxY, static_cast<int32_t>(endRow) - 1);
+			if (minY > maxY) {
+				continue;
+			}
+			const __m128 edgeX0 = _mm_set1_ps(triangle.edgeX[0]);
+			const __m128 edgeX1 = _mm_set1_ps(triangle.edgeX[1]);
+			const __m128 edgeX2 = _mm_set1_ps(triangle.edgeX[2]);
+			const __m128 depthX = _mm_set1_ps(triangle.depthX);
+			// Rows are padded to a multiple of four, so whole groups stay inside.
+			const int32_t startX = triangle.minX & ~3;
+			for (int32_t row = minY; row <= maxY; ++row) {
+				const float centerY = static_cast<float>(row) + 0.5f;
+				const __m128 rowEdge0 = _mm_set1_ps(triangle.edgeY[0] * centerY + triangle.edgeC[0]);
+				const __m128 rowEdge1 = _mm_set1_ps(triangle.edgeY[1] * centerY + triangle.edgeC[1]);
+				const __m128 rowEdge2 = _mm_set1_ps(triangle.edgeY[2] * centerY + triangle.edgeC[2]);
+				const __m128 rowDepth = _mm_set1_ps(triangle.depthY * centerY + triangle.depthC);
+				float* pixels = depth + static_cast<size_t>(row) * m_width;
+				for (int32_t x = startX; x <= triangle.maxX; x += 4) {
+					const __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+					__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX0, centerX), rowEdge0), zero);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX1, centerX), rowEdge1), zero));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX2, centerX), rowEdge2), zero));
+					if (_mm_movemask_ps(inside) == 0) {
+						continue;
+					}
+					const __m128 current = _mm_loadu_ps(pixels + x);
+					const __m128 nearest = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(depthX, centerX), rowDepth));
+					_mm_storeu_ps(pixels + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+				}
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::buildPyramid() {
+	for (size_t level = 1; level < m_levels.size(); ++level) {
+		const auto& source = m_levels[level - 1];
+		const uint32_t sourceWidth = m_levelWidths[level - 1];
+		const uint32_t sourceHeight = m_levelHeights[level - 1];
+		auto& destination = m_levels[level];
+		for (uint32_t y = 0; y < m_levelHeights[level]; ++y) {
+			const uint32_t y0 = 2 * y;
+			const uint32_t y1 = std::min(y0 + 1, sourceHeight - 1);
+			for (uint32_t x = 0; x < m_levelWidths[level]; ++x) {
+				const uint32_t x0 = 2 * x;
+				const uint32_t x1 = std::min(x0 + 1, sourceWidth - 1);
+				destination[static_cast<size_t>(y) * m_levelWidths[level] + x] = std::max({
+					source[static_cast<size_t>(y0) * sourceWidth + x0], source[static_cast<size_t>(y0) * sourceWidth + x1],
+					source[static_cast<size_t>(y1) * sourceWidth + x0], source[static_cast<size_t>(y1) * sourceWidth + x1] });
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::Rasterize(const std::vector<Occluder>& occluders, const XMFLOAT4X4& viewProjection, ThreadPool& threadPool, OcclusionStats& stats) {
+	auto start = high_resolution_clock::now();
+	m_viewProjection = viewProjection;
+	m_triangles.resize(occluders.size());
+	threadPool.ParallelFor(occluders.size(), 1, [this, &occluders](size_t begin, size_t end) {
+		for (size_t occluder = begin; occluder < end; ++occluder) {
+			setupOccluder(occluders[occluder], m_triangles[occluder]);
+		}
+	});
+	stats.occluders += occluders.size();
+	for (const auto& triangles : m_triangles) {
+		stats.occluderTriangles += triangles.size();
+	}
+
+	const uint32_t bandCount = (m_height + kOcclusionBandHeight - 1) / kOcclusionBandHeight;
+	threadPool.ParallelFor(bandCount, 1, [this](size_t begin, size_t end) {
+		for (size_t band = begin; band < end; ++band) {
+			const uint32_t firstRow = static_cast<uint32_t>(band) * kOcclusionBandHeight;
+			rasterizeBand(firstRow, std::min(firstRow + kOcclusionBandHeight, m_height));
+		}
+	});
+	buildPyramid();
+	stats.rasterMicroseconds += duration<double, std::micro>(high_resolution_clock::now() - start).count();
+}
+
+bool OcclusionBuffer::SphereOccluded(const XMFLOAT3& center, float radius) const {
+	// The corners of the sphere's bounding box bound its projection as long as
+	// they are all in front of the eye.
+	XMMATRIX viewProjection = XMLoadFloat4x4(&m_viewProjection);
+	float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f, nearest = 1.0f;
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		XMVECTOR position = XMVectorSet(
+			center.x + (corner & 1 ? radius : -radius),
+			center.y + (corner & 2 ? radius : -radius),
+			center.z + (corner & 4 ? radius : -radius), 1.0f);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(position, viewProjection));
+		if (clip.w < kOcclusionNearW || clip.z < 0.0f) {
+			return false;
+		}
+		const float inverseW = 1.0f / clip.w;
+		const float x = clip.x * inverseW;
+		const float y = clip.y * inverseW;
+		if (corner == 0) {
+			minX = maxX = x;
+			minY = maxY = y;
+		}
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * inverseW);
+	}
+	// Every on screen pixel the bounds touch, then the finest level where that
+	// is at most two texels across in each direction. What lies off screen
+	// cannot be seen either way.
+	minX = std::max(minX, -1.0f);
+	maxX = std::min(maxX, 1.0f);
+	minY = std::max(minY, -1.0f);
+	maxY = std::min(maxY, 1.0f);
+	if (minX >= maxX || minY >= maxY) {
+		return false;
+	}
+	const int32_t x0 = static_cast<int32_t>(std::floor((minX * 0.5f + 0.5f) * m_width));
+	const int32_t x1 = std::min(static_cast<int32_t>(m_width) - 1, static_cast<int32_t>(std::floor((maxX * 0.5f + 0.5f) * m_width)));
+	const int32_t y0 = static_cast<int32_t>(std::floor((0.5f - maxY * 0.5f) * m_height));
+	const int32_t y1 = std::min(static_cast<int32_t>(m_height) - 1, static_cast<int32_t>(std::floor((0.5f - minY * 0.5f) * m_height)));
+	size_t level = 0;
+	while (level + 1 < m_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+		++level;
+	}
+
+	const auto& depth = m_levels[level];
+	const uint32_t levelWidth = m_levelWidths[level];
+	float farthest = 0.0f;
+	for (int32_t y = y0 >> level; y <= y1 >> level; ++y) {
+		for (int32_t x = x0 >> level; x <= x1 >> level; ++x) {
+			farthest = std::max(farthest, depth[static_cast<size_t>(y) * levelWidth + x]);
+		}
+	}
+	return nearest > farthest;
+}
+
+void OcclusionBuffer::Visualize(std::vector<uint8_t>& pixels) const {
+	const auto& depth = m_levels[0];
+	float nearest = 1.0f;
+	float farthest = 0.0f;
+	for (float value : depth) {
+		if (value < 1.0f) {
+			nearest = std::min(nearest, value);
+			farthest = std::max(farthest, value);
+		}
+	}
+	// Depths crowd towards 1 under perspective, so the covered range is
+	// stretched over the brighter three quarters of the scale.
+	const float scale = farthest > nearest ? 191.0f / (farthest - nearest) : 0.0f;
+	pixels.resize(depth.size() * 4);
+	for (size_t pixel = 0; pixel < depth.size(); ++pixel) {
+		uint8_t value = depth[pixel] < 1.0f ? static_cast<uint8_t>(255.0f - (depth[pixel] - nearest) * scale) : 0;
+		pixels[pixel * 4 + 0] = value;
+		pixels[pixel * 4 + 1] = value;
+		pixels[pixel * 4 + 2] = value;
+		pixels[pixel * 4 + 3] = 255;
+	}
+}
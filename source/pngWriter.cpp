@@ -0,0 +1,353 @@
+#include "pngWriter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+	constexpr uint32_t kWindowSize = 32768;
+	constexpr uint32_t kHashBits = 15;
+	constexpr uint32_t kMaxChain = 32;
+	constexpr uint32_t kMinMatch = 3;
+	constexpr uint32_t kMaxMatch = 258;
+	constexpr uint32_t kEndOfBlock = 256;
+	constexpr uint32_t kBytesPerPixel = 4;
+
+	const uint16_t kLengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t kLengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t kDistanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t kDistanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+		static const auto table = [] {
+			std::vector<uint32_t> table(256);
+			for (uint32_t n = 0; n < 256; ++n) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				table[n] = c;
+			}
+			return table;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i) {
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+		uint32_t a = adler & 0xffff;
+		uint32_t b = adler >> 16;
+		while (size > 0) {
+			// Largest run that cannot overflow 32 bits before the modulo.
+			size_t run = std::min<size_t>(size, 5552);
+			size -= run;
+			while (run--) {
+				a += *data++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void storeBigEndian(uint8_t* out, uint32_t value) {
+		out[0] = static_cast<uint8_t>(value >> 24);
+		out[1] = static_cast<uint8_t>(value >> 16);
+		out[2] = static_cast<uint8_t>(value >> 8);
+		out[3] = static_cast<uint8_t>(value);
+	}
+
+	uint8_t paeth(int a, int b, int c) {
+		int p = a + b - c;
+		int pa = std::abs(p - a);
+		int pb = std::abs(p - b);
+		int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) {
+			return static_cast<uint8_t>(a);
+		}
+		return static_cast<uint8_t>(pb <= pc ? b : c);
+	}
+
+	uint32_t hash3(const uint8_t* p) {
+		return ((uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2]) * 2654435761u) >> (32 - kHashBits);
+	}
+}
+
+bool PngWriter::Open(const std::string& path, uint32_t width, uint32_t height) {
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file) {
+		return false;
+	}
+	m_toMemory = false;
+	return begin(width, height);
+}
+
+bool PngWriter::Open(uint32_t width, uint32_t height) {
+	m_toMemory = true;
+	m_output.clear();
+	return begin(width, height);
+}
+
+bool PngWriter::begin(uint32_t width, uint32_t height) {
+	m_open = true;
+	m_width = width;
+	m_height = height;
+	m_rowsWritten = 0;
+	m_adler = 1;
+	m_bitBuffer = 0;
+	m_bitCount = 0;
+	m_previousRow.assign(static_cast<size_t>(width) * kBytesPerPixel, 0);
+	m_hashHead.resize(size_t(1) << kHashBits);
+	m_hashPrevious.resize(kWindowSize);
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	emit(signature, sizeof(signature));
+
+	uint8_t header[13] = {};
+	storeBigEndian(header, width);
+	storeBigEndian(header + 4, height);
+	header[8] = 8; // bit depth
+	header[9] = 6; // RGBA
+	writeChunk("IHDR", header, sizeof(header));
+
+	// zlib header: deflate with a 32K window, no preset dictionary.
+	m_compressed.clear();
+	m_compressed.push_back(0x78);
+	m_compressed.push_back(0x01);
+	return m_toMemory || static_cast<bool>(m_file);
+}
+
+void PngWriter::WriteRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount) {
+	rowCount = std::min(rowCount, m_height - m_rowsWritten);
+	if (!m_open || rowCount == 0) {
+		return;
+	}
+	filterRows(rows, rowPitch, rowCount);
+	m_adler = adler32(m_adler, m_filtered.data(), m_filtered.size());
+	deflate(m_filtered.data(), m_filtered.size());
+	flushBits(false);
+	writeChunk("IDAT", m_compressed.data(), m_compressed.size());
+	m_compressed.clear();
+	m_rowsWritten += rowCount;
+}
+
+void PngWriter::TakeOutput(std::vector<uint8_t>& output) {
+	output.swap(m_output);
+	m_output.clear();
+}
+
+bool PngWriter::Close() {
+	if (!m_open) {
+		return false;
+	}
+	// Empty final block terminates the deflate stream.
+	putBits(1, 1);
+	putBits(1, 2);
+	putLiteral(kEndOfBlock);
+	flushBits(true);
+	uint8_t adler[4];
+	storeBigEndian(adler, m_adler);
+	m_compressed.insert(m_compressed.end(), adler, adler + 4);
+	writeChunk("IDAT", m_compressed.data(), m_compressed.size());
+	m_compressed.clear();
+	writeChunk("IEND", nullptr, 0);
+
+	m_open = false;
+	if (m_toMemory) {
+		return m_rowsWritten == m_height;
+	}
+	bool complete = m_rowsWritten == m_height && m_file.good();
+	m_file.close();
+	return complete;
+}
+
+void PngWriter::filterRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount) {
+	const size_t rowSize = static_cast<size_t>(m_width) * kBytesPerPixel;
+	m_filtered.resize((rowSize + 1) * rowCount);
+
+	for (uint32_t r = 0; r < rowCount; ++r) {
+		const uint8_t* raw = rows + rowPitch * r;
+		const uint8_t* previous = m_previousRow.data();
+		uint8_t* out = &m_filtered[(rowSize + 1) * r];
+
+		// Pick the filter with the smallest sum of absolute signed residuals.
+		int bestFilter = 0;
+		uint64_t bestScore = UINT64_MAX;
+		for (int filter = 0; filter < 5; ++filter) {
+			uint64_t score = 0;
+			for (size_t i = 0; i < rowSize; ++i) {
+				int a = i >= kBytesPerPixel ? raw[i - kBytesPerPixel] : 0;
+				int b = previous[i];
+				int c = i >= kBytesPerPixel ? previous[i - kBytesPerPixel] : 0;
+				uint8_t value = raw[i];
+				switch (filter) {
+				case 1: value = static_cast<uint8_t>(raw[i] - a); break;
+				case 2: value = static_cast<uint8_t>(raw[i] - b); break;
+				case 3: value = static_cast<uint8_t>(raw[i] - ((a + b) >> 1)); break;
+				case 4: value = static_cast<uint8_t>(raw[i] - paeth(a, b, c)); break;
+				}
+				out[i + 1] = value;
+				score += std::abs(static_cast<int8_t>(value));
+			}
+			if (score < bestScore) {
+				bestScore = score;
+				bestFilter = filter;
+			}
+		}
+
+		out[0] = static_cast<uint8_t>(bestFilter);
+		if (bestFilter != 4) {
+			for (size_t i = 0; i < rowSize; ++i) {
+				int a = i >= kBytesPerPixel ? raw[i - kBytesPerPixel] : 0;
+				int b = previous[i];
+				switch (bestFilter) {
+				case 0: out[i + 1] = raw[i]; break;
+				case 1: out[i + 1] = static_cast<uint8_t>(raw[i] - a); break;
+				case 2: out[i + 1] = static_cast<uint8_t>(raw[i] - b); break;
+				case 3: out[i + 1] = static_cast<uint8_t>(raw[i] - ((a + b) >> 1)); break;
+				}
+			}
+		}
+		memcpy(m_previousRow.data(), raw, rowSize);
+	}
+}
+
+void PngWriter::deflate(const uint8_t* data, size_t size) {
+	// Non final fixed Huffman block. Matches never reach back into earlier
+	// bands, whose bytes are no longer resident.
+	putBits(0, 1);
+	putBits(1, 2);
+	std::fill(m_hashHead.begin(), m_hashHead.end(), -1);
+
+	auto insert = [&](size_t position) {
+		uint32_t h = hash3(data + position);
+		m_hashPrevious[position % kWindowSize] = m_hashHead[h];
+		m_hashHead[h] = static_cast<int32_t>(position);
+	};
+
+	size_t i = 0;
+	while (i < size) {
+		uint32_t bestLength = 0;
+		uint32_t bestDistance = 0;
+		if (i + kMinMatch <= size) {
+			const uint32_t maxLength = static_cast<uint32_t>(std::min<size_t>(kMaxMatch, size - i));
+			int32_t candidate = m_hashHead[hash3(data + i)];
+			for (uint32_t chain = 0; candidate >= 0 && i - candidate <= kWindowSize && chain < kMaxChain; ++chain) {
+				const uint8_t* a = data + candidate;
+				const uint8_t* b = data + i;
+				uint32_t length = 0;
+				while (length < maxLength && a[length] == b[length]) {
+					++length;
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					bestDistance = static_cast<uint32_t>(i - candidate);
+					if (length == maxLength) {
+						break;
+					}
+				}
+				candidate = m_hashPrevious[candidate % kWindowSize];
+			}
+			insert(i);
+		}
+
+		if (bestLength >= kMinMatch) {
+			putMatch(bestLength, bestDistance);
+			for (size_t j = i + 1; j < i + bestLength && j + kMinMatch <= size; ++j) {
+				insert(j);
+			}
+			i += bestLength;
+		}
+		else {
+			putLiteral(data[i]);
+			++i;
+		}
+	}
+	putLiteral(kEndOfBlock);
+}
+
+void PngWriter::putBits(uint32_t value, uint32_t count) {
+	m_bitBuffer |= static_cast<uint64_t>(value) << m_bitCount;
+	m_bitCount += count;
+	while (m_bitCount >= 8) {
+		m_compressed.push_back(static_cast<uint8_t>(m_bitBuffer));
+		m_bitBuffer >>= 8;
+		m_bitCount -= 8;
+	}
+}
+
+void PngWriter::putCode(uint32_t code, uint32_t length) {
+	// Huffman codes are packed starting with their most significant bit.
+	uint32_t reversed = 0;
+	for (uint32_t i = 0; i < length; ++i) {
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	putBits(reversed, length);
+}
+
+void PngWriter::putLiteral(uint32_t literal) {
+	if (literal < 144) {
+		putCode(0x30 + literal, 8);
+	}
+	else if (literal < 256) {
+		putCode(0x190 + literal - 144, 9);
+	}
+	else if (literal < 280) {
+		putCode(literal - 256, 7);
+	}
+	else {
+		putCode(0xc0 + literal - 280, 8);
+	}
+}
+
+void PngWriter::putMatch(uint32_t length, uint32_t distance) {
+	uint32_t lengthCode = 0;
+	while (lengthCode + 1 < std::size(kLengthBase) && kLengthBase[lengthCode + 1] <= length) {
+		++lengthCode;
+	}
+	putLiteral(257 + lengthCode);
+	putBits(length - kLengthBase[lengthCode], kLengthExtra[lengthCode]);
+
+	uint32_t distanceCode = 0;
+	while (distanceCode + 1 < std::size(kDistanceBase) && kDistanceBase[distanceCode + 1] <= distance) {
+		++distanceCode;
+	}
+	putCode(distanceCode, 5);
+	putBits(distance - kDistanceBase[distanceCode], kDistanceExtra[distanceCode]);
+}
+
+void PngWriter::flushBits(bool pad) {
+	if (pad && m_bitCount > 0) {
+		m_compressed.push_back(static_cast<uint8_t>(m_bitBuffer));
+		m_bitBuffer = 0;
+		m_bitCount = 0;
+	}
+}
+
+void PngWriter::writeChunk(const char type[4], const uint8_t* data, size_t size) {
+	uint8_t length[4];
+	storeBigEndian(length, static_cast<uint32_t>(size));
+	emit(length, 4);
+	emit(type, 4);
+	uint32_t crc = crc32(0, reinterpret_cast<const uint8_t*>(type), 4);
+	if (size > 0) {
+		emit(data, size);
+		crc = crc32(crc, data, size);
+	}
+	uint8_t crcBytes[4];
+	storeBigEndian(crcBytes, crc);
+	emit(crcBytes, 4);
+}
+
+void PngWriter::emit(const void* data, size_t size) {
+	if (m_toMemory) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		m_output.insert(m_output.end(), bytes, bytes + size);
+	}
+	else {
+		m_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	}
+}
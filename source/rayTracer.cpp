@@ -0,0 +1,581 @@
+#include "rayTracer.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// Four rays in structure of arrays form, one lane per ray.
+struct RayPacket {
+	XMVECTOR origin[3];
+	XMVECTOR direction[3];
+	XMVECTOR inverseDirection[3];
+	XMVECTOR tMax;
+	// All bits set in lanes still being traced.
+	XMVECTOR active;
+};
+
+// Closest hit per lane; instance and triangle hold integers. Lanes that hit
+// nothing keep tMax at FLT_MAX.
+struct RayPacketHit {
+	XMVECTOR instance;
+	XMVECTOR triangle;
+	XMVECTOR u;
+	XMVECTOR v;
+};
+
+namespace {
+	// Pixels per side of the blocks handed to the pool, traced as 2x2 quads.
+	constexpr uint32_t kBlockSize = 8;
+	constexpr float kAmbient = 0.3f;
+	constexpr float kDiffuse = 0.7f;
+
+	bool anyLane(FXMVECTOR mask) {
+		return XMVector4NotEqualInt(mask, XMVectorFalseInt());
+	}
+
+	uint32_t laneCount(FXMVECTOR mask) {
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, mask);
+		return (lanes[0] ? 1 : 0) + (lanes[1] ? 1 : 0) + (lanes[2] ? 1 : 0) + (lanes[3] ? 1 : 0);
+	}
+
+	float minLane(FXMVECTOR value) {
+		XMFLOAT4 lanes;
+		XMStoreFloat4(&lanes, value);
+		return std::min(std::min(lanes.x, lanes.y), std::min(lanes.z, lanes.w));
+	}
+
+	void setInverseDirection(RayPacket& packet) {
+		// Axis parallel lanes get a tiny direction instead of 0 so slab tests
+		// never compute 0 * infinity.
+		const XMVECTOR tiny = XMVectorReplicate(1e-20f);
+		for (int a = 0; a < 3; ++a) {
+			XMVECTOR direction = XMVectorSelect(packet.direction[a], tiny, XMVectorLess(XMVectorAbs(packet.direction[a]), tiny));
+			packet.inverseDirection[a] = XMVectorReciprocal(direction);
+		}
+	}
+
+	// Lanes whose ray enters the box before tMax; tEnter receives the entry distance.
+	XMVECTOR intersectBox(const RayPacket& packet, const BvhNode& node, XMVECTOR& tEnter) {
+		const float* min = &node.min.x;
+		const float* max = &node.max.x;
+		XMVECTOR enter = XMVectorZero();
+		XMVECTOR exit = packet.tMax;
+		for (int a = 0; a < 3; ++a) {
+			XMVECTOR t0 = (XMVectorReplicate(min[a]) - packet.origin[a]) * packet.inverseDirection[a];
+			XMVECTOR t1 = (XMVectorReplicate(max[a]) - packet.origin[a]) * packet.inverseDirection[a];
+			enter = XMVectorMax(enter, XMVectorMin(t0, t1));
+			exit = XMVectorMin(exit, XMVectorMax(t0, t1));
+		}
+		tEnter = enter;
+		return XMVectorAndInt(XMVectorLessOrEqual(enter, exit), packet.active);
+	}
+
+	// Möller-Trumbore with the triangle broadcast to every lane.
+	XMVECTOR intersectTriangle(const RayPacket& packet, const XMFLOAT3& v0, const XMFLOAT3& e1, const XMFLOAT3& e2, XMVECTOR& t, XMVECTOR& u, XMVECTOR& v) {
+		const XMVECTOR e1x = XMVectorReplicate(e1.x);
+		const XMVECTOR e1y = XMVectorReplicate(e1.y);
+		const XMVECTOR e1z = XMVectorReplicate(e1.z);
+		const XMVECTOR e2x = XMVectorReplicate(e2.x);
+		const XMVECTOR e2y = XMVectorReplicate(e2.y);
+		const XMVECTOR e2z = XMVectorReplicate(e2.z);
+		const XMVECTOR& dx = packet.direction[0];
+		const XMVECTOR& dy = packet.direction[1];
+		const XMVECTOR& dz = packet.direction[2];
+
+		XMVECTOR px = dy * e2z - dz * e2y;
+		XMVECTOR py = dz * e2x - dx * e2z;
+		XMVECTOR pz = dx * e2y - dy * e2x;
+		XMVECTOR determinant = e1x * px + e1y * py + e1z * pz;
+		XMVECTOR inverseDeterminant = XMVectorReciprocal(determinant);
+
+		XMVECTOR sx = packet.origin[0] - XMVectorReplicate(v0.x);
+		XMVECTOR sy = packet.origin[1] - XMVectorReplicate(v0.y);
+		XMVECTOR sz = packet.origin[2] - XMVectorReplicate(v0.z);
+		u = (sx * px + sy * py + sz * pz) * inverseDeterminant;
+
+		XMVECTOR qx = sy * e1z - sz * e1y;
+		XMVECTOR qy = sz * e1x - sx * e1z;
+		XMVECTOR qz = sx * e1y - sy * e1x;
+		v = (dx * qx + dy * qy + dz * qz) * inverseDeterminant;
+		t = (e2x * qx + e2y * qy + e2z * qz) * inverseDeterminant;
+
+		// NaNs from degenerate triangles fail every comparison.
+		XMVECTOR mask = XMVectorAndInt(packet.active, XMVectorGreater(XMVectorAbs(determinant), XMVectorReplicate(1e-20f)));
+		mask = XMVectorAndInt(mask, XMVectorGreaterOrEqual(u, XMVectorZero()));
+		mask = XMVectorAndInt(mask, XMVectorGreaterOrEqual(v, XMVectorZero()));
+		mask = XMVectorAndInt(mask, XMVectorLessOrEqual(u + v, XMVectorReplicate(1.0f)));
+		mask = XMVectorAndInt(mask, XMVectorGreater(t, XMVectorZero()));
+		return XMVectorAndInt(mask, XMVectorLess(t, packet.tMax));
+	}
+
+	// Front to back traversal of one BVH; leaf(node) is called for every leaf
+	// the packet reaches.
+	template <typename Leaf>
+	void traverse(const std::vector<BvhNode>& nodes, RayPacket& packet, Leaf&& leaf) {
+		XMVECTOR tEnter;
+		if (nodes.empty() || !anyLane(intersectBox(packet, nodes[0], tEnter))) {
+			return;
+		}
+		uint32_t stack[kBvhMaxDepth];
+		uint32_t size = 0;
+		uint32_t current = 0;
+		for (;;) {
+			const BvhNode& node = nodes[current];
+			if (node.count == 0) {
+				XMVECTOR enterA, enterB;
+				XMVECTOR maskA = intersectBox(packet, nodes[node.first], enterA);
+				XMVECTOR maskB = intersectBox(packet, nodes[node.first + 1], enterB);
+				bool hitA = anyLane(maskA);
+				bool hitB = anyLane(maskB);
+				if (hitA && hitB) {
+					// Descend into the child the packet reaches first.
+					const XMVECTOR missed = XMVectorReplicate(FLT_MAX);
+					bool swap = minLane(XMVectorSelect(missed, enterB, maskB)) < minLane(XMVectorSelect(missed, enterA, maskA));
+					current = node.first + (swap ? 1 : 0);
+					stack[size++] = node.first + (swap ? 0 : 1);
+					continue;
+				}
+				if (hitA || hitB) {
+					current = node.first + (hitA ? 0 : 1);
+					continue;
+				}
+			}
+			else {
+				leaf(node);
+				if (!anyLane(packet.active)) {
+					return;
+				}
+			}
+
+			// Pop, skipping nodes that lie beyond every lane's current hit.
+			for (;;) {
+				if (size == 0) {
+					return;
+				}
+				current = stack[--size];
+				if (anyLane(intersectBox(packet, nodes[current], tEnter))) {
+					break;
+				}
+			}
+		}
+	}
+
+	// Lane wise transform of three vectors by the upper 3x4 of a row vector matrix.
+	void transformLanes(const XMVECTOR (&input)[3], const XMFLOAT4X4& matrix, bool point, XMVECTOR (&output)[3]) {
+		for (int c = 0; c < 3; ++c) {
+			XMVECTOR value = point ? XMVectorReplicate(matrix.m[3][c]) : XMVectorZero();
+			value = XMVectorMultiplyAdd(input[0], XMVectorReplicate(matrix.m[0][c]), value);
+			value = XMVectorMultiplyAdd(input[1], XMVectorReplicate(matrix.m[1][c]), value);
+			output[c] = XMVectorMultiplyAdd(input[2], XMVectorReplicate(matrix.m[2][c]), value);
+		}
+	}
+
+	uint32_t hash(uint32_t value) {
+		value ^= value >> 16;
+		value *= 0x7feb352d;
+		value ^= value >> 15;
+		value *= 0x846ca68b;
+		value ^= value >> 16;
+		return value;
+	}
+
+	float unitFloat(uint32_t bits) {
+		return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Cosine weighted direction around normal from two uniform numbers.
+	XMFLOAT3 cosineDirection(const XMFLOAT3& normal, float r1, float r2) {
+		// Branchless orthonormal basis (Duff et al. 2017).
+		const float sign = std::copysign(1.0f, normal.z);
+		const float a = -1.0f / (sign + normal.z);
+		const float b = normal.x * normal.y * a;
+		const XMFLOAT3 tangent = { 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+		const XMFLOAT3 bitangent = { b, sign + normal.y * normal.y * a, -normal.y };
+
+		const float phi = 2.0f * XM_PI * r1;
+		const float radius = std::sqrt(r2);
+		const float x = radius * std::cos(phi);
+		const float y = radius * std::sin(phi);
+		const float z = std::sqrt(std::max(0.0f, 1.0f - r2));
+		return {
+			tangent.x * x + bitangent.x * y + normal.x * z,
+			tangent.y * x + bitangent.y * y + normal.y * z,
+			tangent.z * x + bitangent.z * y + normal.z * z };
+	}
+
+	uint8_t unitToByte(float value) {
+		return static_cast<uint8_t>(value > 0.0f ? (value < 1.0f ? value * 255.0f : 255.0f) : 0.0f);
+	}
+}
+
+RayTracer::RayTracer(ThreadPool& pool) :
+	m_pool(pool)
+{
+}
+
+int32_t RayTracer::AddTexture(const uint8_t* pixels, uint32_t width, uint32_t height) {
+	m_textures.push_back({ pixels, width, height });
+	return static_cast<int32_t>(m_textures.size() - 1);
+}
+
+uint32_t RayTracer::AddMaterial(const RayTracingMaterial& material) {
+	m_materials.push_back(material);
+	return static_cast<uint32_t>(m_materials.size() - 1);
+}
+
+uint32_t RayTracer::AddMesh(const std::vector<RayTracingPrimitive>& primitives) {
+	std::vector<Triangle> triangles;
+	std::vector<TriangleShading> shading;
+	std::vector<BvhBounds> bounds;
+	for (const auto& primitive : primitives) {
+		const size_t vertexCount = primitive.positions.size();
+		const bool hasTexcoords = primitive.texcoords.size() >= vertexCount;
+		for (size_t i = 0; i + 2 < primitive.indices.size(); i += 3) {
+			const uint32_t i0 = primitive.indices[i];
+			const uint32_t i1 = primitive.indices[i + 1];
+			const uint32_t i2 = primitive.indices[i + 2];
+			if (i0 >= vertexCount || i1 >= vertexCount || i2 >= vertexCount) {
+				continue;
+			}
+			XMVECTOR p0 = XMLoadFloat3(&primitive.positions[i0]);
+			XMVECTOR p1 = XMLoadFloat3(&primitive.positions[i1]);
+			XMVECTOR p2 = XMLoadFloat3(&primitive.positions[i2]);
+
+			Triangle triangle;
+			XMStoreFloat3(&triangle.v0, p0);
+			XMStoreFloat3(&triangle.e1, p1 - p0);
+			XMStoreFloat3(&triangle.e2, p2 - p0);
+			triangles.push_back(triangle);
+
+			TriangleShading triangleShading = {};
+			if (hasTexcoords) {
+				triangleShading.uv0 = primitive.texcoords[i0];
+				triangleShading.uv1 = primitive.texcoords[i1];
+				triangleShading.uv2 = primitive.texcoords[i2];
+			}
+			triangleShading.material = primitive.material;
+			shading.push_back(triangleShading);
+
+			BvhBounds triangleBounds;
+			XMStoreFloat3(&triangleBounds.min, XMVectorMin(p0, XMVectorMin(p1, p2)));
+			XMStoreFloat3(&triangleBounds.max, XMVectorMax(p0, XMVectorMax(p1, p2)));
+			bounds.push_back(triangleBounds);
+		}
+	}
+
+	Bvh bvh = BuildBvh(bounds, &m_pool);
+	Mesh mesh;
+	mesh.nodes = std::move(bvh.nodes);
+	mesh.triangles.reserve(triangles.size());
+	mesh.shading.reserve(shading.size());
+	for (uint32_t index : bvh.primitives) {
+		mesh.triangles.push_back(triangles[index]);
+		mesh.shading.push_back(shading[index]);
+	}
+	m_meshes.push_back(std::move(mesh));
+	return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+void RayTracer::ClearInstances() {
+	m_pendingInstances.clear();
+}
+
+void RayTracer::AddInstance(uint32_t mesh, const XMFLOAT4X4& world) {
+	if (m_meshes[mesh].nodes.empty()) {
+		return;
+	}
+	Instance instance;
+	instance.mesh = mesh;
+	instance.world = world;
+	XMMATRIX inverseWorld = XMMatrixInverse(nullptr, XMLoadFloat4x4(&world));
+	XMStoreFloat4x4(&instance.inverseWorld, inverseWorld);
+	XMStoreFloat4x4(&instance.normalMatrix, XMMatrixTranspose(inverseWorld));
+	m_pendingInstances.push_back(instance);
+}
+
+void RayTracer::BuildInstances() {
+	std::vector<BvhBounds> bounds(m_pendingInstances.size());
+	for (size_t i = 0; i < m_pendingInstances.size(); ++i) {
+		const auto& instance = m_pendingInstances[i];
+		const BvhNode& root = m_meshes[instance.mesh].nodes[0];
+		XMMATRIX world = XMLoadFloat4x4(&instance.world);
+		XMVECTOR min = XMVectorReplicate(FLT_MAX);
+		XMVECTOR max = XMVectorReplicate(-FLT_MAX);
+		for (int corner = 0; corner < 8; ++corner) {
+			XMVECTOR point = XMVectorSet(
+				corner & 1 ? root.max.x : root.min.x,
+				corner & 2 ? root.max.y : root.min.y,
+				corner & 4 ? root.max.z : root.min.z, 1.0f);
+			point = XMVector3Transform(point, world);
+			min = XMVectorMin(min, point);
+			max = XMVectorMax(max, point);
+		}
+		XMStoreFloat3(&bounds[i].min, min);
+		XMStoreFloat3(&bounds[i].max, max);
+	}
+
+	Bvh bvh = BuildBvh(bounds, &m_pool);
+	m_instanceNodes = std::move(bvh.nodes);
+	m_instances.clear();
+	for (uint32_t index : bvh.primitives) {
+		m_instances.push_back(m_pendingInstances[index]);
+	}
+	m_sceneDiagonal = 0.0f;
+	if (!m_instanceNodes.empty()) {
+		const BvhNode& root = m_instanceNodes[0];
+		m_sceneDiagonal = XMVectorGetX(XMVector3Length(XMLoadFloat3(&root.max) - XMLoadFloat3(&root.min)));
+	}
+}
+
+uint64_t RayTracer::ByteSize() const {
+	uint64_t bytes = (m_instances.capacity() + m_pendingInstances.capacity()) * sizeof(Instance) + m_instanceNodes.capacity() * sizeof(BvhNode);
+	for (const auto& mesh : m_meshes) {
+		bytes += mesh.nodes.capacity() * sizeof(BvhNode) + mesh.triangles.capacity() * sizeof(Triangle) + mesh.shading.capacity() * sizeof(TriangleShading);
+	}
+	return bytes;
+}
+
+template <bool AnyHit>
+void RayTracer::traceInstances(RayPacket& packet, RayPacketHit* hit) const {
+	traverse(m_instanceNodes, packet, [&](const BvhNode& leaf) {
+		for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+			const Instance& instance = m_instances[i];
+			// Directions are not renormalized, so hit distances carry over
+			// unchanged between world and object space.
+			RayPacket local;
+			transformLanes(packet.origin, instance.inverseWorld, true, local.origin);
+			transformLanes(packet.direction, instance.inverseWorld, false, local.direction);
+			setInverseDirection(local);
+			local.tMax = packet.tMax;
+			local.active = packet.active;
+			traceMesh<AnyHit>(m_meshes[instance.mesh], i, local, hit);
+			packet.tMax = local.tMax;
+			packet.active = local.active;
+			if (AnyHit && !anyLane(packet.active)) {
+				return;
+			}
+		}
+	});
+}
+
+template <bool AnyHit>
+void RayTracer::traceMesh(const Mesh& mesh, uint32_t instance, RayPacket& packet, RayPacketHit* hit) const {
+	traverse(mesh.nodes, packet, [&](const BvhNode& leaf) {
+		for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+			const Triangle& triangle = mesh.triangles[i];
+			XMVECTOR t, u, v;
+			XMVECTOR mask = intersectTriangle(packet, triangle.v0, triangle.e1, triangle.e2, t, u, v);
+			if (!anyLane(mask)) {
+				continue;
+			}
+			if constexpr (AnyHit) {
+				packet.active = XMVectorAndCInt(packet.active, mask);
+				if (!anyLane(packet.active)) {
+					return;
+				}
+			}
+			else {
+				packet.tMax = XMVectorSelect(packet.tMax, t, mask);
+				hit->instance = XMVectorSelect(hit->instance, XMVectorReplicateInt(instance), mask);
+				hit->triangle = XMVectorSelect(hit->triangle, XMVectorReplicateInt(i), mask);
+				hit->u = XMVectorSelect(hit->u, u, mask);
+				hit->v = XMVectorSelect(hit->v, v, mask);
+			}
+		}
+	});
+}
+
+XMVECTOR RayTracer::baseColor(const TriangleShading& shading, float u, float v) const {
+	if (shading.material >= m_materials.size()) {
+		return XMVectorReplicate(1.0f);
+	}
+	const auto& material = m_materials[shading.material];
+	XMVECTOR color = XMLoadFloat4(&material.baseColor);
+	if (material.baseColorTexture < 0) {
+		return color;
+	}
+	// Nearest texel with wrapping; glTF samplers are not evaluated.
+	const auto& texture = m_textures[material.baseColorTexture];
+	const float w = 1.0f - u - v;
+	float s = w * shading.uv0.x + u * shading.uv1.x + v * shading.uv2.x;
+	float t = w * shading.uv0.y + u * shading.uv1.y + v * shading.uv2.y;
+	s -= std::floor(s);
+	t -= std::floor(t);
+	uint32_t x = std::min(texture.width - 1, static_cast<uint32_t>(s * texture.width));
+	uint32_t y = std::min(texture.height - 1, static_cast<uint32_t>(t * texture.height));
+	const uint8_t* texel = texture.pixels + (static_cast<size_t>(y) * texture.width + x) * 4;
+	return color * XMVectorSet(texel[0], texel[1], texel[2], texel[3]) * (1.0f / 255.0f);
+}
+
+void RayTracer::Render(const RayTracingView& view, uint32_t firstRow, uint32_t rowCount, uint8_t* rows, size_t rowPitch, RayTracingStats& stats) {
+	const XMMATRIX inverseViewProjection = XMLoadFloat4x4(&view.inverseViewProjection);
+	const XMVECTOR eye = XMLoadFloat3(&view.eye);
+	XMFLOAT3 light;
+	XMStoreFloat3(&light, XMVector3Normalize(XMLoadFloat3(&view.lightDirection)));
+	const float occlusionDistance = view.occlusionDistance > 0.0f ? view.occlusionDistance : 0.2f * m_sceneDiagonal;
+	// Secondary rays start this far off the surface to avoid hitting it again.
+	const float rayOffset = 1e-4f * std::max(m_sceneDiagonal, 1e-3f);
+	const uint32_t occlusionPackets = (view.occlusionSamples + 3) / 4;
+	const uint32_t lastRow = std::min(firstRow + rowCount, view.height);
+	const uint32_t blockColumns = (view.width + kBlockSize - 1) / kBlockSize;
+	const uint32_t blockRows = (lastRow - std::min(firstRow, lastRow) + kBlockSize - 1) / kBlockSize;
+
+	std::atomic<uint64_t> primaryRays = 0;
+	std::atomic<uint64_t> shadowRays = 0;
+	std::atomic<uint64_t> occlusionRays = 0;
+	m_pool.ParallelFor(static_cast<size_t>(blockColumns) * blockRows, 1, [&](size_t begin, size_t end) {
+		RayTracingStats local;
+		for (size_t block = begin; block < end; ++block) {
+			const uint32_t blockX = static_cast<uint32_t>(block % blockColumns) * kBlockSize;
+			const uint32_t blockY = firstRow + static_cast<uint32_t>(block / blockColumns) * kBlockSize;
+			const uint32_t blockEndX = std::min(blockX + kBlockSize, view.width);
+			const uint32_t blockEndY = std::min(blockY + kBlockSize, lastRow);
+			for (uint32_t y = blockY; y < blockEndY; y += 2) {
+				for (uint32_t x = blockX; x < blockEndX; x += 2) {
+					// Lanes cover the 2x2 quad at (x, y); lanes outside the rows stay inactive.
+					const uint32_t laneX[4] = { x, x + 1, x, x + 1 };
+					const uint32_t laneY[4] = { y, y, y + 1, y + 1 };
+					bool laneActive[4];
+					XMFLOAT3 directions[4];
+					for (int lane = 0; lane < 4; ++lane) {
+						laneActive[lane] = laneX[lane] < blockEndX && laneY[lane] < blockEndY;
+						float ndcX = (static_cast<float>(std::min(laneX[lane], view.width - 1)) + 0.5f) / view.width * 2.0f - 1.0f;
+						float ndcY = 1.0f - (static_cast<float>(std::min(laneY[lane], view.height - 1)) + 0.5f) / view.height * 2.0f;
+						XMVECTOR target = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverseViewProjection);
+						XMStoreFloat3(&directions[lane], XMVector3Normalize(target - eye));
+					}
+
+					RayPacket packet;
+					for (int a = 0; a < 3; ++a) {
+						packet.origin[a] = XMVectorReplicate((&view.eye.x)[a]);
+						packet.direction[a] = XMVectorSet((&directions[0].x)[a], (&directions[1].x)[a], (&directions[2].x)[a], (&directions[3].x)[a]);
+					}
+					setInverseDirection(packet);
+					packet.tMax = XMVectorReplicate(FLT_MAX);
+					packet.active = XMVectorSetInt(laneActive[0] ? ~0u : 0u, laneActive[1] ? ~0u : 0u, laneActive[2] ? ~0u : 0u, laneActive[3] ? ~0u : 0u);
+					RayPacketHit hit = { XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+					traceInstances<false>(packet, &hit);
+					local.primaryRays += laneCount(packet.active);
+
+					XMFLOAT4 distances, us, vs;
+					uint32_t instances[4], triangles[4];
+					XMStoreFloat4(&distances, packet.tMax);
+					XMStoreFloat4(&us, hit.u);
+					XMStoreFloat4(&vs, hit.v);
+					XMStoreInt4(instances, hit.instance);
+					XMStoreInt4(triangles, hit.triangle);
+
+					bool laneHit[4];
+					XMFLOAT3 positions[4];
+					XMFLOAT3 normals[4];
+					XMVECTOR colors[4];
+					for (int lane = 0; lane < 4; ++lane) {
+						const float distance = (&distances.x)[lane];
+						laneHit[lane] = laneActive[lane] && distance < FLT_MAX;
+						if (!laneHit[lane]) {
+							colors[lane] = XMLoadFloat4(&view.background);
+							continue;
+						}
+						const auto& instance = m_instances[instances[lane]];
+						const auto& mesh = m_meshes[instance.mesh];
+						const auto& triangle = mesh.triangles[triangles[lane]];
+						XMVECTOR direction = XMLoadFloat3(&directions[lane]);
+						XMVECTOR normal = XMVector3Cross(XMLoadFloat3(&triangle.e1), XMLoadFloat3(&triangle.e2));
+						normal = XMVector3Normalize(XMVector3TransformNormal(normal, XMLoadFloat4x4(&instance.normalMatrix)));
+						if (XMVectorGetX(XMVector3Dot(normal, direction)) > 0.0f) {
+							normal = -normal;
+						}
+						XMStoreFloat3(&normals[lane], normal);
+						XMStoreFloat3(&positions[lane], eye + direction * distance + normal * rayOffset);
+						colors[lane] = baseColor(mesh.shading[triangles[lane]], (&us.x)[lane], (&vs.x)[lane]);
+					}
+
+					// One shadow ray per lit lane, all towards the light.
+					float lambert[4] = {};
+					bool lit[4] = {};
+					for (int lane = 0; lane < 4; ++lane) {
+						if (laneHit[lane]) {
+							lambert[lane] = normals[lane].x * light.x + normals[lane].y * light.y + normals[lane].z * light.z;
+							lit[lane] = lambert[lane] > 0.0f;
+						}
+					}
+					RayPacket shadow;
+					for (int a = 0; a < 3; ++a) {
+						shadow.origin[a] = XMVectorSet((&positions[0].x)[a], (&positions[1].x)[a], (&positions[2].x)[a], (&positions[3].x)[a]);
+						shadow.direction[a] = XMVectorReplicate((&light.x)[a]);
+					}
+					setInverseDirection(shadow);
+					shadow.tMax = XMVectorReplicate(FLT_MAX);
+					shadow.active = XMVectorSetInt(lit[0] ? ~0u : 0u, lit[1] ? ~0u : 0u, lit[2] ? ~0u : 0u, lit[3] ? ~0u : 0u);
+					local.shadowRays += laneCount(shadow.active);
+					if (anyLane(shadow.active)) {
+						traceInstances<true>(shadow, nullptr);
+					}
+					uint32_t visible[4];
+					XMStoreInt4(visible, shadow.active);
+
+					for (int lane = 0; lane < 4; ++lane) {
+						if (!laneHit[lane]) {
+							continue;
+						}
+						// Occlusion packets share the lane's origin and fan out over the hemisphere.
+						float ambient = 1.0f;
+						if (occlusionPackets) {
+							uint32_t open = 0;
+							uint32_t issued = 0;
+							uint32_t seed = hash(laneX[lane] ^ hash(laneY[lane]));
+							for (uint32_t p = 0; p < occlusionPackets; ++p) {
+								RayPacket occlusion;
+								XMFLOAT3 sampleDirections[4];
+								bool sampleActive[4];
+								for (uint32_t s = 0; s < 4; ++s) {
+									uint32_t sample = p * 4 + s;
+									sampleActive[s] = sample < view.occlusionSamples;
+									uint32_t r1 = hash(seed + sample * 2);
+									uint32_t r2 = hash(seed + sample * 2 + 1);
+									sampleDirections[s] = cosineDirection(normals[lane], unitFloat(r1), unitFloat(r2));
+								}
+								for (int a = 0; a < 3; ++a) {
+									occlusion.origin[a] = XMVectorReplicate((&positions[lane].x)[a]);
+									occlusion.direction[a] = XMVectorSet((&sampleDirections[0].x)[a], (&sampleDirections[1].x)[a], (&sampleDirections[2].x)[a], (&sampleDirections[3].x)[a]);
+								}
+								setInverseDirection(occlusion);
+								occlusion.tMax = XMVectorReplicate(occlusionDistance);
+								occlusion.active = XMVectorSetInt(sampleActive[0] ? ~0u : 0u, sampleActive[1] ? ~0u : 0u, sampleActive[2] ? ~0u : 0u, sampleActive[3] ? ~0u : 0u);
+								issued += laneCount(occlusion.active);
+								traceInstances<true>(occlusion, nullptr);
+								open += laneCount(occlusion.active);
+							}
+							local.occlusionRays += issued;
+							ambient = issued ? static_cast<float>(open) / issued : 1.0f;
+						}
+						const float direct = visible[lane] ? lambert[lane] : 0.0f;
+						colors[lane] = XMVectorSelect(colors[lane], colors[lane] * (kAmbient * ambient + kDiffuse * direct), g_XMSelect1110);
+					}
+
+					for (int lane = 0; lane < 4; ++lane) {
+						if (!laneActive[lane]) {
+							continue;
+						}
+						XMFLOAT4 color;
+						XMStoreFloat4(&color, colors[lane]);
+						uint8_t* pixel = rows + static_cast<size_t>(laneY[lane] - firstRow) * rowPitch + static_cast<size_t>(laneX[lane]) * 4;
+						pixel[0] = unitToByte(color.x);
+						pixel[1] = unitToByte(color.y);
+						pixel[2] = unitToByte(color.z);
+						pixel[3] = unitToByte(color.w);
+					}
+				}
+			}
+		}
+		primaryRays += local.primaryRays;
+		shadowRays += local.shadowRays;
+		occlusionRays += local.occlusionRays;
+	});
+	stats.primaryRays += primaryRays;
+	stats.shadowRays += shadowRays;
+	stats.occlusionRays += occlusionRays;
+}
@@ -1,4 +1,5 @@
 #include "renderer.h"
+#include "log.h"
 
 #define GLFW_EXPOSE_NATIVE_WIN32
 #define TINYGLTF_IMPLEMENTATION
@@ -16,37 +17,264 @@
 using namespace Microsoft::WRL;
 using namespace std::chrono;
 
-Renderer::Renderer(UINT width, UINT height, std::string title) :
+namespace {
+	struct DecodedImage {
+		size_t encodedSize;
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	// Scene files read ahead of tinygltf, by normalized path, and the images
+	// decoded from them, by the hash of their encoded bytes.
+	struct ScenePrefetch {
+		std::mutex mutex;
+		// The scene file and every file it references.
+		std::vector<std::string> paths;
+		std::unordered_map<std::string, std::vector<unsigned char>> files;
+		std::unordered_map<ContentHash, DecodedImage, ContentHashHasher> images;
+	};
+
+	std::string normalizedPath(const std::string& path) {
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	// Reads the scene file, then every buffer and image it references at once.
+	// One thread drives the reads while the others decode images as they
+	// arrive; with a single thread the images are decoded after the reads.
+	void prefetchScene(const std::string& scenePath, uint32_t queueDepth, ThreadPool& threadPool, ScenePrefetch& prefetch) {
+		auto start = high_resolution_clock::now();
+		AssetReader reader(queueDepth);
+		const uint32_t scene = reader.Add(scenePath);
+		reader.Run();
+		std::vector<SceneFile> sceneFiles;
+		if (!reader.Succeeded(scene)) {
+			return;
+		}
+		ListSceneFiles(scenePath, reader.Data(scene), sceneFiles);
+		prefetch.files[normalizedPath(scenePath)] = std::move(reader.Data(scene));
+		prefetch.paths.push_back(scenePath);
+		for (const auto& sceneFile : sceneFiles) {
+			reader.Add(sceneFile.path);
+			prefetch.paths.push_back(sceneFile.path);
+		}
+
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<uint32_t> decodes;
+		bool reading = true;
+		std::atomic<uint32_t> decoded = 0;
+		auto keep = [&](uint32_t file) {
+			std::lock_guard<std::mutex> lock(prefetch.mutex);
+			prefetch.files[normalizedPath(reader.Path(file))] = std::move(reader.Data(file));
+		};
+		auto decode = [&](uint32_t file) {
+			const auto& bytes = reader.Data(file);
+			const int size = static_cast<int>(bytes.size());
+			int width, height, components;
+			// 16 bit images are left to tinygltf, which keeps their precision.
+			unsigned char* pixels = stbi_is_16_bit_from_memory(bytes.data(), size) ? nullptr : stbi_load_from_memory(bytes.data(), size, &width, &height, &components, 4);
+			if (pixels) {
+				DecodedImage image = { bytes.size(), width, height, std::vector<unsigned char>(pixels, pixels + static_cast<size_t>(width) * height * 4) };
+				stbi_image_free(pixels);
+				const ContentHash hash = HashContent(bytes.data(), bytes.size());
+				std::lock_guard<std::mutex> lock(prefetch.mutex);
+				prefetch.images.emplace(hash, std::move(image));
+				++decoded;
+			}
+			keep(file);
+		};
+		threadPool.ParallelFor(threadPool.ThreadCount(), 1, [&](size_t begin, size_t end) {
+			for (size_t worker = begin; worker < end; ++worker) {
+				if (worker == 0) {
+					reader.Run([&](uint32_t file) {
+						if (!reader.Succeeded(file)) {
+							return;
+						}
+						if (!sceneFiles[file - scene - 1].image) {
+							keep(file);
+							return;
+						}
+						std::lock_guard<std::mutex> lock(mutex);
+						decodes.push_back(file);
+						ready.notify_one();
+					});
+					std::lock_guard<std::mutex> lock(mutex);
+					reading = false;
+					ready.notify_all();
+				}
+				for (;;) {
+					std::unique_lock<std::mutex> lock(mutex);
+					ready.wait(lock, [&] { return !decodes.empty() || !reading; });
+					if (decodes.empty()) {
+						break;
+					}
+					uint32_t file = decodes.front();
+					decodes.pop_front();
+					lock.unlock();
+					decode(file);
+				}
+			}
+		});
+
+		Log(LogLevel::Info, { "load" }, "scene files {}", reader.Report());
+		Log(LogLevel::Info, { "load" }, "{} images decoded alongside the reads, {:.1f} ms to read and decode",
+			decoded.load(), duration<double_t, std::milli>(high_resolution_clock::now() - start).count());
+	}
+
+	// tinygltf's file reads, served from the prefetched files where possible.
+	bool readPrefetchedFile(std::vector<unsigned char>* data, std::string* error, const std::string& path, void* userData) {
+		auto& prefetch = *static_cast<ScenePrefetch*>(userData);
+		auto file = prefetch.files.find(normalizedPath(path));
+		if (file != prefetch.files.end()) {
+			data->swap(file->second);
+			prefetch.files.erase(file);
+			return true;
+		}
+		return tinygltf::ReadWholeFile(data, error, path, nullptr);
+	}
+
+	// tinygltf's image decoder, taking the pixels decoded during the prefetch
+	// when the encoded bytes match.
+	bool loadPrefetchedImage(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int requestedWidth, int requestedHeight, const unsigned char* bytes, int size, void* userData) {
+		auto& prefetch = *static_cast<ScenePrefetch*>(userData);
+		auto decoded = prefetch.images.find(HashContent(bytes, size));
+		if (decoded != prefetch.images.end() && decoded->second.encodedSize == static_cast<size_t>(size) && requestedWidth <= 0 && requestedHeight <= 0) {
+			image->width = decoded->second.width;
+			image->height = decoded->second.height;
+			image->component = 4;
+			image->bits = 8;
+			image->pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+			image->image = std::move(decoded->second.pixels);
+			prefetch.images.erase(decoded);
+			return true;
+		}
+		return tinygltf::LoadImageData(image, imageIndex, error, warning, requestedWidth, requestedHeight, bytes, size, nullptr);
+	}
+
+	// Records where each image's encoded bytes can be read again: images in
+	// buffer views keep a copy, since the buffers are released after upload.
+	void keepImageSources(const std::string& scenePath, const tinygltf::Model& model, std::vector<SceneImage>& images) {
+		for (size_t imageIndex = 0; imageIndex < model.images.size(); ++imageIndex) {
+			const auto& gltfImage = model.images[imageIndex];
+			auto& image = images[imageIndex];
+			image.sourcePath.clear();
+			image.sourceBytes.reset();
+			if (gltfImage.bufferView >= 0) {
+				const auto& gltfBufferView = model.bufferViews[gltfImage.bufferView];
+				const auto& data = model.buffers[gltfBufferView.buffer].data;
+				if (gltfBufferView.byteOffset + gltfBufferView.byteLength <= data.size()) {
+					const auto begin = data.begin() + gltfBufferView.byteOffset;
+					image.sourceBytes = std::make_shared<const std::vector<unsigned char>>(begin, begin + gltfBufferView.byteLength);
+				}
+			}
+			else if (!gltfImage.uri.empty() && gltfImage.uri.rfind("data:", 0) != 0) {
+				image.sourcePath = SceneFilePath(scenePath, gltfImage.uri);
+			}
+		}
+	}
+
+	// Decodes an image again from its file, read through an AssetReader, or
+	// from its kept bytes. Fails unless it decodes to the size it had.
+	bool reloadImage(const std::string& path, const std::vector<unsigned char>* bytes, uint32_t width, uint32_t height, uint32_t queueDepth, std::vector<uint8_t>& pixels) {
+		std::vector<unsigned char> file;
+		if (!bytes) {
+			AssetReader reader(queueDepth);
+			const uint32_t index = reader.Add(path);
+			reader.Run();
+			if (!reader.Succeeded(index)) {
+				return false;
+			}
+			file = std::move(reader.Data(index));
+			bytes = &file;
+		}
+		int decodedWidth, decodedHeight, components;
+		unsigned char* decoded = stbi_load_from_memory(bytes->data(), static_cast<int>(bytes->size()), &decodedWidth, &decodedHeight, &components, 4);
+		if (!decoded) {
+			return false;
+		}
+		const bool matches = static_cast<uint32_t>(decodedWidth) == width && static_cast<uint32_t>(decodedHeight) == height;
+		if (matches) {
+			pixels.assign(decoded, decoded + static_cast<size_t>(width) * height * 4);
+		}
+		stbi_image_free(decoded);
+		return matches;
+	}
+}
+
+Renderer::Renderer(UINT width, UINT height, std::string title, const RendererOptions& options) :
 	m_width(width),
 	m_height(height),
 	m_title(title)
 {
+	m_tileWidth = options.tileSize ? std::min<LONG>(options.tileSize, m_width) : m_width;
+	m_tileHeight = options.tileSize ? std::min<LONG>(options.tileSize, m_height) : m_height;
+	m_renderTargetFormat = options.renderTargetFormat;
+	if (!IsSupportedRenderTargetFormat(m_renderTargetFormat)) {
+		Log(LogLevel::Warning, { "init" }, "Unsupported render target format, using R32G32B32A32_FLOAT");
+		m_renderTargetFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	}
+
+	m_memoryReportInterval = options.memoryReportInterval;
+	m_memoryTracker.SetProcessBudget(static_cast<uint64_t>(options.memoryBudget) << 20);
+	m_memoryTracker.SetWarningCallback([](const std::string& warning) {
+		Log(LogLevel::Warning, { "memory" }, "{}", warning);
+	});
+
+	m_textureResidency.SetBudget(static_cast<uint64_t>(options.textureBudget) << 20);
+	m_uploadRingSize = static_cast<UINT64>(std::max(1u, options.uploadRingSize)) << 20;
+	m_maxOccluders = options.occluders;
+	m_occlusionDumpInterval = options.occlusionDumpInterval;
+
+	m_animation = options.animation;
+	m_threadPool = std::make_unique<ThreadPool>(options.workerThreads);
+	if (options.rayTrace) {
+		m_rayTracer = std::make_unique<RayTracer>(*m_threadPool);
+		m_occlusionSamples = options.occlusionSamples;
+	}
+
+	if (!options.sequencePath.empty()) {
+		m_writeSequence = m_sequenceEncoder.Open(options.sequencePath, width, height, options.keyframeInterval);
+		if (!m_writeSequence) {
+			Log(LogLevel::Warning, { "init" }, "Failed to open output sequence, writing images");
+		}
+	}
+	if (!m_writeSequence) {
+		m_frameWriter = std::make_unique<FrameWriter>(options.writeQueueDepth);
+	}
+
 	m_aspectRatio = static_cast<FLOAT>(width) / static_cast<FLOAT>(height);
 	currentFrameTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
 	lastFrameTime = currentFrameTime;
 
 	for (UINT n = 0; n < FrameCount; n++) {
-		m_renderTargets[n].clearValue.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		m_renderTargets[n].clearValue.Format = m_renderTargetFormat;
 		m_renderTargets[n].clearValue.Color[0] = 0.0f;
 		m_renderTargets[n].clearValue.Color[1] = 0.1f;
 		m_renderTargets[n].clearValue.Color[2] = 0.2f;
 		m_renderTargets[n].clearValue.Color[3] = 1.0f;
 	}
 
-	outputFloatImage = new float_t[width * height * 4];
-	outputCharImage = new uint8_t[width * height * 4];
+	// 8 bit sRGB tiles spanning the full width are encoded straight from the
+	// mapped readback buffer. Anything else, traced bands included, is
+	// converted into one band of rows.
+	m_encodeFromReadback = !m_rayTracer && m_renderTargetFormat == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB && m_tileWidth == m_width;
+	if (!m_encodeFromReadback) {
+		m_bandImage.resize(static_cast<size_t>(width) * m_tileHeight * 4);
+		m_memoryTracker.Add({ 0, MemoryCategory::OutputImage, MemoryDomain::Cpu, m_bandImage.size() });
+	}
 
 	m_viewport.TopLeftX = (FLOAT)0.0f;
 	m_viewport.TopLeftY = (FLOAT)0.0f;
-	m_viewport.Width = static_cast<FLOAT>(width);
-	m_viewport.Height = static_cast<FLOAT>(height);
+	m_viewport.Width = static_cast<FLOAT>(m_tileWidth);
+	m_viewport.Height = static_cast<FLOAT>(m_tileHeight);
 	m_viewport.MinDepth = (FLOAT)0.0f;
 	m_viewport.MaxDepth = (FLOAT)1.0f;
 
 	m_scissorRect.left = (LONG)0;
 	m_scissorRect.top = (LONG)0;
-	m_scissorRect.right = (LONG)width;
-	m_scissorRect.bottom = (LONG)height;
+	m_scissorRect.right = m_tileWidth;
+	m_scissorRect.bottom = m_tileHeight;
 
 	CHAR moduleName[512];
 	memset(moduleName, 0, _countof(moduleName));
@@ -60,21 +288,89 @@ Renderer::Renderer(UINT width, UINT height, std::string title) :
 	m_pixelShaderPath = moduleDir + "pixelShader.hlsl";
 	m_grayPixelShaderPath = moduleDir + "grayPixelShader.hlsl";
 
+	std::string modelPath = options.scenePath.empty() ? moduleDir + "Cube\\Cube.gltf" : options.scenePath;
+	m_scenePath = modelPath;
+	m_assetQueueDepth = options.assetQueueDepth;
+	std::vector<std::string> sceneFiles;
+	loadScene(modelPath, m_gltfModel, sceneFiles);
+	deduplicateScene(m_gltfModel, m_bufferUploadRanges, m_dedupStats);
+
+	// Reloads are applied to the rasterizer's resources; traced scenes keep
+	// their acceleration structures for the whole run.
+	if (options.hotReload && m_rayTracer) {
+		Log(LogLevel::Warning, { "init" }, "Hot reload is not supported when ray tracing");
+	}
+	else if (options.hotReload) {
+		m_hotReload = true;
+		m_sceneSignature = signScene(m_gltfModel, m_bufferUploadRanges);
+		for (const auto& path : sceneFiles) {
+			m_fileWatcher.Watch(path);
+		}
+		for (const auto& path : { m_vertexShaderPath, m_pixelShaderPath, m_grayPixelShaderPath }) {
+			m_fileWatcher.Watch(path);
+		}
+	}
+
+	// The hierarchy and pixels move to the runtime model; the tinygltf model,
+	// with its buffers, is released once Init has uploaded them.
+	m_scene.Build(m_gltfModel);
+	keepImageSources(modelPath, m_gltfModel, m_scene.Images());
+	m_memoryScene = m_memoryTracker.AddScene(modelPath.substr(modelPath.find_last_of("\\/") + 1));
+	m_sceneSourceMemory = { m_memoryScene, MemoryCategory::SceneSource, MemoryDomain::Cpu, sceneSourceBytes() };
+	m_memoryTracker.Add(m_sceneSourceMemory);
+}
+
+Renderer::~Renderer() {
+}
+
+// Streams of 8 bit RGBA images with a file or kept bytes decode the image
+// again instead of reading its pixels. The ray tracer samples the pixels
+// themselves, so they are kept while it runs.
+bool Renderer::streamsFromSource(size_t imageIndex) const {
+	const auto& image = m_scene.Images()[imageIndex];
+	return !m_rayTracer && image.components == 4 && image.bits == 8 && (image.sourceBytes || !image.sourcePath.empty());
+}
+
+uint64_t Renderer::sceneSourceBytes() const {
+	uint64_t bytes = 0;
+	for (const auto& gltfBuffer : m_gltfModel.buffers) {
+		bytes += gltfBuffer.data.size();
+	}
+	return bytes + m_scene.Bytes();
+}
+
+bool Renderer::loadScene(const std::string& path, tinygltf::Model& model, std::vector<std::string>& files) {
 	std::string error;
 	std::string warning;
-	std::string modelPath = moduleDir + "Cube\\Cube.gltf";
 
+	// tinygltf reads files one at a time and decodes images on this thread, so
+	// both are done ahead of it and it is handed the results.
+	ScenePrefetch prefetch;
+	prefetchScene(path, m_assetQueueDepth, *m_threadPool, prefetch);
 	tinygltf::TinyGLTF gltfContext;
-	gltfContext.LoadASCIIFromFile(&m_gltfModel, &error, &warning, modelPath.c_str());
+	tinygltf::FsCallbacks fsCallbacks = {};
+	fsCallbacks.FileExists = &tinygltf::FileExists;
+	fsCallbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+	fsCallbacks.ReadWholeFile = &readPrefetchedFile;
+	fsCallbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+	fsCallbacks.user_data = &prefetch;
+	gltfContext.SetFsCallbacks(fsCallbacks);
+	gltfContext.SetImageLoader(&loadPrefetchedImage, &prefetch);
+	bool loaded;
+	if (path.ends_with(".glb")) {
+		loaded = gltfContext.LoadBinaryFromFile(&model, &error, &warning, path);
+	}
+	else {
+		loaded = gltfContext.LoadASCIIFromFile(&model, &error, &warning, path);
+	}
 	if (!error.empty()) {
-		OutputDebugString(error.c_str());
+		Log(LogLevel::Error, { "load" }, "{}", error);
 	}
 	if (!warning.empty()) {
-		OutputDebugString(warning.c_str());
+		Log(LogLevel::Warning, { "load" }, "{}", warning);
 	}
-}
-
-Renderer::~Renderer() {
+	files = std::move(prefetch.paths);
+	return loaded;
 }
 
 double_t Renderer::GetDeltaTime() {
@@ -83,23 +379,1081 @@ double_t Renderer::GetDeltaTime() {
 	return (static_cast<double_t>(currentFrameTime.count()) - static_cast<double_t>(lastFrameTime.count())) / 1000.0;
 }
 
+// Every committed resource goes through here so it is accounted to a scene and
+// category. The record is dropped again by the resource's destruction callback,
+// whichever ComPtr happens to release it last.
+HRESULT Renderer::createCommittedResource(const D3D12_HEAP_PROPERTIES& heapProperties, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clearValue, MemoryCategory category, uint32_t scene, ComPtr<ID3D12Resource>& resource) {
+	HRESULT result = m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, state, clearValue, IID_PPV_ARGS(&resource));
+	if (FAILED(result)) {
+		return result;
+	}
+	MemoryDomain domain = heapProperties.Type == D3D12_HEAP_TYPE_DEFAULT ? MemoryDomain::Local : MemoryDomain::NonLocal;
+	MemoryAllocation allocation = { scene, category, domain, m_device->GetResourceAllocationInfo(0, 1, &resourceDesc).SizeInBytes };
+	m_memoryTracker.Add(allocation);
+
+	struct TrackedAllocation {
+		MemoryTracker* tracker;
+		MemoryAllocation allocation;
+	};
+	ComPtr<ID3DDestructionNotifier> notifier;
+	if (SUCCEEDED(resource.As(&notifier))) {
+		UINT callbackId = 0;
+		notifier->RegisterDestructionCallback([](void* data) {
+			auto* tracked = static_cast<TrackedAllocation*>(data);
+			tracked->tracker->Remove(tracked->allocation);
+			delete tracked;
+		}, new TrackedAllocation{ &m_memoryTracker, allocation }, &callbackId);
+	}
+	return result;
+}
+
+void Renderer::checkVideoMemory() {
+	DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+	if (FAILED(m_adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)) || info.Budget == 0) {
+		return;
+	}
+	bool nearBudget = info.CurrentUsage >= static_cast<UINT64>(info.Budget * kMemoryWarningFraction);
+	if (nearBudget && !m_videoMemoryWarned) {
+		Log(LogLevel::Warning, { "memory" }, "video memory {:.1f} MiB of {:.1f} MiB OS budget", info.CurrentUsage / 1048576.0, info.Budget / 1048576.0);
+	}
+	m_videoMemoryWarned = nearBudget;
+}
+
+void Renderer::ReportMemory() {
+	std::string report = m_memoryTracker.Report();
+	if (m_adapter) {
+		const std::pair<DXGI_MEMORY_SEGMENT_GROUP, MemoryDomain> segments[] = {
+			{ DXGI_MEMORY_SEGMENT_GROUP_LOCAL, MemoryDomain::Local },
+			{ DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, MemoryDomain::NonLocal },
+		};
+		for (const auto& [group, domain] : segments) {
+			DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+			if (SUCCEEDED(m_adapter->QueryVideoMemoryInfo(0, group, &info))) {
+				report += std::format("  OS {:<10} {:10.2f} of {:.2f} budget, {:.2f} tracked\n", MemoryDomainName(domain),
+					info.CurrentUsage / 1048576.0, info.Budget / 1048576.0, m_memoryTracker.Usage(domain).current / 1048576.0);
+			}
+		}
+	}
+	Log(LogLevel::Info, { "memory", static_cast<int64_t>(fCounter) }, "{}", report);
+}
+
 uint64_t Renderer::alignPow2(uint64_t value, uint64_t alignment) {
 	return (value + alignment - 1) & ~(alignment - 1);
 }
 
+const uint8_t* Renderer::accessorData(const tinygltf::Accessor& accessor) {
+	const auto& gltfBufferView = m_gltfModel.bufferViews[accessor.bufferView];
+	const auto& gltfBuffer = m_gltfModel.buffers[gltfBufferView.buffer];
+	return &gltfBuffer.data[gltfBufferView.byteOffset + accessor.byteOffset];
+}
+
+std::vector<float> Renderer::readFloats(const tinygltf::Accessor& accessor) {
+	const auto& gltfBufferView = m_gltfModel.bufferViews[accessor.bufferView];
+	const uint8_t* data = accessorData(accessor);
+	const size_t stride = accessor.ByteStride(gltfBufferView);
+	const size_t components = tinygltf::GetNumComponentsInType(accessor.type);
+
+	// Rotations and weights may be stored as normalized integers.
+	std::vector<float> values(accessor.count * components);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		const uint8_t* element = data + i * stride;
+		for (size_t c = 0; c < components; ++c) {
+			float& value = values[i * components + c];
+			switch (accessor.componentType) {
+			case TINYGLTF_COMPONENT_TYPE_FLOAT:
+				value = reinterpret_cast<const float*>(element)[c];
+				break;
+			case TINYGLTF_COMPONENT_TYPE_BYTE:
+				value = std::max(reinterpret_cast<const int8_t*>(element)[c] / 127.0f, -1.0f);
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+				value = element[c] / 255.0f;
+				break;
+			case TINYGLTF_COMPONENT_TYPE_SHORT:
+				value = std::max(reinterpret_cast<const int16_t*>(element)[c] / 32767.0f, -1.0f);
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+				value = reinterpret_cast<const uint16_t*>(element)[c] / 65535.0f;
+				break;
+			}
+		}
+	}
+	return values;
+}
+
+// The parameter block of a material, everything but its name and extensions.
+ContentHash Renderer::materialHash(const tinygltf::Material& gltfMaterial) {
+	const auto& gltfPBRMetallicRoughness = gltfMaterial.pbrMetallicRoughness;
+	std::vector<double> block(gltfPBRMetallicRoughness.baseColorFactor.begin(), gltfPBRMetallicRoughness.baseColorFactor.end());
+	block.insert(block.end(), gltfMaterial.emissiveFactor.begin(), gltfMaterial.emissiveFactor.end());
+	block.insert(block.end(), {
+		gltfPBRMetallicRoughness.metallicFactor, gltfPBRMetallicRoughness.roughnessFactor, gltfMaterial.alphaCutoff,
+		gltfMaterial.normalTexture.scale, gltfMaterial.occlusionTexture.strength, static_cast<double>(gltfMaterial.doubleSided),
+		static_cast<double>(gltfPBRMetallicRoughness.baseColorTexture.index), static_cast<double>(gltfPBRMetallicRoughness.baseColorTexture.texCoord),
+		static_cast<double>(gltfPBRMetallicRoughness.metallicRoughnessTexture.index), static_cast<double>(gltfPBRMetallicRoughness.metallicRoughnessTexture.texCoord),
+		static_cast<double>(gltfMaterial.normalTexture.index), static_cast<double>(gltfMaterial.occlusionTexture.index),
+		static_cast<double>(gltfMaterial.emissiveTexture.index) });
+	const uint64_t seed = HashContent(gltfMaterial.alphaMode.data(), gltfMaterial.alphaMode.size()).low;
+	return HashContent(block.data(), block.size() * sizeof(double), seed);
+}
+
+// Scenes put together from several sources often repeat a texture, vertex
+// stream or material under different names. Copies are found by content hash,
+// confirmed byte for byte, and every reference is pointed at the first one, so
+// each is kept in memory, uploaded and bound once.
+void Renderer::deduplicateScene(tinygltf::Model& model, std::vector<std::vector<std::pair<size_t, size_t>>>& uploadRanges, DedupStats& stats) {
+	auto start = high_resolution_clock::now();
+
+	// Keeps only the first copies and returns each old index's new one.
+	auto compact = [](auto& items, const std::vector<int>& first) {
+		std::vector<int> remap(items.size());
+		size_t kept = 0;
+		for (size_t index = 0; index < items.size(); ++index) {
+			if (first[index] != static_cast<int>(index)) {
+				remap[index] = remap[first[index]];
+				continue;
+			}
+			if (kept != index) {
+				items[kept] = std::move(items[index]);
+			}
+			remap[index] = static_cast<int>(kept++);
+		}
+		items.erase(items.begin() + kept, items.end());
+		return remap;
+	};
+
+	// Images compare by decoded pixels, so the same picture stored in two
+	// files or formats still matches.
+	auto& images = model.images;
+	std::vector<ContentHash> imageHashes(images.size());
+	m_threadPool->ParallelFor(images.size(), 1, [&images, &imageHashes](size_t begin, size_t end) {
+		for (size_t imageIndex = begin; imageIndex < end; ++imageIndex) {
+			imageHashes[imageIndex] = HashContent(images[imageIndex].image.data(), images[imageIndex].image.size());
+		}
+	});
+	auto imageFirst = FirstCopies(imageHashes, [&images](int a, int b) {
+		return images[a].width == images[b].width && images[a].height == images[b].height && images[a].component == images[b].component &&
+			images[a].bits == images[b].bits && images[a].image == images[b].image;
+	});
+	for (size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex) {
+		if (imageFirst[imageIndex] != static_cast<int>(imageIndex)) {
+			++stats.images;
+			stats.imageBytes += images[imageIndex].image.size();
+		}
+	}
+	auto imageRemap = compact(images, imageFirst);
+	for (auto& gltfTexture : model.textures) {
+		if (gltfTexture.source >= 0) {
+			gltfTexture.source = imageRemap[gltfTexture.source];
+		}
+	}
+
+	// Textures are only an image and a sampler; materials are pointed at the
+	// first texture pairing the same two so that they can match below.
+	std::vector<int> textureFirst(model.textures.size());
+	std::map<std::pair<int, int>, int> textureKeys;
+	for (size_t textureIndex = 0; textureIndex < model.textures.size(); ++textureIndex) {
+		const auto& gltfTexture = model.textures[textureIndex];
+		textureFirst[textureIndex] = static_cast<int>(textureIndex);
+		if (gltfTexture.extensions.empty()) {
+			textureFirst[textureIndex] = textureKeys.try_emplace({ gltfTexture.source, gltfTexture.sampler }, static_cast<int>(textureIndex)).first->second;
+		}
+	}
+	auto& materials = model.materials;
+	for (auto& gltfMaterial : materials) {
+		for (int* textureIndex : { &gltfMaterial.pbrMetallicRoughness.baseColorTexture.index, &gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index,
+			&gltfMaterial.normalTexture.index, &gltfMaterial.occlusionTexture.index, &gltfMaterial.emissiveTexture.index }) {
+			if (*textureIndex >= 0) {
+				*textureIndex = textureFirst[*textureIndex];
+			}
+		}
+	}
+
+	// Materials hash their parameter block, everything but the name. Matches
+	// are confirmed on the whole material, extensions included.
+	std::vector<ContentHash> materialHashes(materials.size());
+	for (size_t materialIndex = 0; materialIndex < materials.size(); ++materialIndex) {
+		materialHashes[materialIndex] = materialHash(materials[materialIndex]);
+	}
+	auto materialFirst = FirstCopies(materialHashes, [&materials](int a, int b) {
+		tinygltf::Material first = materials[a];
+		tinygltf::Material second = materials[b];
+		first.name.clear();
+		second.name.clear();
+		return first == second;
+	});
+	for (size_t materialIndex = 0; materialIndex < materials.size(); ++materialIndex) {
+		stats.materials += materialFirst[materialIndex] != static_cast<int>(materialIndex);
+	}
+	auto materialRemap = compact(materials, materialFirst);
+	for (auto& gltfMesh : model.meshes) {
+		for (auto& gltfPrimitive : gltfMesh.primitives) {
+			if (gltfPrimitive.material >= 0) {
+				gltfPrimitive.material = materialRemap[gltfPrimitive.material];
+			}
+		}
+	}
+
+	// Buffer views stay in place, since images may still name theirs; the
+	// accessors are pointed at the first copy instead.
+	auto& bufferViews = model.bufferViews;
+	auto viewData = [&model](const tinygltf::BufferView& gltfBufferView) {
+		return model.buffers[gltfBufferView.buffer].data.data() + gltfBufferView.byteOffset;
+	};
+	std::vector<ContentHash> viewHashes(bufferViews.size());
+	m_threadPool->ParallelFor(bufferViews.size(), 1, [&bufferViews, &viewHashes, &viewData](size_t begin, size_t end) {
+		for (size_t viewIndex = begin; viewIndex < end; ++viewIndex) {
+			const auto& gltfBufferView = bufferViews[viewIndex];
+			const uint64_t seed = static_cast<uint64_t>(gltfBufferView.byteStride) << 32 | static_cast<uint32_t>(gltfBufferView.target);
+			viewHashes[viewIndex] = HashContent(viewData(gltfBufferView), gltfBufferView.byteLength, seed);
+		}
+	});
+	auto viewFirst = FirstCopies(viewHashes, [&bufferViews, &viewData](int a, int b) {
+		return bufferViews[a].byteLength == bufferViews[b].byteLength && bufferViews[a].byteStride == bufferViews[b].byteStride &&
+			bufferViews[a].target == bufferViews[b].target && memcmp(viewData(bufferViews[a]), viewData(bufferViews[b]), bufferViews[a].byteLength) == 0;
+	});
+	// Which views accessors read before and after pointing them at the first
+	// copies, to tell the duplicates apart from views nothing reads.
+	std::vector<bool> viewRead(bufferViews.size());
+	std::vector<bool> viewReferenced(bufferViews.size());
+	auto remapView = [&viewFirst, &viewRead, &viewReferenced](int& viewIndex) {
+		if (viewIndex >= 0) {
+			viewRead[viewIndex] = true;
+			viewIndex = viewFirst[viewIndex];
+			viewReferenced[viewIndex] = true;
+		}
+	};
+	for (auto& gltfAccessor : model.accessors) {
+		remapView(gltfAccessor.bufferView);
+		if (gltfAccessor.sparse.isSparse) {
+			remapView(gltfAccessor.sparse.indices.bufferView);
+			remapView(gltfAccessor.sparse.values.bufferView);
+		}
+	}
+	for (size_t viewIndex = 0; viewIndex < bufferViews.size(); ++viewIndex) {
+		if (viewFirst[viewIndex] != static_cast<int>(viewIndex)) {
+			++stats.bufferViews;
+			stats.bufferViewBytes += bufferViews[viewIndex].byteLength;
+		}
+	}
+
+	// Only ranges an accessor still reads are uploaded. That leaves out the
+	// duplicates as well as views that only held encoded images. Ranges
+	// overlap, so bytes are counted once the ranges are merged.
+	auto readRanges = [&model, &bufferViews](const std::vector<bool>& read, std::vector<std::vector<std::pair<size_t, size_t>>>& bufferRanges) {
+		bufferRanges.assign(model.buffers.size(), {});
+		for (size_t viewIndex = 0; viewIndex < bufferViews.size(); ++viewIndex) {
+			if (read[viewIndex]) {
+				const auto& gltfBufferView = bufferViews[viewIndex];
+				bufferRanges[gltfBufferView.buffer].push_back({ gltfBufferView.byteOffset, gltfBufferView.byteOffset + gltfBufferView.byteLength });
+			}
+		}
+		uint64_t bytes = 0;
+		for (auto& ranges : bufferRanges) {
+			std::sort(ranges.begin(), ranges.end());
+			size_t merged = 0;
+			for (const auto& range : ranges) {
+				if (merged > 0 && range.first <= ranges[merged - 1].second) {
+					ranges[merged - 1].second = std::max(ranges[merged - 1].second, range.second);
+				}
+				else {
+					ranges[merged++] = range;
+				}
+			}
+			ranges.resize(merged);
+			for (const auto& [begin, end] : ranges) {
+				bytes += end - begin;
+			}
+		}
+		return bytes;
+	};
+	for (const auto& gltfBuffer : model.buffers) {
+		stats.bufferBytes += gltfBuffer.data.size();
+	}
+	std::vector<std::vector<std::pair<size_t, size_t>>> readBeforeDedup;
+	stats.readBufferBytes = readRanges(viewRead, readBeforeDedup);
+	stats.uploadBufferBytes = readRanges(viewReferenced, uploadRanges);
+	stats.hashMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+
+	Log(LogLevel::Info, { "load" }, "dedup in {:.1f} ms: {} duplicate images ({:.1f} MiB), {} buffer views ({:.1f} MiB), {} materials; uploading {:.1f} of {:.1f} MiB of buffers, "
+		"{:.1f} MiB left out as duplicates and {:.1f} MiB as unreferenced",
+		stats.hashMicroseconds / 1000.0, stats.images, stats.imageBytes / 1048576.0, stats.bufferViews, stats.bufferViewBytes / 1048576.0, stats.materials,
+		stats.uploadBufferBytes / 1048576.0, stats.bufferBytes / 1048576.0, (stats.readBufferBytes - stats.uploadBufferBytes) / 1048576.0,
+		(stats.bufferBytes - stats.readBufferBytes) / 1048576.0);
+}
+
+void Renderer::loadAnimations() {
+	for (const auto& gltfAnimation : m_gltfModel.animations) {
+		uint32_t animation = m_animations.AddAnimation();
+		for (const auto& gltfChannel : gltfAnimation.channels) {
+			if (gltfChannel.target_node < 0 || gltfChannel.sampler < 0) {
+				continue;
+			}
+			const auto& gltfSampler = gltfAnimation.samplers[gltfChannel.sampler];
+			AnimationPath path;
+			if (gltfChannel.target_path == "translation") {
+				path = AnimationPath::Translation;
+			}
+			else if (gltfChannel.target_path == "rotation") {
+				path = AnimationPath::Rotation;
+			}
+			else if (gltfChannel.target_path == "scale") {
+				path = AnimationPath::Scale;
+			}
+			else if (gltfChannel.target_path == "weights") {
+				path = AnimationPath::Weights;
+			}
+			else {
+				continue;
+			}
+			Interpolation interpolation = Interpolation::Linear;
+			if (gltfSampler.interpolation == "STEP") {
+				interpolation = Interpolation::Step;
+			}
+			else if (gltfSampler.interpolation == "CUBICSPLINE") {
+				interpolation = Interpolation::CubicSpline;
+			}
+
+			const auto& inputAccessor = m_gltfModel.accessors[gltfSampler.input];
+			const auto& outputAccessor = m_gltfModel.accessors[gltfSampler.output];
+			std::vector<float> times = readFloats(inputAccessor);
+			std::vector<float> values = readFloats(outputAccessor);
+			uint32_t keyCount = static_cast<uint32_t>(times.size());
+			uint32_t keyValues = keyCount * (interpolation == Interpolation::CubicSpline ? 3 : 1);
+			if (keyCount == 0 || values.size() % keyValues != 0) {
+				continue;
+			}
+			uint32_t components = static_cast<uint32_t>(values.size() / keyValues);
+			m_animations.AddChannel(animation, static_cast<uint32_t>(gltfChannel.target_node), path, interpolation, times.data(), keyCount, values.data(), components);
+		}
+	}
+	if (m_animation >= static_cast<int>(m_animations.AnimationCount())) {
+		m_animation = -1;
+	}
+}
+
+void Renderer::updateNode(uint64_t nodeIndex, FXMMATRIX parent) {
+	auto& node = m_nodes[nodeIndex];
+	XMMATRIX local;
+	if (node.hasMatrix) {
+		local = XMLoadFloat4x4(&node.matrix);
+	}
+	else {
+		const auto& transform = m_nodeTransforms[nodeIndex];
+		local = XMMatrixScalingFromVector(XMLoadFloat3(&transform.scale)) *
+			XMMatrixRotationQuaternion(XMLoadFloat4(&transform.rotation)) *
+			XMMatrixTranslationFromVector(XMLoadFloat3(&transform.translation));
+	}
+	XMMATRIX world = XMMatrixMultiply(local, parent);
+	XMStoreFloat4x4(&node.M, world);
+
+	for (auto childNodeIndex : m_scene.Nodes()[nodeIndex].children) {
+		updateNode(childNodeIndex, world);
+	}
+}
+
+void Renderer::updateNodes() {
+	for (auto nodeIndex : m_scene.Roots()) {
+		updateNode(nodeIndex, XMMatrixIdentity());
+	}
+}
+
+std::vector<uint16_t> Renderer::readJoints(const tinygltf::Accessor& accessor) {
+	const auto& gltfBufferView = m_gltfModel.bufferViews[accessor.bufferView];
+	const uint8_t* data = accessorData(accessor);
+	const size_t stride = accessor.ByteStride(gltfBufferView);
+
+	std::vector<uint16_t> joints(accessor.count * 4);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		for (size_t c = 0; c < 4; ++c) {
+			if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+				joints[i * 4 + c] = data[i * stride + c];
+			}
+			else {
+				joints[i * 4 + c] = reinterpret_cast<const uint16_t*>(data + i * stride)[c];
+			}
+		}
+	}
+	return joints;
+}
+
+// Skinned and morphed primitives are deformed on the CPU into per node upload
+// buffers, which replace their POSITION, NORMAL and TANGENT vertex buffers.
+// Each buffer has a copy per frame in flight, so a frame deforms into one
+// while the draws of the frame before still read another.
+void Renderer::loadDeformations() {
+	for (const auto& gltfSkin : m_gltfModel.skins) {
+		Skin skin;
+		skin.joints.assign(gltfSkin.joints.begin(), gltfSkin.joints.end());
+		skin.inverseBindMatrices.resize(skin.joints.size());
+		for (auto& matrix : skin.inverseBindMatrices) {
+			XMStoreFloat4x4(&matrix, XMMatrixIdentity());
+		}
+		if (gltfSkin.inverseBindMatrices >= 0) {
+			auto values = readFloats(m_gltfModel.accessors[gltfSkin.inverseBindMatrices]);
+			memcpy(skin.inverseBindMatrices.data(), values.data(), std::min(values.size() * sizeof(float), skin.inverseBindMatrices.size() * sizeof(XMFLOAT4X4)));
+		}
+		m_skins.push_back(std::move(skin));
+	}
+
+	auto readVectors = [this](const std::map<std::string, int>& attributes, const char* name, uint32_t vertexCount, auto& vectors) {
+		auto attribute = attributes.find(name);
+		if (attribute == attributes.end()) {
+			return;
+		}
+		auto values = readFloats(m_gltfModel.accessors[attribute->second]);
+		vectors.resize(vertexCount);
+		memcpy(vectors.data(), values.data(), std::min(values.size() * sizeof(float), vectors.size() * sizeof(vectors[0])));
+	};
+
+	std::vector<std::vector<uint32_t>> deformableMeshIndices(m_gltfModel.meshes.size());
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		const auto& gltfMesh = m_gltfModel.meshes[meshIndex];
+		deformableMeshIndices[meshIndex].assign(gltfMesh.primitives.size(), UINT32_MAX);
+		for (size_t primitiveIndex = 0; primitiveIndex < gltfMesh.primitives.size(); ++primitiveIndex) {
+			const auto& gltfPrimitive = gltfMesh.primitives[primitiveIndex];
+			auto joints = gltfPrimitive.attributes.find("JOINTS_0");
+			auto weights = gltfPrimitive.attributes.find("WEIGHTS_0");
+			bool skinned = joints != gltfPrimitive.attributes.end() && weights != gltfPrimitive.attributes.end();
+			if ((!skinned && gltfPrimitive.targets.empty()) || !gltfPrimitive.attributes.count("POSITION")) {
+				continue;
+			}
+
+			DeformableMesh mesh;
+			mesh.vertexCount = m_meshes[meshIndex].primitives[primitiveIndex].vertexCount;
+			readVectors(gltfPrimitive.attributes, "POSITION", mesh.vertexCount, mesh.positions);
+			readVectors(gltfPrimitive.attributes, "NORMAL", mesh.vertexCount, mesh.normals);
+			readVectors(gltfPrimitive.attributes, "TANGENT", mesh.vertexCount, mesh.tangents);
+			if (skinned) {
+				mesh.joints = readJoints(m_gltfModel.accessors[joints->second]);
+				readVectors(gltfPrimitive.attributes, "WEIGHTS_0", mesh.vertexCount, mesh.weights);
+				mesh.joints.resize(static_cast<size_t>(mesh.vertexCount) * 4);
+				if (!mesh.joints.empty()) {
+					mesh.maxJoint = *std::max_element(mesh.joints.begin(), mesh.joints.end());
+				}
+			}
+			for (const auto& gltfTarget : gltfPrimitive.targets) {
+				MorphTarget target;
+				readVectors(gltfTarget, "POSITION", mesh.vertexCount, target.positions);
+				readVectors(gltfTarget, "NORMAL", mesh.vertexCount, target.normals);
+				readVectors(gltfTarget, "TANGENT", mesh.vertexCount, target.tangents);
+				mesh.targets.push_back(std::move(target));
+			}
+			deformableMeshIndices[meshIndex][primitiveIndex] = static_cast<uint32_t>(m_deformableMeshes.size());
+			m_deformableMeshes.push_back(std::move(mesh));
+		}
+	}
+
+	constexpr uint32_t kDeformChunkSize = 4096;
+	for (size_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex) {
+		auto& node = m_nodes[nodeIndex];
+		const auto& gltfNode = m_gltfModel.nodes[nodeIndex];
+		node.skin = gltfNode.skin < static_cast<int>(m_skins.size()) ? gltfNode.skin : -1;
+		node.deformedPrimitives = -1;
+		// Joint indices past the end of the skin would read past the node's
+		// joint matrices; such a node is drawn unskinned.
+		if (node.skin >= 0 && gltfNode.mesh >= 0) {
+			for (uint32_t meshIndex : deformableMeshIndices[gltfNode.mesh]) {
+				if (meshIndex != UINT32_MAX && !m_deformableMeshes[meshIndex].joints.empty() &&
+					m_deformableMeshes[meshIndex].maxJoint >= m_skins[node.skin].joints.size()) {
+					Log(LogLevel::Warning, { "deform" }, "Node {} uses joint {} of skin {}, which has {} joints; ignoring the skin",
+						nodeIndex, m_deformableMeshes[meshIndex].maxJoint, node.skin, m_skins[node.skin].joints.size());
+					node.skin = -1;
+					break;
+				}
+			}
+		}
+		if (node.skin >= 0) {
+			node.jointOffset = static_cast<uint32_t>(m_jointMatrices.size());
+			m_jointMatrices.resize(m_jointMatrices.size() + m_skins[node.skin].joints.size());
+		}
+		if (gltfNode.mesh < 0) {
+			continue;
+		}
+		const auto& meshIndices = deformableMeshIndices[gltfNode.mesh];
+		if (std::all_of(meshIndices.begin(), meshIndices.end(), [](uint32_t index) { return index == UINT32_MAX; })) {
+			continue;
+		}
+
+		node.deformedPrimitives = static_cast<int32_t>(m_deformedPrimitives.size());
+		for (size_t primitiveIndex = 0; primitiveIndex < meshIndices.size(); ++primitiveIndex) {
+			DeformedPrimitive deformed = {};
+			deformed.nodeIndex = nodeIndex;
+			deformed.mesh = meshIndices[primitiveIndex];
+			if (deformed.mesh == UINT32_MAX) {
+				m_deformedPrimitives.push_back(std::move(deformed));
+				continue;
+			}
+			const auto& mesh = m_deformableMeshes[deformed.mesh];
+			const auto& primitive = m_meshes[gltfNode.mesh].primitives[primitiveIndex];
+			const UINT64 positionSize = static_cast<UINT64>(mesh.vertexCount) * sizeof(XMFLOAT3);
+			const UINT64 normalSize = mesh.normals.empty() ? 0 : static_cast<UINT64>(mesh.vertexCount) * sizeof(XMFLOAT3);
+			const UINT64 tangentSize = mesh.tangents.empty() ? 0 : static_cast<UINT64>(mesh.vertexCount) * sizeof(XMFLOAT4);
+			const UINT64 copySize = positionSize + normalSize + tangentSize;
+
+			D3D12_HEAP_PROPERTIES heapProperties = {};
+			heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+			heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+			heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+			D3D12_RESOURCE_DESC resourceDesc = {};
+			resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			resourceDesc.Width = copySize * FrameCount;
+			resourceDesc.Height = 1;
+			resourceDesc.DepthOrArraySize = 1;
+			resourceDesc.MipLevels = 1;
+			resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+			resourceDesc.SampleDesc = { 1, 0 };
+			resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MemoryCategory::Geometry, m_memoryScene, deformed.buffer); FAILED(hr)) {
+				Log(LogLevel::Error, { "deform", -1, static_cast<uint32_t>(hr) }, "Failed to create deformed vertex buffer");
+				deformed.mesh = UINT32_MAX;
+				m_deformedPrimitives.push_back(std::move(deformed));
+				continue;
+			}
+			void* data;
+			if (HRESULT hr = deformed.buffer->Map(0, nullptr, &data); FAILED(hr)) {
+				Log(LogLevel::Error, { "deform", -1, static_cast<uint32_t>(hr) }, "Failed to map deformed vertex buffer");
+				deformed.mesh = UINT32_MAX;
+				m_deformedPrimitives.push_back(std::move(deformed));
+				continue;
+			}
+			for (UINT copy = 0; copy < FrameCount; ++copy) {
+				auto* bytes = static_cast<uint8_t*>(data) + copy * copySize;
+				auto& streams = deformed.streams[copy];
+				streams.positions = reinterpret_cast<XMFLOAT3*>(bytes);
+				streams.normals = normalSize ? reinterpret_cast<XMFLOAT3*>(bytes + positionSize) : nullptr;
+				streams.tangents = tangentSize ? reinterpret_cast<XMFLOAT4*>(bytes + positionSize + normalSize) : nullptr;
+
+				const D3D12_GPU_VIRTUAL_ADDRESS address = deformed.buffer->GetGPUVirtualAddress() + copy * copySize;
+				for (const auto& attribute : primitive.attributes) {
+					D3D12_VERTEX_BUFFER_VIEW view = attribute.vertexBufferView;
+					if (attribute.name == "POSITION") {
+						view = { address, static_cast<UINT>(positionSize), sizeof(XMFLOAT3) };
+					}
+					else if (attribute.name == "NORMAL" && normalSize) {
+						view = { address + positionSize, static_cast<UINT>(normalSize), sizeof(XMFLOAT3) };
+					}
+					else if (attribute.name == "TANGENT" && tangentSize) {
+						view = { address + positionSize + normalSize, static_cast<UINT>(tangentSize), sizeof(XMFLOAT4) };
+					}
+					deformed.vertexBufferViews[copy].push_back(view);
+				}
+			}
+
+			// Vertex ranges are the unit of parallel work, so one large character
+			// spreads over every thread just like many small ones.
+			for (uint32_t first = 0; first < mesh.vertexCount; first += kDeformChunkSize) {
+				m_deformChunks.push_back({ static_cast<uint32_t>(m_deformedPrimitives.size()), first, std::min(kDeformChunkSize, mesh.vertexCount - first) });
+			}
+			m_deformedPrimitives.push_back(std::move(deformed));
+		}
+	}
+
+	uint64_t bindPoseBytes = 0;
+	for (const auto& mesh : m_deformableMeshes) {
+		bindPoseBytes += mesh.positions.size() * sizeof(XMFLOAT3) + mesh.normals.size() * sizeof(XMFLOAT3) + mesh.tangents.size() * sizeof(XMFLOAT4) +
+			mesh.joints.size() * sizeof(uint16_t) + mesh.weights.size() * sizeof(XMFLOAT4);
+		for (const auto& target : mesh.targets) {
+			bindPoseBytes += (target.positions.size() + target.normals.size() + target.tangents.size()) * sizeof(XMFLOAT3);
+		}
+	}
+	if (bindPoseBytes) {
+		m_memoryTracker.Add({ m_memoryScene, MemoryCategory::Geometry, MemoryDomain::Cpu, bindPoseBytes });
+	}
+}
+
+void Renderer::deformMeshes() {
+	auto start = high_resolution_clock::now();
+
+	// glTF skins place vertices in world space through the joints; the node's
+	// own world matrix is applied again in the vertex shader, so it is divided out.
+	for (auto& node : m_nodes) {
+		if (node.skin < 0) {
+			continue;
+		}
+		const auto& skin = m_skins[node.skin];
+		XMMATRIX inverseWorld = XMMatrixInverse(nullptr, XMLoadFloat4x4(&node.M));
+		for (size_t j = 0; j < skin.joints.size(); ++j) {
+			XMMATRIX joint = XMLoadFloat4x4(&skin.inverseBindMatrices[j]) * XMLoadFloat4x4(&m_nodes[skin.joints[j]].M) * inverseWorld;
+			XMStoreFloat4x4(&m_jointMatrices[node.jointOffset + j], joint);
+		}
+	}
+
+	m_threadPool->ParallelFor(m_deformChunks.size(), 1, [this](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const auto& chunk = m_deformChunks[c];
+			const auto& deformed = m_deformedPrimitives[chunk.deformedPrimitive];
+			const auto& node = m_nodes[deformed.nodeIndex];
+			const auto& weights = m_nodeWeights[deformed.nodeIndex];
+			const XMFLOAT4X4* jointMatrices = node.skin >= 0 ? &m_jointMatrices[node.jointOffset] : nullptr;
+			DeformVertices(m_deformableMeshes[deformed.mesh], jointMatrices, weights.data(), static_cast<uint32_t>(weights.size()), chunk.first, chunk.count,
+				deformed.streams[m_deformedCopy]);
+		}
+	});
+
+	m_deformedVertices = 0;
+	for (const auto& chunk : m_deformChunks) {
+		m_deformedVertices += chunk.count;
+	}
+	m_deformMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+}
+
+// The tracer gets its own copy of every triangle list: one bottom level BVH per
+// glTF mesh, instanced by the nodes each frame. Textures are read from the
+// scene's decoded images, whose pixels are kept while tracing.
+void Renderer::loadRayTracing() {
+	auto start = high_resolution_clock::now();
+
+	const auto& images = m_scene.Images();
+	std::vector<int32_t> textures(images.size(), -1);
+	for (size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex) {
+		const auto& image = images[imageIndex];
+		if (image.components == 4 && image.bits == 8 && !image.pixels.empty()) {
+			textures[imageIndex] = m_rayTracer->AddTexture(image.pixels.data(), image.width, image.height);
+		}
+	}
+	for (const auto& gltfMaterial : m_gltfModel.materials) {
+		const auto& gltfPBRMetallicRoughness = gltfMaterial.pbrMetallicRoughness;
+		RayTracingMaterial material;
+		material.baseColor = {
+			static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[0]),
+			static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[1]),
+			static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[2]),
+			static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[3]) };
+		if (gltfPBRMetallicRoughness.baseColorTexture.index >= 0) {
+			int source = m_gltfModel.textures[gltfPBRMetallicRoughness.baseColorTexture.index].source;
+			if (source >= 0) {
+				material.baseColorTexture = textures[source];
+			}
+		}
+		m_rayTracer->AddMaterial(material);
+	}
+
+	uint64_t triangleCount = 0;
+	m_rayTracingMeshes.resize(m_gltfModel.meshes.size());
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		std::vector<RayTracingPrimitive> primitives;
+		for (const auto& gltfPrimitive : m_gltfModel.meshes[meshIndex].primitives) {
+			auto positionAttribute = gltfPrimitive.attributes.find("POSITION");
+			if (gltfPrimitive.mode != TINYGLTF_MODE_TRIANGLES || positionAttribute == gltfPrimitive.attributes.end()) {
+				continue;
+			}
+			RayTracingPrimitive primitive;
+			auto positions = readFloats(m_gltfModel.accessors[positionAttribute->second]);
+			primitive.positions.resize(positions.size() / 3);
+			memcpy(primitive.positions.data(), positions.data(), primitive.positions.size() * sizeof(XMFLOAT3));
+			auto texcoordAttribute = gltfPrimitive.attributes.find("TEXCOORD_0");
+			if (texcoordAttribute != gltfPrimitive.attributes.end()) {
+				auto texcoords = readFloats(m_gltfModel.accessors[texcoordAttribute->second]);
+				primitive.texcoords.resize(texcoords.size() / 2);
+				memcpy(primitive.texcoords.data(), texcoords.data(), primitive.texcoords.size() * sizeof(XMFLOAT2));
+			}
+			if (gltfPrimitive.indices >= 0) {
+				primitive.indices = readIndices(m_gltfModel.accessors[gltfPrimitive.indices]);
+			}
+			else {
+				primitive.indices.resize(primitive.positions.size());
+				std::iota(primitive.indices.begin(), primitive.indices.end(), 0u);
+			}
+			if (gltfPrimitive.material >= 0) {
+				primitive.material = static_cast<uint32_t>(gltfPrimitive.material);
+			}
+			primitives.push_back(std::move(primitive));
+		}
+		m_rayTracingMeshes[meshIndex] = m_rayTracer->AddMesh(primitives);
+		triangleCount += m_rayTracer->MeshTriangleCount(m_rayTracingMeshes[meshIndex]);
+	}
+
+	Log(LogLevel::Info, { "ray tracing" }, "built {} ray tracing meshes with {} triangles in {:.1f} ms on {} threads",
+		m_rayTracingMeshes.size(), triangleCount, duration<double_t, std::milli>(high_resolution_clock::now() - start).count(), m_threadPool->ThreadCount());
+
+	m_rayTracingMemory = { m_memoryScene, MemoryCategory::RayTracing, MemoryDomain::Cpu, m_rayTracer->ByteSize() };
+	m_memoryTracker.Add(m_rayTracingMemory);
+}
+
+// Instances follow the same scene walk as DrawNode, with this frame's world matrices.
+void Renderer::updateRayTracingInstances() {
+	auto start = high_resolution_clock::now();
+	m_rayTracer->ClearInstances();
+	const auto roots = m_scene.Roots();
+	std::vector<uint32_t> pending(roots.begin(), roots.end());
+	while (!pending.empty()) {
+		uint32_t nodeIndex = pending.back();
+		pending.pop_back();
+		const auto& sceneNode = m_scene.Nodes()[nodeIndex];
+		if (sceneNode.mesh >= 0) {
+			m_rayTracer->AddInstance(m_rayTracingMeshes[sceneNode.mesh], m_nodes[nodeIndex].M);
+		}
+		pending.insert(pending.end(), sceneNode.children.begin(), sceneNode.children.end());
+	}
+	m_rayTracer->BuildInstances();
+	m_memoryTracker.Resize(m_rayTracingMemory, m_rayTracer->ByteSize());
+	m_instanceBuildMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+}
+
+// Each textured primitive in view asks for the mip matching its closest point:
+// texture coordinates per world unit over pixels per world unit at that distance.
+void Renderer::requestTextureMips() {
+	m_textureResidency.BeginFrame();
+	CullingView view = BuildCullingView(XMLoadFloat4x4(&m_camera.VP), XMLoadFloat3(&m_cameraPosition));
+	const auto roots = m_scene.Roots();
+	std::vector<uint32_t> pending(roots.begin(), roots.end());
+	while (!pending.empty()) {
+		uint32_t nodeIndex = pending.back();
+		pending.pop_back();
+		const auto& sceneNode = m_scene.Nodes()[nodeIndex];
+		pending.insert(pending.end(), sceneNode.children.begin(), sceneNode.children.end());
+		if (sceneNode.mesh < 0) {
+			continue;
+		}
+		XMMATRIX M = XMLoadFloat4x4(&m_nodes[nodeIndex].M);
+		float scale = std::max({
+			XMVectorGetX(XMVector3Length(M.r[0])),
+			XMVectorGetX(XMVector3Length(M.r[1])),
+			XMVectorGetX(XMVector3Length(M.r[2])) });
+		for (const auto& primitive : m_meshes[sceneNode.mesh].primitives) {
+			if (!primitive.material || primitive.textureDensity <= 0.0f || scale <= 0.0f) {
+				continue;
+			}
+			XMVECTOR center = XMVector3Transform(XMLoadFloat3(&primitive.boundsCenter), M);
+			float radius = primitive.boundsRadius * scale;
+			bool visible = true;
+			for (const auto& plane : view.planes) {
+				visible = visible && XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), center)) >= -radius;
+			}
+			if (!visible) {
+				continue;
+			}
+			float distance = std::max(XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&view.cameraPosition))) - radius, 0.01f);
+			float uvPerPixel = primitive.textureDensity / scale * distance / m_lodProjectionScale;
+			for (int32_t source : primitive.material->textureSources) {
+				if (source >= 0 && !m_lostTextureSources[source]) {
+					m_textureResidency.RequestFootprint(static_cast<uint32_t>(source), uvPerPixel);
+				}
+			}
+		}
+	}
+}
+
+// Runs at the start of a frame, while both queues are idle: finished streams
+// and evictions each rebuild their texture with the new mip range, keeping the
+// mips both ranges share with a GPU copy, and the material SRVs are rewritten.
+void Renderer::updateTextureResidency() {
+	auto start = high_resolution_clock::now();
+	requestTextureMips();
+
+	struct Rebuild {
+		uint32_t texture;
+		uint32_t firstMip;
+		// Mips [firstMip, the texture's current first mip), empty for evictions.
+		std::vector<TextureMipLevel> levels;
+	};
+	std::vector<Rebuild> rebuilds;
+	std::vector<TextureStreamResult> results;
+	m_textureStreamer.TakeCompleted(results);
+	for (auto& result : results) {
+		// Streams submitted before a reload changed the image hold the old
+		// pixels; they are dropped and the texture streams again from the new.
+		// A texture has one stream at a time, so the next is not stale.
+		if (m_staleTextureStreams[result.texture]) {
+			m_staleTextureStreams[result.texture] = 0;
+			m_textureResidency.Cancel(result.texture);
+			continue;
+		}
+		if (result.levels.empty()) {
+			Log(LogLevel::Warning, { "streaming" }, "Failed to reload image {}, its texture stays at mip {}", result.texture, m_textureResidentMips[result.texture]);
+			m_textureResidency.Cancel(result.texture);
+			m_lostTextureSources[result.texture] = 1;
+			continue;
+		}
+		m_textureResidency.Complete(result.texture);
+		rebuilds.push_back({ result.texture, result.firstMip, std::move(result.levels) });
+	}
+	m_textureResidency.Update(m_textureStreams, m_textureEvictions);
+	for (const auto& eviction : m_textureEvictions) {
+		// A stream that just landed may be evicted straight away; its texture
+		// is then rebuilt once, with only the mips that are still wanted.
+		auto streamed = std::find_if(rebuilds.begin(), rebuilds.end(), [&](const Rebuild& rebuild) { return rebuild.texture == eviction.texture; });
+		if (streamed == rebuilds.end()) {
+			rebuilds.push_back({ eviction.texture, eviction.mip, {} });
+			continue;
+		}
+		size_t dropped = std::min<size_t>(streamed->levels.size(), eviction.mip - streamed->firstMip);
+		streamed->levels.erase(streamed->levels.begin(), streamed->levels.begin() + dropped);
+		streamed->firstMip = eviction.mip;
+	}
+	for (const auto& stream : m_textureStreams) {
+		if (m_lostTextureSources[stream.texture]) {
+			m_textureResidency.Cancel(stream.texture);
+			continue;
+		}
+		const auto& image = m_scene.Images()[stream.texture];
+		TextureStreamJob job = { stream.texture, stream.mip, m_textureResidentMips[stream.texture], image.pixels.data(), image.width, image.height, 4 };
+		if (streamsFromSource(stream.texture)) {
+			job.source = nullptr;
+			job.load = [path = image.sourcePath, bytes = image.sourceBytes, width = image.width, height = image.height, queueDepth = m_assetQueueDepth](std::vector<uint8_t>& pixels) {
+				return reloadImage(path, bytes.get(), width, height, queueDepth, pixels);
+			};
+		}
+		m_textureStreamer.Submit(job);
+	}
+	if (rebuilds.empty()) {
+		// Cancelled streams leave their textures free to release as well.
+		if (!results.empty()) {
+			releaseSceneSource();
+		}
+		m_textureResidencyMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+		return;
+	}
+
+	// Draws still in flight may sample the textures and descriptors replaced here.
+	m_frameScheduler.WaitIdle();
+	// Replaced textures are released once the copies are done.
+	std::vector<ComPtr<ID3D12Resource>> retired;
+	for (const auto& rebuild : rebuilds) {
+		const auto& image = m_scene.Images()[rebuild.texture];
+		const uint32_t mipCount = m_textureResidency.MipCount(rebuild.texture);
+		const uint32_t oldFirstMip = m_textureResidentMips[rebuild.texture];
+		ComPtr<ID3D12Resource> oldTexture = m_textures[rebuild.texture];
+
+		D3D12_HEAP_PROPERTIES heapProperties = {};
+		heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+		D3D12_RESOURCE_DESC resourceDesc = {};
+		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+		resourceDesc.Alignment = 0;
+		resourceDesc.Width = std::max(1u, image.width >> rebuild.firstMip);
+		resourceDesc.Height = std::max(1u, image.height >> rebuild.firstMip);
+		resourceDesc.DepthOrArraySize = 1;
+		resourceDesc.MipLevels = static_cast<UINT16>(mipCount - rebuild.firstMip);
+		resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		resourceDesc.SampleDesc = { 1, 0 };
+		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+		ComPtr<ID3D12Resource> texture;
+		if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, MemoryCategory::Textures, m_memoryScene, texture); FAILED(hr)) {
+			Log(LogLevel::Error, { "streaming", -1, static_cast<uint32_t>(hr) }, "Failed to create streamed texture");
+			continue;
+		}
+
+		for (uint32_t mip = std::max(rebuild.firstMip, oldFirstMip); mip < mipCount; ++mip) {
+			m_uploadManager.CopySubresource(texture.Get(), mip - rebuild.firstMip, oldTexture.Get(), mip - oldFirstMip);
+		}
+
+		std::vector<UploadSubresource> sources;
+		for (const auto& level : rebuild.levels) {
+			sources.push_back({ level.pixels.data(), static_cast<size_t>(level.width) * 4 });
+		}
+		m_uploadManager.UploadTexture(texture.Get(), 0, static_cast<UINT>(sources.size()), sources.data());
+
+		retired.push_back(oldTexture);
+		m_textures[rebuild.texture] = texture;
+		m_textureResidentMips[rebuild.texture] = rebuild.firstMip;
+	}
+	m_uploadManager.WaitIdle();
+
+	for (const auto& rebuild : rebuilds) {
+		for (auto descriptor : m_textureDescriptors[rebuild.texture]) {
+			m_device->CreateShaderResourceView(m_textures[rebuild.texture].Get(), nullptr, descriptor);
+		}
+	}
+	// Textures whose streams just landed may no longer need their pixels.
+	releaseSceneSource();
+	m_textureResidencyMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+}
+
+std::vector<uint32_t> Renderer::readIndices(const tinygltf::Accessor& accessor) {
+	const auto& gltfBufferView = m_gltfModel.bufferViews[accessor.bufferView];
+	const uint8_t* data = accessorData(accessor);
+	const size_t stride = accessor.ByteStride(gltfBufferView);
+
+	std::vector<uint32_t> indices(accessor.count);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		switch (accessor.componentType) {
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			indices[i] = data[i * stride];
+			break;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+			indices[i] = *reinterpret_cast<const uint16_t*>(data + i * stride);
+			break;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+			indices[i] = *reinterpret_cast<const uint32_t*>(data + i * stride);
+			break;
+		}
+	}
+	return indices;
+}
+
+// Init is a graph of tasks on the worker threads. Device setup gates
+// everything that creates resources, while decoding work such as tail mips and
+// LOD chains, and shader compiles, start right away. Uploads share one staging
+// ring, so they are chained in a fixed order; everything that calls
+// ThreadPool::ParallelFor runs after the graph.
 void Renderer::Init() {
+	TaskGraph graph;
+	const uint32_t device = graph.Add("device", [this] { initDevice(); });
+	for (UINT slot = 0; slot < FrameCount; ++slot) {
+		graph.Add(std::format("render target {}", slot), [this, slot] { initRenderTarget(slot); }, { device });
+	}
+
+	// Uploads go through the staging ring in batches. Each phase flushes what it
+	// recorded, so the copy queue works on it while the next phase records.
+	const uint32_t uploadBuffersTask = graph.Add("upload buffers", [this] { uploadBuffers(); }, { device });
+
+	// Textures start with just their tail mips, built from the decoded images.
+	// Finer mips are streamed in once frames show they are needed.
+	const auto& images = m_scene.Images();
+	std::vector<std::vector<TextureMipLevel>> tailLevels(images.size());
+	for (const auto& image : images) {
+		uint32_t texture = m_textureResidency.AddTexture(image.width, image.height, 4);
+		m_textureResidentMips.push_back(m_textureResidency.TailMip(texture));
+	}
+	m_textureDescriptors.resize(images.size());
+	m_staleTextureStreams.resize(images.size());
+	m_lostTextureSources.resize(images.size());
+	const uint32_t uploadTexturesTask = graph.Add("upload textures", [this, &tailLevels] { uploadTextures(tailLevels); }, { uploadBuffersTask });
+	for (size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex) {
+		const uint32_t mips = graph.Add(std::format("tail mips image {}", imageIndex), [this, &tailLevels, imageIndex] {
+			const auto& image = m_scene.Images()[imageIndex];
+			uint32_t texture = static_cast<uint32_t>(imageIndex);
+			BuildTextureMips(image.pixels.data(), image.width, image.height, 4, m_textureResidency.TailMip(texture), m_textureResidency.MipCount(texture), tailLevels[imageIndex]);
+		});
+		graph.Depend(uploadTexturesTask, mips);
+	}
+
+	// LOD chains are built per mesh and uploaded together once all are done.
+	m_meshes.resize(m_gltfModel.meshes.size());
+	std::vector<std::vector<std::vector<uint32_t>>> lodIndices(m_gltfModel.meshes.size());
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		m_meshes[meshIndex].primitives.resize(m_gltfModel.meshes[meshIndex].primitives.size());
+		lodIndices[meshIndex].resize(m_gltfModel.meshes[meshIndex].primitives.size());
+	}
+	const uint32_t uploadLodsTask = graph.Add("upload lod indices", [this, &lodIndices] {
+		for (size_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex) {
+			uploadLodIndices(meshIndex, lodIndices[meshIndex]);
+		}
+		m_uploadManager.Flush();
+	}, { uploadTexturesTask });
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		const uint32_t lods = graph.Add(std::format("lods mesh {}", meshIndex), [this, &lodIndices, meshIndex] { buildLods(meshIndex, lodIndices[meshIndex]); });
+		graph.Depend(uploadLodsTask, lods);
+	}
+
+	const uint32_t samplers = graph.Add("samplers", [this] { initSamplers(); });
+	m_materials.resize(m_gltfModel.materials.size());
+	std::vector<uint32_t> materialTasks;
+	for (size_t materialIndex = 0; materialIndex < m_gltfModel.materials.size(); ++materialIndex) {
+		materialTasks.push_back(graph.Add(std::format("material {}", materialIndex), [this, materialIndex] { initMaterial(materialIndex); }, { device, samplers, uploadTexturesTask }));
+	}
+
+	// Vertex and index buffer views need the buffers; pipelines need only the
+	// device, their material and their shaders.
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		graph.Add(std::format("views mesh {}", meshIndex), [this, meshIndex] { initPrimitiveViews(meshIndex); }, { uploadLodsTask });
+	}
+
+	// One compile per shader, target and attribute set, shared by every
+	// primitive that uses it.
+	std::map<std::string, uint32_t> shaderVariantKeys;
+	std::vector<uint32_t> shaderTasks;
+	auto shaderVariant = [&](const std::string& path, const char* target, const std::vector<std::string>& defines) {
+		std::string key = path + "|" + target;
+		for (const auto& define : defines) {
+			key += "|" + define;
+		}
+		auto [variant, added] = shaderVariantKeys.try_emplace(key, static_cast<uint32_t>(m_shaderVariants.size()));
+		if (added) {
+			const uint32_t variantIndex = variant->second;
+			m_shaderVariants.push_back({ path, target, defines, nullptr });
+			shaderTasks.push_back(graph.Add("compile " + path.substr(path.find_last_of("\\/") + 1) + " " + target, [this, variantIndex] {
+				ShaderVariant& compiled = m_shaderVariants[variantIndex];
+				compileShader(compiled.path, compiled.defines, compiled.target, &compiled.shader);
+			}));
+		}
+		return variant->second;
+	};
+	for (size_t meshIndex = 0; meshIndex < m_gltfModel.meshes.size(); ++meshIndex) {
+		const auto& gltfMesh = m_gltfModel.meshes[meshIndex];
+		for (size_t primitiveIndex = 0; primitiveIndex < gltfMesh.primitives.size(); ++primitiveIndex) {
+			const auto& gltfPrimitive = gltfMesh.primitives[primitiveIndex];
+			auto& primitive = m_meshes[meshIndex].primitives[primitiveIndex];
+			auto defines = shaderDefines(vertexAttributes(gltfPrimitive));
+			primitive.vertexShader = shaderVariant(m_vertexShaderPath, "vs_5_1", defines);
+			primitive.pixelShader = gltfPrimitive.material >= 0 ? shaderVariant(m_pixelShaderPath, "ps_5_1", defines) : shaderVariant(m_grayPixelShaderPath, "ps_5_1", defines);
+			std::vector<uint32_t> dependencies = { device, shaderTasks[primitive.vertexShader], shaderTasks[primitive.pixelShader] };
+			if (gltfPrimitive.material >= 0) {
+				dependencies.push_back(materialTasks[gltfPrimitive.material]);
+			}
+			graph.Add(std::format("pipeline mesh {} primitive {}", meshIndex, primitiveIndex), [this, meshIndex, primitiveIndex] {
+				const auto& primitive = m_meshes[meshIndex].primitives[primitiveIndex];
+				initPipeline(meshIndex, primitiveIndex, m_shaderVariants[primitive.vertexShader].shader.Get(), m_shaderVariants[primitive.pixelShader].shader.Get());
+			}, dependencies);
+		}
+	}
+
+	graph.Add("nodes", [this] { initNodes(); }, { device });
+	graph.Add("constants", [this] { initConstantAllocator(); }, { device });
+
+	graph.Run(*m_threadPool);
+	Log(LogLevel::Info, { "init" }, "init {}", graph.Report());
+
+	collectTextureDescriptors();
+
+	m_nodeWeights.resize(m_nodes.size());
+	for (size_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex) {
+		readNodeWeights(nodeIndex);
+	}
+	if (m_maxOccluders) {
+		m_occlusionBuffer.Resize(kOcclusionWidth, std::max(1u, static_cast<UINT>(kOcclusionWidth * m_height / m_width)));
+		m_occlusionMemory = { m_memoryScene, MemoryCategory::Occlusion, MemoryDomain::Cpu, occlusionBytes() };
+		m_memoryTracker.Add(m_occlusionMemory);
+	}
+	loadAnimations();
+	updateNodes();
+	loadDeformations();
+	if (m_rayTracer) {
+		loadRayTracing();
+	}
+	m_uploadManager.WaitIdle();
+	const UploadStats& uploadStats = m_uploadManager.Stats();
+	// Only the time spent uploading, not the LOD builds, pipelines and other
+	// Init work between the uploads. What the duplicates would have cost is
+	// estimated at the throughput it gives.
+	const double uploadMilliseconds = uploadStats.busyMicroseconds / 1000.0;
+	Log(LogLevel::Info, { "upload" }, "uploaded {:.1f} MiB in {} chunks and {} batches in {:.1f} ms, peak staging {:.1f} of {} MiB, {:.1f} ms stalled",
+		uploadStats.bytes / 1048576.0, uploadStats.chunks, uploadStats.batches, uploadMilliseconds,
+		uploadStats.peakRingBytes / 1048576.0, m_uploadRingSize >> 20, uploadStats.stallMicroseconds / 1000.0);
+	// Only duplicates count towards the saving; ranges nothing reads, such as
+	// encoded images, are trimmed whether or not anything repeats.
+	const uint64_t duplicateBytes = m_dedupStats.imageBytes + m_dedupStats.readBufferBytes - m_dedupStats.uploadBufferBytes;
+	const uint64_t unreferencedBytes = m_dedupStats.bufferBytes - m_dedupStats.readBufferBytes;
+	if (uploadStats.bytes > 0) {
+		Log(LogLevel::Info, { "upload" }, "dedup skipped {:.1f} MiB of duplicate uploads, about {:.1f} ms; {:.1f} MiB of buffers nothing reads were left out as well",
+			duplicateBytes / 1048576.0, uploadMilliseconds * duplicateBytes / uploadStats.bytes, unreferencedBytes / 1048576.0);
+	}
+	releaseSceneSource();
+
+	//todo: output depth
+	//todo: consume lightfield config file
+}
+
+void Renderer::initDevice() {
 	UINT dxgiFactoryFlags = DXGI_CREATE_FACTORY_DEBUG;
 
 	ComPtr<ID3D12Debug> debugController;
-	if (FAILED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+	if (HRESULT hr = D3D12GetDebugInterface(IID_PPV_ARGS(&debugController)); FAILED(hr))
 	{
-		OutputDebugString("-------------------------Failed to create ID3D12Debug Interface\n");
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create ID3D12Debug Interface");
 	}
 	debugController->EnableDebugLayer();
 
-	if (FAILED(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&m_factory))))
+	if (HRESULT hr = CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&m_factory)); FAILED(hr))
 	{
-		OutputDebugString("-------------------------Failed to create DXGIFactory7\n");
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create DXGIFactory7");
 		return;
 	}
 
@@ -116,265 +1470,342 @@ void Renderer::Init() {
 			}
 		}
 	}
-	if (FAILED(D3D12CreateDevice(m_adapter.Get(), D3D_FEATURE_LEVEL_12_2, IID_PPV_ARGS(&m_device)))) {
-		OutputDebugString("-------------------------Failed to create d3d12Device\n");
+	if (HRESULT hr = D3D12CreateDevice(m_adapter.Get(), D3D_FEATURE_LEVEL_12_2, IID_PPV_ARGS(&m_device)); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create d3d12Device");
+	}
+	DXGI_QUERY_VIDEO_MEMORY_INFO videoMemoryInfo = {};
+	if (SUCCEEDED(m_adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &videoMemoryInfo))) {
+		m_memoryTracker.SetBudget(MemoryDomain::Local, videoMemoryInfo.Budget);
 	}
 	D3D12_FEATURE_DATA_D3D12_OPTIONS5 featureData;
 	m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &featureData, sizeof(featureData));
 	if (featureData.RaytracingTier == D3D12_RAYTRACING_TIER_NOT_SUPPORTED) {
-		OutputDebugString("--------------------------Failed to create device with ray tracing support\n");
+		Log(LogLevel::Error, { "device" }, "Failed to create device with ray tracing support");
 	}
 
 	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
 	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
 	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-	if (FAILED(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_directCommandQueue)))) {
-		OutputDebugString("-------------------------Failed to create direct d3d12CommandQueue\n");
+	if (HRESULT hr = m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_directCommandQueue)); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create direct d3d12CommandQueue");
 	}
 
 	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
 	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
-	if (FAILED(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_copyCommandQueue)))) {
-		OutputDebugString("-------------------------Failed to create copy d3d12CommandQueue\n");
+	if (HRESULT hr = m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_copyCommandQueue)); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create copy d3d12CommandQueue");
 	}
 
-	if (FAILED(m_device->CreateFence(m_directFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_directFence)))) {
-		OutputDebugString("-------------------------Failed to create direct fence\n");
+	if (HRESULT hr = m_frameScheduler.Init(m_device.Get(), m_directCommandQueue.Get(), m_copyCommandQueue.Get(), FrameCount); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create frame scheduler");
 	}
 
-	if (FAILED(m_device->CreateFence(m_copyFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_copyFence)))) {
-		OutputDebugString("-------------------------Failed to create copy fence\n");
+	{
+		D3D12_HEAP_PROPERTIES heapProperties = {};
+		heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+		D3D12_RESOURCE_DESC resourceDesc = {};
+		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		resourceDesc.Width = m_uploadRingSize;
+		resourceDesc.Height = 1;
+		resourceDesc.DepthOrArraySize = 1;
+		resourceDesc.MipLevels = 1;
+		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+		resourceDesc.SampleDesc = { 1, 0 };
+		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		ComPtr<ID3D12Resource> uploadRing;
+		if (FAILED(createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MemoryCategory::Staging, 0, uploadRing)) ||
+			FAILED(m_uploadManager.Init(m_device.Get(), m_copyCommandQueue.Get(), uploadRing))) {
+			Log(LogLevel::Error, { "device" }, "Failed to create upload ring");
+		}
 	}
 
 	for (UINT n = 0; n < FrameCount; ++n) {
-		if (FAILED(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_directCommandAllocators[n])))) {
-			OutputDebugString("-------------------------Failed to create direct command allocator\n");
+		if (HRESULT hr = m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_directCommandAllocators[n])); FAILED(hr)) {
+			Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create direct command allocator");
 		}
-		if (FAILED(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_copyCommandAllocator[n])))) {
-			OutputDebugString("-------------------------Failed to create copy command allocator\n");
+		if (HRESULT hr = m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_copyCommandAllocator[n])); FAILED(hr)) {
+			Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create copy command allocator");
 		}
 	}
-	if (FAILED(m_device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&m_directCommandList)))) {
-		OutputDebugString("-------------------------Failed to create direct command list\n");
+	if (HRESULT hr = m_device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&m_directCommandList)); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create direct command list");
 	}
-	if (FAILED(m_device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_COPY, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&m_copyCommandList)))) {
-		OutputDebugString("-------------------------Failed to create copy command list\n");
+	if (HRESULT hr = m_device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_COPY, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&m_copyCommandList)); FAILED(hr)) {
+		Log(LogLevel::Error, { "device", -1, static_cast<uint32_t>(hr) }, "Failed to create copy command list");
 	}
 	for (UINT n = 0; n < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++n) {
 		m_descriptorSizes[n] = m_device->GetDescriptorHandleIncrementSize((D3D12_DESCRIPTOR_HEAP_TYPE)n);
 	}
 
-	for (UINT n = 0; n < FrameCount; ++n) {
-		RenderTarget& renderTarget = m_renderTargets[n];
-		ComPtr<ID3D12DescriptorHeap>& rtvDescriptorHeap = m_rtvDescriptorHeaps[n];
-		D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-		heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-		heapDesc.NumDescriptors = FrameCount;
-		heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-		if (FAILED(m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&rtvDescriptorHeap)))) {
-			OutputDebugString("-------------------------Failed to create rtv descriptor heap.\n");
-		}
-		renderTarget.rtvDescriptor = rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	dsDesc.DepthEnable = true;
+	dsDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+	dsDesc.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+	dsDesc.StencilEnable = true;
+	dsDesc.StencilReadMask = 0xFF;
+	dsDesc.StencilWriteMask = 0xFF;
+	dsDesc.FrontFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilDepthFailOp = D3D12_STENCIL_OP_INCR;
+	dsDesc.FrontFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+	dsDesc.BackFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
+	dsDesc.BackFace.StencilDepthFailOp = D3D12_STENCIL_OP_DECR;
+	dsDesc.BackFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
+	dsDesc.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+}
 
-		ComPtr<ID3D12DescriptorHeap>& dsvDescriptorHeap = m_dsvDescriptorHeaps[n];
-		heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-		if (FAILED(m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&dsvDescriptorHeap)))) {
-			OutputDebugString("-------------------------Failed to create rtv descriptor heap.\n");
-		}
-		renderTarget.dsvDescriptor = dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+void Renderer::initRenderTarget(UINT slot) {
+	RenderTarget& renderTarget = m_renderTargets[slot];
+	ComPtr<ID3D12DescriptorHeap>& rtvDescriptorHeap = m_rtvDescriptorHeaps[slot];
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	heapDesc.NumDescriptors = FrameCount;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	if (HRESULT hr = m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&rtvDescriptorHeap)); FAILED(hr)) {
+		Log(LogLevel::Error, { "render target", -1, static_cast<uint32_t>(hr) }, "Failed to create rtv descriptor heap");
+	}
+	renderTarget.rtvDescriptor = rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
 
-		D3D12_HEAP_PROPERTIES heapProperties = {};
-		heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
-		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		heapProperties.CreationNodeMask = 0;
-		heapProperties.VisibleNodeMask = 0;
+	ComPtr<ID3D12DescriptorHeap>& dsvDescriptorHeap = m_dsvDescriptorHeaps[slot];
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	if (HRESULT hr = m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&dsvDescriptorHeap)); FAILED(hr)) {
+		Log(LogLevel::Error, { "render target", -1, static_cast<uint32_t>(hr) }, "Failed to create dsv descriptor heap");
+	}
+	renderTarget.dsvDescriptor = dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
 
-		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-		resourceDesc.Alignment = 0;
-		resourceDesc.Width = m_width;
-		resourceDesc.Height = m_height;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.MipLevels = 1;
-		resourceDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		resourceDesc.SampleDesc = { 1, 0 };
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
-
-		m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, &renderTarget.clearValue, IID_PPV_ARGS(&renderTarget.texture));
-		m_device->CreateRenderTargetView(renderTarget.texture.Get(), nullptr, renderTarget.rtvDescriptor);
-
-		resourceDesc.Format = DXGI_FORMAT_D32_FLOAT;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-
-		D3D12_CLEAR_VALUE depthOptimizedClearValue = {};
-		depthOptimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;
-		depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
-		depthOptimizedClearValue.DepthStencil.Stencil = 0;
-
-		m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthOptimizedClearValue, IID_PPV_ARGS(&renderTarget.depthTexture));
-
-		D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
-		dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-		m_device->CreateDepthStencilView(renderTarget.depthTexture.Get(), &dsvDesc, renderTarget.dsvDescriptor);
-
-		dsDesc.DepthEnable = true;
-		dsDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
-		dsDesc.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
-		dsDesc.StencilEnable = true;
-		dsDesc.StencilReadMask = 0xFF;
-		dsDesc.StencilWriteMask = 0xFF;
-		dsDesc.FrontFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
-		dsDesc.FrontFace.StencilDepthFailOp = D3D12_STENCIL_OP_INCR;
-		dsDesc.FrontFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
-		dsDesc.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-		dsDesc.BackFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
-		dsDesc.BackFace.StencilDepthFailOp = D3D12_STENCIL_OP_DECR;
-		dsDesc.BackFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
-		dsDesc.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-
-		D3D12_RESOURCE_DESC srcTextureDesc = renderTarget.texture->GetDesc();
-		m_device->GetCopyableFootprints(&srcTextureDesc, 0, 1, 0, &renderTarget.footprint, &renderTarget.rowCount, &renderTarget.rowSize, &renderTarget.size);
-
-		heapProperties.Type = D3D12_HEAP_TYPE_READBACK;
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Width = renderTarget.size;
-		resourceDesc.Height = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	D3D12_HEAP_PROPERTIES heapProperties = {};
+	heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+	heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapProperties.CreationNodeMask = 0;
+	heapProperties.VisibleNodeMask = 0;
+
+	D3D12_RESOURCE_DESC resourceDesc = {};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	resourceDesc.Alignment = 0;
+	resourceDesc.Width = m_tileWidth;
+	resourceDesc.Height = m_tileHeight;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = 1;
+	resourceDesc.Format = m_renderTargetFormat;
+	resourceDesc.SampleDesc = { 1, 0 };
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
 
-		m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&renderTarget.dest));
+	createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COMMON, &renderTarget.clearValue, MemoryCategory::RenderTargets, 0, renderTarget.texture);
+	m_device->CreateRenderTargetView(renderTarget.texture.Get(), nullptr, renderTarget.rtvDescriptor);
 
+	resourceDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
 
-		renderTarget.srcCopyLocation.pResource = renderTarget.texture.Get();
-		renderTarget.srcCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		renderTarget.srcCopyLocation.SubresourceIndex = 0;
+	D3D12_CLEAR_VALUE depthOptimizedClearValue = {};
+	depthOptimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;
+	depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
+	depthOptimizedClearValue.DepthStencil.Stencil = 0;
 
-		renderTarget.dstCopyLocation.pResource = renderTarget.dest.Get();
-		renderTarget.dstCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-		renderTarget.dstCopyLocation.PlacedFootprint = renderTarget.footprint;
+	createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthOptimizedClearValue, MemoryCategory::RenderTargets, 0, renderTarget.depthTexture);
+
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	m_device->CreateDepthStencilView(renderTarget.depthTexture.Get(), &dsvDesc, renderTarget.dsvDescriptor);
+
+	D3D12_RESOURCE_DESC srcTextureDesc = renderTarget.texture->GetDesc();
+	m_device->GetCopyableFootprints(&srcTextureDesc, 0, 1, 0, &renderTarget.footprint, &renderTarget.rowCount, &renderTarget.rowSize, &renderTarget.size);
+
+	heapProperties.Type = D3D12_HEAP_TYPE_READBACK;
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Width = renderTarget.size;
+	resourceDesc.Height = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, MemoryCategory::Readback, 0, renderTarget.dest);
+	// Readback heaps may stay mapped; the fence wait in renderTile orders the copy
+	// before any CPU read.
+	D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(renderTarget.size) };
+	void* destData;
+	if (HRESULT hr = renderTarget.dest->Map(0, &readRange, &destData); FAILED(hr)) {
+		Log(LogLevel::Error, { "render target", -1, static_cast<uint32_t>(hr) }, "Failed to map dest image buffer");
 	}
+	renderTarget.destData = static_cast<uint8_t*>(destData);
+
+	renderTarget.srcCopyLocation.pResource = renderTarget.texture.Get();
+	renderTarget.srcCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	renderTarget.srcCopyLocation.SubresourceIndex = 0;
 
-	if (FAILED(m_copyCommandList->Reset(m_copyCommandAllocator[0].Get(), nullptr))) {
-		OutputDebugString("-------------------------Failed to reset copy command list\n");
+	renderTarget.dstCopyLocation.pResource = renderTarget.dest.Get();
+	renderTarget.dstCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	renderTarget.dstCopyLocation.PlacedFootprint = renderTarget.footprint;
+}
+
+void Renderer::uploadBuffers() {
+	for (size_t bufferIndex = 0; bufferIndex < m_gltfModel.buffers.size(); ++bufferIndex) {
+		m_buffers.push_back(uploadBuffer(bufferIndex));
 	}
+	m_uploadManager.Flush();
+}
 
-	std::vector<ComPtr<ID3D12Resource> > stagingResources;
-	stagingResources.reserve(256);
-	for (auto& gltfBuffer : m_gltfModel.buffers) {
-		ComPtr<ID3D12Resource> dstBuffer;
+// Records the upload of a glTF buffer's referenced ranges into a new buffer,
+// null when nothing in it is referenced.
+ComPtr<ID3D12Resource> Renderer::uploadBuffer(size_t bufferIndex) {
+	const auto& gltfBuffer = m_gltfModel.buffers[bufferIndex];
+	const auto& ranges = m_bufferUploadRanges[bufferIndex];
+	if (ranges.empty()) {
+		return nullptr;
+	}
+	ComPtr<ID3D12Resource> dstBuffer;
 
-		D3D12_HEAP_PROPERTIES heapProperties = {};
-		heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
-		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	D3D12_HEAP_PROPERTIES heapProperties = {};
+	heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+	heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
 
-		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Alignment = 0;
-		resourceDesc.Width = gltfBuffer.data.size();
-		resourceDesc.Height = 1;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.MipLevels = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.SampleDesc = { 1, 0 };
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-		if (FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&dstBuffer)))) {
-			OutputDebugString("-------------------------Failed to create destination buffer\n");
-		}
-		m_buffers.push_back(dstBuffer);
+	D3D12_RESOURCE_DESC resourceDesc = {};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Alignment = 0;
+	resourceDesc.Width = gltfBuffer.data.size();
+	resourceDesc.Height = 1;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.SampleDesc = { 1, 0 };
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, MemoryCategory::Geometry, m_memoryScene, dstBuffer); FAILED(hr)) {
+		Log(LogLevel::Error, { "upload", -1, static_cast<uint32_t>(hr) }, "Failed to create destination buffer");
+		return nullptr;
+	}
+	for (const auto& [begin, end] : ranges) {
+		m_uploadManager.UploadBuffer(dstBuffer.Get(), begin, gltfBuffer.data.data() + begin, end - begin);
+	}
+	return dstBuffer;
+}
 
-		ComPtr<ID3D12Resource> srcBuffer;
-		heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
-		if (FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&srcBuffer)))) {
-			OutputDebugString("-------------------------Failed to create source buffer\n");
-		}
-		stagingResources.push_back(srcBuffer);
+void Renderer::uploadTextures(const std::vector<std::vector<TextureMipLevel>>& tailLevels) {
+	for (size_t imageIndex = 0; imageIndex < m_scene.Images().size(); ++imageIndex) {
+		m_textures.push_back(uploadTexture(tailLevels[imageIndex]));
+	}
+	m_uploadManager.Flush();
+}
+
+// Records the upload of a texture holding exactly the given levels.
+ComPtr<ID3D12Resource> Renderer::uploadTexture(const std::vector<TextureMipLevel>& levels) {
+	ComPtr<ID3D12Resource> dstTexture;
+
+	D3D12_HEAP_PROPERTIES heapProperties = {};
+	heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+	heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+	D3D12_RESOURCE_DESC resourceDesc = {};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	resourceDesc.Alignment = 0;
+	resourceDesc.Width = levels[0].width;
+	resourceDesc.Height = levels[0].height;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = static_cast<UINT16>(levels.size());
+	resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	resourceDesc.SampleDesc = { 1, 0 };
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, MemoryCategory::Textures, m_memoryScene, dstTexture); FAILED(hr)) {
+		Log(LogLevel::Error, { "upload", -1, static_cast<uint32_t>(hr) }, "Failed to create destination image");
+		return nullptr;
+	}
 
-		void* data;
-		if (FAILED(srcBuffer->Map(0, nullptr, &data))) {
-			OutputDebugString("-------------------------Failed to map source buffer\n");
+	std::vector<UploadSubresource> sources;
+	for (const auto& level : levels) {
+		sources.push_back({ level.pixels.data(), static_cast<size_t>(level.width) * 4 });
+	}
+	m_uploadManager.UploadTexture(dstTexture.Get(), 0, static_cast<UINT>(sources.size()), sources.data());
+	return dstTexture;
+}
+
+// Indexed triangle lists get a simplified LOD chain, each level split into
+// meshlets so DrawNode can pick a level and cull it per cluster. All levels
+// are stored as reordered 32 bit indices, one list per primitive, and uploaded
+// into one buffer per primitive by uploadLodIndices.
+void Renderer::buildLods(size_t meshIndex, std::vector<std::vector<uint32_t>>& lodIndices) {
+	auto& gltfMesh = m_gltfModel.meshes[meshIndex];
+	auto& primitives = m_meshes[meshIndex].primitives;
+	for (size_t primitiveIndex = 0; primitiveIndex < gltfMesh.primitives.size(); ++primitiveIndex) {
+		auto& gltfPrimitive = gltfMesh.primitives[primitiveIndex];
+		auto positionAttribute = gltfPrimitive.attributes.find("POSITION");
+		if (gltfPrimitive.mode != TINYGLTF_MODE_TRIANGLES || gltfPrimitive.indices < 0 || positionAttribute == gltfPrimitive.attributes.end()) {
+			continue;
+		}
+		const auto& positionAccessor = m_gltfModel.accessors[positionAttribute->second];
+		const auto& positionBufferView = m_gltfModel.bufferViews[positionAccessor.bufferView];
+		auto indices = readIndices(m_gltfModel.accessors[gltfPrimitive.indices]);
+
+		auto& primitive = primitives[primitiveIndex];
+		auto texcoordAttribute = gltfPrimitive.attributes.find("TEXCOORD_0");
+		if (texcoordAttribute != gltfPrimitive.attributes.end()) {
+			auto positions = readFloats(positionAccessor);
+			auto texcoords = readFloats(m_gltfModel.accessors[texcoordAttribute->second]);
+			primitive.textureDensity = TextureCoordinateDensity(positions.data(), texcoords.data(), indices.data(), indices.size());
+		}
+		auto lodChain = BuildLodChain(indices, accessorData(positionAccessor), positionAccessor.ByteStride(positionBufferView), positionAccessor.count);
+		if (lodChain.lods.empty()) {
+			continue;
+		}
+		primitive.lods = std::move(lodChain.lods);
+		primitive.boundsCenter = lodChain.center;
+		primitive.boundsRadius = lodChain.radius;
+		// Opaque primitives keep their coarsest level within kOccluderError on
+		// the CPU for the occlusion buffer; LODs are ordered fine to coarse.
+		if (m_maxOccluders && (gltfPrimitive.material < 0 || m_gltfModel.materials[gltfPrimitive.material].alphaMode == "OPAQUE")) {
+			const Lod* occluderLod = &primitive.lods[0];
+			for (const auto& lod : primitive.lods) {
+				if (lod.error <= kOccluderError * primitive.boundsRadius) {
+					occluderLod = &lod;
+				}
+			}
+			primitive.occluderIndices.assign(indices.begin() + occluderLod->indexOffset, indices.begin() + occluderLod->indexOffset + occluderLod->indexCount);
+			primitive.occluderPositions = readFloats(positionAccessor);
 		}
-		memcpy(data, &gltfBuffer.data[0], gltfBuffer.data.size());
-		m_copyCommandList->CopyBufferRegion(dstBuffer.Get(), 0, srcBuffer.Get(), 0, gltfBuffer.data.size());
+		lodIndices[primitiveIndex] = std::move(indices);
 	}
+}
 
-	for (tinygltf::Image& gltfImage : m_gltfModel.images) {
-		ComPtr<ID3D12Resource> dstTexture;
+// Records the upload of one mesh's LOD indices, one buffer per primitive.
+void Renderer::uploadLodIndices(size_t meshIndex, const std::vector<std::vector<uint32_t>>& lodIndices) {
+	auto& primitives = m_meshes[meshIndex].primitives;
+	for (size_t primitiveIndex = 0; primitiveIndex < primitives.size(); ++primitiveIndex) {
+		auto& primitive = primitives[primitiveIndex];
+		const auto& indices = lodIndices[primitiveIndex];
+		if (primitive.lods.empty()) {
+			continue;
+		}
 
 		D3D12_HEAP_PROPERTIES heapProperties = {};
 		heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
 		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
 		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
 
+		const UINT64 indexBufferSize = indices.size() * sizeof(uint32_t);
 		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
 		resourceDesc.Alignment = 0;
-		resourceDesc.Width = gltfImage.width;
-		resourceDesc.Height = gltfImage.height;
+		resourceDesc.Width = indexBufferSize;
+		resourceDesc.Height = 1;
 		resourceDesc.DepthOrArraySize = 1;
 		resourceDesc.MipLevels = 1;
-		resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		resourceDesc.SampleDesc = { 1, 0 };
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-		if (FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&dstTexture)))) {
-			OutputDebugString("-------------------------Failed to create destination image\n");
-		}
-		m_textures.push_back(dstTexture);
-
-		D3D12_RESOURCE_DESC dstTextureDesc = dstTexture->GetDesc();
-		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
-		UINT rowCount;
-		UINT64 rowSize;
-		UINT64 size;
-		m_device->GetCopyableFootprints(&dstTextureDesc, 0, 1, 0, &footprint, &rowCount, &rowSize, &size);
-
-		ComPtr<ID3D12Resource> srcBuffer;
-		heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Width = size;
-		resourceDesc.Height = 1;
 		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+		resourceDesc.SampleDesc = { 1, 0 };
 		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		if(FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&srcBuffer)))){
-			OutputDebugString("-------------------------Failed to create source image buffer\n");
-		}
-		stagingResources.push_back(srcBuffer);
-
-		void* data;
-		if (FAILED(srcBuffer->Map(0, nullptr, &data))) {
-			OutputDebugString("-------------------------Failed to map source image buffer\n");
-		}
-		for (UINT rowIndex = 0; rowIndex < rowCount; ++rowIndex) {
-			memcpy(static_cast<uint8_t*>(data) + rowSize * rowIndex, &gltfImage.image[0] + gltfImage.width * gltfImage.component * rowIndex, gltfImage.width * gltfImage.component);
+		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, MemoryCategory::Geometry, m_memoryScene, primitive.lodIndexBuffer); FAILED(hr)) {
+			Log(LogLevel::Error, { "upload", -1, static_cast<uint32_t>(hr) }, "Failed to create lod index buffer");
 		}
-		D3D12_TEXTURE_COPY_LOCATION dstCopyLocation = {};
-		dstCopyLocation.pResource = dstTexture.Get();
-		dstCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		dstCopyLocation.SubresourceIndex = 0;
-
-		D3D12_TEXTURE_COPY_LOCATION srcCopyLocation = {};
-		srcCopyLocation.pResource = srcBuffer.Get();
-		srcCopyLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-		srcCopyLocation.PlacedFootprint = footprint;
-
-		m_copyCommandList->CopyTextureRegion(&dstCopyLocation, 0, 0, 0, &srcCopyLocation, nullptr);
-	}
 
-	if (FAILED(m_copyCommandList->Close())) {
-		OutputDebugString("-------------------------Failed to close copy command list\n");
+		m_uploadManager.UploadBuffer(primitive.lodIndexBuffer.Get(), 0, indices.data(), indexBufferSize);
 	}
+}
 
-	ID3D12CommandList* copyCommandLists[] = {m_copyCommandList.Get()};
-	m_copyCommandQueue->ExecuteCommandLists(_countof(copyCommandLists), copyCommandLists);
-	m_copyCommandQueue->Signal(m_copyFence.Get(), ++m_copyFenceValue);
-
+void Renderer::initSamplers() {
 	for (tinygltf::Sampler& gltfSampler : m_gltfModel.samplers) {
 		D3D12_SAMPLER_DESC samplerDesc = {};
 		switch (gltfSampler.minFilter) {
@@ -428,7 +1859,7 @@ void Renderer::Init() {
 			case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
 				return D3D12_TEXTURE_ADDRESS_MODE_MIRROR;
 			default:
-				OutputDebugString("-------------------------Invalide wrap mode in gltf file\n");
+				Log(LogLevel::Error, { "material" }, "Invalid wrap mode in gltf file");
 				return D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 			}
 		};
@@ -440,538 +1871,1216 @@ void Renderer::Init() {
 
 		m_samplerDescs.push_back(samplerDesc);
 	}
+}
 
-	for (tinygltf::Material gltfMaterial : m_gltfModel.materials) {
-		Material material = {};
-		material.name = gltfMaterial.name;
-
-		D3D12_BLEND_DESC& blendDesc = material.blendDesc;
-		if (gltfMaterial.alphaMode == "BLEND") {
-			blendDesc.RenderTarget[0].BlendEnable = true;
-			blendDesc.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
-			blendDesc.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
-			blendDesc.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
-			blendDesc.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ONE;
-			blendDesc.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_ZERO;
-			blendDesc.RenderTarget[0].BlendOpAlpha = D3D12_BLEND_OP_ADD;
-			blendDesc.RenderTarget[0].LogicOp = D3D12_LOGIC_OP_NOOP;
-		}
-		else if (gltfMaterial.alphaMode == "MASK") {
-			OutputDebugString("--------------------- MASK alpha mode is not support but was specified in the gltf file\n");
-		}
-
-		blendDesc.RenderTarget[0].RenderTargetWriteMask =
-			D3D12_COLOR_WRITE_ENABLE_ALL;
-
-		D3D12_RASTERIZER_DESC& rasterizerDesc = material.rasterizerDesc;
-		rasterizerDesc.FillMode = D3D12_FILL_MODE_SOLID;
-		rasterizerDesc.CullMode = D3D12_CULL_MODE_NONE;
-//		if (gltfMaterial.doubleSided) {
-	//	}
-		//else {
-			//rasterizerDesc.CullMode = D3D12_CULL_MODE_BACK;
-		//}
-
-		rasterizerDesc.FrontCounterClockwise = true;
-		rasterizerDesc.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
-		rasterizerDesc.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
-		rasterizerDesc.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
-		rasterizerDesc.DepthClipEnable = false;
-		rasterizerDesc.MultisampleEnable = false;
-		rasterizerDesc.AntialiasedLineEnable = false;
-		rasterizerDesc.ForcedSampleCount = 0;
-		rasterizerDesc.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
-
-		auto& buffer = material.buffer;
-		auto& bufferData = material.bufferData;
+void Renderer::initMaterial(size_t materialIndex) {
+	const tinygltf::Material& gltfMaterial = m_gltfModel.materials[materialIndex];
+	Material& material = m_materials[materialIndex];
+	material.name = gltfMaterial.name;
+	material.doubleSided = gltfMaterial.doubleSided;
+
+	D3D12_BLEND_DESC& blendDesc = material.blendDesc;
+	if (gltfMaterial.alphaMode == "BLEND") {
+		blendDesc.RenderTarget[0].BlendEnable = true;
+		blendDesc.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+		blendDesc.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+		blendDesc.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
+		blendDesc.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ONE;
+		blendDesc.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_ZERO;
+		blendDesc.RenderTarget[0].BlendOpAlpha = D3D12_BLEND_OP_ADD;
+		blendDesc.RenderTarget[0].LogicOp = D3D12_LOGIC_OP_NOOP;
+	}
+	else if (gltfMaterial.alphaMode == "MASK") {
+		Log(LogLevel::Warning, { "material" }, "MASK alpha mode is not supported but was specified in the gltf file");
+	}
 
-		D3D12_HEAP_PROPERTIES heapProperties = {};
-		heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
-		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask =
+		D3D12_COLOR_WRITE_ENABLE_ALL;
+
+	D3D12_RASTERIZER_DESC& rasterizerDesc = material.rasterizerDesc;
+	rasterizerDesc.FillMode = D3D12_FILL_MODE_SOLID;
+	// glTF only asks for back faces to be drawn on double sided materials;
+	// meshlet cone culling relies on the others being culled by winding.
+	rasterizerDesc.CullMode = gltfMaterial.doubleSided ? D3D12_CULL_MODE_NONE : D3D12_CULL_MODE_BACK;
+
+	rasterizerDesc.FrontCounterClockwise = true;
+	rasterizerDesc.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
+	rasterizerDesc.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
+	rasterizerDesc.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
+	rasterizerDesc.DepthClipEnable = false;
+	rasterizerDesc.MultisampleEnable = false;
+	rasterizerDesc.AntialiasedLineEnable = false;
+	rasterizerDesc.ForcedSampleCount = 0;
+	rasterizerDesc.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+	auto& SRVDescriptorHeap = material.SRVDescriptorHeap;
+	D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
+	descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	descriptorHeapDesc.NumDescriptors = 5;
+	descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	if (HRESULT hr = m_device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&SRVDescriptorHeap)); FAILED(hr)) {
+		Log(LogLevel::Error, { "material", -1, static_cast<uint32_t>(hr) }, "Failed to create descriptor heap for pbr material");
+	}
 
-		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Width = alignPow2(sizeof(PBRMetallicRoughness), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-		resourceDesc.Height = 1;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.MipLevels = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.SampleDesc = { 1, 0 };
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		if (FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer)))) {
-			OutputDebugString("---------------------Failed to create commited resource for pbr descriptor.\n");
+	auto& samplerDescriptorHeap = material.samplerDescriptorHeap;
+	descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
+	if (HRESULT hr = m_device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&samplerDescriptorHeap)); FAILED(hr)) {
+		Log(LogLevel::Error, { "material", -1, static_cast<uint32_t>(hr) }, "Failed to create sampler heap for pbr material");
+	}
+
+	auto& gltfPBRMetallicRoughness = gltfMaterial.pbrMetallicRoughness;
+	auto PBRMetallicRoughness = &material.constants;
+
+	auto& baseColorFactor = PBRMetallicRoughness->baseColorFactor;
+	baseColorFactor.x = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[0]);
+	baseColorFactor.y = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[1]);
+	baseColorFactor.z = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[2]);
+	baseColorFactor.w = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[3]);
+
+	auto& gltfBaseColorTexture = gltfPBRMetallicRoughness.baseColorTexture;
+	auto& baseColorTexture = PBRMetallicRoughness->baseColorTexture;
+	if (gltfBaseColorTexture.index >= 0) {
+		baseColorTexture.textureIndex = 0;
+		baseColorTexture.samplerIndex = 0;
+	}
+	else {
+		baseColorTexture.textureIndex = -1;
+		baseColorTexture.samplerIndex = -1;
+	}
+	PBRMetallicRoughness->metallicFactor =
+		static_cast<float>(gltfPBRMetallicRoughness.metallicFactor);
+	PBRMetallicRoughness->roughnessFactor =
+		static_cast<float>(gltfPBRMetallicRoughness.roughnessFactor);
+
+	auto& gltfMetallicRoughnessTexture = gltfPBRMetallicRoughness.metallicRoughnessTexture;
+	auto& metallicRoughnessTexture = PBRMetallicRoughness->metallicRoughnessTexture;
+	if (gltfMetallicRoughnessTexture.index >= 0) {
+		metallicRoughnessTexture.textureIndex = 1;
+		metallicRoughnessTexture.samplerIndex = 1;
+	}
+	else {
+		metallicRoughnessTexture.textureIndex = -1;
+		metallicRoughnessTexture.samplerIndex = -1;
+	}
+	auto srvDescriptor = SRVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	auto samplerDescriptor = samplerDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	material.textureSources[0] = -1;
+	material.textureSources[1] = -1;
+	if (gltfBaseColorTexture.index >= 0) {
+		auto& gltfTexture = m_gltfModel.textures[gltfBaseColorTexture.index];
+		auto texture = m_textures[gltfTexture.source].Get();
+		m_device->CreateShaderResourceView(texture, nullptr, srvDescriptor);
+		material.textureSources[0] = gltfTexture.source;
+		auto& samplerDesc = m_samplerDescs[gltfTexture.sampler];
+		m_device->CreateSampler(&samplerDesc, samplerDescriptor);
+	}
+	srvDescriptor.ptr +=
+		m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV];
+	samplerDescriptor.ptr +=
+		m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER];
+	auto& glTFMetallicRoughnessTexture = gltfPBRMetallicRoughness.metallicRoughnessTexture;
+	if (gltfMetallicRoughnessTexture.index >= 0) {
+		auto& gltfTexture = m_gltfModel.textures[gltfMetallicRoughnessTexture.index];
+		auto texture = m_textures[gltfTexture.source].Get();
+		m_device->CreateShaderResourceView(texture, nullptr, srvDescriptor);
+		material.textureSources[1] = gltfTexture.source;
+
+		auto& samplerDesc = m_samplerDescs[gltfTexture.sampler];
+		m_device->CreateSampler(&samplerDesc, samplerDescriptor);
+	}
+}
+
+// Materials bind their base color and metallic roughness SRVs in the first
+// two slots of their heap.
+void Renderer::collectTextureDescriptors() {
+	for (auto& descriptors : m_textureDescriptors) {
+		descriptors.clear();
+	}
+	for (const auto& material : m_materials) {
+		for (UINT slot = 0; slot < 2; ++slot) {
+			if (material.textureSources[slot] >= 0) {
+				auto srvDescriptor = material.SRVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+				srvDescriptor.ptr += slot * m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV];
+				m_textureDescriptors[material.textureSources[slot]].push_back(srvDescriptor);
+			}
 		}
-		if (FAILED(buffer->Map(0, nullptr, &bufferData))) {
-			OutputDebugString("---------------------Failed to map pbr buffer descriptor\n");
-		};
+	}
+}
+
+// Buffers are on the GPU once Init or a reload has uploaded them. Scene
+// reloads diff against m_sceneSignature, but shader reloads rebuild pipelines
+// from the model's primitives, so with hot reload the model stays without its
+// buffers. Pixels go once no texture can stream from them again: the tracer
+// samples them directly, streams in flight read them, and under a budget any
+// texture may be evicted and streamed back, so only textures no material
+// samples, or fully resident ones under an unlimited budget, qualify.
+void Renderer::releaseSceneSource() {
+	const uint64_t before = sceneSourceBytes();
+	if (m_hotReload) {
+		for (auto& gltfBuffer : m_gltfModel.buffers) {
+			std::vector<unsigned char>().swap(gltfBuffer.data);
+		}
+	}
+	else {
+		m_gltfModel = {};
+	}
+	// Images that streams decode again from their source go at once, budget or
+	// not. The rest go once their texture cannot stream from them anymore,
+	// judged per texture so that streams of other textures do not hold them.
+	if (!m_rayTracer) {
+		const bool unlimited = m_textureResidency.Stats().budgetBytes == 0;
+		for (size_t imageIndex = 0; imageIndex < m_scene.Images().size(); ++imageIndex) {
+			const uint32_t texture = static_cast<uint32_t>(imageIndex);
+			const bool streaming = m_textureResidency.Pending(texture);
+			if (streamsFromSource(imageIndex) || (!streaming && (m_textureDescriptors[imageIndex].empty() || (unlimited && m_textureResidentMips[imageIndex] == 0)))) {
+				m_scene.ReleasePixels(imageIndex);
+			}
+		}
+	}
+	const uint64_t after = sceneSourceBytes();
+	if (after != before) {
+		m_memoryTracker.Resize(m_sceneSourceMemory, after);
+		Log(LogLevel::Info, { "memory" }, "released {:.1f} MiB of scene source, {:.1f} MiB kept",
+			(before - after) / 1048576.0, after / 1048576.0);
+	}
+}
+
+// The occlusion buffer and the occluder geometry every primitive keeps.
+uint64_t Renderer::occlusionBytes() const {
+	uint64_t bytes = m_occlusionBuffer.ByteSize();
+	for (const auto& mesh : m_meshes) {
+		for (const auto& primitive : mesh.primitives) {
+			bytes += primitive.occluderIndices.size() * sizeof(uint32_t) + primitive.occluderPositions.size() * sizeof(float);
+		}
+	}
+	return bytes;
+}
+
+// Attributes the vertex shader reads, one input slot each, without buffer
+// views.
+std::vector<Renderer::Attribute> Renderer::vertexAttributes(const tinygltf::Primitive& gltfPrimitive) const {
+	std::vector<Attribute> attributes;
+	for (auto& [attributeName, accessorIndex] : gltfPrimitive.attributes) {
+		// Joints and weights are consumed by CPU skinning, not by the vertex shader.
+		if (attributeName.rfind("JOINTS_", 0) == 0 || attributeName.rfind("WEIGHTS_", 0) == 0) {
+			continue;
+		}
+		Attribute attribute = {};
+		attribute.name = m_scene.AttributeName(attributeName);
+		switch (m_gltfModel.accessors[accessorIndex].type) {
+		case TINYGLTF_TYPE_VEC2:
+			attribute.format = DXGI_FORMAT_R32G32_FLOAT;
+			break;
+		case TINYGLTF_TYPE_VEC3:
+			attribute.format = DXGI_FORMAT_R32G32B32_FLOAT;
+			break;
+		case TINYGLTF_TYPE_VEC4:
+			attribute.format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			break;
+		}
+		attributes.emplace_back(attribute);
+	}
+	return attributes;
+}
+
+std::vector<std::string> Renderer::shaderDefines(const std::vector<Attribute>& attributes) {
+	std::vector<std::string> defines;
+	for (auto& attribute : attributes) {
+		if (attribute.name == "NORMAL")
+			defines.push_back("HAS_NORMAL");
+		else if (attribute.name == "TANGENT")
+			defines.push_back("HAS_TANGENT");
+		else if (attribute.name == "TEXCOORD_0")
+			defines.push_back("HAS_TEXCOORD_0");
+	}
+	return defines;
+}
+
+D3D_PRIMITIVE_TOPOLOGY Renderer::primitiveTopology(int mode) {
+	switch (mode) {
+	case TINYGLTF_MODE_POINTS:
+		return D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+	case TINYGLTF_MODE_LINE:
+		return D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+	case TINYGLTF_MODE_LINE_STRIP:
+		return D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
+	case TINYGLTF_MODE_TRIANGLES:
+		return D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	case TINYGLTF_MODE_TRIANGLE_STRIP:
+		return D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+	default:
+		assert(false);
+		return D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	}
+}
+
+void Renderer::compileShader(const std::string& path, const std::vector<std::string>& defines, const char* target, ID3DBlob** shader) {
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const auto& define : defines) {
+		macros.push_back({ define.c_str(), "1" });
+	}
+	macros.push_back({ nullptr, nullptr });
+	std::wstring filePath(path.begin(), path.end());
+	UINT flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+	ComPtr<ID3DBlob> error;
+	if (HRESULT hr = D3DCompileFromFile(filePath.c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", target, flags, 0, shader, &error); FAILED(hr)) {
+		Log(LogLevel::Error, { "shader", -1, static_cast<uint32_t>(hr) }, "Failed to compile shader");
+		if (error) {
+			Log(LogLevel::Error, { "shader" }, "{}: {}", path, static_cast<const char*>(error->GetBufferPointer()));
+		}
+	}
+}
+
+void Renderer::createRootSignature(const D3D12_ROOT_SIGNATURE_DESC& rootSignatureDesc, ComPtr<ID3D12RootSignature>& rootSignature) {
+	ComPtr<ID3DBlob> serializeRootSignature;
+	ComPtr<ID3DBlob> error;
+	if (HRESULT hr = D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, serializeRootSignature.GetAddressOf(), error.GetAddressOf()); FAILED(hr)) {
+		Log(LogLevel::Error, { "pipeline", -1, static_cast<uint32_t>(hr) }, "Failed to serialize Root Signature");
+		Log(LogLevel::Error, { "pipeline" }, "{}", static_cast<const char*>(error->GetBufferPointer()));
+	}
+	if (HRESULT hr = m_device->CreateRootSignature(0, serializeRootSignature->GetBufferPointer(), serializeRootSignature->GetBufferSize(), IID_PPV_ARGS(&rootSignature)); FAILED(hr)) {
+		Log(LogLevel::Error, { "pipeline", -1, static_cast<uint32_t>(hr) }, "Failed to create root signature");
+	}
+}
+
+std::vector<D3D12_INPUT_ELEMENT_DESC> Renderer::buildInputElementDescs(const std::vector<Attribute>& attributes) {
+	std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDescs;
+	for (auto& attribute : attributes) {
+		D3D12_INPUT_ELEMENT_DESC inputElementDesc = {};
+		inputElementDesc.SemanticName = attribute.name.data();
+		inputElementDesc.Format = attribute.format;
+		if (attribute.name == "TEXCOORD_0") {
+			inputElementDesc.SemanticName = "TEXCOORD_";
+			inputElementDesc.SemanticIndex = 0;
+		}
+		inputElementDesc.InputSlot =
+			static_cast<UINT>(inputElementDescs.size());
+		inputElementDesc.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+		inputElementDesc.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
+		inputElementDescs.push_back(inputElementDesc);
+	}
+	return inputElementDescs;
+}
+
+void Renderer::initPrimitiveViews(size_t meshIndex) {
+	auto& gltfMesh = m_gltfModel.meshes[meshIndex];
+	auto& mesh = m_meshes[meshIndex];
+	mesh.name = gltfMesh.name;
+
+	auto& primitives = mesh.primitives;
+	for (size_t primitiveIndex = 0; primitiveIndex < gltfMesh.primitives.size(); ++primitiveIndex) {
+		auto& gltfPrimitive = gltfMesh.primitives[primitiveIndex];
+		auto& primitive = primitives[primitiveIndex];
+		auto& attributes = primitive.attributes;
+		attributes = vertexAttributes(gltfPrimitive);
+		for (auto& attribute : attributes) {
+			const auto& gltfAccessor = m_gltfModel.accessors[gltfPrimitive.attributes.at(std::string(attribute.name))];
+			const auto& gltfBufferView = m_gltfModel.bufferViews[gltfAccessor.bufferView];
+			attribute.vertexBufferView.BufferLocation = m_buffers[gltfBufferView.buffer]->GetGPUVirtualAddress() + gltfBufferView.byteOffset + gltfAccessor.byteOffset;
+			attribute.vertexBufferView.SizeInBytes = static_cast<UINT>(gltfBufferView.byteLength - gltfAccessor.byteOffset);
+			attribute.vertexBufferView.StrideInBytes = gltfAccessor.ByteStride(gltfBufferView);
+
+			if (attribute.name == "POSITION") {
+				primitive.vertexCount = static_cast<uint32_t>(gltfAccessor.count);
+			}
+		}
+		primitive.primitiveTopology = primitiveTopology(gltfPrimitive.mode);
+
+		if (gltfPrimitive.indices >= 0) {
+			const auto& gltfAccessor = m_gltfModel.accessors[gltfPrimitive.indices];
+			const auto& gltfBufferView = m_gltfModel.bufferViews[gltfAccessor.bufferView];
+
+			auto& indexBufferView = primitive.indexBufferView;
+			indexBufferView.BufferLocation = m_buffers[gltfBufferView.buffer]->GetGPUVirtualAddress() + gltfBufferView.byteOffset + gltfAccessor.byteOffset;
+			indexBufferView.SizeInBytes = static_cast<UINT>(gltfBufferView.byteLength - gltfAccessor.byteOffset);
+			switch (gltfAccessor.componentType) {
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+				indexBufferView.Format = DXGI_FORMAT_R8_UINT;
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+				indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+				indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+				break;
+			}
+			auto& indexCount = primitive.indexCount;
+			indexCount = static_cast<uint32_t>(gltfAccessor.count);
+
+			if (!primitive.lods.empty()) {
+				auto& lastLod = primitive.lods.back();
+				indexBufferView.BufferLocation = primitive.lodIndexBuffer->GetGPUVirtualAddress();
+				indexBufferView.SizeInBytes = (lastLod.indexOffset + lastLod.indexCount) * sizeof(uint32_t);
+				indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+			}
+		}
+		// Single sided materials are culled by winding, the fallback pipeline always is.
+		primitive.coneCulling = gltfPrimitive.material < 0 || !m_gltfModel.materials[gltfPrimitive.material].doubleSided;
+	}
+}
+
+// Runs alongside initPrimitiveViews for the same primitive, so it takes the
+// attributes and topology from the glTF primitive rather than from primitive.
+void Renderer::initPipeline(size_t meshIndex, size_t primitiveIndex, ID3DBlob* vertexShader, ID3DBlob* pixelShader) {
+	const auto& gltfPrimitive = m_gltfModel.meshes[meshIndex].primitives[primitiveIndex];
+	auto& primitive = m_meshes[meshIndex].primitives[primitiveIndex];
+	const auto attributes = vertexAttributes(gltfPrimitive);
+	const D3D_PRIMITIVE_TOPOLOGY topology = primitiveTopology(gltfPrimitive.mode);
+
+	if (gltfPrimitive.material >= 0) {
+		primitive.material = &m_materials[gltfPrimitive.material];
+
+		auto& rootSignature = primitive.rootSignature;
+
+		D3D12_DESCRIPTOR_RANGE SRVDescriptorRange = {};
+		SRVDescriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+		SRVDescriptorRange.NumDescriptors = 5;
+
+		D3D12_DESCRIPTOR_RANGE samplerDescriptorRange = {};
+		samplerDescriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+		samplerDescriptorRange.NumDescriptors = 5;
+
+		D3D12_ROOT_PARAMETER rootParams[5] = {};
+		rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		rootParams[0].Descriptor = { 0, 0 };
+		rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+		rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
+		rootParams[1].Descriptor = { 1, 0 };
+		rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+		rootParams[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		rootParams[2].Descriptor = { 2, 0 };
+		rootParams[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+		rootParams[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		rootParams[3].DescriptorTable = { 1, &SRVDescriptorRange };
+		rootParams[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+		rootParams[4].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		rootParams[4].DescriptorTable = { 1, &samplerDescriptorRange };
+		rootParams[4].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+		D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+		rootSignatureDesc.NumParameters = _countof(rootParams);
+		rootSignatureDesc.pParameters = &rootParams[0];
+		rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+		createRootSignature(rootSignatureDesc, rootSignature);
+
+		auto inputElementDescs = buildInputElementDescs(attributes);
+
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = {};
+		pipelineStateDesc.pRootSignature = rootSignature.Get();
+		pipelineStateDesc.VS = { vertexShader->GetBufferPointer(), vertexShader->GetBufferSize() };
+		pipelineStateDesc.PS = { pixelShader->GetBufferPointer(), pixelShader->GetBufferSize() };
+		pipelineStateDesc.BlendState = primitive.material->blendDesc;
+		pipelineStateDesc.SampleMask = UINT_MAX;
+		pipelineStateDesc.RasterizerState = primitive.material->rasterizerDesc;
+		pipelineStateDesc.DepthStencilState = dsDesc;
+		pipelineStateDesc.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
+		switch (topology) {
+		case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+			break;
+		case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
+		case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+			break;
+		case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
+		case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+			break;
+		default:
+			Log(LogLevel::Warning, { "pipeline" }, "Unsupported primitiveTopology");
+		}
+		pipelineStateDesc.NumRenderTargets = 1;
+		pipelineStateDesc.RTVFormats[0] = m_renderTargetFormat;
+		pipelineStateDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+		pipelineStateDesc.SampleDesc = { 1, 0 };
+		auto& pipelineState = primitive.pipelineState;
+		if (HRESULT hr = m_device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)); FAILED(hr)) {
+			Log(LogLevel::Error, { "pipeline", -1, static_cast<uint32_t>(hr) }, "Failed to create pipelineState");
+		}
+	}
+	else {
+		auto& rootSignature = primitive.rootSignature;
+		D3D12_ROOT_PARAMETER rootParams[2] = {};
+		rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		rootParams[0].Descriptor = { 0, 0 };
+		rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+		rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		rootParams[1].Descriptor = { 1, 0 };
+		rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+
+		D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+		rootSignatureDesc.NumParameters = _countof(rootParams);
+		rootSignatureDesc.pParameters = &rootParams[0];
+		rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+		createRootSignature(rootSignatureDesc, rootSignature);
+
+		auto inputElementDescs = buildInputElementDescs(attributes);
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = {};
+		pipelineStateDesc.pRootSignature = rootSignature.Get();
+		pipelineStateDesc.VS = { vertexShader->GetBufferPointer(), vertexShader->GetBufferSize() };
+		pipelineStateDesc.PS = { pixelShader->GetBufferPointer(), pixelShader->GetBufferSize() };
+		pipelineStateDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+		pipelineStateDesc.SampleMask = UINT_MAX;
+		pipelineStateDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+		pipelineStateDesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+		pipelineStateDesc.RasterizerState.FrontCounterClockwise = true;
+		pipelineStateDesc.DepthStencilState = dsDesc;
+		pipelineStateDesc.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
+		switch (topology) {
+		case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+			break;
+		case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
+		case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+			break;
+		case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
+		case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
+			pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+			break;
+		default:
+			Log(LogLevel::Warning, { "pipeline" }, "Unsupported primitiveTopology");
+		}
+		pipelineStateDesc.NumRenderTargets = 1;
+		pipelineStateDesc.RTVFormats[0] = m_renderTargetFormat;
+		pipelineStateDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+		pipelineStateDesc.SampleDesc = { 1, 0 };
+
+		auto& pipelineState = primitive.pipelineState;
+		if (HRESULT hr = m_device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)); FAILED(hr)) {
+			Log(LogLevel::Error, { "pipeline", -1, static_cast<uint32_t>(hr) }, "Failed to create graphics pipeline state");
+		}
+	}
+}
+
+void Renderer::initNodes() {
+	for (auto& gltfNode : m_gltfModel.nodes) {
+		Node node = {};
+		XMStoreFloat4x4(&node.M, XMMatrixIdentity());
+		node.primitiveOffset = static_cast<uint32_t>(m_primitiveVisible.size());
+		if (gltfNode.mesh >= 0) {
+			m_primitiveVisible.resize(m_primitiveVisible.size() + m_gltfModel.meshes[gltfNode.mesh].primitives.size(), 1);
+		}
+		NodeTransform transform;
+		readNodeTransform(gltfNode, node, transform);
+		m_nodes.push_back(node);
+		m_nodeTransforms.push_back(transform);
+	}
+}
 
-		auto& SRVDescriptorHeap = material.SRVDescriptorHeap;
-		D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
-		descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		descriptorHeapDesc.NumDescriptors = 5;
-		descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		if (FAILED(m_device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&SRVDescriptorHeap)))) {
-			OutputDebugString("---------------------Failed to crreate descriptor heap for pbr material.\n");
+// The local transform of a node, as a matrix or as TRS.
+void Renderer::readNodeTransform(const tinygltf::Node& gltfNode, Node& node, NodeTransform& transform) {
+	node.hasMatrix = !gltfNode.matrix.empty();
+	if (node.hasMatrix) {
+		float* element = &node.matrix.m[0][0];
+		for (auto value : gltfNode.matrix) {
+			*element = static_cast<float>(value);
+			++element;
 		}
+	}
+	transform = {};
+	if (gltfNode.translation.size() == 3) {
+		transform.translation = { static_cast<float>(gltfNode.translation[0]), static_cast<float>(gltfNode.translation[1]), static_cast<float>(gltfNode.translation[2]) };
+	}
+	if (gltfNode.rotation.size() == 4) {
+		transform.rotation = { static_cast<float>(gltfNode.rotation[0]), static_cast<float>(gltfNode.rotation[1]), static_cast<float>(gltfNode.rotation[2]), static_cast<float>(gltfNode.rotation[3]) };
+	}
+	if (gltfNode.scale.size() == 3) {
+		transform.scale = { static_cast<float>(gltfNode.scale[0]), static_cast<float>(gltfNode.scale[1]), static_cast<float>(gltfNode.scale[2]) };
+	}
+}
+
+// Morph weights of a node, its own or else its mesh's.
+void Renderer::readNodeWeights(size_t nodeIndex) {
+	const auto& gltfNode = m_gltfModel.nodes[nodeIndex];
+	m_nodeWeights[nodeIndex].clear();
+	if (gltfNode.mesh >= 0) {
+		const auto& weights = m_gltfModel.meshes[gltfNode.mesh].weights;
+		m_nodeWeights[nodeIndex].assign(weights.begin(), weights.end());
+	}
+	if (!gltfNode.weights.empty()) {
+		m_nodeWeights[nodeIndex].assign(gltfNode.weights.begin(), gltfNode.weights.end());
+	}
+}
+
+// Sized for the most one tile draws: its camera, every node once and every
+// material once. Hot reload keeps the node and material counts.
+void Renderer::initConstantAllocator() {
+	const uint64_t pageSize = ConstantAllocator::Align(sizeof(Camera)) +
+		m_gltfModel.nodes.size() * ConstantAllocator::Align(sizeof(XMFLOAT4X4)) +
+		m_gltfModel.materials.size() * ConstantAllocator::Align(sizeof(PBRMetallicRoughness));
+
+	D3D12_HEAP_PROPERTIES heapProperties = {};
+	heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
+	heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+	D3D12_RESOURCE_DESC resourceDesc = {};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Width = pageSize * FrameCount;
+	resourceDesc.Height = 1;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.SampleDesc = { 1, 0 };
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+	ComPtr<ID3D12Resource> buffer;
+	if (HRESULT hr = createCommittedResource(heapProperties, resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MemoryCategory::Constants, m_memoryScene, buffer); FAILED(hr)) {
+		Log(LogLevel::Error, { "constants", -1, static_cast<uint32_t>(hr) }, "Failed to create constant buffer");
+		return;
+	}
+	if (HRESULT hr = m_constantAllocator.Init(buffer, FrameCount); FAILED(hr)) {
+		Log(LogLevel::Error, { "constants", -1, static_cast<uint32_t>(hr) }, "Failed to map constant buffer");
+	}
+	m_materialConstants.assign(m_materials.size(), 0);
+}
 
-		auto& samplerDescriptorHeap = material.samplerDescriptorHeap;
-		descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
-		if (FAILED(m_device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&samplerDescriptorHeap)))) {
-			OutputDebugString("---------------------Failed to crreate sampler heap for pbr material.\n");
-		}
+void Renderer::retire(ComPtr<IUnknown> object) {
+	if (object) {
+		m_retiredObjects.push_back({ std::move(object), m_frameScheduler.SubmittedDirectValue() });
+	}
+}
 
-		auto& gltfPBRMetallicRoughness = gltfMaterial.pbrMetallicRoughness;
-		auto PBRMetallicRoughness = static_cast<Renderer::PBRMetallicRoughness*>(bufferData);
+void Renderer::releaseRetired() {
+	if (m_retiredObjects.empty()) {
+		return;
+	}
+	const uint64_t completed = m_frameScheduler.CompletedDirectValue();
+	while (!m_retiredObjects.empty() && m_retiredObjects.front().fenceValue <= completed) {
+		m_retiredObjects.pop_front();
+	}
+}
 
-		auto& baseColorFactor = PBRMetallicRoughness->baseColorFactor;
-		baseColorFactor.x = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[0]);
-		baseColorFactor.y = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[1]);
-		baseColorFactor.z = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[2]);
-		baseColorFactor.w = static_cast<float>(gltfPBRMetallicRoughness.baseColorFactor[3]);
+void Renderer::applyReloads() {
+	// Once nothing is streaming, no stream can be reading replaced pixels or
+	// be building mips from them.
+	if (!m_retiredImagePixels.empty() && m_textureStreamer.Outstanding() == 0) {
+		m_retiredImagePixels.clear();
+		std::fill(m_staleTextureStreams.begin(), m_staleTextureStreams.end(), 0);
+	}
 
-		auto& gltfBaseColorTexture = gltfPBRMetallicRoughness.baseColorTexture;
-		auto& baseColorTexture = PBRMetallicRoughness->baseColorTexture;
-		if (gltfBaseColorTexture.index >= 0) {
-			baseColorTexture.textureIndex = 0;
-			baseColorTexture.samplerIndex = 0;
+	auto changed = m_fileWatcher.Poll();
+	if (changed.empty()) {
+		return;
+	}
+	std::vector<std::string> shaders;
+	bool scene = false;
+	for (const auto& path : changed) {
+		if (path == m_vertexShaderPath || path == m_pixelShaderPath || path == m_grayPixelShaderPath) {
+			shaders.push_back(path);
 		}
 		else {
-			baseColorTexture.textureIndex = -1;
-			baseColorTexture.samplerIndex = -1;
+			scene = true;
 		}
-		PBRMetallicRoughness->metallicFactor =
-			static_cast<float>(gltfPBRMetallicRoughness.metallicFactor);
-		PBRMetallicRoughness->roughnessFactor =
-			static_cast<float>(gltfPBRMetallicRoughness.roughnessFactor);
+	}
+	// Scene reloads rewrite descriptors and buffers in place, so the draws in
+	// flight have to be done with them. Shader reloads only replace pipelines,
+	// which are retired until the frames using them complete.
+	if (scene) {
+		m_frameScheduler.WaitForDirectQueue();
+		reloadScene();
+	}
+	if (!shaders.empty()) {
+		reloadShaders(shaders);
+	}
+}
 
-		auto& gltfMetallicRoughnessTexture = gltfPBRMetallicRoughness.metallicRoughnessTexture;
-		auto& metallicRoughnessTexture = PBRMetallicRoughness->metallicRoughnessTexture;
-		if (gltfMetallicRoughnessTexture.index >= 0) {
-			metallicRoughnessTexture.textureIndex = 1;
-			metallicRoughnessTexture.samplerIndex = 1;
+// Recompiles every variant of the changed shaders. A variant that fails to
+// compile keeps its previous shader, and its primitives their pipelines.
+void Renderer::reloadShaders(const std::vector<std::string>& paths) {
+	auto start = high_resolution_clock::now();
+	std::vector<uint32_t> variants;
+	for (uint32_t variantIndex = 0; variantIndex < m_shaderVariants.size(); ++variantIndex) {
+		if (std::find(paths.begin(), paths.end(), m_shaderVariants[variantIndex].path) != paths.end()) {
+			variants.push_back(variantIndex);
 		}
-		else {
-			metallicRoughnessTexture.textureIndex = -1;
-			metallicRoughnessTexture.samplerIndex = -1;
-		}
-		auto srvDescriptor = SRVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-		auto samplerDescriptor = samplerDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-		if (gltfBaseColorTexture.index >= 0) {
-			auto& gltfTexture = m_gltfModel.textures[gltfBaseColorTexture.index];
-			auto texture = m_textures[gltfTexture.source].Get();
-			m_device->CreateShaderResourceView(texture, nullptr, srvDescriptor);
-			auto& samplerDesc = m_samplerDescs[gltfTexture.sampler];
-			m_device->CreateSampler(&samplerDesc, samplerDescriptor);
-		}
-		srvDescriptor.ptr +=
-			m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV];
-		samplerDescriptor.ptr +=
-			m_descriptorSizes[D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER];
-		auto& glTFMetallicRoughnessTexture = gltfPBRMetallicRoughness.metallicRoughnessTexture;
-		if (gltfMetallicRoughnessTexture.index >= 0) {
-			auto& gltfTexture = m_gltfModel.textures[gltfMetallicRoughnessTexture.index];
-			auto texture = m_textures[gltfTexture.source].Get();
-			m_device->CreateShaderResourceView(texture, nullptr, srvDescriptor);
-
-			auto& samplerDesc = m_samplerDescs[gltfTexture.sampler];
-			m_device->CreateSampler(&samplerDesc, samplerDescriptor);
-		}
-		m_materials.push_back(material);
-	}
-
-	for (auto& gltfMesh : m_gltfModel.meshes) {
-		Mesh mesh = {};
-		mesh.name = gltfMesh.name;
-
-		auto& primitives = mesh.primitives;
-		for (auto& gltfPrimitive : gltfMesh.primitives) {
-			Primitive primitive = {};
-			auto& attributes = primitive.attributes;
-			for (auto& [attributeName, accessorIndex] : gltfPrimitive.attributes) {
-				const auto& gltfAccessor = m_gltfModel.accessors[accessorIndex];
-				const auto& gltfBufferView = m_gltfModel.bufferViews[gltfAccessor.bufferView];
-
-				Attribute attribute = {};
-				attribute.name = attributeName;
-				switch (gltfAccessor.type) {
-				case TINYGLTF_TYPE_VEC2:
-					attribute.format = DXGI_FORMAT_R32G32_FLOAT;
-					break;
-				case TINYGLTF_TYPE_VEC3:
-					attribute.format = DXGI_FORMAT_R32G32B32_FLOAT;
-					break;
-				case TINYGLTF_TYPE_VEC4:
-					attribute.format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-					break;
-				}
-				attribute.vertexBufferView.BufferLocation = m_buffers[gltfBufferView.buffer]->GetGPUVirtualAddress() + gltfBufferView.byteOffset + gltfAccessor.byteOffset;
-				attribute.vertexBufferView.SizeInBytes = static_cast<UINT>(gltfBufferView.byteLength - gltfAccessor.byteOffset);
-				attribute.vertexBufferView.StrideInBytes = gltfAccessor.ByteStride(gltfBufferView);
-				attributes.emplace_back(attribute);
+	}
+	std::vector<ComPtr<ID3DBlob>> compiled(variants.size());
+	m_threadPool->ParallelFor(variants.size(), 1, [this, &variants, &compiled](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const ShaderVariant& variant = m_shaderVariants[variants[i]];
+			compileShader(variant.path, variant.defines, variant.target, &compiled[i]);
+		}
+	});
+	std::vector<uint8_t> updated(m_shaderVariants.size());
+	size_t compiledCount = 0;
+	for (size_t i = 0; i < variants.size(); ++i) {
+		if (compiled[i]) {
+			m_shaderVariants[variants[i]].shader = compiled[i];
+			updated[variants[i]] = 1;
+			++compiledCount;
+		}
+	}
 
-				if (attributeName == "POSITION") {
-					primitive.vertexCount = static_cast<uint32_t>(gltfAccessor.count);
-				}
+	std::vector<std::pair<size_t, size_t>> pipelines;
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex) {
+		const auto& primitives = m_meshes[meshIndex].primitives;
+		for (size_t primitiveIndex = 0; primitiveIndex < primitives.size(); ++primitiveIndex) {
+			if (updated[primitives[primitiveIndex].vertexShader] || updated[primitives[primitiveIndex].pixelShader]) {
+				pipelines.push_back({ meshIndex, primitiveIndex });
 			}
+		}
+	}
+	rebuildPipelines(pipelines);
 
-			auto& primitiveTopology = primitive.primitiveTopology;
-			switch (gltfPrimitive.mode) {
-			case TINYGLTF_MODE_POINTS:
-				primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-				break;
-			case TINYGLTF_MODE_LINE:
-				primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
-				break;
-			case TINYGLTF_MODE_LINE_STRIP:
-				primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
-				break;
-			case TINYGLTF_MODE_TRIANGLES:
-				primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-				break;
-			case TINYGLTF_MODE_TRIANGLE_STRIP:
-				primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
-				break;
-			default:
-				assert(false);
-			}
+	std::string files;
+	for (const auto& path : paths) {
+		files += (files.empty() ? "" : ", ") + path.substr(path.find_last_of("\\/") + 1);
+	}
+	Log(LogLevel::Info, { "reload" }, "reload {}: {} of {} shader variants compiled, {} pipelines rebuilt in {:.1f} ms",
+		files, compiledCount, variants.size(), pipelines.size(), duration<double_t, std::milli>(high_resolution_clock::now() - start).count());
+}
 
-			if (gltfPrimitive.indices >= 0) {
-				const auto& gltfAccessor = m_gltfModel.accessors[gltfPrimitive.indices];
-				const auto& gltfBufferView = m_gltfModel.bufferViews[gltfAccessor.bufferView];
-
-				auto& indexBufferView = primitive.indexBufferView;
-				indexBufferView.BufferLocation = m_buffers[gltfBufferView.buffer]->GetGPUVirtualAddress() + gltfBufferView.byteOffset + gltfAccessor.byteOffset;
-				indexBufferView.SizeInBytes = static_cast<UINT>(gltfBufferView.byteLength - gltfAccessor.byteOffset);
-				switch (gltfAccessor.componentType) {
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-					indexBufferView.Format = DXGI_FORMAT_R8_UINT;
-					break;
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-					indexBufferView.Format = DXGI_FORMAT_R16_UINT;
-					break;
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-					indexBufferView.Format = DXGI_FORMAT_R32_UINT;
-					break;
-				}
-				auto& indexCount = primitive.indexCount;
-				indexCount = static_cast<uint32_t>(gltfAccessor.count);
-			}
-
-			auto buildDefines = [](const std::vector<Attribute>& attributes) {
-				std::vector<D3D_SHADER_MACRO> defines;
-				for (auto& attribute : attributes) {
-					if (attribute.name == "NORMAL")
-						defines.push_back({ "HAS_NORMAL", "1" });
-					else if (attribute.name == "TANGENT")
-						defines.push_back({ "HAS_TANGENT", "1" });
-					else if (attribute.name == "TEXCOORD_0")
-						defines.push_back({ "HAS_TEXCOORD_0", "1" });
-				}
-				defines.push_back({ nullptr, nullptr });
+void Renderer::rebuildPipelines(const std::vector<std::pair<size_t, size_t>>& primitives) {
+	std::vector<std::pair<size_t, size_t>> rebuilt;
+	for (const auto& [meshIndex, primitiveIndex] : primitives) {
+		auto& primitive = m_meshes[meshIndex].primitives[primitiveIndex];
+		if (!m_shaderVariants[primitive.vertexShader].shader || !m_shaderVariants[primitive.pixelShader].shader) {
+			continue;
+		}
+		retire(primitive.rootSignature);
+		retire(primitive.pipelineState);
+		rebuilt.push_back({ meshIndex, primitiveIndex });
+	}
+	m_threadPool->ParallelFor(rebuilt.size(), 1, [this, &rebuilt](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			auto [meshIndex, primitiveIndex] = rebuilt[i];
+			const auto& primitive = m_meshes[meshIndex].primitives[primitiveIndex];
+			initPipeline(meshIndex, primitiveIndex, m_shaderVariants[primitive.vertexShader].shader.Get(), m_shaderVariants[primitive.pixelShader].shader.Get());
+		}
+	});
+}
 
-				return defines;
-			};
-			auto compileShaderFromFile = [](LPCWSTR filePath, D3D_SHADER_MACRO* defines, LPCSTR target, ID3DBlob** shader) {
-				UINT flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-				ComPtr<ID3DBlob> error;
-				if (FAILED(D3DCompileFromFile(filePath, defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", target, flags, 0, shader, &error))) {
-					OutputDebugString("------------------------------Failed to compile shader\n");
-					OutputDebugString(static_cast<char*>(error->GetBufferPointer()));
-				}
-			};
-			auto createRootSignature = [this](D3D12_ROOT_SIGNATURE_DESC* rootSignatureDesc, ID3D12RootSignature** rootSignature) {
-				ComPtr<ID3DBlob> serializeRootSignature;
-				ComPtr<ID3DBlob> error;
-				if (FAILED(D3D12SerializeRootSignature(rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, serializeRootSignature.GetAddressOf(), error.GetAddressOf()))) {
-					OutputDebugString("------------------------------Failed to serialize Root Signiture\n");
-					OutputDebugString(static_cast<char*>(error->GetBufferPointer()));
-				}
-				if(FAILED(m_device->CreateRootSignature(0, serializeRootSignature->GetBufferPointer(), serializeRootSignature->GetBufferSize(), IID_PPV_ARGS(rootSignature)))){
-					OutputDebugString("------------------------------Failed to create root signature\n");
+Renderer::SceneSignature Renderer::signScene(const tinygltf::Model& model, const std::vector<std::vector<std::pair<size_t, size_t>>>& uploadRanges) const {
+	SceneSignature signature;
+	auto combine = [](const std::vector<ContentHash>& hashes) {
+		return HashContent(hashes.data(), hashes.size() * sizeof(ContentHash));
+	};
+	auto stringHash = [](const std::string& value) {
+		return static_cast<int64_t>(HashContent(value.data(), value.size()).low);
+	};
+	// The layout of an accessor and the bytes it reads, from its first element
+	// to the end of its view.
+	auto viewHash = [&model](int viewIndex, size_t byteOffset, uint64_t seed) {
+		if (viewIndex < 0) {
+			return HashContent(nullptr, 0, seed);
+		}
+		const auto& gltfBufferView = model.bufferViews[viewIndex];
+		const auto& gltfBuffer = model.buffers[gltfBufferView.buffer];
+		return HashContent(gltfBuffer.data.data() + gltfBufferView.byteOffset + byteOffset, gltfBufferView.byteLength - byteOffset, seed);
+	};
+	auto accessorHash = [&](int accessorIndex) {
+		if (accessorIndex < 0) {
+			return ContentHash{};
+		}
+		const auto& gltfAccessor = model.accessors[accessorIndex];
+		const int64_t stride = gltfAccessor.bufferView >= 0 ? gltfAccessor.ByteStride(model.bufferViews[gltfAccessor.bufferView]) : 0;
+		const int64_t layout[] = { static_cast<int64_t>(gltfAccessor.count), gltfAccessor.componentType, gltfAccessor.type, gltfAccessor.normalized, stride };
+		const uint64_t seed = HashContent(layout, sizeof(layout)).low;
+		std::vector<ContentHash> hashes = { viewHash(gltfAccessor.bufferView, gltfAccessor.byteOffset, seed) };
+		if (gltfAccessor.sparse.isSparse) {
+			hashes.push_back(viewHash(gltfAccessor.sparse.indices.bufferView, gltfAccessor.sparse.indices.byteOffset, gltfAccessor.sparse.count));
+			hashes.push_back(viewHash(gltfAccessor.sparse.values.bufferView, gltfAccessor.sparse.values.byteOffset, gltfAccessor.sparse.count));
+		}
+		return combine(hashes);
+	};
+
+	// Everything Init builds that a reload does not rebuild.
+	std::vector<int64_t> structure = {
+		static_cast<int64_t>(model.buffers.size()), static_cast<int64_t>(model.images.size()), static_cast<int64_t>(model.textures.size()),
+		static_cast<int64_t>(model.samplers.size()), static_cast<int64_t>(model.materials.size()), static_cast<int64_t>(model.meshes.size()),
+		static_cast<int64_t>(model.nodes.size()), static_cast<int64_t>(model.skins.size()), static_cast<int64_t>(model.animations.size()),
+		static_cast<int64_t>(model.scenes.size()), model.defaultScene };
+	for (const auto& gltfImage : model.images) {
+		structure.insert(structure.end(), { gltfImage.width, gltfImage.height });
+	}
+	for (const auto& gltfTexture : model.textures) {
+		structure.insert(structure.end(), { gltfTexture.source, gltfTexture.sampler });
+	}
+	for (const auto& gltfSampler : model.samplers) {
+		structure.insert(structure.end(), { gltfSampler.minFilter, gltfSampler.magFilter, gltfSampler.wrapS, gltfSampler.wrapT });
+	}
+	for (const auto& gltfMesh : model.meshes) {
+		structure.insert(structure.end(), { static_cast<int64_t>(gltfMesh.primitives.size()), static_cast<int64_t>(gltfMesh.weights.size()) });
+		for (const auto& gltfPrimitive : gltfMesh.primitives) {
+			// Attribute formats pick the shader variant and input layout.
+			structure.insert(structure.end(), { gltfPrimitive.mode, gltfPrimitive.material, gltfPrimitive.indices >= 0, static_cast<int64_t>(gltfPrimitive.targets.size()) });
+			for (const auto& [name, accessorIndex] : gltfPrimitive.attributes) {
+				const auto& gltfAccessor = model.accessors[accessorIndex];
+				structure.insert(structure.end(), { stringHash(name), gltfAccessor.type, gltfAccessor.componentType, gltfAccessor.normalized });
+			}
+		}
+	}
+	for (const auto& gltfNode : model.nodes) {
+		structure.insert(structure.end(), { gltfNode.mesh, gltfNode.skin, gltfNode.camera, static_cast<int64_t>(gltfNode.weights.size()), static_cast<int64_t>(gltfNode.children.size()) });
+		structure.insert(structure.end(), gltfNode.children.begin(), gltfNode.children.end());
+	}
+	std::vector<ContentHash> dataHashes;
+	for (const auto& gltfSkin : model.skins) {
+		structure.insert(structure.end(), { gltfSkin.skeleton, static_cast<int64_t>(gltfSkin.joints.size()) });
+		structure.insert(structure.end(), gltfSkin.joints.begin(), gltfSkin.joints.end());
+		dataHashes.push_back(accessorHash(gltfSkin.inverseBindMatrices));
+	}
+	for (const auto& gltfAnimation : model.animations) {
+		for (const auto& gltfChannel : gltfAnimation.channels) {
+			structure.insert(structure.end(), { gltfChannel.sampler, gltfChannel.target_node, stringHash(gltfChannel.target_path) });
+		}
+		for (const auto& gltfSampler : gltfAnimation.samplers) {
+			structure.push_back(stringHash(gltfSampler.interpolation));
+			dataHashes.push_back(accessorHash(gltfSampler.input));
+			dataHashes.push_back(accessorHash(gltfSampler.output));
+		}
+	}
+	for (const auto& gltfScene : model.scenes) {
+		structure.push_back(static_cast<int64_t>(gltfScene.nodes.size()));
+		structure.insert(structure.end(), gltfScene.nodes.begin(), gltfScene.nodes.end());
+	}
+	dataHashes.push_back(HashContent(structure.data(), structure.size() * sizeof(int64_t)));
+	signature.structure = combine(dataHashes);
+
+	auto& images = model.images;
+	signature.images.resize(images.size());
+	m_threadPool->ParallelFor(images.size(), 1, [&images, &signature](size_t begin, size_t end) {
+		for (size_t imageIndex = begin; imageIndex < end; ++imageIndex) {
+			signature.images[imageIndex] = HashContent(images[imageIndex].image.data(), images[imageIndex].image.size());
+		}
+	});
+	for (size_t bufferIndex = 0; bufferIndex < model.buffers.size(); ++bufferIndex) {
+		std::vector<ContentHash> ranges;
+		for (const auto& [begin, end] : uploadRanges[bufferIndex]) {
+			ranges.push_back(HashContent(model.buffers[bufferIndex].data.data() + begin, end - begin, begin));
+		}
+		signature.buffers.push_back(combine(ranges));
+	}
+	signature.meshes.resize(model.meshes.size());
+	m_threadPool->ParallelFor(model.meshes.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t meshIndex = begin; meshIndex < end; ++meshIndex) {
+			std::vector<ContentHash> accessors;
+			for (const auto& gltfPrimitive : model.meshes[meshIndex].primitives) {
+				accessors.push_back(accessorHash(gltfPrimitive.indices));
+				for (const auto& [name, accessorIndex] : gltfPrimitive.attributes) {
+					accessors.push_back(accessorHash(accessorIndex));
 				}
-			};
-			auto buildInputElementDescs = [](const std::vector<Attribute>& attributes) {
-				std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDescs;
-				for (auto& attribute : attributes) {
-					D3D12_INPUT_ELEMENT_DESC inputElementDesc = {};
-					inputElementDesc.SemanticName = &attribute.name[0];
-					inputElementDesc.Format = attribute.format;
-					if (attribute.name == "TEXCOORD_0") {
-						inputElementDesc.SemanticName = "TEXCOORD_";
-						inputElementDesc.SemanticIndex = 0;
+				for (const auto& target : gltfPrimitive.targets) {
+					for (const auto& [name, accessorIndex] : target) {
+						accessors.push_back(accessorHash(accessorIndex));
 					}
-					inputElementDesc.InputSlot =
-						static_cast<UINT>(inputElementDescs.size());
-					inputElementDesc.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
-					inputElementDesc.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-					inputElementDescs.push_back(inputElementDesc);
-				}
-				return inputElementDescs;
-			};
-
-			if (gltfPrimitive.material >= 0) {
-				primitive.material = &m_materials[gltfPrimitive.material];
-
-				auto& rootSignature = primitive.rootSignature;
-
-				D3D12_DESCRIPTOR_RANGE SRVDescriptorRange = {};
-				SRVDescriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-				SRVDescriptorRange.NumDescriptors = 5;
-
-				D3D12_DESCRIPTOR_RANGE samplerDescriptorRange = {};
-				samplerDescriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
-				samplerDescriptorRange.NumDescriptors = 5;
-
-				D3D12_ROOT_PARAMETER rootParams[5] = {};
-				rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-				rootParams[0].Descriptor = { 0, 0 };
-				rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-				rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
-				rootParams[1].Descriptor = { 1, 0 };
-				rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-				rootParams[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-				rootParams[2].Descriptor = { 2, 0 };
-				rootParams[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-				rootParams[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-				rootParams[3].DescriptorTable = { 1, &SRVDescriptorRange };
-				rootParams[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-				rootParams[4].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-				rootParams[4].DescriptorTable = { 1, &samplerDescriptorRange };
-				rootParams[4].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-
-				D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
-				rootSignatureDesc.NumParameters = _countof(rootParams);
-				rootSignatureDesc.pParameters = &rootParams[0];
-				rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-				createRootSignature(&rootSignatureDesc, &rootSignature);
-
-				auto defines = buildDefines(attributes);
-
-				ComPtr<ID3DBlob> vertexShader;
-				std::wstring vertexShaderPath(m_vertexShaderPath.begin(), m_vertexShaderPath.end());
-				ComPtr<ID3DBlob> pixelShader;
-				std::wstring pixelShaderPath(m_pixelShaderPath.begin(), m_pixelShaderPath.end());
-
-				compileShaderFromFile(vertexShaderPath.c_str(), &defines[0], "vs_5_1", &vertexShader);
-				compileShaderFromFile(pixelShaderPath.c_str(), &defines[0], "ps_5_1", &pixelShader);
-				auto inputElementDescs = buildInputElementDescs(attributes);
-
-				D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = {};
-				pipelineStateDesc.pRootSignature = rootSignature.Get();
-				pipelineStateDesc.VS = { vertexShader->GetBufferPointer(), vertexShader->GetBufferSize() };
-				pipelineStateDesc.PS = { pixelShader->GetBufferPointer(), pixelShader->GetBufferSize() };
-				pipelineStateDesc.BlendState = primitive.material->blendDesc;
-				pipelineStateDesc.SampleMask = UINT_MAX;
-				pipelineStateDesc.RasterizerState = primitive.material->rasterizerDesc;
-				pipelineStateDesc.DepthStencilState = dsDesc;
-				pipelineStateDesc.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
-				switch (primitive.primitiveTopology) {
-				case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-					break;
-				case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
-				case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
-					break;
-				case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
-				case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-					break;
-				default:
-					OutputDebugString("-------------------------Unsupported primitiveTopology\n");
-				}
-				pipelineStateDesc.NumRenderTargets = 1;
-				pipelineStateDesc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
-				pipelineStateDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
-				pipelineStateDesc.SampleDesc = { 1, 0 };
-				auto& pipelineState = primitive.pipelineState;
-				if (FAILED(m_device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)))) {
-					OutputDebugString("---------------------------Failed to create pipelineState\n");
 				}
 			}
-			else {
-				auto& rootSignature = primitive.rootSignature;
-				D3D12_ROOT_PARAMETER rootParams[2] = {};
-				rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-				rootParams[0].Descriptor = { 0, 0 };
-				rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-				rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-				rootParams[1].Descriptor = { 1, 0 };
-				rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-
-				D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
-				rootSignatureDesc.NumParameters = _countof(rootParams);
-				rootSignatureDesc.pParameters = &rootParams[0];
-				rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-				createRootSignature(&rootSignatureDesc, &rootSignature);
-				auto defines = buildDefines(attributes);
-				ComPtr<ID3DBlob> vertexShader;
-				ComPtr<ID3DBlob> pixelShader;
-				std::wstring vertexShaderPath(m_vertexShaderPath.begin(), m_vertexShaderPath.end());
-				std::wstring grayPixelShaderPath(m_grayPixelShaderPath.begin(), m_grayPixelShaderPath.end());
-				compileShaderFromFile(vertexShaderPath.c_str(), &defines[0], "vs_5_1", &vertexShader);
-				compileShaderFromFile(grayPixelShaderPath.c_str(), &defines[0], "vs_5_1", &pixelShader);
-
-				auto inputElementDescs = buildInputElementDescs(attributes);
-				D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = {};
-				pipelineStateDesc.pRootSignature = rootSignature.Get();
-				pipelineStateDesc.VS = { vertexShader->GetBufferPointer(), vertexShader->GetBufferSize() };
-				pipelineStateDesc.PS = { pixelShader->GetBufferPointer(), pixelShader->GetBufferSize() };
-				pipelineStateDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-				pipelineStateDesc.SampleMask = UINT_MAX;
-				pipelineStateDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-				pipelineStateDesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
-				pipelineStateDesc.RasterizerState.FrontCounterClockwise = true;
-				pipelineStateDesc.DepthStencilState = dsDesc;
-				pipelineStateDesc.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
-				switch (primitive.primitiveTopology) {
-				case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-					break;
-				case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
-				case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
-					break;
-				case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
-				case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
-					pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-					break;
-				default:
-					OutputDebugString("-------------------------Unsupported primitiveTopology\n");
-				}
-				pipelineStateDesc.NumRenderTargets = 1;
-				pipelineStateDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UINT;
-				pipelineStateDesc.SampleDesc = { 1, 0 };
+			signature.meshes[meshIndex] = combine(accessors);
+		}
+	});
+	for (const auto& gltfMaterial : model.materials) {
+		signature.materials.push_back(materialHash(gltfMaterial));
+	}
+	for (const auto& gltfNode : model.nodes) {
+		std::vector<double> transform;
+		for (const auto* values : { &gltfNode.translation, &gltfNode.rotation, &gltfNode.scale, &gltfNode.matrix, &gltfNode.weights }) {
+			transform.push_back(static_cast<double>(values->size()));
+			transform.insert(transform.end(), values->begin(), values->end());
+		}
+		signature.nodes.push_back(HashContent(transform.data(), transform.size() * sizeof(double)));
+	}
+	return signature;
+}
 
-				auto& pipelineState = primitive.pipelineState;
-				if (FAILED(m_device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)))) {
-					OutputDebugString("-------------------------Failed to create graphics pipeline state\n");
-				}
+// Loads the scene again and rebuilds what differs from the loaded one: each
+// changed buffer, texture, mesh and material, the pipelines of the changed
+// materials' primitives, and the changed nodes' transforms. Anything else
+// changing, or the geometry of a skinned or morphed mesh, takes a restart.
+void Renderer::reloadScene() {
+	auto start = high_resolution_clock::now();
+	const std::string sceneName = m_scenePath.substr(m_scenePath.find_last_of("\\/") + 1);
+	tinygltf::Model model;
+	std::vector<std::string> files;
+	if (!loadScene(m_scenePath, model, files)) {
+		Log(LogLevel::Warning, { "reload" }, "Reload of {} failed, keeping the loaded scene", sceneName);
+		return;
+	}
+	std::vector<std::vector<std::pair<size_t, size_t>>> uploadRanges;
+	DedupStats dedupStats;
+	deduplicateScene(model, uploadRanges, dedupStats);
+	SceneSignature signature = signScene(model, uploadRanges);
+	if (signature.structure != m_sceneSignature.structure) {
+		Log(LogLevel::Warning, { "reload" }, "The structure of {} changed, restart to load it", sceneName);
+		return;
+	}
+	for (const auto& path : files) {
+		m_fileWatcher.Watch(path);
+	}
+
+	auto changedItems = [](const std::vector<ContentHash>& loaded, const std::vector<ContentHash>& reloaded) {
+		std::vector<size_t> changed;
+		for (size_t index = 0; index < loaded.size(); ++index) {
+			if (loaded[index] != reloaded[index]) {
+				changed.push_back(index);
+			}
+		}
+		return changed;
+	};
+	const auto changedImages = changedItems(m_sceneSignature.images, signature.images);
+	const auto changedBuffers = changedItems(m_sceneSignature.buffers, signature.buffers);
+	const auto changedMeshes = changedItems(m_sceneSignature.meshes, signature.meshes);
+	const auto changedMaterials = changedItems(m_sceneSignature.materials, signature.materials);
+	const auto changedNodes = changedItems(m_sceneSignature.nodes, signature.nodes);
+	// Skinned and morphed meshes keep their bind pose on the CPU and in their
+	// own per node buffers.
+	for (size_t meshIndex : changedMeshes) {
+		for (const auto& gltfPrimitive : model.meshes[meshIndex].primitives) {
+			if (!gltfPrimitive.targets.empty() || gltfPrimitive.attributes.count("JOINTS_0")) {
+				Log(LogLevel::Warning, { "reload" }, "Deformed mesh {} of {} changed, restart to load it", meshIndex, sceneName);
+				return;
 			}
-			primitives.push_back(primitive);
 		}
-		m_meshes.push_back(mesh);
 	}
 
-	for (auto& gltfNode : m_gltfModel.nodes) {
-		D3D12_HEAP_PROPERTIES heapProperties = {};
-		heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
-		heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	// Unchanged images keep the pixels already loaded, which streams in flight
+	// may be reading; released ones take the pixels just decoded, since a
+	// changed material may sample them now. Replaced pixels are kept until the
+	// streamer is idle.
+	for (size_t imageIndex = 0; imageIndex < model.images.size(); ++imageIndex) {
+		auto& pixels = m_scene.Images()[imageIndex].pixels;
+		if (std::binary_search(changedImages.begin(), changedImages.end(), imageIndex)) {
+			m_retiredImagePixels.push_back(std::move(pixels));
+			m_staleTextureStreams[imageIndex] = m_textureResidency.Pending(static_cast<uint32_t>(imageIndex));
+			m_lostTextureSources[imageIndex] = 0;
+		}
+		else if (!pixels.empty()) {
+			model.images[imageIndex].image.swap(pixels);
+		}
+	}
+	m_gltfModel = std::move(model);
+	m_scene.Build(m_gltfModel);
+	keepImageSources(m_scenePath, m_gltfModel, m_scene.Images());
+	m_bufferUploadRanges = std::move(uploadRanges);
+	m_sceneSignature = std::move(signature);
+	m_memoryTracker.Resize(m_sceneSourceMemory, sceneSourceBytes());
+
+	for (size_t bufferIndex : changedBuffers) {
+		retire(m_buffers[bufferIndex]);
+		m_buffers[bufferIndex] = uploadBuffer(bufferIndex);
+	}
 
-		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Width = alignPow2(sizeof(PBRMetallicRoughness), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-		resourceDesc.Height = 1;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.MipLevels = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.SampleDesc = { 1, 0 };
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	// Textures are rebuilt with the mips they had resident.
+	std::vector<std::vector<TextureMipLevel>> levels(changedImages.size());
+	m_threadPool->ParallelFor(changedImages.size(), 1, [this, &changedImages, &levels](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const uint32_t texture = static_cast<uint32_t>(changedImages[i]);
+			const auto& image = m_scene.Images()[texture];
+			BuildTextureMips(image.pixels.data(), image.width, image.height, 4, m_textureResidentMips[texture], m_textureResidency.MipCount(texture), levels[i]);
+		}
+	});
+	for (size_t i = 0; i < changedImages.size(); ++i) {
+		retire(m_textures[changedImages[i]]);
+		m_textures[changedImages[i]] = uploadTexture(levels[i]);
+	}
 
-		ComPtr<ID3D12Resource> buffer;
-		if (FAILED(m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer)))) {
-			OutputDebugString("---------------------------------Failed to create node buffer\n");
+	std::vector<std::vector<std::vector<uint32_t>>> lodIndices(changedMeshes.size());
+	for (size_t i = 0; i < changedMeshes.size(); ++i) {
+		for (auto& primitive : m_meshes[changedMeshes[i]].primitives) {
+			retire(primitive.lodIndexBuffer);
+			primitive.lods.clear();
+			primitive.textureDensity = 0.0f;
+			primitive.occluderIndices.clear();
+			primitive.occluderPositions.clear();
+		}
+		lodIndices[i].resize(m_meshes[changedMeshes[i]].primitives.size());
+	}
+	m_threadPool->ParallelFor(changedMeshes.size(), 1, [this, &changedMeshes, &lodIndices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			buildLods(changedMeshes[i], lodIndices[i]);
 		}
+	});
+	for (size_t i = 0; i < changedMeshes.size(); ++i) {
+		uploadLodIndices(changedMeshes[i], lodIndices[i]);
+	}
+	// The new buffers and textures have to be complete before a frame reads them.
+	m_uploadManager.WaitIdle();
+	if (m_maxOccluders) {
+		m_memoryTracker.Resize(m_occlusionMemory, occlusionBytes());
+	}
 
-		void* data;
-		if (FAILED(buffer->Map(0, nullptr, &data))) {
-			OutputDebugString("---------------------------------Failed to map buffer\n");
+	// Views are cheap and depend on buffers, LODs and materials alike, so every
+	// mesh gets them anew.
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex) {
+		initPrimitiveViews(meshIndex);
+	}
+	for (size_t materialIndex : changedMaterials) {
+		Material& material = m_materials[materialIndex];
+		retire(material.SRVDescriptorHeap);
+		retire(material.samplerDescriptorHeap);
+		material = {};
+	}
+	m_threadPool->ParallelFor(changedMaterials.size(), 1, [this, &changedMaterials](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			initMaterial(changedMaterials[i]);
 		}
-		if (gltfNode.matrix.empty()) {
-			XMStoreFloat4x4(static_cast<DirectX::XMFLOAT4X4*>(data),
-				XMMatrixIdentity());
+	});
+	collectTextureDescriptors();
+	for (size_t imageIndex : changedImages) {
+		for (auto descriptor : m_textureDescriptors[imageIndex]) {
+			m_device->CreateShaderResourceView(m_textures[imageIndex].Get(), nullptr, descriptor);
 		}
-		else {
-			float* element = static_cast<float*>(data);
-			for (auto value : gltfNode.matrix) {
-				*element = static_cast<float>(value);
-				++element;
+	}
+	std::vector<std::pair<size_t, size_t>> pipelines;
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex) {
+		const auto& gltfPrimitives = m_gltfModel.meshes[meshIndex].primitives;
+		for (size_t primitiveIndex = 0; primitiveIndex < gltfPrimitives.size(); ++primitiveIndex) {
+			const int material = gltfPrimitives[primitiveIndex].material;
+			if (material >= 0 && std::binary_search(changedMaterials.begin(), changedMaterials.end(), static_cast<size_t>(material))) {
+				pipelines.push_back({ meshIndex, primitiveIndex });
 			}
 		}
-		m_nodeBuffers.push_back(buffer);
-	}
-	if (m_copyFence->GetCompletedValue() < m_copyFenceValue) {
-		HANDLE event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
-		m_copyFence->SetEventOnCompletion(m_copyFenceValue, event);
-		WaitForSingleObject(event, INFINITE);
-		CloseHandle(event);
 	}
-	D3D12_HEAP_PROPERTIES heapProperties = {};
-	heapProperties.Type = D3D12_HEAP_TYPE_UPLOAD;
-	heapProperties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProperties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-
-	D3D12_RESOURCE_DESC resourceDesc = {};
-	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	resourceDesc.Width = alignPow2(sizeof(PBRMetallicRoughness), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-	resourceDesc.Height = 1;
-	resourceDesc.DepthOrArraySize = 1;
-	resourceDesc.MipLevels = 1;
-	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-	resourceDesc.SampleDesc = { 1, 0 };
-	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	rebuildPipelines(pipelines);
 
-	m_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_cameraBuffer));
+	for (size_t nodeIndex : changedNodes) {
+		readNodeTransform(m_gltfModel.nodes[nodeIndex], m_nodes[nodeIndex], m_nodeTransforms[nodeIndex]);
+		readNodeWeights(nodeIndex);
+	}
+	if (!changedNodes.empty()) {
+		updateNodes();
+	}
 
-	//todo: raytracing
-	//todo: output depth
-	//todo: consume lightfield config file
+	Log(LogLevel::Info, { "reload" }, "reload {}: {} buffers, {} textures, {} meshes, {} materials, {} pipelines, {} nodes rebuilt in {:.1f} ms",
+		sceneName, changedBuffers.size(), changedImages.size(), changedMeshes.size(), changedMaterials.size(), pipelines.size(), changedNodes.size(),
+		duration<double_t, std::milli>(high_resolution_clock::now() - start).count());
+	releaseSceneSource();
 }
 
 void Renderer::Update(double_t deltaTime) {
-	void* data;
-	m_cameraBuffer->Map(0, nullptr, &data);
-
-	auto* cameraData = static_cast<Camera*>(data);
+	// Deformed vertices go to the next copy, last drawn FrameCount frames ago.
+	// At most FrameCount tiles are in flight, so those draws are normally done
+	// and the wait returns at once; the previous frame's draws keep running.
+	if (!m_deformChunks.empty()) {
+		m_deformedCopy = (m_deformedCopy + 1) % FrameCount;
+		m_frameScheduler.WaitForDirectValue(m_deformedCopyFences[m_deformedCopy]);
+	}
+	releaseRetired();
+	if (m_hotReload) {
+		applyReloads();
+	}
 
 	constexpr auto kRadius = 3.0;
-	static auto degree = 0.0;
-	degree += 10.0 * deltaTime;
+	m_sceneTime += deltaTime;
+	auto degree = 10.0 * m_sceneTime;
 	auto radian = degree * XM_PI / 180.0;
 
 	XMMATRIX P = XMMatrixPerspectiveFovRH(90.0f * XM_PI / 180.0f, m_aspectRatio, 0.01f, 100.0f);
-	XMStoreFloat4x4(&cameraData->P, XMMatrixTranspose(P));
+	XMStoreFloat4x4(&m_camera.P, P);
 
+	XMVECTOR eye = XMVectorSet(static_cast<float>(kRadius * cos(radian)), 0.0f, static_cast<float>(kRadius * sin(radian)), 1.0f);
 	XMMATRIX V = XMMatrixLookAtRH(
-		XMVectorSet(static_cast<float>(kRadius * cos(radian)), 0.0f, static_cast<float>(kRadius * sin(radian)), 1.0f),
+		eye,
 		XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f),
 		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
-	XMStoreFloat4x4(&cameraData->V, XMMatrixTranspose(V));
-
-	XMMATRIX VP = XMMatrixMultiply(V, P);
-	XMStoreFloat4x4(&cameraData->VP, XMMatrixTranspose(VP));
-	m_cameraBuffer->Unmap(0, nullptr);
+	XMStoreFloat4x4(&m_camera.V, V);
+	XMStoreFloat4x4(&m_camera.VP, XMMatrixMultiply(V, P));
+	XMStoreFloat3(&m_cameraPosition, eye);
+
+	m_lodProjectionScale = 0.5f * static_cast<float>(m_height) * XMVectorGetY(P.r[1]);
+
+	// Animated transforms are written before the world matrices are rebuilt.
+	if (m_animation >= 0) {
+		m_animationTime += deltaTime;
+		auto sampleStart = high_resolution_clock::now();
+		m_animations.Sample(static_cast<uint32_t>(m_animation), static_cast<float>(m_animationTime), m_nodeTransforms, m_nodeWeights, m_animationStats);
+		m_animationMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - sampleStart).count();
+		updateNodes();
+	}
+	if (!m_deformChunks.empty()) {
+		deformMeshes();
+	}
+	if (m_rayTracer) {
+		updateRayTracingInstances();
+	}
 }
 
 
+// Runs once per frame, before its tiles: occluders are ranked by the angle
+// their bounds subtend, and deformed primitives are left out both as
+// occluders and as occludees since their bounds describe the bind pose.
+void Renderer::updateOcclusion() {
+	m_occlusionStats = {};
+	std::fill(m_primitiveVisible.begin(), m_primitiveVisible.end(), 1);
+	if (!m_maxOccluders) {
+		return;
+	}
+
+	XMVECTOR eye = XMLoadFloat3(&m_cameraPosition);
+	m_occluderCandidates.clear();
+	for (size_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex) {
+		const auto& sceneNode = m_scene.Nodes()[nodeIndex];
+		if (sceneNode.mesh < 0) {
+			continue;
+		}
+		const auto& node = m_nodes[nodeIndex];
+		const auto& primitives = m_meshes[sceneNode.mesh].primitives;
+		XMMATRIX M = XMLoadFloat4x4(&node.M);
+		float scale = std::max({
+			XMVectorGetX(XMVector3Length(M.r[0])),
+			XMVectorGetX(XMVector3Length(M.r[1])),
+			XMVectorGetX(XMVector3Length(M.r[2])) });
+		for (size_t primitiveIndex = 0; primitiveIndex < primitives.size(); ++primitiveIndex) {
+			const auto& primitive = primitives[primitiveIndex];
+			const bool deformed = node.deformedPrimitives >= 0 && m_deformedPrimitives[node.deformedPrimitives + primitiveIndex].mesh != UINT32_MAX;
+			if (deformed || primitive.occluderIndices.empty()) {
+				continue;
+			}
+			XMVECTOR center = XMVector3Transform(XMLoadFloat3(&primitive.boundsCenter), M);
+			float distance = std::max(XMVectorGetX(XMVector3Length(center - eye)), 1e-3f);
+			Occluder occluder = { primitive.occluderPositions.data(), static_cast<uint32_t>(primitive.occluderPositions.size() / 3),
+				primitive.occluderIndices.data(), static_cast<uint32_t>(primitive.occluderIndices.size()), node.M };
+			m_occluderCandidates.push_back({ primitive.boundsRadius * scale / distance, occluder });
+		}
+	}
+	const size_t occluderCount = std::min<size_t>(m_maxOccluders, m_occluderCandidates.size());
+	std::partial_sort(m_occluderCandidates.begin(), m_occluderCandidates.begin() + occluderCount, m_occluderCandidates.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; });
+	m_occluders.clear();
+	for (size_t i = 0; i < occluderCount; ++i) {
+		m_occluders.push_back(m_occluderCandidates[i].second);
+	}
+	m_occlusionBuffer.Rasterize(m_occluders, m_camera.VP, *m_threadPool, m_occlusionStats);
+
+	auto start = high_resolution_clock::now();
+	for (size_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex) {
+		const auto& sceneNode = m_scene.Nodes()[nodeIndex];
+		if (sceneNode.mesh < 0) {
+			continue;
+		}
+		const auto& node = m_nodes[nodeIndex];
+		const auto& primitives = m_meshes[sceneNode.mesh].primitives;
+		XMMATRIX M = XMLoadFloat4x4(&node.M);
+		float scale = std::max({
+			XMVectorGetX(XMVector3Length(M.r[0])),
+			XMVectorGetX(XMVector3Length(M.r[1])),
+			XMVectorGetX(XMVector3Length(M.r[2])) });
+		for (size_t primitiveIndex = 0; primitiveIndex < primitives.size(); ++primitiveIndex) {
+			const auto& primitive = primitives[primitiveIndex];
+			const bool deformed = node.deformedPrimitives >= 0 && m_deformedPrimitives[node.deformedPrimitives + primitiveIndex].mesh != UINT32_MAX;
+			if (deformed || primitive.lods.empty()) {
+				continue;
+			}
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&primitive.boundsCenter), M));
+			++m_occlusionStats.tested;
+			if (m_occlusionBuffer.SphereOccluded(center, primitive.boundsRadius * scale)) {
+				m_primitiveVisible[node.primitiveOffset + primitiveIndex] = 0;
+				++m_occlusionStats.rejected;
+			}
+		}
+	}
+	m_occlusionStats.testMicroseconds = duration<double_t, std::micro>(high_resolution_clock::now() - start).count();
+
+	if (m_occlusionDumpInterval && fCounter % m_occlusionDumpInterval == 0) {
+		std::vector<uint8_t> pixels;
+		m_occlusionBuffer.Visualize(pixels);
+		PngWriter writer;
+		std::string path = std::format("output\\occlusion{}.png", fCounter);
+		if (!writer.Open(path, m_occlusionBuffer.Width(), m_occlusionBuffer.Height())) {
+			Log(LogLevel::Error, { "occlusion", static_cast<int64_t>(fCounter) }, "Failed to open occlusion dump");
+			return;
+		}
+		writer.WriteRows(pixels.data(), static_cast<size_t>(m_occlusionBuffer.Width()) * 4, m_occlusionBuffer.Height());
+		if (!writer.Close()) {
+			Log(LogLevel::Error, { "occlusion", static_cast<int64_t>(fCounter) }, "Failed to write occlusion dump");
+		}
+	}
+}
+
 void Renderer::DrawNode(uint64_t nodeIndex) {
-	const auto& gltfNode = m_gltfModel.nodes[nodeIndex];
+	const auto& sceneNode = m_scene.Nodes()[nodeIndex];
+
+	if (sceneNode.mesh >= 0) {
+		const auto& mesh = m_meshes[sceneNode.mesh];
+		const auto& node = m_nodes[nodeIndex];
+		// Written once per tile and shared by the node's primitives.
+		const D3D12_GPU_VIRTUAL_ADDRESS nodeConstants = m_constantAllocator.Write(node.M).address;
+
+		for (size_t primitiveIndex = 0; primitiveIndex < mesh.primitives.size(); ++primitiveIndex) {
+			const auto& primitive = mesh.primitives[primitiveIndex];
+			const DeformedPrimitive* deformed = nullptr;
+			if (node.deformedPrimitives >= 0 && m_deformedPrimitives[node.deformedPrimitives + primitiveIndex].mesh != UINT32_MAX) {
+				deformed = &m_deformedPrimitives[node.deformedPrimitives + primitiveIndex];
+			}
+			if (!m_primitiveVisible[node.primitiveOffset + primitiveIndex]) {
+				m_lodStats.fullDetailTriangles += primitive.lods[0].indexCount / 3;
+				continue;
+			}
 
-	if (gltfNode.mesh >= 0) {
-		const auto& mesh = m_meshes[gltfNode.mesh];
+			if (deformed && !primitive.lods.empty()) {
+				// Meshlet bounds and LOD errors describe the bind pose, so deformed
+				// primitives are drawn at full detail without culling.
+				const auto& lod = primitive.lods[0];
+				m_drawRanges.clear();
+				m_drawRanges.push_back({ lod.indexOffset, lod.indexCount });
+				m_lodStats.fullDetailTriangles += lod.indexCount / 3;
+				m_lodStats.submittedTriangles += lod.indexCount / 3;
+			}
+			else if (!primitive.lods.empty()) {
+				XMMATRIX M = XMLoadFloat4x4(&m_nodes[nodeIndex].M);
+				float scale = std::max({
+					XMVectorGetX(XMVector3Length(M.r[0])),
+					XMVectorGetX(XMVector3Length(M.r[1])),
+					XMVectorGetX(XMVector3Length(M.r[2])) });
+				XMVECTOR center = XMVector3Transform(XMLoadFloat3(&primitive.boundsCenter), M);
+				float distance = XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&m_cullingView.cameraPosition))) - primitive.boundsRadius * scale;
+				auto& lod = primitive.lods[SelectLod(primitive.lods, scale, distance, m_lodProjectionScale)];
+				m_lodStats.fullDetailTriangles += primitive.lods[0].indexCount / 3;
+
+				m_drawRanges.clear();
+				CullMeshlets(lod.meshlets, m_nodes[nodeIndex].M, m_cullingView, primitive.coneCulling, m_drawRanges, m_meshletStats);
+				for (auto& range : m_drawRanges) {
+					m_lodStats.submittedTriangles += range.indexCount / 3;
+				}
+				if (m_drawRanges.empty()) {
+					continue;
+				}
+			}
+			else if (primitive.primitiveTopology == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST) {
+				uint64_t triangleCount = (primitive.indexCount ? primitive.indexCount : primitive.vertexCount) / 3;
+				m_lodStats.fullDetailTriangles += triangleCount;
+				m_lodStats.submittedTriangles += triangleCount;
+			}
+
+			auto& materialConstants = m_materialConstants[primitive.material - m_materials.data()];
+			if (!materialConstants) {
+				materialConstants = m_constantAllocator.Write(primitive.material->constants).address;
+			}
+			// Only when the page was sized too small; counted in the constants report.
+			if (!m_cameraConstants || !nodeConstants || !materialConstants) {
+				continue;
+			}
 
-		for (auto& primitive : mesh.primitives) {
 			m_directCommandList->SetGraphicsRootSignature(primitive.rootSignature.Get());
 			m_directCommandList->SetPipelineState(primitive.pipelineState.Get());
 			m_directCommandList->IASetPrimitiveTopology(primitive.primitiveTopology);
 
 			for (auto i = 0; i != primitive.attributes.size(); ++i) {
-				m_directCommandList->IASetVertexBuffers(i, 1, &primitive.attributes[i].vertexBufferView);
+				const auto& vertexBufferView = deformed ? deformed->vertexBufferViews[m_deformedCopy][i] : primitive.attributes[i].vertexBufferView;
+				m_directCommandList->IASetVertexBuffers(i, 1, &vertexBufferView);
 			}
 
 			ID3D12DescriptorHeap* descriptorHeaps[] = { primitive.material->SRVDescriptorHeap.Get(), primitive.material->samplerDescriptorHeap.Get() };
 			m_directCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-			m_directCommandList->SetGraphicsRootConstantBufferView(0, m_cameraBuffer->GetGPUVirtualAddress());
-			m_directCommandList->SetGraphicsRootConstantBufferView(1, m_nodeBuffers[nodeIndex]->GetGPUVirtualAddress());
-			m_directCommandList->SetGraphicsRootConstantBufferView(2, primitive.material->buffer->GetGPUVirtualAddress());
+			m_directCommandList->SetGraphicsRootConstantBufferView(0, m_cameraConstants);
+			m_directCommandList->SetGraphicsRootConstantBufferView(1, nodeConstants);
+			m_directCommandList->SetGraphicsRootConstantBufferView(2, materialConstants);
 			m_directCommandList->SetGraphicsRootDescriptorTable(3, primitive.material->SRVDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 			m_directCommandList->SetGraphicsRootDescriptorTable(4, primitive.material->samplerDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
 			if (primitive.indexCount) {
 				m_directCommandList->IASetIndexBuffer(&primitive.indexBufferView);
-				m_directCommandList->DrawIndexedInstanced(primitive.indexCount, 1, 0, 0, 0);
+				if (primitive.lods.empty()) {
+					m_directCommandList->DrawIndexedInstanced(primitive.indexCount, 1, 0, 0, 0);
+				}
+				else {
+					for (auto& range : m_drawRanges) {
+						m_directCommandList->DrawIndexedInstanced(range.indexCount, 1, range.indexOffset, 0, 0);
+					}
+				}
 			}
 			else {
 				m_directCommandList->DrawInstanced(primitive.vertexCount, 1, 0, 0);
@@ -979,25 +3088,252 @@ void Renderer::DrawNode(uint64_t nodeIndex) {
 		}
 	}
 
-	for (auto childNodeIndex : gltfNode.children) {
+	for (auto childNodeIndex : sceneNode.children) {
 		DrawNode(childNodeIndex);
 	}
 }
 
 void Renderer::Render() {
-	fIndex = (fIndex + 1) % FrameCount;
+	m_meshletStats = {};
+	m_lodStats = {};
+
+	RayTracingView rayTracingView;
+	if (m_rayTracer) {
+		XMStoreFloat4x4(&rayTracingView.inverseViewProjection, XMMatrixInverse(nullptr, XMLoadFloat4x4(&m_camera.VP)));
+		rayTracingView.eye = m_cameraPosition;
+		rayTracingView.width = static_cast<uint32_t>(m_width);
+		rayTracingView.height = static_cast<uint32_t>(m_height);
+		const FLOAT* clearColor = m_renderTargets[0].clearValue.Color;
+		rayTracingView.background = { clearColor[0], clearColor[1], clearColor[2], clearColor[3] };
+		rayTracingView.occlusionSamples = m_occlusionSamples;
+		m_rayTracingStats = {};
+		m_rayTracingMicroseconds = 0.0;
+	}
+	else {
+		updateTextureResidency();
+		updateOcclusion();
+	}
+
+	// Tiles are rendered left to right; once a row of tiles is complete the band
+	// of rows it covers is handed to the encoder and its memory reused. Traced
+	// bands are written as they finish. Rasterized tiles stay in flight while
+	// the next one renders and are written once their readback has landed,
+	// which for the last tiles of a frame is during the next frame.
+	if (m_rayTracer) {
+		beginFrameOutput(fCounter);
+	}
+	for (LONG tileY = 0; tileY < m_height; tileY += m_tileHeight) {
+		UINT bandHeight = static_cast<UINT>(std::min<LONG>(m_tileHeight, m_height - tileY));
+		if (m_rayTracer) {
+			auto traceStart = high_resolution_clock::now();
+			m_rayTracer->Render(rayTracingView, static_cast<uint32_t>(tileY), bandHeight, m_bandImage.data(), static_cast<size_t>(m_width) * 4, m_rayTracingStats);
+			m_rayTracingMicroseconds += duration<double_t, std::micro>(high_resolution_clock::now() - traceStart).count();
+			writeRows(m_bandImage.data(), static_cast<size_t>(m_width) * 4, bandHeight);
+			continue;
+		}
+		for (LONG tileX = 0; tileX < m_width; tileX += m_tileWidth) {
+			UINT tileWidth = static_cast<UINT>(std::min<LONG>(m_tileWidth, m_width - tileX));
+			renderTile(tileX, tileY, tileWidth, bandHeight);
+			m_pendingTiles.push_back({ fIndex, tileX, tileY, tileWidth, bandHeight, fCounter });
+			while (m_pendingTiles.size() >= FrameCount) {
+				retireTile();
+			}
+		}
+	}
+	if (m_rayTracer) {
+		endFrameOutput(fCounter);
+	}
+	else {
+		m_deformedCopyFences[m_deformedCopy] = m_frameScheduler.SubmittedDirectValue();
+	}
+
+	if (m_rayTracer) {
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "traced {} rays ({} primary {} shadow {} occlusion) in {:.1f} ms on {} threads, {:.2f} M rays/s, {} instances in {:.1f} us",
+			m_rayTracingStats.Rays(), m_rayTracingStats.primaryRays, m_rayTracingStats.shadowRays, m_rayTracingStats.occlusionRays, m_rayTracingMicroseconds / 1000.0,
+			m_threadPool->ThreadCount(), m_rayTracingMicroseconds > 0.0 ? m_rayTracingStats.Rays() / m_rayTracingMicroseconds : 0.0,
+			m_rayTracer->InstanceCount(), m_instanceBuildMicroseconds);
+	}
+	else {
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "meshlets tested {} rejected {}", m_meshletStats.tested, m_meshletStats.rejected);
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "triangles submitted {} of {} full detail", m_lodStats.submittedTriangles, m_lodStats.fullDetailTriangles);
+		if (m_maxOccluders) {
+			Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "occlusion {} occluders {} triangles in {:.1f} us, rejected {} of {} draws ({:.1f}%) in {:.1f} us",
+				m_occlusionStats.occluders, m_occlusionStats.occluderTriangles, m_occlusionStats.rasterMicroseconds, m_occlusionStats.rejected, m_occlusionStats.tested,
+				m_occlusionStats.tested ? 100.0 * m_occlusionStats.rejected / m_occlusionStats.tested : 0.0, m_occlusionStats.testMicroseconds);
+		}
+		const auto& textureStats = m_textureResidency.Stats();
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "textures resident {:.1f} MiB, {} short of their mip: {} streamed {} deferred, {} evicted, {} in flight, updated in {:.1f} us",
+			textureStats.residentBytes / 1048576.0, textureStats.requested, textureStats.streamed, textureStats.deferred, textureStats.evicted,
+			m_textureStreamer.Outstanding(), m_textureResidencyMicroseconds);
+		auto scheduleStats = m_frameScheduler.TakeStats();
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "{} submissions, {} frames in flight, cpu stalled {:.1f} us, gpu idle {:.1f} us busy {:.1f} us",
+			scheduleStats.submissions, m_frameScheduler.SlotCount(), scheduleStats.cpuStallMicroseconds, scheduleStats.gpuIdleMicroseconds, scheduleStats.gpuBusyMicroseconds);
+		auto constantStats = m_constantAllocator.TakeStats();
+		Log(constantStats.failures ? LogLevel::Warning : LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "constants {} allocations, {} failed, peak {:.1f} of {:.1f} KiB per tile",
+			constantStats.allocations, constantStats.failures, constantStats.peakSlotBytes / 1024.0, m_constantAllocator.PageSize() / 1024.0);
+	}
+	if (m_animation >= 0) {
+		uint32_t channelCount = m_animations.ChannelCount(static_cast<uint32_t>(m_animation));
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "animation sampled {} channels in {:.1f} us, {:.2f} us per 1k channels",
+			channelCount, m_animationMicroseconds, channelCount ? m_animationMicroseconds * 1000.0 / channelCount : 0.0);
+	}
+	if (!m_deformChunks.empty()) {
+		Log(LogLevel::Info, { "frame", static_cast<int64_t>(fCounter) }, "deformed {} vertices in {:.1f} us on {} threads, {:.1f} M vertices/s",
+			m_deformedVertices, m_deformMicroseconds, m_threadPool->ThreadCount(), m_deformMicroseconds > 0.0 ? m_deformedVertices / m_deformMicroseconds : 0.0);
+	}
+	checkVideoMemory();
+	if (m_memoryReportInterval && fCounter % m_memoryReportInterval == 0) {
+		ReportMemory();
+	}
+	fCounter++;
+}
+
+void Renderer::RenderFrame(uint64_t frame, double_t frameRate) {
+	fCounter = static_cast<UINT>(frame);
+	Update(static_cast<double_t>(frame) / frameRate - m_sceneTime);
+	Render();
+	// Render leaves the last tiles in flight for the next frame to retire.
+	while (!m_pendingTiles.empty()) {
+		retireTile();
+	}
+	if (m_frameWriter) {
+		m_frameWriter->Flush();
+		reportFrameWrites();
+	}
+}
+
+void Renderer::beginFrameOutput(uint64_t frame) {
+	if (m_writeSequence) {
+		return;
+	}
+	if (!m_frameWriter->Open(std::format("output\\output{}.png", frame), frame)) {
+		Log(LogLevel::Error, { "output", static_cast<int64_t>(frame) }, "Failed to open output image");
+		return;
+	}
+	m_pngWriter.Open(m_width, m_height);
+}
+
+void Renderer::endFrameOutput(uint64_t frame) {
+	if (m_writeSequence) {
+		if (!m_sequenceEncoder.EndFrame()) {
+			Log(LogLevel::Error, { "output", static_cast<int64_t>(frame) }, "Failed to write output sequence frame");
+		}
+		const auto& stats = m_sequenceEncoder.Stats();
+		Log(LogLevel::Info, { "output", static_cast<int64_t>(frame) }, "sequence frame {} tiles skipped {} of {} bytes {} of {} raw",
+			stats.frames, stats.skippedTiles, stats.tiles, stats.encodedBytes, stats.rawBytes);
+	}
+	else {
+		if (!m_pngWriter.Close()) {
+			Log(LogLevel::Error, { "output", static_cast<int64_t>(frame) }, "Failed to encode output image");
+		}
+		m_pngWriter.TakeOutput(m_encodedBytes);
+		m_frameWriter->Write(m_encodedBytes.data(), m_encodedBytes.size());
+		m_frameWriter->Close();
+		reportFrameWrites();
+	}
+}
+
+void Renderer::reportFrameWrites() {
+	std::vector<FrameWriteReport> reports;
+	m_frameWriter->TakeCompleted(reports);
+	for (const auto& report : reports) {
+		if (!report.succeeded) {
+			Log(LogLevel::Error, { "output", static_cast<int64_t>(report.frame) }, "Failed to write output image {}", report.path);
+			continue;
+		}
+		Log(LogLevel::Info, { "output", static_cast<int64_t>(report.frame) }, "wrote image {}, {:.1f} KiB in {} writes, {:.1f} MiB/s, write latency p50 {:.2f} p99 {:.2f} max {:.2f} ms",
+			report.path, report.bytes / 1024.0, report.writes,
+			report.busyMilliseconds > 0.0 ? report.bytes / 1048576.0 * 1000.0 / report.busyMilliseconds : 0.0,
+			report.p50Milliseconds, report.p99Milliseconds, report.maxMilliseconds);
+	}
+}
+
+// Writes out the oldest tile in flight once its readback has finished. Tiles
+// retire in the order they were rendered, so frames and bands stay in order.
+void Renderer::retireTile() {
+	PendingTile tile = m_pendingTiles.front();
+	m_pendingTiles.pop_front();
+	m_frameScheduler.WaitForSlot(tile.slot);
+	if (tile.x == 0 && tile.y == 0) {
+		beginFrameOutput(tile.frame);
+	}
+
+	auto& renderTarget = m_renderTargets[tile.slot];
+	if (m_encodeFromReadback) {
+		writeRows(renderTarget.destData, renderTarget.footprint.Footprint.RowPitch, tile.height);
+	}
+	else {
+		for (UINT rowIndex = 0; rowIndex < tile.height; ++rowIndex) {
+			const uint8_t* src = renderTarget.destData + static_cast<size_t>(rowIndex) * renderTarget.footprint.Footprint.RowPitch;
+			uint8_t* dst = m_bandImage.data() + (static_cast<size_t>(rowIndex) * m_width + tile.x) * 4;
+			ConvertRowToRGBA8(m_renderTargetFormat, src, dst, tile.width);
+		}
+		if (tile.x + static_cast<LONG>(tile.width) >= m_width) {
+			writeRows(m_bandImage.data(), static_cast<size_t>(m_width) * 4, tile.height);
+		}
+	}
+
+	if (tile.x + static_cast<LONG>(tile.width) >= m_width && tile.y + static_cast<LONG>(tile.height) >= m_height) {
+		endFrameOutput(tile.frame);
+	}
+}
+
+void Renderer::writeRows(const uint8_t* rows, size_t rowPitch, UINT rowCount) {
+	if (m_writeSequence) {
+		m_sequenceEncoder.WriteRows(rows, rowPitch, rowCount);
+	}
+	else {
+		m_pngWriter.WriteRows(rows, rowPitch, rowCount);
+		m_pngWriter.TakeOutput(m_encodedBytes);
+		m_frameWriter->Write(m_encodedBytes.data(), m_encodedBytes.size());
+	}
+}
+
+void Renderer::renderTile(LONG x, LONG y, UINT width, UINT height) {
+	// Offset projection: scale and shift clip space so this tile's pixel
+	// rectangle of the full frame covers the whole render target.
+	float scaleX = static_cast<float>(m_width) / static_cast<float>(width);
+	float scaleY = static_cast<float>(m_height) / static_cast<float>(height);
+	float centerX = static_cast<float>(2 * x + static_cast<LONG>(width)) / static_cast<float>(m_width) - 1.0f;
+	float centerY = 1.0f - static_cast<float>(2 * y + static_cast<LONG>(height)) / static_cast<float>(m_height);
+	XMMATRIX tileTransform = XMMatrixSet(
+		scaleX, 0.0f, 0.0f, 0.0f,
+		0.0f, scaleY, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		-centerX * scaleX, -centerY * scaleY, 0.0f, 1.0f);
+	XMMATRIX V = XMLoadFloat4x4(&m_camera.V);
+	XMMATRIX P = XMMatrixMultiply(XMLoadFloat4x4(&m_camera.P), tileTransform);
+	XMMATRIX VP = XMMatrixMultiply(V, P);
+
+	// The slot's allocators, render target and constants are free once its
+	// previous tile has been read back.
+	fIndex = m_frameScheduler.AcquireSlot();
+	m_constantAllocator.BeginSlot(fIndex);
+	std::fill(m_materialConstants.begin(), m_materialConstants.end(), 0);
+	Camera camera;
+	XMStoreFloat4x4(&camera.V, XMMatrixTranspose(V));
+	XMStoreFloat4x4(&camera.P, XMMatrixTranspose(P));
+	XMStoreFloat4x4(&camera.VP, XMMatrixTranspose(VP));
+	m_cameraConstants = m_constantAllocator.Write(camera).address;
+	m_cullingView = BuildCullingView(VP, XMLoadFloat3(&m_cameraPosition));
+
+	m_viewport.Width = static_cast<FLOAT>(width);
+	m_viewport.Height = static_cast<FLOAT>(height);
+	m_scissorRect.right = static_cast<LONG>(width);
+	m_scissorRect.bottom = static_cast<LONG>(height);
+
 	auto directCommandAllocator = m_directCommandAllocators[fIndex].Get();
 	auto copyCommandAllocator = m_copyCommandAllocator[fIndex].Get();
 	directCommandAllocator->Reset();
 	copyCommandAllocator->Reset();
 	m_directCommandList->Reset(directCommandAllocator, nullptr);
 	m_copyCommandList->Reset(copyCommandAllocator, nullptr);
+	m_frameScheduler.BeginTimestamp(m_directCommandList.Get(), fIndex);
 	m_directCommandList->RSSetViewports(1, &m_viewport);
 	m_directCommandList->RSSetScissorRects(1, &m_scissorRect);
 
 	auto& renderTarget = m_renderTargets[fIndex];
 	auto texture = renderTarget.texture.Get();
-	auto dest = renderTarget.dest.Get();
 	auto footprint = renderTarget.footprint;
 	auto rtvDescriptor = renderTarget.rtvDescriptor;
 	auto dsvDescriptor = renderTarget.dsvDescriptor;
@@ -1014,66 +3350,51 @@ void Renderer::Render() {
 	m_directCommandList->ClearRenderTargetView(rtvDescriptor, renderTarget.clearValue.Color, 0, nullptr);
 
 
-	auto& scene = m_gltfModel.scenes[m_gltfModel.defaultScene];
-	for (auto nodeIndex : scene.nodes) {
+	for (auto nodeIndex : m_scene.Roots()) {
 		DrawNode(nodeIndex);
 	}
 
 	resourceBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
 	resourceBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
 	m_directCommandList->ResourceBarrier(1, &resourceBarrier);
+	m_frameScheduler.EndTimestamp(m_directCommandList.Get(), fIndex);
 	m_directCommandList->Close();
 
-	ID3D12CommandList* commandLists[] = {m_directCommandList.Get()};
-	m_directCommandQueue->ExecuteCommandLists(1, commandLists);
-	m_directCommandQueue->Signal(m_directFence.Get(), ++m_directFenceValue);
-
 	resourceBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COMMON;
 	resourceBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
 	m_copyCommandList->ResourceBarrier(1, &resourceBarrier);
 
-	m_copyCommandList->CopyTextureRegion(&renderTarget.dstCopyLocation, 0, 0, 0, &renderTarget.srcCopyLocation, nullptr);
+	D3D12_BOX tileBox = { 0, 0, 0, width, height, 1 };
+	m_copyCommandList->CopyTextureRegion(&renderTarget.dstCopyLocation, 0, 0, 0, &renderTarget.srcCopyLocation, &tileBox);
 
 	resourceBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
 	resourceBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COMMON;
 	m_copyCommandList->ResourceBarrier(1, &resourceBarrier);
 	m_copyCommandList->Close();
 
-	ID3D12CommandList* copyCommandLists[] = { m_copyCommandList.Get() };
+	m_frameScheduler.Submit(fIndex, m_directCommandList.Get(), m_copyCommandList.Get());
+}
 
-	if (m_directFence->GetCompletedValue() < m_directFenceValue) {
-		auto event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
-		m_directFence->SetEventOnCompletion(m_directFenceValue, event);
-		WaitForSingleObject(event, INFINITE);
-		CloseHandle(event);
-	}
-	m_copyCommandQueue->ExecuteCommandLists(1, copyCommandLists);
-	m_copyCommandQueue->Signal(m_copyFence.Get(), ++m_copyFenceValue);
-	if (m_copyFence->GetCompletedValue() < m_copyFenceValue) {
-		auto event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
-		m_copyFence->SetEventOnCompletion(m_copyFenceValue, event);
-		WaitForSingleObject(event, INFINITE);
-		CloseHandle(event);
+void Renderer::Destroy() {
+	while (!m_pendingTiles.empty()) {
+		retireTile();
 	}
-
-	void* data;
-	if (FAILED(dest->Map(0, nullptr, &data))) {
-		OutputDebugString("-------------------------Failed to map dest image buffer\n");
+	m_frameScheduler.WaitIdle();
+	ReportMemory();
+	if (m_writeSequence) {
+		m_sequenceEncoder.Close();
+		m_writeSequence = false;
 	}
-
-	for (UINT rowIndex = 0; rowIndex < renderTarget.rowCount; ++rowIndex) {
-		memcpy(reinterpret_cast<uint8_t*>(outputFloatImage) + rowIndex * m_width * 16, static_cast<uint8_t*>(data) + rowIndex * renderTarget.footprint.Footprint.RowPitch, m_width * 16);
+	if (m_frameWriter) {
+		m_frameWriter->Flush();
+		reportFrameWrites();
+		Log(LogLevel::Info, { "output" }, "frame writer {}", m_frameWriter->Report());
 	}
-	for (UINT i = 0; i < m_width * m_height * 4; ++i) {
-		outputCharImage[i] = (uint8_t)(outputFloatImage[i]*255.0f);
+	for (auto& renderTarget : m_renderTargets) {
+		if (renderTarget.destData) {
+			D3D12_RANGE writtenRange = { 0, 0 };
+			renderTarget.dest->Unmap(0, &writtenRange);
+			renderTarget.destData = nullptr;
+		}
 	}
-	std::string formated_name = std::format("output\\output{}.png", fCounter);
-	stbi_write_png(formated_name.c_str(), m_width, m_height, 4, outputCharImage, m_width * 4);
-	OutputDebugString("-----------------------------------wrote image ");
-	OutputDebugString(formated_name.c_str());
-	OutputDebugString("\n");
-	fCounter++;
-}
-
-void Renderer::Destroy() {
 }
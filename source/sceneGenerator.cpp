@@ -0,0 +1,268 @@
+#include "sceneGenerator.h"
+#include "pngWriter.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+#include "json.hpp"
+
+namespace {
+	constexpr float kPi = 3.14159265358979f;
+	// Half the edge of the cube the node grid fills. The renderer's camera
+	// orbits the origin at a distance of 3.
+	constexpr float kExtent = 1.2f;
+
+	constexpr uint32_t kArrayBuffer = 34962;
+	constexpr uint32_t kElementArrayBuffer = 34963;
+	constexpr uint32_t kFloat = 5126;
+	constexpr uint32_t kUnsignedInt = 5125;
+
+	struct Vertex {
+		float position[3];
+		float normal[3];
+		float texcoord[2];
+	};
+
+	// Appends data to the binary buffer, 4 byte aligned, and returns the index
+	// of the buffer view covering it.
+	uint32_t addBufferView(nlohmann::json& gltf, std::vector<uint8_t>& bin, const void* data, size_t size, uint32_t target) {
+		bin.resize((bin.size() + 3) & ~size_t(3));
+		const size_t offset = bin.size();
+		bin.resize(offset + size);
+		memcpy(bin.data() + offset, data, size);
+		gltf["bufferViews"].push_back({ { "buffer", 0 }, { "byteOffset", offset }, { "byteLength", size }, { "target", target } });
+		return static_cast<uint32_t>(gltf["bufferViews"].size() - 1);
+	}
+
+	uint32_t addAccessor(nlohmann::json& gltf, uint32_t bufferView, uint32_t componentType, size_t count, const char* type) {
+		gltf["accessors"].push_back({ { "bufferView", bufferView }, { "componentType", componentType }, { "count", count }, { "type", type } });
+		return static_cast<uint32_t>(gltf["accessors"].size() - 1);
+	}
+
+	// A sphere of radius about radius with random bumps, rings by twice as many
+	// segments, seams duplicated so texture coordinates wrap.
+	void buildMesh(std::mt19937& random, uint32_t rings, float radius, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float amplitude = 0.05f + 0.15f * unit(random);
+		const float thetaFrequency = 2.0f + std::floor(6.0f * unit(random));
+		const float phiFrequency = 2.0f + std::floor(6.0f * unit(random));
+		const float phase = 2.0f * kPi * unit(random);
+		const uint32_t segments = rings * 2;
+
+		vertices.clear();
+		for (uint32_t ring = 0; ring <= rings; ++ring) {
+			const float theta = kPi * ring / rings;
+			for (uint32_t segment = 0; segment <= segments; ++segment) {
+				const float phi = 2.0f * kPi * segment / segments;
+				const float direction[3] = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+				const float scale = radius * (1.0f + amplitude * std::sin(thetaFrequency * theta + phase) * std::sin(phiFrequency * phi));
+				Vertex vertex;
+				for (int axis = 0; axis < 3; ++axis) {
+					vertex.position[axis] = direction[axis] * scale;
+					// The sphere's normal; close enough for shading a benchmark.
+					vertex.normal[axis] = direction[axis];
+				}
+				vertex.texcoord[0] = static_cast<float>(segment) / segments;
+				vertex.texcoord[1] = static_cast<float>(ring) / rings;
+				vertices.push_back(vertex);
+			}
+		}
+
+		// Counter clockwise seen from outside.
+		indices.clear();
+		for (uint32_t ring = 0; ring < rings; ++ring) {
+			for (uint32_t segment = 0; segment < segments; ++segment) {
+				const uint32_t a = ring * (segments + 1) + segment;
+				const uint32_t b = a + segments + 1;
+				indices.insert(indices.end(), { a, b + 1, b, a, a + 1, b + 1 });
+			}
+		}
+	}
+
+	bool writeTexture(const std::filesystem::path& path, uint32_t size, std::mt19937& random) {
+		std::uniform_int_distribution<uint32_t> byte(0, 255);
+		const uint8_t colors[2][3] = {
+			{ static_cast<uint8_t>(byte(random)), static_cast<uint8_t>(byte(random)), static_cast<uint8_t>(byte(random)) },
+			{ static_cast<uint8_t>(byte(random)), static_cast<uint8_t>(byte(random)), static_cast<uint8_t>(byte(random)) } };
+		const uint32_t cell = std::max(1u, size >> (2 + byte(random) % 4));
+
+		PngWriter writer;
+		if (!writer.Open(path.string(), size, size)) {
+			return false;
+		}
+		std::vector<uint8_t> row(static_cast<size_t>(size) * 4);
+		for (uint32_t y = 0; y < size; ++y) {
+			for (uint32_t x = 0; x < size; ++x) {
+				const uint8_t* color = colors[((x / cell) + (y / cell)) & 1];
+				// A gradient on top of the checker gives every mip level detail.
+				const uint32_t shade = 192 + 63 * (x + y) / (2 * size);
+				for (int channel = 0; channel < 3; ++channel) {
+					row[x * 4 + channel] = static_cast<uint8_t>(color[channel] * shade / 255);
+				}
+				row[x * 4 + 3] = 255;
+			}
+			writer.WriteRows(row.data(), row.size(), 1);
+		}
+		return writer.Close();
+	}
+
+	bool writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return static_cast<bool>(file);
+	}
+}
+
+bool GenerateScene(const std::string& path, const SceneParameters& parameters, SceneStats& stats) {
+	namespace fs = std::filesystem;
+	const fs::path scenePath(path);
+	const bool binary = scenePath.extension() == ".glb";
+	const uint32_t nodeCount = std::max(1u, parameters.nodes);
+	const uint32_t meshCount = (nodeCount + std::max(1u, parameters.instancing) - 1) / std::max(1u, parameters.instancing);
+	const uint32_t materialCount = std::max(1u, parameters.materials);
+	const uint32_t rings = std::max(2u, static_cast<uint32_t>(std::lround(std::sqrt(parameters.triangles / 4.0))));
+	stats = {};
+	stats.meshes = meshCount;
+	stats.trianglesPerMesh = 4 * rings * rings;
+	stats.sceneTriangles = static_cast<uint64_t>(nodeCount) * stats.trianglesPerMesh;
+
+	nlohmann::json gltf;
+	gltf["asset"] = { { "version", "2.0" }, { "generator", "renderlab-bench" } };
+	gltf["bufferViews"] = nlohmann::json::array();
+	gltf["accessors"] = nlohmann::json::array();
+	std::vector<uint8_t> bin;
+
+	// Nodes sit on a grid filling the view, sized so neighbours just touch.
+	const uint32_t grid = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(nodeCount))));
+	const float spacing = 2.0f * kExtent / grid;
+	const float radius = 0.45f * spacing;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	for (uint32_t meshIndex = 0; meshIndex < meshCount; ++meshIndex) {
+		std::mt19937 random(parameters.seed * 7919u + meshIndex);
+		buildMesh(random, rings, radius, vertices, indices);
+
+		float minimum[3] = { INFINITY, INFINITY, INFINITY };
+		float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+		std::vector<float> positions, normals, texcoords;
+		for (const auto& vertex : vertices) {
+			positions.insert(positions.end(), vertex.position, vertex.position + 3);
+			normals.insert(normals.end(), vertex.normal, vertex.normal + 3);
+			texcoords.insert(texcoords.end(), vertex.texcoord, vertex.texcoord + 2);
+			for (int axis = 0; axis < 3; ++axis) {
+				minimum[axis] = std::min(minimum[axis], vertex.position[axis]);
+				maximum[axis] = std::max(maximum[axis], vertex.position[axis]);
+			}
+		}
+		uint32_t position = addAccessor(gltf, addBufferView(gltf, bin, positions.data(), positions.size() * sizeof(float), kArrayBuffer), kFloat, vertices.size(), "VEC3");
+		gltf["accessors"][position]["min"] = minimum;
+		gltf["accessors"][position]["max"] = maximum;
+		uint32_t normal = addAccessor(gltf, addBufferView(gltf, bin, normals.data(), normals.size() * sizeof(float), kArrayBuffer), kFloat, vertices.size(), "VEC3");
+		uint32_t texcoord = addAccessor(gltf, addBufferView(gltf, bin, texcoords.data(), texcoords.size() * sizeof(float), kArrayBuffer), kFloat, vertices.size(), "VEC2");
+		uint32_t index = addAccessor(gltf, addBufferView(gltf, bin, indices.data(), indices.size() * sizeof(uint32_t), kElementArrayBuffer), kUnsignedInt, indices.size(), "SCALAR");
+
+		nlohmann::json primitive = {
+			{ "attributes", { { "POSITION", position }, { "NORMAL", normal }, { "TEXCOORD_0", texcoord } } },
+			{ "indices", index },
+			{ "material", meshIndex % materialCount },
+			{ "mode", 4 } };
+		gltf["meshes"].push_back({ { "name", "mesh" + std::to_string(meshIndex) }, { "primitives", { primitive } } });
+	}
+	bin.resize((bin.size() + 3) & ~size_t(3));
+	stats.bufferBytes = bin.size();
+
+	std::mt19937 materialRandom(parameters.seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t materialIndex = 0; materialIndex < materialCount; ++materialIndex) {
+		nlohmann::json pbr = {
+			{ "baseColorFactor", { 0.5f + 0.5f * unit(materialRandom), 0.5f + 0.5f * unit(materialRandom), 0.5f + 0.5f * unit(materialRandom), 1.0f } },
+			{ "metallicFactor", unit(materialRandom) },
+			{ "roughnessFactor", unit(materialRandom) } };
+		if (parameters.textures) {
+			pbr["baseColorTexture"] = { { "index", materialIndex % parameters.textures } };
+		}
+		gltf["materials"].push_back({ { "name", "material" + std::to_string(materialIndex) }, { "pbrMetallicRoughness", pbr } });
+	}
+
+	if (parameters.textures) {
+		gltf["samplers"] = { { { "magFilter", 9729 }, { "minFilter", 9987 }, { "wrapS", 10497 }, { "wrapT", 10497 } } };
+	}
+	for (uint32_t textureIndex = 0; textureIndex < parameters.textures; ++textureIndex) {
+		const std::string imageName = scenePath.stem().string() + ".texture" + std::to_string(textureIndex) + ".png";
+		const fs::path imagePath = scenePath.parent_path() / imageName;
+		std::mt19937 random(parameters.seed * 104729u + textureIndex);
+		if (!writeTexture(imagePath, parameters.textureSize, random)) {
+			return false;
+		}
+		stats.fileBytes += fs::file_size(imagePath);
+		stats.textureBytes += static_cast<uint64_t>(parameters.textureSize) * parameters.textureSize * 4;
+		gltf["images"].push_back({ { "uri", imageName } });
+		gltf["textures"].push_back({ { "source", textureIndex }, { "sampler", 0 } });
+	}
+
+	// A tree of the given depth: node i's children are b * i + 1 to b * i + b,
+	// with the branching factor b just large enough to fit every node.
+	const uint32_t depth = std::max(1u, parameters.depth);
+	uint32_t branching = depth > 1 ? std::max(2u, static_cast<uint32_t>(std::ceil(std::pow(static_cast<double>(nodeCount), 1.0 / (depth - 1))))) : 0;
+	std::vector<std::array<float, 3>> worldPositions(nodeCount);
+	std::vector<uint32_t> levels(nodeCount, 1);
+	gltf["scenes"] = { { { "nodes", nlohmann::json::array() } } };
+	for (uint32_t nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+		const uint32_t cell[3] = { nodeIndex % grid, nodeIndex / grid % grid, nodeIndex / (grid * grid) };
+		for (int axis = 0; axis < 3; ++axis) {
+			worldPositions[nodeIndex][axis] = (cell[axis] + 0.5f) * spacing - kExtent;
+		}
+		std::array<float, 3> translation = worldPositions[nodeIndex];
+		if (branching && nodeIndex > 0) {
+			const uint32_t parent = (nodeIndex - 1) / branching;
+			for (int axis = 0; axis < 3; ++axis) {
+				translation[axis] -= worldPositions[parent][axis];
+			}
+			levels[nodeIndex] = levels[parent] + 1;
+			gltf["nodes"][parent]["children"].push_back(nodeIndex);
+		}
+		else {
+			gltf["scenes"][0]["nodes"].push_back(nodeIndex);
+		}
+		gltf["nodes"][nodeIndex]["name"] = "node" + std::to_string(nodeIndex);
+		gltf["nodes"][nodeIndex]["mesh"] = nodeIndex % meshCount;
+		gltf["nodes"][nodeIndex]["translation"] = translation;
+		stats.depth = std::max(stats.depth, levels[nodeIndex]);
+	}
+	gltf["scene"] = 0;
+
+	if (binary) {
+		gltf["buffers"] = { { { "byteLength", bin.size() } } };
+		std::string text = gltf.dump();
+		text.resize((text.size() + 3) & ~size_t(3), ' ');
+		const uint32_t header[5] = {
+			0x46546C67, 2, static_cast<uint32_t>(12 + 8 + text.size() + 8 + bin.size()),
+			static_cast<uint32_t>(text.size()), 0x4E4F534A };
+		const uint32_t binHeader[2] = { static_cast<uint32_t>(bin.size()), 0x004E4942 };
+		std::vector<uint8_t> glb(sizeof(header) + text.size() + sizeof(binHeader) + bin.size());
+		uint8_t* out = glb.data();
+		memcpy(out, header, sizeof(header));
+		memcpy(out += sizeof(header), text.data(), text.size());
+		memcpy(out += text.size(), binHeader, sizeof(binHeader));
+		memcpy(out + sizeof(binHeader), bin.data(), bin.size());
+		if (!writeFile(scenePath, glb)) {
+			return false;
+		}
+		stats.fileBytes += glb.size();
+	}
+	else {
+		const std::string binName = scenePath.stem().string() + ".bin";
+		gltf["buffers"] = { { { "byteLength", bin.size() }, { "uri", binName } } };
+		const std::string text = gltf.dump(1);
+		if (!writeFile(scenePath.parent_path() / binName, bin) || !writeFile(scenePath, std::vector<uint8_t>(text.begin(), text.end()))) {
+			return false;
+		}
+		stats.fileBytes += bin.size() + text.size();
+	}
+	return true;
+}
@@ -0,0 +1,70 @@
+#include "sceneModel.h"
+#include "tiny_gltf.h"
+#include <algorithm>
+
+void SceneModel::Build(tinygltf::Model& model) {
+	m_arena.Reset();
+
+	std::span<SceneNode> nodes = m_arena.AllocateArray<SceneNode>(model.nodes.size());
+	for (size_t nodeIndex = 0; nodeIndex < model.nodes.size(); ++nodeIndex) {
+		const auto& gltfNode = model.nodes[nodeIndex];
+		nodes[nodeIndex].mesh = gltfNode.mesh;
+		std::span<uint32_t> children = m_arena.AllocateArray<uint32_t>(gltfNode.children.size());
+		std::copy(gltfNode.children.begin(), gltfNode.children.end(), children.begin());
+		nodes[nodeIndex].children = children;
+	}
+	m_nodes = nodes;
+
+	m_roots = {};
+	if (!model.scenes.empty()) {
+		const auto& scene = model.scenes[std::clamp(model.defaultScene, 0, static_cast<int>(model.scenes.size()) - 1)];
+		std::span<uint32_t> roots = m_arena.AllocateArray<uint32_t>(scene.nodes.size());
+		std::copy(scene.nodes.begin(), scene.nodes.end(), roots.begin());
+		m_roots = roots;
+	}
+
+	std::vector<std::string_view> names;
+	for (const auto& gltfMesh : model.meshes) {
+		for (const auto& gltfPrimitive : gltfMesh.primitives) {
+			for (const auto& [name, accessorIndex] : gltfPrimitive.attributes) {
+				if (std::find(names.begin(), names.end(), name) == names.end()) {
+					names.push_back(name);
+				}
+			}
+		}
+	}
+	std::span<std::string_view> attributeNames = m_arena.AllocateArray<std::string_view>(names.size());
+	for (size_t i = 0; i < names.size(); ++i) {
+		attributeNames[i] = m_arena.CopyString(names[i]);
+	}
+	m_attributeNames = attributeNames;
+
+	m_images.resize(model.images.size());
+	for (size_t imageIndex = 0; imageIndex < model.images.size(); ++imageIndex) {
+		auto& gltfImage = model.images[imageIndex];
+		auto& image = m_images[imageIndex];
+		image.width = static_cast<uint32_t>(gltfImage.width);
+		image.height = static_cast<uint32_t>(gltfImage.height);
+		image.components = static_cast<uint32_t>(gltfImage.component);
+		image.bits = static_cast<uint32_t>(gltfImage.bits);
+		image.pixels = std::move(gltfImage.image);
+		gltfImage.image = {};
+	}
+}
+
+std::string_view SceneModel::AttributeName(std::string_view name) const {
+	auto found = std::find(m_attributeNames.begin(), m_attributeNames.end(), name);
+	return found != m_attributeNames.end() ? *found : std::string_view();
+}
+
+void SceneModel::ReleasePixels(size_t imageIndex) {
+	std::vector<unsigned char>().swap(m_images[imageIndex].pixels);
+}
+
+uint64_t SceneModel::Bytes() const {
+	uint64_t bytes = m_arena.Bytes();
+	for (const auto& image : m_images) {
+		bytes += image.pixels.capacity() + (image.sourceBytes ? image.sourceBytes->size() : 0);
+	}
+	return bytes;
+}
@@ -0,0 +1,421 @@
+#include "sequenceEncoder.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SEQUENCE_SSE2 1
+#endif
+
+namespace {
+	const char kMagic[4] = { 'R', 'L', 'S', 'Q' };
+	constexpr uint32_t kVersion = 1;
+	constexpr uint32_t kHeaderSize = 24;
+	constexpr uint32_t kFrameHeaderSize = 5;
+	constexpr uint32_t kBytesPerPixel = 4;
+	constexpr uint8_t kTileUnchanged = 0;
+	constexpr uint8_t kTileCoded = 1;
+	// Shorter zero runs are cheaper to keep inside a literal.
+	constexpr size_t kMinZeroRun = 4;
+
+	constexpr uint32_t kPrime1 = 2654435761u;
+	constexpr uint32_t kPrime2 = 2246822519u;
+	const uint32_t kSeeds[4] = { kPrime1 + kPrime2, kPrime2, 0, 0u - kPrime1 };
+
+	uint32_t hashRound(uint32_t accumulator, uint32_t value) {
+		accumulator += value * kPrime2;
+		accumulator = (accumulator << 13) | (accumulator >> 19);
+		return accumulator * kPrime1;
+	}
+
+#ifdef SEQUENCE_SSE2
+	// SSE2 has no 32 bit multiply keeping the low halves; build it from the even and odd lanes.
+	__m128i multiplyLow(__m128i a, __m128i b) {
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+#endif
+
+	// Four independent xxHash32 style lanes over the tile's rows, one 32 bit word
+	// per lane per step, giving a 128 bit hash.
+	void hashTile(const uint8_t* rows, size_t rowPitch, uint32_t rowBytes, uint32_t rowCount, uint32_t lanes[4]) {
+		const uint32_t vectorBytes = rowBytes & ~15u;
+#ifdef SEQUENCE_SSE2
+		__m128i accumulator = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kSeeds));
+		const __m128i prime1 = _mm_set1_epi32(static_cast<int>(kPrime1));
+		const __m128i prime2 = _mm_set1_epi32(static_cast<int>(kPrime2));
+		for (uint32_t row = 0; row < rowCount; ++row) {
+			const uint8_t* data = rows + row * rowPitch;
+			for (uint32_t i = 0; i < vectorBytes; i += 16) {
+				__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				accumulator = _mm_add_epi32(accumulator, multiplyLow(value, prime2));
+				accumulator = _mm_or_si128(_mm_slli_epi32(accumulator, 13), _mm_srli_epi32(accumulator, 19));
+				accumulator = multiplyLow(accumulator, prime1);
+			}
+			if (vectorBytes != rowBytes) {
+				alignas(16) uint32_t partial[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(partial), accumulator);
+				for (uint32_t i = vectorBytes; i < rowBytes; i += 4) {
+					uint32_t value;
+					memcpy(&value, data + i, 4);
+					partial[(i / 4) & 3] = hashRound(partial[(i / 4) & 3], value);
+				}
+				accumulator = _mm_load_si128(reinterpret_cast<const __m128i*>(partial));
+			}
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+#else
+		memcpy(lanes, kSeeds, sizeof(kSeeds));
+		for (uint32_t row = 0; row < rowCount; ++row) {
+			const uint8_t* data = rows + row * rowPitch;
+			for (uint32_t i = 0; i < rowBytes; i += 4) {
+				uint32_t value;
+				memcpy(&value, data + i, 4);
+				lanes[(i / 4) & 3] = hashRound(lanes[(i / 4) & 3], value);
+			}
+		}
+		(void)vectorBytes;
+#endif
+	}
+
+	void xorRows(const uint8_t* rows, size_t rowPitch, const uint8_t* previous, size_t previousPitch, uint32_t rowBytes, uint32_t rowCount, uint8_t* out) {
+		for (uint32_t row = 0; row < rowCount; ++row) {
+			const uint8_t* a = rows + row * rowPitch;
+			const uint8_t* b = previous + row * previousPitch;
+			uint32_t i = 0;
+#ifdef SEQUENCE_SSE2
+			for (; i + 16 <= rowBytes; i += 16) {
+				__m128i value = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), value);
+			}
+#endif
+			for (; i < rowBytes; ++i) {
+				out[i] = a[i] ^ b[i];
+			}
+			out += rowBytes;
+		}
+	}
+
+	void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	bool getVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+		value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7) {
+			if (data == end) {
+				return false;
+			}
+			uint8_t byte = *data++;
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Alternating zero runs and literal runs, each prefixed by its length.
+	void encodeZeroRuns(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+		size_t i = 0;
+		while (i < size) {
+			size_t zeroStart = i;
+			while (i < size && data[i] == 0) {
+				++i;
+			}
+			size_t literalStart = i;
+			while (i < size) {
+				if (data[i] != 0) {
+					++i;
+					continue;
+				}
+				size_t j = i;
+				while (j < size && data[j] == 0 && j - i < kMinZeroRun) {
+					++j;
+				}
+				if (j - i >= kMinZeroRun || j == size) {
+					break;
+				}
+				i = j;
+			}
+			putVarint(out, literalStart - zeroStart);
+			putVarint(out, i - literalStart);
+			out.insert(out.end(), data + literalStart, data + i);
+		}
+	}
+
+	bool decodeZeroRuns(const uint8_t* data, const uint8_t* end, uint8_t* out, size_t size) {
+		size_t i = 0;
+		while (data != end) {
+			uint64_t zeros;
+			uint64_t literals;
+			if (!getVarint(data, end, zeros) || !getVarint(data, end, literals) ||
+				zeros > size - i || literals > size - i - zeros || literals > static_cast<uint64_t>(end - data)) {
+				return false;
+			}
+			memset(out + i, 0, zeros);
+			i += zeros;
+			memcpy(out + i, data, literals);
+			i += literals;
+			data += literals;
+		}
+		return i == size;
+	}
+
+	void storeLittleEndian(uint8_t* out, uint32_t value) {
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+		out[2] = static_cast<uint8_t>(value >> 16);
+		out[3] = static_cast<uint8_t>(value >> 24);
+	}
+
+	uint32_t loadLittleEndian(const uint8_t* in) {
+		return uint32_t(in[0]) | uint32_t(in[1]) << 8 | uint32_t(in[2]) << 16 | uint32_t(in[3]) << 24;
+	}
+}
+
+bool SequenceEncoder::Open(const std::string& path, uint32_t width, uint32_t height, uint32_t keyframeInterval) {
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file || width == 0 || height == 0) {
+		return false;
+	}
+	m_width = width;
+	m_height = height;
+	m_keyframeInterval = std::max(keyframeInterval, 1u);
+	m_tileColumns = (width + kSequenceTileSize - 1) / kSequenceTileSize;
+	uint32_t tileRows = (height + kSequenceTileSize - 1) / kSequenceTileSize;
+	m_frameIndex = 0;
+	m_keyframe = true;
+	m_stripRows = 0;
+	m_stripY = 0;
+	m_stats = {};
+
+	m_strip.clear();
+	m_previous.assign(static_cast<size_t>(width) * height * kBytesPerPixel, 0);
+	m_tileHashes.assign(static_cast<size_t>(m_tileColumns) * tileRows, {});
+	m_delta.resize(kSequenceTileSize * kSequenceTileSize * kBytesPerPixel);
+	m_payload.clear();
+
+	uint8_t header[kHeaderSize];
+	memcpy(header, kMagic, 4);
+	storeLittleEndian(header + 4, kVersion);
+	storeLittleEndian(header + 8, width);
+	storeLittleEndian(header + 12, height);
+	storeLittleEndian(header + 16, kSequenceTileSize);
+	storeLittleEndian(header + 20, m_keyframeInterval);
+	m_file.write(reinterpret_cast<const char*>(header), kHeaderSize);
+	return static_cast<bool>(m_file);
+}
+
+void SequenceEncoder::WriteRows(const uint8_t* rows, size_t rowPitch, uint32_t rowCount) {
+	const size_t rowBytes = static_cast<size_t>(m_width) * kBytesPerPixel;
+	rowCount = std::min(rowCount, m_height - m_stripY - m_stripRows);
+	while (rowCount > 0) {
+		uint32_t stripHeight = std::min(kSequenceTileSize, m_height - m_stripY);
+		// Whole strips are hashed and diffed in place, without a copy.
+		if (m_stripRows == 0 && rowCount >= stripHeight) {
+			encodeStrip(rows, rowPitch, stripHeight);
+			rows += stripHeight * rowPitch;
+			rowCount -= stripHeight;
+			continue;
+		}
+		if (m_strip.empty()) {
+			m_strip.resize(rowBytes * kSequenceTileSize);
+		}
+		uint32_t count = std::min(rowCount, stripHeight - m_stripRows);
+		for (uint32_t row = 0; row < count; ++row) {
+			memcpy(m_strip.data() + (m_stripRows + row) * rowBytes, rows + row * rowPitch, rowBytes);
+		}
+		m_stripRows += count;
+		rows += count * rowPitch;
+		rowCount -= count;
+		if (m_stripRows == stripHeight) {
+			m_stripRows = 0;
+			encodeStrip(m_strip.data(), rowBytes, stripHeight);
+		}
+	}
+}
+
+void SequenceEncoder::encodeStrip(const uint8_t* rows, size_t rowPitch, uint32_t rowCount) {
+	const size_t previousPitch = static_cast<size_t>(m_width) * kBytesPerPixel;
+	const uint32_t tileRow = m_stripY / kSequenceTileSize;
+	for (uint32_t column = 0; column < m_tileColumns; ++column) {
+		const uint32_t x = column * kSequenceTileSize;
+		const uint32_t tileBytes = std::min(kSequenceTileSize, m_width - x) * kBytesPerPixel;
+		const uint8_t* tile = rows + x * kBytesPerPixel;
+		uint8_t* previous = m_previous.data() + m_stripY * previousPitch + x * kBytesPerPixel;
+
+		uint32_t lanes[4];
+		hashTile(tile, rowPitch, tileBytes, rowCount, lanes);
+		TileHash hash = { lanes[0] | static_cast<uint64_t>(lanes[1]) << 32, lanes[2] | static_cast<uint64_t>(lanes[3]) << 32 };
+		TileHash& previousHash = m_tileHashes[static_cast<size_t>(tileRow) * m_tileColumns + column];
+
+		++m_stats.tiles;
+		m_stats.rawBytes += static_cast<uint64_t>(tileBytes) * rowCount;
+		if (!m_keyframe && hash.low == previousHash.low && hash.high == previousHash.high) {
+			++m_stats.skippedTiles;
+			m_payload.push_back(kTileUnchanged);
+			continue;
+		}
+		previousHash = hash;
+
+		// Keyframes are coded against black so they decode on their own.
+		if (m_keyframe) {
+			for (uint32_t row = 0; row < rowCount; ++row) {
+				memcpy(m_delta.data() + row * tileBytes, tile + row * rowPitch, tileBytes);
+			}
+		}
+		else {
+			xorRows(tile, rowPitch, previous, previousPitch, tileBytes, rowCount, m_delta.data());
+		}
+		m_coded.clear();
+		encodeZeroRuns(m_delta.data(), static_cast<size_t>(tileBytes) * rowCount, m_coded);
+		m_payload.push_back(kTileCoded);
+		putVarint(m_payload, m_coded.size());
+		m_payload.insert(m_payload.end(), m_coded.begin(), m_coded.end());
+
+		for (uint32_t row = 0; row < rowCount; ++row) {
+			memcpy(previous + row * previousPitch, tile + row * rowPitch, tileBytes);
+		}
+	}
+	m_stripY += rowCount;
+}
+
+bool SequenceEncoder::EndFrame() {
+	if (m_stripY != m_height) {
+		return false;
+	}
+	uint8_t header[kFrameHeaderSize];
+	header[0] = m_keyframe ? 1 : 0;
+	storeLittleEndian(header + 1, static_cast<uint32_t>(m_payload.size()));
+	m_file.write(reinterpret_cast<const char*>(header), kFrameHeaderSize);
+	m_file.write(reinterpret_cast<const char*>(m_payload.data()), m_payload.size());
+	// Frames are complete on disk as soon as they are written, so an interrupted
+	// sequence still decodes up to its last frame.
+	m_file.flush();
+	m_stats.encodedBytes += kFrameHeaderSize + m_payload.size();
+	++m_stats.frames;
+
+	m_payload.clear();
+	m_stripY = 0;
+	++m_frameIndex;
+	m_keyframe = m_frameIndex % m_keyframeInterval == 0;
+	return static_cast<bool>(m_file);
+}
+
+bool SequenceEncoder::Close() {
+	m_file.close();
+	m_previous.clear();
+	m_previous.shrink_to_fit();
+	return !m_file.fail();
+}
+
+bool SequenceDecoder::Open(const std::string& path) {
+	m_file.open(path, std::ios::binary);
+	uint8_t header[kHeaderSize];
+	if (!m_file.read(reinterpret_cast<char*>(header), kHeaderSize) ||
+		memcmp(header, kMagic, 4) != 0 ||
+		loadLittleEndian(header + 4) != kVersion ||
+		loadLittleEndian(header + 16) != kSequenceTileSize) {
+		return false;
+	}
+	m_width = loadLittleEndian(header + 8);
+	m_height = loadLittleEndian(header + 12);
+	m_frame.assign(static_cast<size_t>(m_width) * m_height * kBytesPerPixel, 0);
+	m_delta.resize(kSequenceTileSize * kSequenceTileSize * kBytesPerPixel);
+	m_decodedFrame = -1;
+
+	// Frames carry their own sizes, so the index is rebuilt by walking the headers.
+	m_frames.clear();
+	uint64_t offset = kHeaderSize;
+	uint8_t frameHeader[kFrameHeaderSize];
+	while (m_file.read(reinterpret_cast<char*>(frameHeader), kFrameHeaderSize)) {
+		FrameRecord frame = { offset + kFrameHeaderSize, loadLittleEndian(frameHeader + 1), frameHeader[0] != 0 };
+		if (!m_file.seekg(frame.size, std::ios::cur)) {
+			break;
+		}
+		m_frames.push_back(frame);
+		offset = frame.offset + frame.size;
+	}
+	// A truncated last frame is dropped.
+	m_file.clear();
+	m_file.seekg(0, std::ios::end);
+	while (!m_frames.empty() && m_frames.back().offset + m_frames.back().size > static_cast<uint64_t>(m_file.tellg())) {
+		m_frames.pop_back();
+	}
+	return !m_frames.empty() && m_frames.front().keyframe;
+}
+
+bool SequenceDecoder::ReadFrame(uint32_t frameIndex, std::vector<uint8_t>& pixels) {
+	if (frameIndex >= m_frames.size()) {
+		return false;
+	}
+	int64_t start = frameIndex;
+	while (!m_frames[start].keyframe) {
+		--start;
+	}
+	// Continue from the last decoded frame when no keyframe lies in between.
+	if (m_decodedFrame >= start && m_decodedFrame <= static_cast<int64_t>(frameIndex)) {
+		start = m_decodedFrame + 1;
+	}
+	for (int64_t index = start; index <= static_cast<int64_t>(frameIndex); ++index) {
+		if (!applyFrame(m_frames[index])) {
+			m_decodedFrame = -1;
+			return false;
+		}
+		m_decodedFrame = index;
+	}
+	pixels = m_frame;
+	return true;
+}
+
+bool SequenceDecoder::applyFrame(const FrameRecord& frame) {
+	m_payload.resize(frame.size);
+	m_file.clear();
+	m_file.seekg(frame.offset);
+	if (!m_file.read(reinterpret_cast<char*>(m_payload.data()), frame.size)) {
+		return false;
+	}
+
+	const size_t framePitch = static_cast<size_t>(m_width) * kBytesPerPixel;
+	const uint8_t* data = m_payload.data();
+	const uint8_t* end = data + m_payload.size();
+	for (uint32_t y = 0; y < m_height; y += kSequenceTileSize) {
+		const uint32_t rowCount = std::min(kSequenceTileSize, m_height - y);
+		for (uint32_t x = 0; x < m_width; x += kSequenceTileSize) {
+			const uint32_t tileBytes = std::min(kSequenceTileSize, m_width - x) * kBytesPerPixel;
+			if (data == end) {
+				return false;
+			}
+			uint8_t mode = *data++;
+			if (mode == kTileUnchanged && !frame.keyframe) {
+				continue;
+			}
+			uint64_t codedSize;
+			if (mode != kTileCoded || !getVarint(data, end, codedSize) || codedSize > static_cast<uint64_t>(end - data) ||
+				!decodeZeroRuns(data, data + codedSize, m_delta.data(), static_cast<size_t>(tileBytes) * rowCount)) {
+				return false;
+			}
+			data += codedSize;
+
+			uint8_t* tile = m_frame.data() + y * framePitch + x * kBytesPerPixel;
+			for (uint32_t row = 0; row < rowCount; ++row) {
+				uint8_t* out = tile + row * framePitch;
+				const uint8_t* delta = m_delta.data() + row * tileBytes;
+				if (frame.keyframe) {
+					memcpy(out, delta, tileBytes);
+					continue;
+				}
+				for (uint32_t i = 0; i < tileBytes; ++i) {
+					out[i] ^= delta[i];
+				}
+			}
+		}
+	}
+	return data == end;
+}
@@ -0,0 +1,532 @@
+#include "shardCoordinator.h"
+#include "sequenceEncoder.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std::chrono;
+
+namespace {
+	// "0-3,8-11" as found in /sys/devices/system/node/node*/cpulist.
+	std::vector<int> parseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		std::istringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			int first, last;
+			int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+			if (fields < 1) {
+				continue;
+			}
+			if (fields == 1) {
+				last = first;
+			}
+			for (int cpu = first; cpu <= last; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+	std::string substitute(std::string argument, const std::string& name, const std::string& value) {
+		for (size_t position = argument.find(name); position != std::string::npos; position = argument.find(name, position + value.size())) {
+			argument.replace(position, name.size(), value);
+		}
+		return argument;
+	}
+
+	struct Range {
+		uint64_t first;
+		uint64_t end;
+	};
+
+	struct Worker {
+		pid_t pid = -1;
+		int input = -1;
+		int output = -1;
+		std::string buffer;
+		std::vector<int> cpus;
+		bool ready = false;
+		bool alive = true;
+		bool busy = false;
+		Range range = {};
+		// First frame of the range not yet reported done.
+		uint64_t next = 0;
+		// Set on a victim while its reply to a steal is outstanding.
+		int thief = -1;
+		Range stealRange = {};
+		// Set on a thief until the victim replies.
+		bool waiting = false;
+	};
+
+	class Coordinator {
+	public:
+		Coordinator(const ShardCoordinatorOptions& options, ShardReport& report) :
+			m_options(options),
+			m_report(report),
+			m_cursor(options.firstFrame)
+		{
+		}
+
+		bool Run();
+
+	private:
+		bool start(uint32_t index, uint32_t node, uint32_t threads);
+		void send(Worker& worker, const std::string& line);
+		void handle(uint32_t index, const std::string& line);
+		void fail(uint32_t index);
+		bool take(Range& range);
+		void assign(uint32_t index, Range range);
+		void dispatch();
+		bool finished() const;
+
+		const ShardCoordinatorOptions& m_options;
+		ShardReport& m_report;
+		std::vector<Worker> m_workers;
+		uint64_t m_cursor;
+		std::deque<Range> m_requeued;
+		high_resolution_clock::time_point m_start;
+	};
+
+	bool Coordinator::start(uint32_t index, uint32_t node, uint32_t threads) {
+		Worker& worker = m_workers[index];
+		std::vector<std::string> arguments;
+		for (const auto& argument : m_options.command) {
+			std::string value = substitute(argument, "{worker}", std::to_string(index));
+			value = substitute(value, "{node}", std::to_string(node));
+			arguments.push_back(substitute(value, "{threads}", std::to_string(threads)));
+		}
+		std::vector<char*> argv;
+		for (auto& argument : arguments) {
+			argv.push_back(argument.data());
+		}
+		argv.push_back(nullptr);
+
+		int toWorker[2], fromWorker[2];
+		if (pipe2(toWorker, O_CLOEXEC) != 0 || pipe2(fromWorker, O_CLOEXEC) != 0) {
+			return false;
+		}
+		pid_t pid = fork();
+		if (pid < 0) {
+			return false;
+		}
+		if (pid == 0) {
+			// Only async signal safe calls from here to exec.
+			dup2(toWorker[0], STDIN_FILENO);
+			dup2(fromWorker[1], STDOUT_FILENO);
+			if (m_options.pinToNumaNodes && !worker.cpus.empty()) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				for (int cpu : worker.cpus) {
+					CPU_SET(cpu, &set);
+				}
+				sched_setaffinity(0, sizeof(set), &set);
+			}
+			execvp(argv[0], argv.data());
+			_exit(127);
+		}
+		close(toWorker[0]);
+		close(fromWorker[1]);
+		worker.pid = pid;
+		worker.input = toWorker[1];
+		worker.output = fromWorker[0];
+		return true;
+	}
+
+	void Coordinator::send(Worker& worker, const std::string& line) {
+		if (!worker.alive) {
+			return;
+		}
+		std::string message = line + "\n";
+		for (size_t written = 0; written < message.size();) {
+			ssize_t result = write(worker.input, message.data() + written, message.size() - written);
+			if (result < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				// The worker is gone; its output closing is handled by the poll loop.
+				return;
+			}
+			written += static_cast<size_t>(result);
+		}
+	}
+
+	// Ranges start at an eighth of each worker's even share and halve as the
+	// remaining frames do, so early ranges keep encoders on long runs of
+	// consecutive frames and late ones leave little for stragglers to hold up.
+	bool Coordinator::take(Range& range) {
+		if (!m_requeued.empty()) {
+			range = m_requeued.front();
+			m_requeued.pop_front();
+			return true;
+		}
+		if (m_cursor >= m_options.endFrame) {
+			return false;
+		}
+		const uint64_t remaining = m_options.endFrame - m_cursor;
+		const uint64_t total = m_options.endFrame - m_options.firstFrame;
+		uint64_t size = std::min(remaining / (2 * m_workers.size()), total / (8 * m_workers.size()));
+		size = std::min(std::max(size, std::max<uint64_t>(m_options.minRange, 1)), remaining);
+		range = { m_cursor, m_cursor + size };
+		m_cursor += size;
+		return true;
+	}
+
+	void Coordinator::assign(uint32_t index, Range range) {
+		Worker& worker = m_workers[index];
+		if (!worker.alive) {
+			m_requeued.push_back(range);
+			return;
+		}
+		worker.busy = true;
+		worker.range = range;
+		worker.next = range.first;
+		send(worker, "render " + std::to_string(range.first) + " " + std::to_string(range.end));
+	}
+
+	void Coordinator::dispatch() {
+		for (uint32_t index = 0; index < m_workers.size(); ++index) {
+			Worker& worker = m_workers[index];
+			if (!worker.alive || !worker.ready || worker.busy || worker.waiting) {
+				continue;
+			}
+			Range range;
+			if (take(range)) {
+				assign(index, range);
+				continue;
+			}
+
+			// Nothing left to hand out: split the busy range with the most frames
+			// not yet started. The frame at next is likely in progress already.
+			int victim = -1;
+			uint64_t mostUnstarted = 0;
+			for (uint32_t other = 0; other < m_workers.size(); ++other) {
+				const Worker& candidate = m_workers[other];
+				if (!candidate.alive || !candidate.busy || candidate.thief >= 0) {
+					continue;
+				}
+				const uint64_t unstarted = candidate.range.end - std::min(candidate.range.end, candidate.next + 1);
+				if (unstarted > mostUnstarted) {
+					mostUnstarted = unstarted;
+					victim = static_cast<int>(other);
+				}
+			}
+			if (victim < 0) {
+				continue;
+			}
+			Worker& straggler = m_workers[victim];
+			const uint64_t split = straggler.range.end - (mostUnstarted + 1) / 2;
+			straggler.thief = static_cast<int>(index);
+			straggler.stealRange = { split, straggler.range.end };
+			worker.waiting = true;
+			send(straggler, "steal " + std::to_string(split));
+		}
+	}
+
+	void Coordinator::fail(uint32_t index) {
+		Worker& worker = m_workers[index];
+		if (!worker.alive) {
+			return;
+		}
+		worker.alive = false;
+		ShardWorkerReport& workerReport = m_report.workers[index];
+		workerReport.failed = true;
+		fprintf(stderr, "renderlab-shard: worker %u exited\n", index);
+		if (worker.busy && worker.next < worker.range.end) {
+			m_requeued.push_back({ worker.next, worker.range.end });
+			m_report.requeuedFrames += worker.range.end - worker.next;
+		}
+		// Its output may end anywhere, even before frames it reported, so
+		// those are rendered again too, in runs of consecutive frames.
+		std::vector<uint64_t> frames = workerReport.frameOrder;
+		std::sort(frames.begin(), frames.end());
+		for (size_t first = 0, end = 1; first < frames.size(); first = end++) {
+			while (end < frames.size() && frames[end] == frames[end - 1] + 1) {
+				++end;
+			}
+			m_requeued.push_back({ frames[first], frames[end - 1] + 1 });
+		}
+		m_report.requeuedFrames += frames.size();
+		m_report.frames -= frames.size();
+		workerReport.frames = 0;
+		workerReport.frameOrder.clear();
+		worker.busy = false;
+		// A thief waiting on this worker gets nothing from it.
+		if (worker.thief >= 0) {
+			m_workers[worker.thief].waiting = false;
+			worker.thief = -1;
+		}
+		close(worker.input);
+		close(worker.output);
+	}
+
+	void Coordinator::handle(uint32_t index, const std::string& line) {
+		Worker& worker = m_workers[index];
+		ShardWorkerReport& workerReport = m_report.workers[index];
+		std::istringstream stream(line);
+		std::string verb;
+		stream >> verb;
+		if (verb == "ready") {
+			worker.ready = true;
+			workerReport.startupMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - m_start).count();
+		}
+		else if (verb == "frame") {
+			uint64_t frame;
+			double milliseconds;
+			stream >> frame >> milliseconds;
+			if (frame < m_options.firstFrame || frame >= m_options.endFrame) {
+				return;
+			}
+			worker.next = std::max(worker.next, frame + 1);
+			++workerReport.frames;
+			workerReport.busyMilliseconds += milliseconds;
+			workerReport.frameOrder.push_back(frame);
+			m_report.frameMilliseconds[frame - m_options.firstFrame] = milliseconds;
+			++m_report.frames;
+		}
+		else if (verb == "stolen") {
+			uint64_t end;
+			stream >> end;
+			const int thief = worker.thief;
+			const Range stolen = worker.stealRange;
+			worker.thief = -1;
+			if (thief < 0) {
+				return;
+			}
+			m_workers[thief].waiting = false;
+			if (end < stolen.end) {
+				// The reply may come after the range was reported done, in which
+				// case the done line already carried the shortened end.
+				if (worker.busy && worker.range.end == stolen.end) {
+					worker.range.end = end;
+				}
+				const uint64_t frames = stolen.end - end;
+				workerReport.lostFrames += frames;
+				m_report.workers[thief].stolenFrames += frames;
+				++m_report.steals;
+				assign(static_cast<uint32_t>(thief), { end, stolen.end });
+			}
+		}
+		else if (verb == "done") {
+			uint64_t first, end;
+			stream >> first >> end;
+			std::string stat;
+			while (stream >> stat) {
+				size_t equals = stat.find('=');
+				if (equals != std::string::npos) {
+					m_report.stats[stat.substr(0, equals)] += strtod(stat.c_str() + equals + 1, nullptr);
+				}
+			}
+			worker.busy = false;
+			++workerReport.ranges;
+		}
+	}
+
+	bool Coordinator::finished() const {
+		if (m_cursor < m_options.endFrame || !m_requeued.empty()) {
+			return false;
+		}
+		for (const auto& worker : m_workers) {
+			if (worker.alive && (worker.busy || worker.waiting || worker.thief >= 0)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Coordinator::Run() {
+		m_start = high_resolution_clock::now();
+		// Writes to a worker that died are reported through errno instead.
+		signal(SIGPIPE, SIG_IGN);
+
+		auto nodes = NumaNodeCpus();
+		const uint32_t workerCount = std::max(1u, m_options.workerCount);
+		m_workers.resize(workerCount);
+		m_report.workers.assign(workerCount, {});
+		m_report.frameMilliseconds.assign(m_options.endFrame - m_options.firstFrame, 0.0);
+		for (uint32_t index = 0; index < workerCount; ++index) {
+			const uint32_t node = index % static_cast<uint32_t>(nodes.size());
+			const uint32_t workersOnNode = workerCount / static_cast<uint32_t>(nodes.size()) + (node < workerCount % nodes.size() ? 1 : 0);
+			// Workers sharing a node share its CPUs, and split them evenly for
+			// their own thread pools.
+			const uint32_t threads = std::max(1u, static_cast<uint32_t>(nodes[node].size()) / workersOnNode);
+			m_workers[index].cpus = nodes[node];
+			m_report.workers[index].node = node;
+			m_report.workers[index].threads = threads;
+			if (!start(index, node, threads)) {
+				fprintf(stderr, "renderlab-shard: cannot start worker %u: %s\n", index, strerror(errno));
+				return false;
+			}
+		}
+
+		std::vector<pollfd> fds;
+		std::vector<uint32_t> fdWorkers;
+		char chunk[4096];
+		while (!finished()) {
+			fds.clear();
+			fdWorkers.clear();
+			for (uint32_t index = 0; index < workerCount; ++index) {
+				if (m_workers[index].alive) {
+					fds.push_back({ m_workers[index].output, POLLIN, 0 });
+					fdWorkers.push_back(index);
+				}
+			}
+			if (fds.empty()) {
+				fprintf(stderr, "renderlab-shard: every worker failed\n");
+				return false;
+			}
+			if (poll(fds.data(), fds.size(), -1) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			for (size_t i = 0; i < fds.size(); ++i) {
+				if (!fds[i].revents) {
+					continue;
+				}
+				const uint32_t index = fdWorkers[i];
+				Worker& worker = m_workers[index];
+				ssize_t bytes = read(worker.output, chunk, sizeof(chunk));
+				if (bytes <= 0) {
+					if (bytes < 0 && errno == EINTR) {
+						continue;
+					}
+					fail(index);
+					continue;
+				}
+				worker.buffer.append(chunk, static_cast<size_t>(bytes));
+				for (size_t newline = worker.buffer.find('\n'); newline != std::string::npos; newline = worker.buffer.find('\n')) {
+					std::string line = worker.buffer.substr(0, newline);
+					worker.buffer.erase(0, newline + 1);
+					handle(index, line);
+				}
+			}
+			dispatch();
+		}
+
+		for (auto& worker : m_workers) {
+			if (worker.alive) {
+				send(worker, "quit");
+				close(worker.input);
+			}
+		}
+		bool success = true;
+		for (uint32_t index = 0; index < workerCount; ++index) {
+			Worker& worker = m_workers[index];
+			int status = 0;
+			waitpid(worker.pid, &status, 0);
+			if (worker.alive) {
+				close(worker.output);
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+					fprintf(stderr, "renderlab-shard: worker %u exited with status %d\n", index, status);
+					m_report.workers[index].failed = true;
+					success = false;
+				}
+			}
+		}
+		m_report.wallMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - m_start).count();
+		return success;
+	}
+}
+
+std::vector<std::vector<int>> NumaNodeCpus() {
+	std::vector<std::vector<int>> nodes;
+	std::error_code error;
+	for (uint32_t node = 0;; ++node) {
+		std::filesystem::path path = "/sys/devices/system/node/node" + std::to_string(node);
+		if (!std::filesystem::exists(path, error)) {
+			break;
+		}
+		std::ifstream file(path / "cpulist");
+		std::string list;
+		std::getline(file, list);
+		auto cpus = parseCpuList(list);
+		if (!cpus.empty()) {
+			nodes.push_back(std::move(cpus));
+		}
+	}
+	if (nodes.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		std::vector<int> cpus;
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+				if (CPU_ISSET(cpu, &set)) {
+					cpus.push_back(cpu);
+				}
+			}
+		}
+		nodes.push_back(std::move(cpus));
+	}
+	return nodes;
+}
+
+bool RunShards(const ShardCoordinatorOptions& options, ShardReport& report) {
+	report = {};
+	if (options.command.empty() || options.endFrame <= options.firstFrame) {
+		return false;
+	}
+	Coordinator coordinator(options, report);
+	return coordinator.Run();
+}
+
+bool MergeShardSequences(const ShardReport& report, uint64_t firstFrame, const std::vector<std::string>& shardPaths, const std::string& path, uint32_t keyframeInterval) {
+	// Where every frame lives: the worker and its position in that worker's output.
+	std::vector<std::pair<uint32_t, uint32_t>> sources(report.frameMilliseconds.size(), { UINT32_MAX, 0 });
+	for (uint32_t worker = 0; worker < report.workers.size(); ++worker) {
+		const auto& order = report.workers[worker].frameOrder;
+		for (uint32_t position = 0; position < order.size(); ++position) {
+			sources[order[position] - firstFrame] = { worker, position };
+		}
+	}
+
+	std::vector<SequenceDecoder> decoders(shardPaths.size());
+	std::vector<bool> opened(shardPaths.size(), false);
+	SequenceEncoder encoder;
+	bool encoderOpen = false;
+	std::vector<uint8_t> pixels;
+	for (size_t frame = 0; frame < sources.size(); ++frame) {
+		const auto [worker, position] = sources[frame];
+		if (worker >= shardPaths.size()) {
+			fprintf(stderr, "renderlab-shard: frame %llu was not rendered\n", static_cast<unsigned long long>(firstFrame + frame));
+			return false;
+		}
+		SequenceDecoder& decoder = decoders[worker];
+		if (!opened[worker]) {
+			if (!decoder.Open(shardPaths[worker])) {
+				fprintf(stderr, "renderlab-shard: cannot read %s\n", shardPaths[worker].c_str());
+				return false;
+			}
+			opened[worker] = true;
+		}
+		if (!decoder.ReadFrame(position, pixels)) {
+			fprintf(stderr, "renderlab-shard: %s has no frame %u\n", shardPaths[worker].c_str(), position);
+			return false;
+		}
+		if (!encoderOpen) {
+			if (!encoder.Open(path, decoder.Width(), decoder.Height(), keyframeInterval)) {
+				return false;
+			}
+			encoderOpen = true;
+		}
+		encoder.WriteRows(pixels.data(), static_cast<size_t>(decoder.Width()) * 4, decoder.Height());
+		if (!encoder.EndFrame()) {
+			return false;
+		}
+	}
+	return encoderOpen && encoder.Close();
+}
@@ -0,0 +1,270 @@
+// renderlab-shard: renders a frame range with several worker processes.
+//
+//   renderlab-shard [options] -- <worker command and arguments>
+//
+// Workers speak the ShardWorker protocol on stdin and stdout, for example
+// "RenderLab --shard-worker 30 --threads {threads} --sequence out.{worker}.rlsq".
+// {worker}, {node} and {threads} are replaced in every argument.
+//
+//   --frames FIRST END     frames to render, [FIRST, END) (0 240)
+//   --workers N            worker processes, 0 for one per NUMA node (0)
+//   --min-range N          smallest range handed to a worker (1)
+//   --no-pin               leave workers unpinned, as for remote workers
+//   --merge PATTERN OUT    merge the per worker sequences PATTERN, with
+//                          {worker} replaced, into the sequence OUT
+//   --keyframe N           keyframe interval of the merged sequence (30)
+//   --report FILE          write a JSON report
+//
+//   renderlab-shard --worker [options]
+//
+// Runs a synthetic worker that needs no GPU, for trying the coordinator on
+// any machine. It renders a moving pattern and spins for the frame time.
+//
+//   --size W H             frame size (256 256)
+//   --frame-ms X           time per frame (5)
+//   --slow FIRST END X     frames in [FIRST, END) take X times longer
+//   --sequence FILE        write the frames to a sequence
+//   --index N              the worker's index, usually {worker}
+//   --crash WORKER N       worker WORKER is killed after N frames, losing
+//                          its sequence
+//
+// Exits with 0 when every frame was rendered and 1 otherwise.
+#include "shardCoordinator.h"
+#include "shardWorker.h"
+#include "sequenceEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+using namespace std::chrono;
+
+namespace {
+	int runSyntheticWorker(int argc, char* argv[]) {
+		uint32_t width = 256;
+		uint32_t height = 256;
+		double frameMilliseconds = 5.0;
+		uint64_t slowFirst = 0, slowEnd = 0;
+		double slowFactor = 1.0;
+		std::string sequencePath;
+		int64_t index = -1;
+		int64_t crashIndex = -2;
+		uint64_t crashFrames = 0;
+		for (int i = 2; i < argc; ++i) {
+			if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+				width = static_cast<uint32_t>(atoi(argv[i + 1]));
+				height = static_cast<uint32_t>(atoi(argv[i + 2]));
+				i += 2;
+			}
+			else if (strcmp(argv[i], "--frame-ms") == 0 && i + 1 < argc) {
+				frameMilliseconds = atof(argv[++i]);
+			}
+			else if (strcmp(argv[i], "--slow") == 0 && i + 3 < argc) {
+				slowFirst = strtoull(argv[i + 1], nullptr, 10);
+				slowEnd = strtoull(argv[i + 2], nullptr, 10);
+				slowFactor = atof(argv[i + 3]);
+				i += 3;
+			}
+			else if (strcmp(argv[i], "--sequence") == 0 && i + 1 < argc) {
+				sequencePath = argv[++i];
+			}
+			else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+				index = atoll(argv[++i]);
+			}
+			else if (strcmp(argv[i], "--crash") == 0 && i + 2 < argc) {
+				crashIndex = atoll(argv[i + 1]);
+				crashFrames = strtoull(argv[i + 2], nullptr, 10);
+				i += 2;
+			}
+		}
+
+		SequenceEncoder encoder;
+		if (!sequencePath.empty() && !encoder.Open(sequencePath, width, height, 30)) {
+			fprintf(stderr, "renderlab-shard: cannot write %s\n", sequencePath.c_str());
+			return 1;
+		}
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+		ShardWorker worker(std::cin, std::cout);
+		uint64_t frame;
+		uint64_t renderedFrames = 0;
+		while (worker.NextFrame(frame)) {
+			auto start = high_resolution_clock::now();
+			for (uint32_t y = 0; y < height; ++y) {
+				uint8_t* row = pixels.data() + static_cast<size_t>(y) * width * 4;
+				for (uint32_t x = 0; x < width; ++x) {
+					row[x * 4 + 0] = static_cast<uint8_t>(x + frame * 3);
+					row[x * 4 + 1] = static_cast<uint8_t>(y + frame);
+					row[x * 4 + 2] = static_cast<uint8_t>(frame * 7);
+					row[x * 4 + 3] = 255;
+				}
+			}
+			const double cost = frameMilliseconds * (frame >= slowFirst && frame < slowEnd ? slowFactor : 1.0);
+			while (duration<double, std::milli>(high_resolution_clock::now() - start).count() < cost) {
+			}
+			if (index == crashIndex && renderedFrames == crashFrames) {
+				// Dies the way a crashed renderer would, with the frames it
+				// reported lost from the cache rather than written.
+				if (!sequencePath.empty()) {
+					encoder.WriteRows(pixels.data(), static_cast<size_t>(width) * 4, height / 2);
+					std::error_code error;
+					std::filesystem::resize_file(sequencePath, 0, error);
+				}
+				raise(SIGKILL);
+			}
+			if (!sequencePath.empty()) {
+				encoder.WriteRows(pixels.data(), static_cast<size_t>(width) * 4, height);
+				encoder.EndFrame();
+			}
+			worker.FrameDone(frame, duration<double, std::milli>(high_resolution_clock::now() - start).count());
+			worker.AddStat("pixels", static_cast<double>(width) * height);
+			++renderedFrames;
+		}
+		if (!sequencePath.empty()) {
+			return encoder.Close() ? 0 : 1;
+		}
+		return 0;
+	}
+
+	double percentile(std::vector<double> values, double fraction) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+		std::nth_element(values.begin(), values.begin() + index, values.end());
+		return values[index];
+	}
+
+	std::string replaceWorker(std::string pattern, uint32_t worker) {
+		size_t position = pattern.find("{worker}");
+		if (position != std::string::npos) {
+			pattern.replace(position, 8, std::to_string(worker));
+		}
+		return pattern;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1 && strcmp(argv[1], "--worker") == 0) {
+		return runSyntheticWorker(argc, argv);
+	}
+
+	ShardCoordinatorOptions options;
+	options.endFrame = 240;
+	options.workerCount = 0;
+	std::string mergePattern;
+	std::string mergePath;
+	uint32_t keyframeInterval = 30;
+	std::string reportPath;
+	int i = 1;
+	for (; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 2 < argc) {
+			options.firstFrame = strtoull(argv[i + 1], nullptr, 10);
+			options.endFrame = strtoull(argv[i + 2], nullptr, 10);
+			i += 2;
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			options.workerCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--min-range") == 0 && i + 1 < argc) {
+			options.minRange = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--no-pin") == 0) {
+			options.pinToNumaNodes = false;
+		}
+		else if (strcmp(argv[i], "--merge") == 0 && i + 2 < argc) {
+			mergePattern = argv[i + 1];
+			mergePath = argv[i + 2];
+			i += 2;
+		}
+		else if (strcmp(argv[i], "--keyframe") == 0 && i + 1 < argc) {
+			keyframeInterval = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+			reportPath = argv[++i];
+		}
+		else {
+			fprintf(stderr, "renderlab-shard: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	for (++i; i < argc; ++i) {
+		options.command.push_back(argv[i]);
+	}
+	if (options.command.empty()) {
+		fprintf(stderr, "usage: renderlab-shard [options] -- <worker command>\n");
+		return 1;
+	}
+	auto nodes = NumaNodeCpus();
+	if (options.workerCount == 0) {
+		options.workerCount = static_cast<uint32_t>(nodes.size());
+	}
+
+	ShardReport report;
+	bool success = RunShards(options, report);
+	const uint64_t frameCount = options.endFrame - options.firstFrame;
+	success = success && report.frames == frameCount;
+
+	double mergeMilliseconds = 0.0;
+	if (success && !mergePath.empty()) {
+		auto start = high_resolution_clock::now();
+		std::vector<std::string> shardPaths;
+		for (uint32_t worker = 0; worker < report.workers.size(); ++worker) {
+			shardPaths.push_back(replaceWorker(mergePattern, worker));
+		}
+		success = MergeShardSequences(report, options.firstFrame, shardPaths, mergePath, keyframeInterval);
+		mergeMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+	}
+
+	printf("%llu of %llu frames in %.1f ms on %u workers over %zu NUMA nodes, %.2f frames/s, %llu steals, %llu frames requeued\n",
+		static_cast<unsigned long long>(report.frames), static_cast<unsigned long long>(frameCount), report.wallMilliseconds,
+		options.workerCount, nodes.size(), report.wallMilliseconds > 0.0 ? report.frames * 1000.0 / report.wallMilliseconds : 0.0,
+		static_cast<unsigned long long>(report.steals), static_cast<unsigned long long>(report.requeuedFrames));
+	printf("frame time p50 %.2f ms p95 %.2f ms max %.2f ms\n", percentile(report.frameMilliseconds, 0.5), percentile(report.frameMilliseconds, 0.95),
+		report.frameMilliseconds.empty() ? 0.0 : *std::max_element(report.frameMilliseconds.begin(), report.frameMilliseconds.end()));
+	for (uint32_t worker = 0; worker < report.workers.size(); ++worker) {
+		const auto& workerReport = report.workers[worker];
+		printf("worker %u node %u threads %u: %llu frames in %llu ranges, stole %llu lost %llu, busy %.1f%%, started in %.1f ms%s\n",
+			worker, workerReport.node, workerReport.threads, static_cast<unsigned long long>(workerReport.frames), static_cast<unsigned long long>(workerReport.ranges),
+			static_cast<unsigned long long>(workerReport.stolenFrames), static_cast<unsigned long long>(workerReport.lostFrames),
+			report.wallMilliseconds > 0.0 ? 100.0 * workerReport.busyMilliseconds / report.wallMilliseconds : 0.0,
+			workerReport.startupMilliseconds, workerReport.failed ? ", failed" : "");
+	}
+	for (const auto& [name, total] : report.stats) {
+		printf("%s %.17g\n", name.c_str(), total);
+	}
+	if (!mergePath.empty() && success) {
+		printf("merged into %s in %.1f ms\n", mergePath.c_str(), mergeMilliseconds);
+	}
+
+	if (!reportPath.empty()) {
+		nlohmann::json json;
+		json["pass"] = success;
+		json["firstFrame"] = options.firstFrame;
+		json["endFrame"] = options.endFrame;
+		json["frames"] = report.frames;
+		json["wallMilliseconds"] = report.wallMilliseconds;
+		json["steals"] = report.steals;
+		json["requeuedFrames"] = report.requeuedFrames;
+		json["mergeMilliseconds"] = mergeMilliseconds;
+		json["frameMilliseconds"] = report.frameMilliseconds;
+		json["stats"] = report.stats;
+		nlohmann::json workers = nlohmann::json::array();
+		for (const auto& workerReport : report.workers) {
+			workers.push_back({ { "node", workerReport.node }, { "threads", workerReport.threads }, { "frames", workerReport.frames },
+				{ "ranges", workerReport.ranges }, { "stolenFrames", workerReport.stolenFrames }, { "lostFrames", workerReport.lostFrames },
+				{ "busyMilliseconds", workerReport.busyMilliseconds }, { "startupMilliseconds", workerReport.startupMilliseconds },
+				{ "failed", workerReport.failed } });
+		}
+		json["workers"] = workers;
+		std::ofstream(reportPath) << json.dump(2) << "\n";
+	}
+	return success ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "shardWorker.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+ShardWorker::ShardWorker(std::istream& input, std::ostream& output) :
+	m_input(input),
+	m_output(output)
+{
+	send("ready");
+	m_reader = std::thread(&ShardWorker::readLoop, this);
+}
+
+ShardWorker::~ShardWorker() {
+	// The reader only stops on quit or end of input, like NextFrame.
+	if (m_reader.joinable()) {
+		m_reader.join();
+	}
+}
+
+void ShardWorker::readLoop() {
+	std::string line;
+	for (;;) {
+		bool quit = !std::getline(m_input, line) || line == "quit";
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_commands.push_back(quit ? "quit" : line);
+		m_received.notify_one();
+		if (quit) {
+			return;
+		}
+	}
+}
+
+void ShardWorker::send(const std::string& line) {
+	m_output << line << '\n';
+	m_output.flush();
+}
+
+bool ShardWorker::apply(const std::string& command) {
+	std::istringstream stream(command);
+	std::string verb;
+	stream >> verb;
+	if (verb == "quit") {
+		return false;
+	}
+	if (verb == "render") {
+		stream >> m_first >> m_end;
+		m_next = m_first;
+		m_active = m_first < m_end;
+	}
+	else if (verb == "steal") {
+		uint64_t end = m_end;
+		stream >> end;
+		// Frames already handed out stay with this worker.
+		m_end = std::clamp(end, m_next, m_end);
+		send("stolen " + std::to_string(m_end));
+	}
+	return true;
+}
+
+void ShardWorker::finishRange() {
+	std::string line = "done " + std::to_string(m_first) + " " + std::to_string(m_end);
+	char value[64];
+	for (const auto& [name, total] : m_stats) {
+		snprintf(value, sizeof(value), "%.17g", total);
+		line += " " + name + "=" + value;
+	}
+	send(line);
+	m_stats.clear();
+	m_active = false;
+}
+
+bool ShardWorker::NextFrame(uint64_t& frame) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		// Pending commands are applied between frames, so a steal takes effect
+		// before the next frame starts.
+		while (!m_commands.empty()) {
+			std::string command = std::move(m_commands.front());
+			m_commands.pop_front();
+			if (!apply(command)) {
+				return false;
+			}
+		}
+		if (m_active && m_next < m_end) {
+			frame = m_next++;
+			return true;
+		}
+		if (m_active) {
+			finishRange();
+		}
+		m_received.wait(lock, [this] { return !m_commands.empty(); });
+	}
+}
+
+void ShardWorker::FrameDone(uint64_t frame, double milliseconds) {
+	char line[64];
+	snprintf(line, sizeof(line), "frame %llu %.3f", static_cast<unsigned long long>(frame), milliseconds);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	send(line);
+}
+
+void ShardWorker::AddStat(const std::string& name, double value) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats[name] += value;
+}
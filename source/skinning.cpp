@@ -0,0 +1,88 @@
+#include "skinning.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+void DeformVertices(const DeformableMesh& mesh, const XMFLOAT4X4* jointMatrices, const float* morphWeights, uint32_t morphWeightCount, uint32_t first, uint32_t count, const DeformedStreams& streams) {
+	// Only targets with a non zero weight cost anything per vertex.
+	struct ActiveTarget {
+		const MorphTarget* target;
+		float weight;
+	};
+	std::vector<ActiveTarget> activeTargets;
+	const uint32_t targetCount = std::min(morphWeightCount, static_cast<uint32_t>(mesh.targets.size()));
+	for (uint32_t t = 0; t < targetCount; ++t) {
+		if (morphWeights[t] != 0.0f) {
+			activeTargets.push_back({ &mesh.targets[t], morphWeights[t] });
+		}
+	}
+	const bool hasNormals = streams.normals && !mesh.normals.empty();
+	const bool hasTangents = streams.tangents && !mesh.tangents.empty();
+	const bool skinned = jointMatrices && !mesh.joints.empty();
+
+	const uint32_t last = std::min(first + count, mesh.vertexCount);
+	for (uint32_t v = first; v < last; ++v) {
+		XMVECTOR position = XMLoadFloat3(&mesh.positions[v]);
+		XMVECTOR normal = hasNormals ? XMLoadFloat3(&mesh.normals[v]) : XMVectorZero();
+		XMVECTOR tangent = hasTangents ? XMLoadFloat4(&mesh.tangents[v]) : XMVectorZero();
+
+		for (const auto& active : activeTargets) {
+			const MorphTarget& target = *active.target;
+			if (!target.positions.empty()) {
+				position = XMVectorMultiplyAdd(XMLoadFloat3(&target.positions[v]), XMVectorReplicate(active.weight), position);
+			}
+			if (hasNormals && !target.normals.empty()) {
+				normal = XMVectorMultiplyAdd(XMLoadFloat3(&target.normals[v]), XMVectorReplicate(active.weight), normal);
+			}
+			if (hasTangents && !target.tangents.empty()) {
+				tangent = XMVectorMultiplyAdd(XMLoadFloat3(&target.tangents[v]), XMVectorReplicate(active.weight), tangent);
+			}
+		}
+
+		if (skinned) {
+			const uint16_t* joints = &mesh.joints[v * 4];
+			XMVECTOR weights = XMLoadFloat4(&mesh.weights[v]);
+			XMMATRIX skin = XMLoadFloat4x4(&jointMatrices[joints[0]]) * XMVectorGetX(weights);
+			XMMATRIX joint = XMLoadFloat4x4(&jointMatrices[joints[1]]);
+			XMVECTOR weight = XMVectorSplatY(weights);
+			for (int r = 0; r < 4; ++r) {
+				skin.r[r] = XMVectorMultiplyAdd(joint.r[r], weight, skin.r[r]);
+			}
+			joint = XMLoadFloat4x4(&jointMatrices[joints[2]]);
+			weight = XMVectorSplatZ(weights);
+			for (int r = 0; r < 4; ++r) {
+				skin.r[r] = XMVectorMultiplyAdd(joint.r[r], weight, skin.r[r]);
+			}
+			joint = XMLoadFloat4x4(&jointMatrices[joints[3]]);
+			weight = XMVectorSplatW(weights);
+			for (int r = 0; r < 4; ++r) {
+				skin.r[r] = XMVectorMultiplyAdd(joint.r[r], weight, skin.r[r]);
+			}
+
+			position = XMVector3Transform(position, skin);
+			if (hasNormals) {
+				normal = XMVector3Normalize(XMVector3TransformNormal(normal, skin));
+			}
+			if (hasTangents) {
+				// w holds the bitangent sign and is kept as is.
+				tangent = XMVectorSelect(tangent, XMVector3Normalize(XMVector3TransformNormal(tangent, skin)), g_XMSelect1110);
+			}
+		}
+		else if (!activeTargets.empty()) {
+			if (hasNormals) {
+				normal = XMVector3Normalize(normal);
+			}
+			if (hasTangents) {
+				tangent = XMVectorSelect(tangent, XMVector3Normalize(tangent), g_XMSelect1110);
+			}
+		}
+
+		XMStoreFloat3(&streams.positions[v], position);
+		if (hasNormals) {
+			XMStoreFloat3(&streams.normals[v], normal);
+		}
+		if (hasTangents) {
+			XMStoreFloat4(&streams.tangents[v], tangent);
+		}
+	}
+}
@@ -0,0 +1,199 @@
+#include "taskGraph.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+using namespace std::chrono;
+
+uint32_t TaskGraph::Add(std::string name, std::function<void()> work, const std::vector<uint32_t>& dependencies) {
+	auto& task = m_tasks.emplace_back();
+	task.name = std::move(name);
+	task.work = std::move(work);
+	const uint32_t index = static_cast<uint32_t>(m_tasks.size() - 1);
+	for (uint32_t dependency : dependencies) {
+		Depend(index, dependency);
+	}
+	return index;
+}
+
+void TaskGraph::Depend(uint32_t task, uint32_t dependency) {
+	m_tasks[task].dependencies.push_back(dependency);
+	m_tasks[dependency].successors.push_back(task);
+}
+
+void TaskGraph::Run(ThreadPool& threadPool) {
+	auto start = high_resolution_clock::now();
+	const uint32_t workers = threadPool.ThreadCount();
+	m_queues.clear();
+	for (uint32_t worker = 0; worker < workers; ++worker) {
+		m_queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	m_finished.clear();
+	m_finished.reserve(m_tasks.size());
+	m_queued = 0;
+	m_steals = 0;
+	m_remaining = m_tasks.size();
+
+	// Tasks ready from the start are dealt out round robin; idle threads steal
+	// whatever a thread that has not started yet was dealt.
+	uint32_t nextWorker = 0;
+	for (uint32_t task = 0; task < m_tasks.size(); ++task) {
+		m_tasks[task].pending = static_cast<uint32_t>(m_tasks[task].dependencies.size());
+		if (m_tasks[task].dependencies.empty()) {
+			push(nextWorker, task);
+			nextWorker = (nextWorker + 1) % workers;
+		}
+	}
+	if (!m_tasks.empty()) {
+		threadPool.ParallelFor(workers, 1, [this](size_t begin, size_t end) {
+			for (size_t worker = begin; worker < end; ++worker) {
+				workerLoop(static_cast<uint32_t>(worker));
+			}
+		});
+	}
+
+	m_stats = {};
+	m_stats.threads = workers;
+	m_stats.wallMilliseconds = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+	m_stats.steals = m_steals;
+	for (const auto& task : m_tasks) {
+		m_stats.workMilliseconds += task.milliseconds;
+	}
+	findCriticalPath();
+}
+
+void TaskGraph::workerLoop(uint32_t worker) {
+	for (;;) {
+		uint32_t task;
+		if (pop(worker, task) || steal(worker, task)) {
+			execute(worker, task);
+			continue;
+		}
+		// Pushes bump m_queued before checking m_sleeping, and sleepers bump
+		// m_sleeping before checking m_queued, so a push is never missed.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		++m_sleeping;
+		m_wake.wait(lock, [this] { return m_queued > 0 || m_remaining == 0; });
+		--m_sleeping;
+		if (m_remaining == 0) {
+			return;
+		}
+	}
+}
+
+bool TaskGraph::pop(uint32_t worker, uint32_t& task) {
+	auto& queue = *m_queues[worker];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	--m_queued;
+	return true;
+}
+
+bool TaskGraph::steal(uint32_t worker, uint32_t& task) {
+	const uint32_t workers = static_cast<uint32_t>(m_queues.size());
+	for (uint32_t offset = 1; offset < workers; ++offset) {
+		auto& queue = *m_queues[(worker + offset) % workers];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			--m_queued;
+			++m_steals;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskGraph::push(uint32_t worker, uint32_t task) {
+	{
+		std::lock_guard<std::mutex> lock(m_queues[worker]->mutex);
+		m_queues[worker]->tasks.push_back(task);
+	}
+	++m_queued;
+	if (m_sleeping > 0) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wake.notify_one();
+	}
+}
+
+void TaskGraph::execute(uint32_t worker, uint32_t taskIndex) {
+	auto& task = m_tasks[taskIndex];
+	auto start = high_resolution_clock::now();
+	task.work();
+	task.milliseconds = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+	{
+		std::lock_guard<std::mutex> lock(m_finishedMutex);
+		m_finished.push_back(taskIndex);
+	}
+	for (uint32_t successor : task.successors) {
+		if (--m_tasks[successor].pending == 0) {
+			push(worker, successor);
+		}
+	}
+	if (--m_remaining == 0) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wake.notify_all();
+	}
+}
+
+void TaskGraph::findCriticalPath() {
+	// Longest path ending at each task, in finishing order so that every
+	// dependency has been seen first.
+	std::vector<double> finish(m_tasks.size(), 0.0);
+	std::vector<int64_t> previous(m_tasks.size(), -1);
+	int64_t last = -1;
+	for (uint32_t task : m_finished) {
+		double begin = 0.0;
+		for (uint32_t dependency : m_tasks[task].dependencies) {
+			if (previous[task] < 0 || finish[dependency] > begin) {
+				begin = finish[dependency];
+				previous[task] = dependency;
+			}
+		}
+		finish[task] = begin + m_tasks[task].milliseconds;
+		if (last < 0 || finish[task] > finish[last]) {
+			last = task;
+		}
+	}
+	for (int64_t task = last; task >= 0; task = previous[task]) {
+		m_stats.criticalPath.push_back(static_cast<uint32_t>(task));
+	}
+	std::reverse(m_stats.criticalPath.begin(), m_stats.criticalPath.end());
+	m_stats.criticalPathMilliseconds = last >= 0 ? finish[last] : 0.0;
+}
+
+std::string TaskGraph::Report(size_t slowest) const {
+	char line[256];
+	snprintf(line, sizeof(line), "%zu tasks in %.1f ms on %u threads, %.1f ms of work (%.1fx), %llu steals, critical path %.1f ms:\n",
+		m_tasks.size(), m_stats.wallMilliseconds, m_stats.threads, m_stats.workMilliseconds,
+		m_stats.wallMilliseconds > 0.0 ? m_stats.workMilliseconds / m_stats.wallMilliseconds : 0.0,
+		static_cast<unsigned long long>(m_stats.steals), m_stats.criticalPathMilliseconds);
+	std::string report = line;
+	for (uint32_t task : m_stats.criticalPath) {
+		snprintf(line, sizeof(line), "  %-40s %10.2f ms\n", m_tasks[task].name.c_str(), m_tasks[task].milliseconds);
+		report += line;
+	}
+
+	std::vector<uint32_t> order(m_tasks.size());
+	for (uint32_t task = 0; task < order.size(); ++task) {
+		order[task] = task;
+	}
+	slowest = std::min(slowest, order.size());
+	std::partial_sort(order.begin(), order.begin() + slowest, order.end(), [this](uint32_t a, uint32_t b) {
+		return m_tasks[a].milliseconds > m_tasks[b].milliseconds;
+	});
+	if (slowest) {
+		report += "slowest tasks:\n";
+	}
+	for (size_t i = 0; i < slowest; ++i) {
+		snprintf(line, sizeof(line), "  %-40s %10.2f ms\n", m_tasks[order[i]].name.c_str(), m_tasks[order[i]].milliseconds);
+		report += line;
+	}
+	return report;
+}
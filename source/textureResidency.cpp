@@ -0,0 +1,317 @@
+#include "textureResidency.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	uint32_t mipEdge(uint32_t edge, uint32_t mip) {
+		return std::max(1u, edge >> mip);
+	}
+
+	// Averages 2x2 blocks, repeating the last row or column of odd edges.
+	void halve(const uint8_t* source, uint32_t width, uint32_t height, uint32_t bytesPerPixel, TextureMipLevel& level) {
+		level.width = mipEdge(width, 1);
+		level.height = mipEdge(height, 1);
+		level.pixels.resize(static_cast<size_t>(level.width) * level.height * bytesPerPixel);
+		const size_t rowPitch = static_cast<size_t>(width) * bytesPerPixel;
+		for (uint32_t y = 0; y < level.height; ++y) {
+			const uint8_t* row0 = source + std::min(2 * y, height - 1) * rowPitch;
+			const uint8_t* row1 = source + std::min(2 * y + 1, height - 1) * rowPitch;
+			uint8_t* dst = level.pixels.data() + static_cast<size_t>(y) * level.width * bytesPerPixel;
+			for (uint32_t x = 0; x < level.width; ++x) {
+				const size_t x0 = static_cast<size_t>(std::min(2 * x, width - 1)) * bytesPerPixel;
+				const size_t x1 = static_cast<size_t>(std::min(2 * x + 1, width - 1)) * bytesPerPixel;
+				for (uint32_t c = 0; c < bytesPerPixel; ++c) {
+					dst[c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+				}
+				dst += bytesPerPixel;
+			}
+		}
+	}
+}
+
+uint32_t TextureMipCount(uint32_t width, uint32_t height) {
+	uint32_t count = 1;
+	for (uint32_t edge = std::max(width, height); edge > 1; edge >>= 1) {
+		++count;
+	}
+	return count;
+}
+
+uint64_t TextureMipBytes(uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t firstMip, uint32_t endMip) {
+	uint64_t bytes = 0;
+	for (uint32_t mip = firstMip; mip < endMip; ++mip) {
+		bytes += static_cast<uint64_t>(mipEdge(width, mip)) * mipEdge(height, mip) * bytesPerPixel;
+	}
+	return bytes;
+}
+
+uint32_t TextureMipForFootprint(float uvPerPixel, uint32_t width, uint32_t height) {
+	const float texelsPerPixel = uvPerPixel * static_cast<float>(std::max(width, height));
+	if (!(texelsPerPixel > 1.0f)) {
+		return 0;
+	}
+	return std::min(static_cast<uint32_t>(std::log2(texelsPerPixel)), TextureMipCount(width, height) - 1);
+}
+
+float TextureCoordinateDensity(const float* positions, const float* texcoords, const uint32_t* indices, size_t indexCount) {
+	double surfaceArea = 0.0;
+	double uvArea = 0.0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		const float* p0 = positions + 3 * static_cast<size_t>(indices[i]);
+		const float* p1 = positions + 3 * static_cast<size_t>(indices[i + 1]);
+		const float* p2 = positions + 3 * static_cast<size_t>(indices[i + 2]);
+		const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		const double cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		surfaceArea += 0.5 * std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+		const float* t0 = texcoords + 2 * static_cast<size_t>(indices[i]);
+		const float* t1 = texcoords + 2 * static_cast<size_t>(indices[i + 1]);
+		const float* t2 = texcoords + 2 * static_cast<size_t>(indices[i + 2]);
+		uvArea += 0.5 * std::abs((t1[0] - t0[0]) * (t2[1] - t0[1]) - (t2[0] - t0[0]) * (t1[1] - t0[1]));
+	}
+	if (surfaceArea <= 0.0 || uvArea <= 0.0) {
+		return 0.0f;
+	}
+	return static_cast<float>(std::sqrt(uvArea / surfaceArea));
+}
+
+void BuildTextureMips(const uint8_t* source, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t firstMip, uint32_t endMip, std::vector<TextureMipLevel>& levels) {
+	levels.clear();
+	if (firstMip >= endMip) {
+		return;
+	}
+	levels.reserve(endMip - firstMip);
+	if (firstMip == 0) {
+		TextureMipLevel level = { width, height, {} };
+		level.pixels.assign(source, source + static_cast<size_t>(width) * height * bytesPerPixel);
+		levels.push_back(std::move(level));
+	}
+	// Only the previous level is needed to build the next, so the levels above
+	// firstMip are dropped as soon as they have been halved.
+	TextureMipLevel scratch[2];
+	const TextureMipLevel* previous = nullptr;
+	for (uint32_t mip = 1; mip < endMip; ++mip) {
+		TextureMipLevel& level = mip > firstMip ? levels.emplace_back() : scratch[mip & 1];
+		if (previous) {
+			halve(previous->pixels.data(), previous->width, previous->height, bytesPerPixel, level);
+		}
+		else {
+			halve(source, width, height, bytesPerPixel, level);
+		}
+		previous = &level;
+		if (mip == firstMip) {
+			levels.push_back(std::move(level));
+			previous = &levels.back();
+		}
+	}
+}
+
+uint32_t TextureResidency::AddTexture(uint32_t width, uint32_t height, uint32_t bytesPerPixel) {
+	Texture texture = {};
+	texture.width = width;
+	texture.height = height;
+	texture.bytesPerPixel = bytesPerPixel;
+	texture.mipCount = TextureMipCount(width, height);
+	texture.tailMip = 0;
+	while (std::max(mipEdge(width, texture.tailMip), mipEdge(height, texture.tailMip)) > kTextureTailSize) {
+		++texture.tailMip;
+	}
+	texture.residentMip = texture.tailMip;
+	texture.wantedMip = texture.tailMip;
+	texture.lastUsedFrame = m_frame;
+	m_stats.residentBytes += bytes(texture, texture.tailMip, texture.mipCount);
+	m_textures.push_back(texture);
+	return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+uint64_t TextureResidency::bytes(const Texture& texture, uint32_t firstMip, uint32_t endMip) const {
+	return TextureMipBytes(texture.width, texture.height, texture.bytesPerPixel, firstMip, endMip);
+}
+
+bool TextureResidency::fits(uint64_t bytes) const {
+	return m_stats.budgetBytes == 0 || m_stats.residentBytes + m_stats.pendingBytes + bytes <= m_stats.budgetBytes;
+}
+
+void TextureResidency::BeginFrame() {
+	++m_frame;
+	for (auto& texture : m_textures) {
+		texture.wantedMip = texture.tailMip;
+	}
+}
+
+void TextureResidency::Request(uint32_t texture, uint32_t mip) {
+	Texture& requested = m_textures[texture];
+	requested.wantedMip = std::min(requested.wantedMip, mip);
+	requested.lastUsedFrame = m_frame;
+}
+
+void TextureResidency::RequestFootprint(uint32_t texture, float uvPerPixel) {
+	Request(texture, TextureMipForFootprint(uvPerPixel, m_textures[texture].width, m_textures[texture].height));
+}
+
+bool TextureResidency::makeRoom(uint64_t bytes, uint32_t requester, std::vector<TextureResidencyChange>& evictions) {
+	struct Candidate {
+		uint32_t texture;
+		uint64_t lastUsedFrame;
+		uint64_t bytes;
+	};
+	std::vector<Candidate> candidates;
+	uint64_t freeable = 0;
+	for (uint32_t i = 0; i < m_textures.size(); ++i) {
+		const Texture& texture = m_textures[i];
+		if (i == requester || texture.pendingMip != kNoTextureMip || texture.residentMip >= texture.wantedMip) {
+			continue;
+		}
+		uint64_t excess = this->bytes(texture, texture.residentMip, texture.wantedMip);
+		candidates.push_back({ i, texture.lastUsedFrame, excess });
+		freeable += excess;
+	}
+	const uint64_t used = m_stats.residentBytes + m_stats.pendingBytes;
+	if (used + bytes > m_stats.budgetBytes + freeable) {
+		return false;
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+		return a.lastUsedFrame != b.lastUsedFrame ? a.lastUsedFrame < b.lastUsedFrame : a.bytes > b.bytes;
+	});
+	for (const auto& candidate : candidates) {
+		if (fits(bytes)) {
+			break;
+		}
+		Texture& texture = m_textures[candidate.texture];
+		texture.residentMip = texture.wantedMip;
+		m_stats.residentBytes -= candidate.bytes;
+		m_stats.evictedBytes += candidate.bytes;
+		++m_stats.evicted;
+		evictions.push_back({ candidate.texture, texture.residentMip });
+	}
+	return true;
+}
+
+void TextureResidency::Update(std::vector<TextureResidencyChange>& streams, std::vector<TextureResidencyChange>& evictions) {
+	streams.clear();
+	evictions.clear();
+	m_stats.requested = 0;
+	m_stats.streamed = 0;
+	m_stats.evicted = 0;
+	m_stats.deferred = 0;
+
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < m_textures.size(); ++i) {
+		const Texture& texture = m_textures[i];
+		if (texture.wantedMip < texture.residentMip && texture.pendingMip == kNoTextureMip) {
+			order.push_back(i);
+		}
+	}
+	m_stats.requested = static_cast<uint32_t>(order.size());
+	// The textures furthest from the detail they need go first, so a tight
+	// budget is spent where it is most visible.
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return m_textures[a].residentMip - m_textures[a].wantedMip > m_textures[b].residentMip - m_textures[b].wantedMip;
+	});
+
+	for (uint32_t i : order) {
+		Texture& texture = m_textures[i];
+		uint32_t target = texture.wantedMip;
+		for (; target < texture.residentMip; ++target) {
+			uint64_t cost = bytes(texture, target, texture.residentMip);
+			if (fits(cost) || makeRoom(cost, i, evictions)) {
+				break;
+			}
+		}
+		if (target != texture.wantedMip) {
+			++m_stats.deferred;
+		}
+		if (target == texture.residentMip) {
+			continue;
+		}
+		texture.pendingMip = target;
+		m_stats.pendingBytes += bytes(texture, target, texture.residentMip);
+		++m_stats.streamed;
+		streams.push_back({ i, target });
+	}
+}
+
+void TextureResidency::Complete(uint32_t texture) {
+	Texture& completed = m_textures[texture];
+	if (completed.pendingMip == kNoTextureMip) {
+		return;
+	}
+	const uint64_t streamed = bytes(completed, completed.pendingMip, completed.residentMip);
+	m_stats.pendingBytes -= streamed;
+	m_stats.residentBytes += streamed;
+	m_stats.streamedBytes += streamed;
+	completed.residentMip = completed.pendingMip;
+	completed.pendingMip = kNoTextureMip;
+}
+
+void TextureResidency::Cancel(uint32_t texture) {
+	Texture& cancelled = m_textures[texture];
+	if (cancelled.pendingMip == kNoTextureMip) {
+		return;
+	}
+	m_stats.pendingBytes -= bytes(cancelled, cancelled.pendingMip, cancelled.residentMip);
+	cancelled.pendingMip = kNoTextureMip;
+}
+
+TextureStreamer::TextureStreamer() {
+	m_thread = std::thread(&TextureStreamer::workerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+void TextureStreamer::Submit(const TextureStreamJob& job) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+		++m_outstanding;
+	}
+	m_wake.notify_one();
+}
+
+void TextureStreamer::TakeCompleted(std::vector<TextureStreamResult>& results) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_outstanding -= m_results.size();
+	for (auto& result : m_results) {
+		results.push_back(std::move(result));
+	}
+	m_results.clear();
+}
+
+size_t TextureStreamer::Outstanding() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_outstanding;
+}
+
+void TextureStreamer::workerLoop() {
+	for (;;) {
+		TextureStreamJob job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_stop) {
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		TextureStreamResult result = { job.texture, job.firstMip, {} };
+		std::vector<uint8_t> loaded;
+		if (!job.source && job.load && job.load(loaded) && loaded.size() == static_cast<size_t>(job.width) * job.height * job.bytesPerPixel) {
+			job.source = loaded.data();
+		}
+		if (job.source) {
+			BuildTextureMips(job.source, job.width, job.height, job.bytesPerPixel, job.firstMip, job.endMip, result.levels);
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_results.push_back(std::move(result));
+	}
+}
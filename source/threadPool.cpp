@@ -0,0 +1,73 @@
+#include "threadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (uint32_t i = 1; i < threadCount; ++i) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& function) {
+	grain = std::max<size_t>(grain, 1);
+	if (count == 0) {
+		return;
+	}
+	if (m_threads.empty() || count <= grain) {
+		function(0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_function = &function;
+		m_count = count;
+		m_grain = grain;
+		m_next = 0;
+		m_active = m_threads.size();
+		++m_generation;
+	}
+	m_wake.notify_all();
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_active == 0; });
+	m_function = nullptr;
+}
+
+void ThreadPool::runChunks() {
+	for (size_t begin = m_next.fetch_add(m_grain); begin < m_count; begin = m_next.fetch_add(m_grain)) {
+		(*m_function)(begin, std::min(begin + m_grain, m_count));
+	}
+}
+
+void ThreadPool::workerLoop() {
+	uint64_t generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+			if (m_stop) {
+				return;
+			}
+			generation = m_generation;
+		}
+		runChunks();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_active == 0) {
+			m_done.notify_one();
+		}
+	}
+}
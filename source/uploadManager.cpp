@@ -0,0 +1,201 @@
+#define NOMINMAX
+#include "uploadManager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace Microsoft::WRL;
+using namespace std::chrono;
+
+UploadManager::~UploadManager() {
+	if (m_event) {
+		CloseHandle(m_event);
+	}
+}
+
+HRESULT UploadManager::Init(ID3D12Device* device, ID3D12CommandQueue* copyQueue, ComPtr<ID3D12Resource> ring) {
+	m_device = device;
+	m_copyQueue = copyQueue;
+	m_ring = ring;
+	m_ringSize = m_ring->GetDesc().Width;
+	m_chunkSize = m_ringSize / 4;
+
+	void* data;
+	HRESULT result = m_ring->Map(0, nullptr, &data);
+	if (FAILED(result)) {
+		return result;
+	}
+	m_ringData = static_cast<uint8_t*>(data);
+	result = m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence));
+	if (FAILED(result)) {
+		return result;
+	}
+	m_event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	return m_event ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+}
+
+UploadManager::BusyScope::BusyScope(UploadManager& manager) :
+	m_manager(manager),
+	m_start(high_resolution_clock::now())
+{
+	++m_manager.m_busyDepth;
+}
+
+UploadManager::BusyScope::~BusyScope() {
+	if (--m_manager.m_busyDepth == 0) {
+		m_manager.m_stats.busyMicroseconds += duration<double, std::micro>(high_resolution_clock::now() - m_start).count();
+	}
+}
+
+void UploadManager::openBatch() {
+	if (m_open) {
+		return;
+	}
+	if (!m_freeAllocators.empty()) {
+		m_allocator = m_freeAllocators.back();
+		m_freeAllocators.pop_back();
+		m_allocator->Reset();
+	}
+	else {
+		m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_allocator));
+	}
+	if (!m_commandList) {
+		m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, m_allocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList));
+	}
+	else {
+		m_commandList->Reset(m_allocator.Get(), nullptr);
+	}
+	m_open = true;
+}
+
+void UploadManager::retireOldest() {
+	Batch& batch = m_inFlight.front();
+	if (m_fence->GetCompletedValue() < batch.fenceValue) {
+		auto start = high_resolution_clock::now();
+		m_fence->SetEventOnCompletion(batch.fenceValue, m_event);
+		WaitForSingleObject(m_event, INFINITE);
+		m_stats.stallMicroseconds += duration<double, std::micro>(high_resolution_clock::now() - start).count();
+	}
+	m_used -= batch.ringBytes;
+	m_freeAllocators.push_back(batch.allocator);
+	m_inFlight.pop_front();
+}
+
+uint64_t UploadManager::allocate(uint64_t size, uint64_t alignment) {
+	while (!m_inFlight.empty() && m_fence->GetCompletedValue() >= m_inFlight.front().fenceValue) {
+		retireOldest();
+	}
+	for (;;) {
+		if (m_used == 0) {
+			m_head = 0;
+		}
+		uint64_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+		// Space left at the end of the ring is skipped rather than split.
+		if (offset + size > m_ringSize) {
+			offset = 0;
+		}
+		const uint64_t needed = (offset >= m_head ? offset - m_head : m_ringSize - m_head + offset) + size;
+		if (m_used + needed <= m_ringSize) {
+			m_head = offset + size;
+			m_used += needed;
+			m_openRingBytes += needed;
+			m_stats.peakRingBytes = std::max(m_stats.peakRingBytes, m_used);
+			return offset;
+		}
+		if (m_openCopies) {
+			Flush();
+		}
+		if (m_inFlight.empty()) {
+			// Larger than the whole ring; chunking keeps this from happening.
+			m_head = 0;
+			m_used = size;
+			m_openRingBytes += size;
+			return 0;
+		}
+		retireOldest();
+	}
+}
+
+void UploadManager::UploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size) {
+	BusyScope busy(*this);
+	for (uint64_t done = 0; done < size;) {
+		const uint64_t chunk = std::min(size - done, m_chunkSize);
+		const uint64_t offset = allocate(chunk, 16);
+		openBatch();
+		memcpy(m_ringData + offset, static_cast<const uint8_t*>(data) + done, chunk);
+		m_commandList->CopyBufferRegion(destination, destinationOffset + done, m_ring.Get(), offset, chunk);
+		++m_openCopies;
+		++m_stats.chunks;
+		m_stats.bytes += chunk;
+		done += chunk;
+	}
+}
+
+void UploadManager::UploadTexture(ID3D12Resource* destination, UINT firstSubresource, UINT count, const UploadSubresource* sources) {
+	BusyScope busy(*this);
+	const D3D12_RESOURCE_DESC desc = destination->GetDesc();
+	for (UINT i = 0; i < count; ++i) {
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+		UINT rowCount;
+		UINT64 rowSize;
+		m_device->GetCopyableFootprints(&desc, firstSubresource + i, 1, 0, &footprint, &rowCount, &rowSize, nullptr);
+		const uint64_t rowPitch = footprint.Footprint.RowPitch;
+		const UINT rowsPerChunk = static_cast<UINT>(std::max<uint64_t>(1, m_chunkSize / rowPitch));
+
+		for (UINT firstRow = 0; firstRow < rowCount; firstRow += rowsPerChunk) {
+			const UINT rows = std::min(rowsPerChunk, rowCount - firstRow);
+			const uint64_t offset = allocate(rows * rowPitch, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+			openBatch();
+			const uint8_t* source = static_cast<const uint8_t*>(sources[i].data) + sources[i].rowPitch * firstRow;
+			for (UINT row = 0; row < rows; ++row) {
+				memcpy(m_ringData + offset + rowPitch * row, source + sources[i].rowPitch * row, rowSize);
+			}
+
+			D3D12_TEXTURE_COPY_LOCATION destinationLocation = { destination, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX };
+			destinationLocation.SubresourceIndex = firstSubresource + i;
+			D3D12_TEXTURE_COPY_LOCATION sourceLocation = { m_ring.Get(), D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT };
+			sourceLocation.PlacedFootprint.Offset = offset;
+			sourceLocation.PlacedFootprint.Footprint = footprint.Footprint;
+			sourceLocation.PlacedFootprint.Footprint.Height = rows;
+			m_commandList->CopyTextureRegion(&destinationLocation, 0, firstRow, 0, &sourceLocation, nullptr);
+			++m_openCopies;
+			++m_stats.chunks;
+			m_stats.bytes += rows * rowSize;
+		}
+	}
+}
+
+void UploadManager::CopySubresource(ID3D12Resource* destination, UINT destinationSubresource, ID3D12Resource* source, UINT sourceSubresource) {
+	openBatch();
+	D3D12_TEXTURE_COPY_LOCATION destinationLocation = { destination, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX };
+	destinationLocation.SubresourceIndex = destinationSubresource;
+	D3D12_TEXTURE_COPY_LOCATION sourceLocation = { source, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX };
+	sourceLocation.SubresourceIndex = sourceSubresource;
+	m_commandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
+	++m_openCopies;
+}
+
+void UploadManager::Flush() {
+	if (!m_open || m_openCopies == 0) {
+		return;
+	}
+	BusyScope busy(*this);
+	m_commandList->Close();
+	ID3D12CommandList* commandLists[] = { m_commandList.Get() };
+	m_copyQueue->ExecuteCommandLists(1, commandLists);
+	m_copyQueue->Signal(m_fence.Get(), ++m_fenceValue);
+	m_inFlight.push_back({ m_fenceValue, m_openRingBytes, m_allocator });
+	m_allocator.Reset();
+	m_open = false;
+	m_openCopies = 0;
+	m_openRingBytes = 0;
+	++m_stats.batches;
+}
+
+void UploadManager::WaitIdle() {
+	BusyScope busy(*this);
+	Flush();
+	while (!m_inFlight.empty()) {
+		retireOldest();
+	}
+}
@@ -34,7 +34,8 @@ cbuffer Node : register(b1) {
 
 VS2RS main(IA2VS input) {
     VS2RS output;
-    output.position = mul(float4(input.position, 1.0), M);
+    // M holds the glTF column-major node matrix, so it transforms column vectors.
+    output.position = mul(M, float4(input.position, 1.0));
     output.position = mul(output.position, V);
     output.position = mul(output.position, P);
 
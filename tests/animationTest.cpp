@@ -0,0 +1,142 @@
+// Checks keyframe sampling at and between keys for every interpolation.
+#include "animation.h"
+#include "testCheck.h"
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	bool approximately(float a, float b) {
+		return std::fabs(a - b) < 1e-4f;
+	}
+
+	bool approximately(const XMFLOAT3& a, float x, float y, float z) {
+		return approximately(a.x, x) && approximately(a.y, y) && approximately(a.z, z);
+	}
+
+	enum Node : uint32_t {
+		LinearTranslation,
+		StepScale,
+		LinearRotation,
+		CubicTranslation,
+		CubicWeights,
+		LinearWeights,
+		NodeCount,
+	};
+
+	// One channel of each kind, added out of kind order, on nodes of their own.
+	AnimationSet buildAnimation() {
+		AnimationSet set;
+		uint32_t animation = set.AddAnimation();
+
+		const float cubicTimes[] = { 0.0f, 2.0f };
+		// In tangent, value and out tangent of each key.
+		const float cubicWeights[] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f };
+		set.AddChannel(animation, CubicWeights, AnimationPath::Weights, Interpolation::CubicSpline, cubicTimes, 2, cubicWeights, 2);
+
+		const float times[] = { 0.0f, 1.0f, 2.0f };
+		const float translations[] = { 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 2.0f, 4.0f, 0.0f };
+		set.AddChannel(animation, LinearTranslation, AnimationPath::Translation, Interpolation::Linear, times, 3, translations, 3);
+
+		const float scales[] = { 1.0f, 1.0f, 1.0f, 3.0f, 3.0f, 3.0f };
+		set.AddChannel(animation, StepScale, AnimationPath::Scale, Interpolation::Step, times, 2, scales, 3);
+
+		const float half = std::sqrt(0.5f);
+		const float rotations[] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, half, half };
+		set.AddChannel(animation, LinearRotation, AnimationPath::Rotation, Interpolation::Linear, times, 2, rotations, 4);
+
+		const float cubicTranslations[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		set.AddChannel(animation, CubicTranslation, AnimationPath::Translation, Interpolation::CubicSpline, cubicTimes, 2, cubicTranslations, 3);
+
+		const float weights[] = { 0.0f, 1.0f, 1.0f, 0.0f, 0.5f, 0.5f };
+		set.AddChannel(animation, LinearWeights, AnimationPath::Weights, Interpolation::Linear, times, 3, weights, 2);
+		return set;
+	}
+
+	void sample(AnimationSet& set, float time, std::vector<NodeTransform>& transforms, std::vector<std::vector<float>>& weights, AnimationStats& stats) {
+		transforms.assign(NodeCount, NodeTransform());
+		weights.assign(NodeCount, {});
+		set.Sample(0, time, transforms, weights, stats);
+	}
+
+	void testKeys() {
+		AnimationSet set = buildAnimation();
+		CHECK(set.AnimationCount() == 1 && set.ChannelCount(0) == 6);
+		CHECK(set.Duration(0) == 2.0f);
+		std::vector<NodeTransform> transforms;
+		std::vector<std::vector<float>> weights;
+		AnimationStats stats;
+
+		sample(set, 0.0f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 0.0f, 0.0f, 0.0f));
+		CHECK(approximately(transforms[StepScale].scale, 1.0f, 1.0f, 1.0f));
+		CHECK(approximately(transforms[LinearRotation].rotation.w, 1.0f));
+		CHECK(approximately(transforms[CubicTranslation].translation, 0.0f, 0.0f, 0.0f));
+		CHECK(weights[CubicWeights].size() == 2 && approximately(weights[CubicWeights][0], 0.0f) && approximately(weights[CubicWeights][1], 1.0f));
+		CHECK(weights[LinearWeights].size() == 2 && approximately(weights[LinearWeights][0], 0.0f) && approximately(weights[LinearWeights][1], 1.0f));
+		CHECK(stats.sampledChannels == 6);
+
+		sample(set, 1.0f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 2.0f, 0.0f, 0.0f));
+		CHECK(approximately(transforms[StepScale].scale, 3.0f, 3.0f, 3.0f));
+		CHECK(approximately(transforms[LinearRotation].rotation.z, std::sqrt(0.5f)) && approximately(transforms[LinearRotation].rotation.w, std::sqrt(0.5f)));
+		CHECK(approximately(weights[LinearWeights][0], 1.0f) && approximately(weights[LinearWeights][1], 0.0f));
+	}
+
+	void testBetweenKeys() {
+		AnimationSet set = buildAnimation();
+		std::vector<NodeTransform> transforms;
+		std::vector<std::vector<float>> weights;
+		AnimationStats stats;
+
+		sample(set, 0.5f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 1.0f, 0.0f, 0.0f));
+		// Step holds the earlier key until the next one.
+		CHECK(approximately(transforms[StepScale].scale, 1.0f, 1.0f, 1.0f));
+		// Halfway from identity to a quarter turn about z is an eighth turn.
+		const float angle = XM_PI / 8.0f;
+		const XMFLOAT4& rotation = transforms[LinearRotation].rotation;
+		CHECK(approximately(rotation.x, 0.0f) && approximately(rotation.y, 0.0f) && approximately(rotation.z, std::sin(angle)) && approximately(rotation.w, std::cos(angle)));
+		CHECK(approximately(weights[LinearWeights][0], 0.5f) && approximately(weights[LinearWeights][1], 0.5f));
+
+		sample(set, 1.5f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 2.0f, 2.0f, 0.0f));
+		CHECK(approximately(transforms[StepScale].scale, 3.0f, 3.0f, 3.0f));
+		CHECK(approximately(weights[LinearWeights][0], 0.75f) && approximately(weights[LinearWeights][1], 0.25f));
+
+		// Halfway along the cubic: value 0 with out tangent 1 to value 1 with in
+		// tangent 0, tangents scaled by the 2 second interval, is 0.75.
+		sample(set, 1.0f, transforms, weights, stats);
+		CHECK(approximately(transforms[CubicTranslation].translation, 0.75f, 0.0f, 0.0f));
+		CHECK(approximately(weights[CubicWeights][0], 0.75f) && approximately(weights[CubicWeights][1], 1.0f));
+	}
+
+	// Times wrap to the duration, and playing forward finds keys through the
+	// cursors rather than by searching.
+	void testWrapAndCursors() {
+		AnimationSet set = buildAnimation();
+		std::vector<NodeTransform> transforms;
+		std::vector<std::vector<float>> weights;
+		AnimationStats stats;
+		sample(set, 2.5f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 1.0f, 0.0f, 0.0f));
+		sample(set, -1.5f, transforms, weights, stats);
+		CHECK(approximately(transforms[LinearTranslation].translation, 1.0f, 0.0f, 0.0f));
+
+		stats = {};
+		for (int frame = 0; frame < 60; ++frame) {
+			sample(set, 0.01f + frame / 30.0f, transforms, weights, stats);
+		}
+		CHECK(stats.sampledChannels == 360);
+		CHECK(stats.cursorHits > 0);
+		CHECK(stats.binarySearches < stats.cursorHits / 10);
+	}
+}
+
+int main() {
+	testKeys();
+	testBetweenKeys();
+	testWrapAndCursors();
+	return TestResult("animationTest");
+}
@@ -0,0 +1,85 @@
+// Checks arena allocations are aligned, do not overlap and survive new blocks.
+#include "arena.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Range {
+		uintptr_t begin;
+		uintptr_t end;
+	};
+
+	// Mixed sizes with alignments up to 256 in small blocks, so allocations
+	// follow odd sized ones within a block and often start new blocks.
+	void testAlignment() {
+		Arena arena(1024);
+		const size_t alignments[] = { 1, 8, 64, 4, 16, 256, 64, 2 };
+		std::vector<Range> ranges;
+		bool aligned = true;
+		for (size_t i = 0; i < 500; ++i) {
+			const size_t alignment = alignments[i % std::size(alignments)];
+			const size_t size = 1 + (i * 37) % 300;
+			void* data = arena.Allocate(size, alignment);
+			const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+			aligned = aligned && address % alignment == 0;
+			std::memset(data, static_cast<int>(i), size);
+			ranges.push_back({ address, address + size });
+		}
+		CHECK(aligned);
+
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+		bool disjoint = true;
+		for (size_t i = 1; i < ranges.size(); ++i) {
+			disjoint = disjoint && ranges[i - 1].end <= ranges[i].begin;
+		}
+		CHECK(disjoint);
+
+		// Every allocation aligned to 64 in one block, one after another.
+		Arena packed;
+		bool packedAligned = true;
+		for (int i = 0; i < 100; ++i) {
+			packed.Allocate(1 + i % 7, 1);
+			packedAligned = packedAligned && reinterpret_cast<uintptr_t>(packed.Allocate(24, 64)) % 64 == 0;
+		}
+		CHECK(packedAligned);
+		CHECK(packed.Bytes() == 64 * 1024);
+	}
+
+	void testBlocks() {
+		Arena arena(256);
+		// Larger than a block, so it gets one of its own.
+		void* large = arena.Allocate(1000, 64);
+		CHECK(reinterpret_cast<uintptr_t>(large) % 64 == 0);
+		CHECK(arena.Bytes() >= 1000 + 64);
+		std::memset(large, 0xab, 1000);
+
+		struct alignas(64) Wide {
+			float values[16];
+		};
+		std::span<Wide> wide = arena.AllocateArray<Wide>(3);
+		CHECK(wide.size() == 3 && reinterpret_cast<uintptr_t>(wide.data()) % 64 == 0);
+		CHECK(wide[2].values[15] == 0.0f);
+		CHECK(arena.AllocateArray<Wide>(0).empty());
+
+		const int numbers[] = { 1, 2, 3 };
+		std::span<const int> copy = arena.Copy(numbers, 3);
+		CHECK(copy.size() == 3 && copy[0] == 1 && copy[2] == 3);
+		std::string_view text = arena.CopyString("arena");
+		CHECK(text == "arena" && text.data()[text.size()] == '\0');
+		CHECK(static_cast<const uint8_t*>(large)[999] == 0xab);
+
+		arena.Reset();
+		CHECK(arena.Bytes() == 0);
+		CHECK(reinterpret_cast<uintptr_t>(arena.Allocate(8, 64)) % 64 == 0);
+	}
+}
+
+int main() {
+	testAlignment();
+	testBlocks();
+	return TestResult("arenaTest");
+}
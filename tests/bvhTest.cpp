@@ -0,0 +1,218 @@
+// Checks BVHs over random triangles: their structure, and that closest hits
+// found through them match testing every triangle.
+#include "bvh.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	uint32_t g_random = 2024;
+
+	float randomFloat(float low, float high) {
+		g_random = g_random * 1664525u + 1013904223u;
+		return low + (high - low) * static_cast<float>(g_random >> 8) / 16777216.0f;
+	}
+
+	struct Triangle {
+		XMFLOAT3 v[3];
+	};
+
+	struct Ray {
+		XMFLOAT3 origin;
+		XMFLOAT3 direction;
+	};
+
+	std::vector<Triangle> randomTriangles(uint32_t count) {
+		std::vector<Triangle> triangles(count);
+		for (auto& triangle : triangles) {
+			const XMFLOAT3 center = { randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f) };
+			for (auto& vertex : triangle.v) {
+				vertex = { center.x + randomFloat(-1.0f, 1.0f), center.y + randomFloat(-1.0f, 1.0f), center.z + randomFloat(-1.0f, 1.0f) };
+			}
+		}
+		return triangles;
+	}
+
+	BvhBounds bounds(const Triangle& triangle) {
+		BvhBounds result = { triangle.v[0], triangle.v[0] };
+		for (const auto& vertex : triangle.v) {
+			result.min = { std::min(result.min.x, vertex.x), std::min(result.min.y, vertex.y), std::min(result.min.z, vertex.z) };
+			result.max = { std::max(result.max.x, vertex.x), std::max(result.max.y, vertex.y), std::max(result.max.z, vertex.z) };
+		}
+		return result;
+	}
+
+	bool contains(const XMFLOAT3& outerMin, const XMFLOAT3& outerMax, const XMFLOAT3& innerMin, const XMFLOAT3& innerMax) {
+		return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+			outerMax.x >= innerMax.x && outerMax.y >= innerMax.y && outerMax.z >= innerMax.z;
+	}
+
+	// Möller-Trumbore, in double so both searches agree on every triangle.
+	double intersect(const Ray& ray, const Triangle& triangle) {
+		const double o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const double d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		double p[3][3];
+		for (int i = 0; i < 3; ++i) {
+			p[i][0] = triangle.v[i].x;
+			p[i][1] = triangle.v[i].y;
+			p[i][2] = triangle.v[i].z;
+		}
+		const double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		const double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		const double h[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+		const double a = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+		if (std::fabs(a) < 1e-12) {
+			return DBL_MAX;
+		}
+		const double s[3] = { o[0] - p[0][0], o[1] - p[0][1], o[2] - p[0][2] };
+		const double u = (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]) / a;
+		const double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		const double v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / a;
+		const double t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / a;
+		if (u < 0.0 || v < 0.0 || u + v > 1.0 || t <= 0.0) {
+			return DBL_MAX;
+		}
+		return t;
+	}
+
+	bool hitsBox(const Ray& ray, const BvhNode& node, double closest) {
+		const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		const float minimum[3] = { node.min.x, node.min.y, node.min.z };
+		const float maximum[3] = { node.max.x, node.max.y, node.max.z };
+		double entry = 0.0, exit = closest;
+		for (int axis = 0; axis < 3; ++axis) {
+			const double inverse = 1.0 / direction[axis];
+			double t0 = (minimum[axis] - origin[axis]) * inverse;
+			double t1 = (maximum[axis] - origin[axis]) * inverse;
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			entry = std::max(entry, t0);
+			exit = std::min(exit, t1);
+		}
+		return entry <= exit;
+	}
+
+	// Closest hit and its triangle, DBL_MAX and UINT32_MAX for a miss.
+	std::pair<double, uint32_t> traverse(const Bvh& bvh, const std::vector<Triangle>& triangles, const Ray& ray) {
+		std::pair<double, uint32_t> closest = { DBL_MAX, UINT32_MAX };
+		if (bvh.nodes.empty()) {
+			return closest;
+		}
+		uint32_t stack[kBvhMaxDepth * 2];
+		uint32_t depth = 0;
+		stack[depth++] = 0;
+		while (depth > 0) {
+			const BvhNode& node = bvh.nodes[stack[--depth]];
+			if (!hitsBox(ray, node, closest.first)) {
+				continue;
+			}
+			if (node.count == 0) {
+				stack[depth++] = node.first;
+				stack[depth++] = node.first + 1;
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				const uint32_t primitive = bvh.primitives[i];
+				const double t = intersect(ray, triangles[primitive]);
+				if (t < closest.first) {
+					closest = { t, primitive };
+				}
+			}
+		}
+		return closest;
+	}
+
+	std::pair<double, uint32_t> bruteForce(const std::vector<Triangle>& triangles, const Ray& ray) {
+		std::pair<double, uint32_t> closest = { DBL_MAX, UINT32_MAX };
+		for (uint32_t i = 0; i < triangles.size(); ++i) {
+			const double t = intersect(ray, triangles[i]);
+			if (t < closest.first) {
+				closest = { t, i };
+			}
+		}
+		return closest;
+	}
+
+	// Every primitive is in exactly one leaf, every node bounds what is below
+	// it, and the tree is no deeper than traversal stacks allow.
+	void checkStructure(const Bvh& bvh, const std::vector<Triangle>& triangles) {
+		CHECK(bvh.primitives.size() == triangles.size());
+		std::vector<uint32_t> sorted = bvh.primitives;
+		std::sort(sorted.begin(), sorted.end());
+		bool permutation = true;
+		for (uint32_t i = 0; i < sorted.size(); ++i) {
+			permutation = permutation && sorted[i] == i;
+		}
+		CHECK(permutation);
+
+		struct Entry {
+			uint32_t node;
+			uint32_t depth;
+		};
+		std::vector<Entry> pending = { { 0, 1 } };
+		uint32_t maxDepth = 0;
+		size_t leafPrimitives = 0;
+		bool bounded = true;
+		while (!pending.empty()) {
+			const Entry entry = pending.back();
+			pending.pop_back();
+			const BvhNode& node = bvh.nodes[entry.node];
+			maxDepth = std::max(maxDepth, entry.depth);
+			if (node.count == 0) {
+				for (uint32_t child = node.first; child < node.first + 2; ++child) {
+					bounded = bounded && contains(node.min, node.max, bvh.nodes[child].min, bvh.nodes[child].max);
+					pending.push_back({ child, entry.depth + 1 });
+				}
+				continue;
+			}
+			CHECK(node.count <= kBvhMaxLeafSize);
+			leafPrimitives += node.count;
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				const BvhBounds primitive = bounds(triangles[bvh.primitives[i]]);
+				bounded = bounded && contains(node.min, node.max, primitive.min, primitive.max);
+			}
+		}
+		CHECK(bounded);
+		CHECK(leafPrimitives == triangles.size());
+		CHECK(maxDepth <= kBvhMaxDepth);
+	}
+
+	void testAgainstBruteForce(ThreadPool* pool) {
+		const std::vector<Triangle> triangles = randomTriangles(5000);
+		std::vector<BvhBounds> primitiveBounds;
+		for (const auto& triangle : triangles) {
+			primitiveBounds.push_back(bounds(triangle));
+		}
+		const Bvh bvh = BuildBvh(primitiveBounds, pool);
+		checkStructure(bvh, triangles);
+
+		uint32_t hits = 0, mismatches = 0;
+		for (int i = 0; i < 2000; ++i) {
+			Ray ray;
+			ray.origin = { randomFloat(-15.0f, 15.0f), randomFloat(-15.0f, 15.0f), randomFloat(-15.0f, 15.0f) };
+			ray.direction = { randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f) };
+			const auto expected = bruteForce(triangles, ray);
+			const auto found = traverse(bvh, triangles, ray);
+			hits += expected.second != UINT32_MAX;
+			mismatches += found != expected;
+		}
+		CHECK(hits > 100);
+		CHECK(mismatches == 0);
+	}
+}
+
+int main() {
+	testAgainstBruteForce(nullptr);
+	ThreadPool pool(4);
+	testAgainstBruteForce(&pool);
+
+	const Bvh empty = BuildBvh({}, nullptr);
+	CHECK(empty.nodes.empty() && empty.primitives.empty());
+	return TestResult("bvhTest");
+}
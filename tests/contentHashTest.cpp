@@ -0,0 +1,96 @@
+// Checks content hashes for collisions and deduplication with FirstCopies.
+#include "contentHash.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+	// Equal bytes hash equally wherever they are and whatever their
+	// alignment, and the seed and every byte change the hash.
+	void testStability() {
+		std::vector<uint8_t> bytes(1000);
+		for (size_t i = 0; i < bytes.size(); ++i) {
+			bytes[i] = static_cast<uint8_t>(i * 31 + 7);
+		}
+		std::vector<uint8_t> shifted(bytes.size() + 3);
+		std::copy(bytes.begin(), bytes.end(), shifted.begin() + 3);
+		const ContentHash hash = HashContent(bytes.data(), bytes.size());
+		CHECK(HashContent(shifted.data() + 3, bytes.size()) == hash);
+		CHECK(!(HashContent(bytes.data(), bytes.size(), 1) == hash));
+		CHECK(HashContent(nullptr, 0) == HashContent(bytes.data(), 0));
+		CHECK(!(HashContent(nullptr, 0, 1) == HashContent(nullptr, 0)));
+
+		bool allChanged = true;
+		for (size_t i = 0; i < bytes.size(); ++i) {
+			bytes[i] ^= 1;
+			allChanged = allChanged && !(HashContent(bytes.data(), bytes.size()) == hash);
+			bytes[i] ^= 1;
+		}
+		CHECK(allChanged);
+	}
+
+	// Inputs that differ little: every length of a zero buffer, a counter in
+	// every position, and single bits. Neither half of the hash collides.
+	void testCollisions() {
+		// Some inputs repeat, such as a zero counter, so distinct hashes are
+		// counted against distinct inputs.
+		std::unordered_set<std::string> inputs;
+		std::unordered_set<uint64_t> lows, highs;
+		std::unordered_set<ContentHash, ContentHashHasher> hashes;
+		auto add = [&](const uint8_t* data, size_t size) {
+			inputs.emplace(reinterpret_cast<const char*>(data), size);
+			const ContentHash hash = HashContent(data, size);
+			lows.insert(hash.low);
+			highs.insert(hash.high);
+			hashes.insert(hash);
+		};
+		const std::vector<uint8_t> zeros(300, 0);
+		for (size_t size = 0; size <= zeros.size(); ++size) {
+			add(zeros.data(), size);
+		}
+		for (uint32_t counter = 0; counter < 50000; ++counter) {
+			uint8_t bytes[64] = {};
+			memcpy(bytes + counter % 61, &counter, sizeof(counter));
+			add(bytes, sizeof(bytes));
+		}
+		for (size_t bit = 0; bit < 256 * 8; ++bit) {
+			uint8_t bytes[256] = {};
+			bytes[bit / 8] = static_cast<uint8_t>(1 << (bit % 8));
+			add(bytes, sizeof(bytes));
+		}
+		CHECK(inputs.size() > 50000);
+		CHECK(hashes.size() == inputs.size());
+		CHECK(lows.size() == inputs.size());
+		CHECK(highs.size() == inputs.size());
+	}
+
+	// Copies map to the first item with equal content, and items whose hashes
+	// match but whose content does not stay apart.
+	void testFirstCopies() {
+		const std::vector<std::vector<uint8_t>> items = {
+			{ 1, 2, 3 }, { 4, 5 }, { 1, 2, 3 }, { 9 }, { 4, 5 }, { 1, 2, 3 }, { 7, 7 },
+		};
+		std::vector<ContentHash> hashes;
+		for (const auto& item : items) {
+			hashes.push_back(HashContent(item.data(), item.size()));
+		}
+		auto equal = [&items](int a, int b) { return items[a] == items[b]; };
+		CHECK((FirstCopies(hashes, equal) == std::vector<int>{ 0, 1, 0, 3, 1, 0, 6 }));
+
+		// Every hash the same, as if they all collided.
+		std::vector<ContentHash> colliding(items.size(), ContentHash{ 42, 42 });
+		CHECK((FirstCopies(colliding, equal) == std::vector<int>{ 0, 1, 0, 3, 1, 0, 6 }));
+		CHECK((FirstCopies(colliding, [](int, int) { return false; }) == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6 }));
+		CHECK(FirstCopies({}, equal).empty());
+	}
+}
+
+int main() {
+	testStability();
+	testCollisions();
+	testFirstCopies();
+	return TestResult("contentHashTest");
+}
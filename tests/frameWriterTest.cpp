@@ -0,0 +1,112 @@
+// Checks that files written through FrameWriter read back byte for byte,
+// with several in flight, through io_uring where available and through the
+// threads backend.
+#include "frameWriter.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+	uint32_t g_random = 99;
+
+	uint8_t randomByte() {
+		g_random = g_random * 1664525u + 1013904223u;
+		return static_cast<uint8_t>(g_random >> 24);
+	}
+
+	std::vector<uint8_t> readFile(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// Sizes around the 4 KiB direct I/O alignment and the 1 MiB block, so
+	// tails are padded and trimmed, and files shorter and longer than the
+	// one before, which they are preallocated to.
+	void testBackend(bool forceThreads) {
+		// In the working directory, since temporary directories are often
+		// tmpfs, which refuses direct I/O.
+		const std::filesystem::path directory = std::filesystem::current_path() / (forceThreads ? "frame-writer-threads" : "frame-writer");
+		std::filesystem::create_directories(directory);
+		const size_t sizes[] = { 0, 1, 4095, 4096, 4097, (1u << 20) + 123, 3 * (1u << 20) + 7, 100, 2 * (1u << 20) };
+		std::vector<std::vector<uint8_t>> contents;
+		FrameWriteStats stats;
+		{
+			// Two blocks outstanding, so the multi-block files wait for blocks
+			// of the files before to be written.
+			FrameWriter writer(2, forceThreads);
+			if (forceThreads) {
+				CHECK(std::string(writer.Stats().backend) == "threads");
+			}
+			for (size_t i = 0; i < std::size(sizes); ++i) {
+				std::vector<uint8_t> bytes(sizes[i]);
+				for (auto& byte : bytes) {
+					byte = randomByte();
+				}
+				CHECK(writer.Open((directory / ("frame" + std::to_string(i) + ".bin")).string(), 100 + i));
+				// Uneven pieces that straddle block boundaries.
+				size_t offset = 0;
+				for (size_t piece = 1; offset < bytes.size(); piece = piece * 3 + 1) {
+					const size_t size = std::min(piece, bytes.size() - offset);
+					writer.Write(bytes.data() + offset, size);
+					offset += size;
+				}
+				writer.Close();
+				contents.push_back(std::move(bytes));
+			}
+			writer.Flush();
+
+			// Reports come in the order files finish, which for a short file
+			// after a long one need not be the order they were opened in.
+			std::vector<FrameWriteReport> reports;
+			writer.TakeCompleted(reports);
+			std::sort(reports.begin(), reports.end(), [](const FrameWriteReport& a, const FrameWriteReport& b) { return a.frame < b.frame; });
+			CHECK(reports.size() == std::size(sizes));
+			bool reported = reports.size() == std::size(sizes);
+			for (size_t i = 0; reported && i < reports.size(); ++i) {
+				reported = reports[i].frame == 100 + i && reports[i].succeeded && reports[i].bytes == sizes[i] &&
+					std::filesystem::path(reports[i].path).filename() == "frame" + std::to_string(i) + ".bin";
+			}
+			CHECK(reported);
+			reports.clear();
+			writer.TakeCompleted(reports);
+			CHECK(reports.empty());
+			stats = writer.Stats();
+		}
+
+		size_t total = 0;
+		bool exact = true;
+		for (size_t i = 0; i < std::size(sizes); ++i) {
+			const std::filesystem::path path = directory / ("frame" + std::to_string(i) + ".bin");
+			exact = exact && std::filesystem::file_size(path) == sizes[i] && readFile(path) == contents[i];
+			total += sizes[i];
+		}
+		CHECK(exact);
+		CHECK(stats.files == std::size(sizes));
+		CHECK(stats.failedFiles == 0);
+		CHECK(stats.bytes == total);
+		CHECK(stats.peakOutstanding >= 1 && stats.peakOutstanding <= 2);
+		std::filesystem::remove_all(directory);
+	}
+
+	void testOpenFailure() {
+		FrameWriter writer(2, true);
+		CHECK(!writer.Open((std::filesystem::current_path() / "missing-directory" / "frame.bin").string(), 0));
+		// Writes and closes without an open file are ignored.
+		const uint8_t byte = 1;
+		writer.Write(&byte, 1);
+		writer.Close();
+		writer.Flush();
+		CHECK(writer.Stats().files == 0);
+	}
+}
+
+int main() {
+	testBackend(false);
+	testBackend(true);
+	testOpenFailure();
+	return TestResult("frameWriterTest");
+}
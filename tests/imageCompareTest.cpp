@@ -0,0 +1,130 @@
+// Checks image comparison metrics against values worked out by hand.
+#include "imageCompare.h"
+#include "testCheck.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+	constexpr uint32_t kWidth = 203;
+	constexpr uint32_t kHeight = 117;
+	// Rows are padded, as they are when read back from the GPU.
+	constexpr size_t kRowPitch = kWidth * 4 + 20;
+
+	uint32_t g_random = 4242;
+
+	uint8_t randomByte(uint8_t low, uint8_t high) {
+		g_random = g_random * 1664525u + 1013904223u;
+		return static_cast<uint8_t>(low + (g_random >> 24) % (high - low + 1));
+	}
+
+	std::vector<uint8_t> randomImage() {
+		std::vector<uint8_t> pixels(kRowPitch * kHeight, 0);
+		for (uint32_t y = 0; y < kHeight; ++y) {
+			for (uint32_t x = 0; x < kWidth * 4; ++x) {
+				pixels[y * kRowPitch + x] = randomByte(10, 245);
+			}
+		}
+		return pixels;
+	}
+
+	ImageView view(const std::vector<uint8_t>& pixels) {
+		return { pixels.data(), kWidth, kHeight, kRowPitch };
+	}
+
+	// Identical images have no error, the PSNR that stands in for infinity and
+	// an SSIM of exactly one, with any number of threads.
+	void testIdentical() {
+		const std::vector<uint8_t> golden = randomImage();
+		std::vector<uint8_t> output = golden;
+		// Alpha and row padding are ignored.
+		for (uint32_t y = 0; y < kHeight; ++y) {
+			output[y * kRowPitch + 3] = 0;
+			output[y * kRowPitch + kWidth * 4] = 99;
+		}
+		for (uint32_t threads : { 1u, 4u }) {
+			ImageComparison result;
+			CHECK(CompareImages(view(output), view(golden), { 64, threads }, result));
+			CHECK(result.tileColumns == 4 && result.tileRows == 2 && result.tiles.size() == 8);
+			CHECK(result.maxAbs == 0 && result.mse == 0.0);
+			CHECK(result.psnr == kIdenticalPsnr);
+			CHECK(result.ssim == 1.0);
+			bool tilesIdentical = true;
+			for (const auto& tile : result.tiles) {
+				tilesIdentical = tilesIdentical && tile.psnr == kIdenticalPsnr && tile.ssim == 1.0;
+			}
+			CHECK(tilesIdentical);
+		}
+	}
+
+	// Every color channel off by 5 gives an MSE of 25 and a PSNR of
+	// 10 log10(255^2 / 25), about 34.15 dB, in every tile.
+	void testFixedError() {
+		const std::vector<uint8_t> golden = randomImage();
+		std::vector<uint8_t> output = golden;
+		for (uint32_t y = 0; y < kHeight; ++y) {
+			for (uint32_t x = 0; x < kWidth; ++x) {
+				uint8_t* pixel = &output[y * kRowPitch + x * 4];
+				for (int c = 0; c < 3; ++c) {
+					pixel[c] = static_cast<uint8_t>((x + y + c) % 2 ? pixel[c] + 5 : pixel[c] - 5);
+				}
+			}
+		}
+		const double expected = 10.0 * std::log10(255.0 * 255.0 / 25.0);
+		ImageComparison result;
+		CHECK(CompareImages(view(output), view(golden), { 48, 3 }, result));
+		CHECK(result.tileSize == 48);
+		CHECK(result.maxAbs == 5);
+		CHECK(result.mse == 25.0);
+		CHECK(std::fabs(result.psnr - expected) < 1e-9);
+		CHECK(std::fabs(result.psnr - 34.1514) < 1e-3);
+		CHECK(result.ssim < 1.0 && result.ssim > 0.9);
+		bool tilesMatch = true;
+		for (const auto& tile : result.tiles) {
+			tilesMatch = tilesMatch && tile.maxAbs == 5 && tile.mse == 25.0 && std::fabs(tile.psnr - expected) < 1e-9;
+		}
+		CHECK(tilesMatch);
+	}
+
+	// An error confined to one tile shows only in that tile, and the whole
+	// image's MSE is spread over every pixel.
+	void testLocalError() {
+		const std::vector<uint8_t> golden = randomImage();
+		std::vector<uint8_t> output = golden;
+		output[70 * kRowPitch + 150 * 4 + 1] += 8;
+		ImageComparison result;
+		CHECK(CompareImages(view(output), view(golden), { 64, 2 }, result));
+		CHECK(result.maxAbs == 8);
+		CHECK(std::fabs(result.mse - 64.0 / (kWidth * kHeight * 3.0)) < 1e-12);
+		uint32_t changed = 0;
+		for (const auto& tile : result.tiles) {
+			if (tile.maxAbs == 0) {
+				continue;
+			}
+			++changed;
+			CHECK(tile.x == 128 && tile.y == 64 && tile.width == 64 && tile.height == 53);
+			CHECK(tile.ssim < 1.0);
+		}
+		CHECK(changed == 1);
+
+		std::vector<uint8_t> heatmap(static_cast<size_t>(kWidth) * 4);
+		BuildHeatmapRows(view(output), view(golden), 70, 1, 1.0f, heatmap.data());
+		CHECK(heatmap[150 * 4] == 24 && heatmap[150 * 4 + 1] == 0 && heatmap[150 * 4 + 3] == 255);
+		CHECK(heatmap[0] == 0 && heatmap[3] == 255);
+	}
+
+	void testSizeMismatch() {
+		const std::vector<uint8_t> golden = randomImage();
+		ImageView smaller = view(golden);
+		smaller.width -= 1;
+		ImageComparison result;
+		CHECK(!CompareImages(smaller, view(golden), {}, result));
+	}
+}
+
+int main() {
+	testIdentical();
+	testFixedError();
+	testLocalError();
+	testSizeMismatch();
+	return TestResult("imageCompareTest");
+}
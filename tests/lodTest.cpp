@@ -0,0 +1,111 @@
+// Checks LOD chains built for a sphere and the LOD selected by distance.
+#include "lod.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	// A closed unit sphere of rings x segments quads, sharing its poles and seam.
+	void buildSphere(uint32_t rings, uint32_t segments, std::vector<XMFLOAT3>& positions, std::vector<uint32_t>& indices) {
+		positions.push_back({ 0.0f, 1.0f, 0.0f });
+		for (uint32_t ring = 1; ring < rings; ++ring) {
+			const float theta = XM_PI * ring / rings;
+			for (uint32_t segment = 0; segment < segments; ++segment) {
+				const float phi = 2.0f * XM_PI * segment / segments;
+				positions.push_back({ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) });
+			}
+		}
+		const uint32_t south = static_cast<uint32_t>(positions.size());
+		positions.push_back({ 0.0f, -1.0f, 0.0f });
+
+		auto vertex = [segments](uint32_t ring, uint32_t segment) {
+			return 1 + (ring - 1) * segments + segment % segments;
+		};
+		for (uint32_t segment = 0; segment < segments; ++segment) {
+			indices.insert(indices.end(), { 0, vertex(1, segment + 1), vertex(1, segment) });
+			indices.insert(indices.end(), { south, vertex(rings - 1, segment), vertex(rings - 1, segment + 1) });
+			for (uint32_t ring = 1; ring + 1 < rings; ++ring) {
+				const uint32_t a = vertex(ring, segment), b = vertex(ring, segment + 1);
+				const uint32_t c = vertex(ring + 1, segment), d = vertex(ring + 1, segment + 1);
+				indices.insert(indices.end(), { a, b, d, a, d, c });
+			}
+		}
+	}
+
+	// Every level has fewer triangles and no less error than the one before,
+	// stays within the error budget and is a contiguous range of meshlets.
+	void testChain() {
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+		buildSphere(32, 64, positions, indices);
+		const size_t fullIndexCount = indices.size();
+		LodChain chain = BuildLodChain(indices, reinterpret_cast<const uint8_t*>(positions.data()), sizeof(XMFLOAT3), positions.size());
+		CHECK(chain.lods.size() >= 3 && chain.lods.size() <= kMaxLodCount);
+		CHECK(std::fabs(chain.radius - std::sqrt(3.0f)) < 1e-3f);
+		if (chain.lods.empty()) {
+			return;
+		}
+		CHECK(chain.lods[0].indexCount == fullIndexCount);
+		CHECK(chain.lods[0].error == 0.0f);
+
+		uint32_t nextOffset = 0;
+		for (size_t i = 0; i < chain.lods.size(); ++i) {
+			const Lod& lod = chain.lods[i];
+			CHECK(lod.indexOffset == nextOffset);
+			nextOffset += lod.indexCount;
+			CHECK(lod.indexCount > 0 && lod.indexCount % 3 == 0);
+			CHECK(lod.error <= kLodErrorBudget * chain.radius);
+			if (i > 0) {
+				CHECK(lod.indexCount < chain.lods[i - 1].indexCount);
+				CHECK(lod.error >= chain.lods[i - 1].error);
+			}
+			uint32_t meshletOffset = lod.indexOffset;
+			for (const auto& meshlet : lod.meshlets) {
+				CHECK(meshlet.indexOffset == meshletOffset);
+				meshletOffset += meshlet.indexCount;
+			}
+			CHECK(meshletOffset == lod.indexOffset + lod.indexCount);
+
+			// Vertices are collapsed onto others, so every level stays on the sphere.
+			for (uint32_t index = lod.indexOffset; index < lod.indexOffset + lod.indexCount; ++index) {
+				CHECK(indices[index] < positions.size());
+			}
+		}
+		CHECK(nextOffset == indices.size());
+		CHECK(chain.lods.back().error > 0.0f);
+	}
+
+	// Farther away, a coarser or the same LOD is selected, and never one whose
+	// error would show.
+	void testSelection() {
+		std::vector<Lod> lods(4);
+		const float errors[] = { 0.0f, 0.001f, 0.004f, 0.016f };
+		for (size_t i = 0; i < lods.size(); ++i) {
+			lods[i].error = errors[i];
+		}
+		const float projectionScale = 1000.0f;
+		size_t previous = 0;
+		for (float distance = 0.5f; distance < 100.0f; distance *= 1.5f) {
+			size_t selected = SelectLod(lods, 1.0f, distance, projectionScale);
+			CHECK(selected >= previous);
+			CHECK(lods[selected].error * projectionScale / distance <= kLodPixelError);
+			if (selected + 1 < lods.size()) {
+				CHECK(lods[selected + 1].error * projectionScale / distance > kLodPixelError);
+			}
+			previous = selected;
+		}
+		CHECK(SelectLod(lods, 1.0f, 0.5f, projectionScale) == 0);
+		CHECK(SelectLod(lods, 1.0f, 1000.0f, projectionScale) == lods.size() - 1);
+		// Scaling the object up is the same as bringing it closer.
+		CHECK(SelectLod(lods, 4.0f, 16.0f, projectionScale) == SelectLod(lods, 1.0f, 4.0f, projectionScale));
+	}
+}
+
+int main() {
+	testChain();
+	testSelection();
+	return TestResult("lodTest");
+}
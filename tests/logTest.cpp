@@ -0,0 +1,201 @@
+// Checks message formatting, the level filter, and that FlushLog delivers
+// every message logged before it, in each thread's order.
+#include "log.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	// Collects entries; the logger owns the sink, so the entries live here.
+	std::mutex g_mutex;
+	std::vector<LogEntry> g_entries;
+	uint32_t g_flushes = 0;
+
+	class MemorySink : public LogSink {
+	public:
+		void Write(const LogEntry& entry) override {
+			std::lock_guard<std::mutex> lock(g_mutex);
+			g_entries.push_back(entry);
+		}
+		void Flush() override {
+			std::lock_guard<std::mutex> lock(g_mutex);
+			++g_flushes;
+		}
+	};
+
+	uint32_t flushes() {
+		std::lock_guard<std::mutex> lock(g_mutex);
+		return g_flushes;
+	}
+
+	std::vector<LogEntry> takeEntries() {
+		FlushLog();
+		std::lock_guard<std::mutex> lock(g_mutex);
+		std::vector<LogEntry> entries = std::move(g_entries);
+		g_entries.clear();
+		return entries;
+	}
+
+	template <typename... Args>
+	std::string format(const char* text, const Args&... args) {
+		Log(LogLevel::Info, { "test" }, text, args...);
+		std::vector<LogEntry> entries = takeEntries();
+		return entries.size() == 1 ? entries[0].message : "(" + std::to_string(entries.size()) + " entries)";
+	}
+
+	void testFormatting() {
+		CHECK(format("plain") == "plain");
+		CHECK(format("a {} b {} c", 1, "x") == "a 1 b x c");
+		CHECK(format("{} {} {} {}", -7, 42u, true, std::string("text")) == "-7 42 true text");
+		CHECK(format("{}", 0.1) == "0.1");
+		CHECK(format("{}", 2.5f) == "2.5");
+		CHECK(format("{:.1f}", 3.14159) == "3.1");
+		CHECK(format("{:.1f} ms", 12) == "12.0 ms");
+		CHECK(format("[{:>8}]", 42) == "[      42]");
+		CHECK(format("[{:>8}]", "ab") == "[      ab]");
+		CHECK(format("[{:8}]", "ab") == "[ab      ]");
+		CHECK(format("[{:<6}]", 5) == "[5     ]");
+		CHECK(format("[{:08.3f}]", 3.14159) == "[0003.142]");
+		CHECK(format("{:x} {:X}", 255, 3054u) == "ff BEE");
+		CHECK(format("{{}} {{{}}} }}{{", 7) == "{} {7} }{");
+		CHECK(format("{} {}", 1) == "1 ");
+		CHECK(format("line\r\n") == "line");
+		CHECK(format("{}", static_cast<const char*>(nullptr)) == "(null)");
+		// Strings are copied when logged, not when formatted.
+		std::string changing = "before";
+		Log(LogLevel::Info, { "test" }, "{}", changing);
+		changing = "after";
+		std::vector<LogEntry> entries = takeEntries();
+		CHECK(entries.size() == 1 && entries[0].message == "before");
+	}
+
+	void testFields() {
+		Log(LogLevel::Warning, { "stage", 12, 0x80004005u }, "fields");
+		std::vector<LogEntry> entries = takeEntries();
+		CHECK(entries.size() == 1);
+		if (entries.size() == 1) {
+			CHECK(entries[0].level == LogLevel::Warning);
+			CHECK(std::string(entries[0].stage) == "stage" && entries[0].frame == 12 && entries[0].hresult == 0x80004005u);
+			CHECK(FormatLogLine(entries[0]).find("fields") != std::string::npos);
+			CHECK(FormatLogJson(entries[0]).find("\"fields\"") != std::string::npos);
+		}
+	}
+
+	void testLevelFilter() {
+		SetLogLevel(LogLevel::Warning);
+		CHECK(!LogEnabled(LogLevel::Debug) && !LogEnabled(LogLevel::Info));
+		CHECK(LogEnabled(LogLevel::Warning) && LogEnabled(LogLevel::Error));
+		Log(LogLevel::Debug, {}, "debug");
+		Log(LogLevel::Info, {}, "info");
+		Log(LogLevel::Warning, {}, "warning");
+		Log(LogLevel::Error, {}, "error");
+		std::vector<LogEntry> entries = takeEntries();
+		CHECK(entries.size() == 2);
+		if (entries.size() == 2) {
+			CHECK(entries[0].message == "warning" && entries[1].message == "error");
+		}
+
+		SetLogLevel(LogLevel::Debug);
+		Log(LogLevel::Debug, {}, "debug");
+		CHECK(takeEntries().size() == 1);
+		SetLogLevel(LogLevel::Info);
+
+		LogLevel level;
+		CHECK(ParseLogLevel(LogLevelName(LogLevel::Error), level) && level == LogLevel::Error);
+		CHECK(!ParseLogLevel("loud", level));
+	}
+
+	// Threads log numbered messages; once FlushLog returns every message is in
+	// the sink, and each thread's messages are in the order it logged them.
+	void testThreads() {
+		constexpr uint32_t kThreads = 4;
+		constexpr uint32_t kMessages = 1000;
+		const uint32_t flushesBefore = flushes();
+		std::vector<std::thread> threads;
+		for (uint32_t t = 0; t < kThreads; ++t) {
+			threads.emplace_back([t] {
+				for (uint32_t i = 0; i < kMessages; ++i) {
+					Log(LogLevel::Info, { "thread", i }, "{} {}", t, i);
+				}
+				// Logged just before the thread exits, so its ring is closed
+				// with messages still in it.
+				Log(LogLevel::Info, { "thread" }, "{} done", t);
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		std::vector<LogEntry> entries = takeEntries();
+		CHECK(entries.size() == kThreads * (kMessages + 1));
+		CHECK(flushes() > flushesBefore);
+
+		std::vector<int64_t> last(kThreads, -1);
+		std::vector<bool> done(kThreads, false);
+		bool ordered = true;
+		for (const auto& entry : entries) {
+			uint32_t thread = 0, index = 0;
+			if (sscanf(entry.message.c_str(), "%u %u", &thread, &index) == 2 && thread < kThreads) {
+				ordered = ordered && !done[thread] && static_cast<int64_t>(index) == last[thread] + 1 && entry.frame == index;
+				last[thread] = index;
+			}
+			else if (sscanf(entry.message.c_str(), "%u done", &thread) == 1 && thread < kThreads) {
+				ordered = ordered && last[thread] == kMessages - 1;
+				done[thread] = true;
+			}
+			else {
+				ordered = false;
+			}
+		}
+		CHECK(ordered);
+
+		// The same, with FlushLog called while the threads are logging.
+		threads.clear();
+		for (uint32_t t = 0; t < kThreads; ++t) {
+			threads.emplace_back([t] {
+				for (uint32_t i = 0; i < kMessages; ++i) {
+					Log(LogLevel::Info, {}, "{} {}", t, i);
+					if (i % 100 == 0) {
+						FlushLog();
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		entries = takeEntries();
+		CHECK(entries.size() == kThreads * kMessages);
+		std::fill(last.begin(), last.end(), -1);
+		ordered = true;
+		for (const auto& entry : entries) {
+			uint32_t thread = 0, index = 0;
+			ordered = ordered && sscanf(entry.message.c_str(), "%u %u", &thread, &index) == 2 && thread < kThreads &&
+				static_cast<int64_t>(index) == last[thread] + 1;
+			if (thread < kThreads) {
+				last[thread] = index;
+			}
+		}
+		CHECK(ordered);
+	}
+}
+
+int main() {
+	// Nothing is logged before the first sink.
+	CHECK(!LogEnabled(LogLevel::Error));
+	AddLogSink(std::make_unique<MemorySink>());
+	CHECK(LogEnabled(LogLevel::Info) && !LogEnabled(LogLevel::Debug));
+
+	testFormatting();
+	testFields();
+	testLevelFilter();
+	testThreads();
+
+	ShutdownLog();
+	CHECK(!LogEnabled(LogLevel::Error));
+	return TestResult("logTest");
+}
@@ -0,0 +1,134 @@
+// Checks meshlet building, bounds and culling on a flat grid.
+#include "meshlet.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	// quads x quads unit squares in the z = 0 plane, centred on the origin and
+	// wound counter clockwise seen from +z.
+	void buildGrid(uint32_t quads, std::vector<XMFLOAT3>& positions, std::vector<uint32_t>& indices) {
+		positions.clear();
+		indices.clear();
+		const float half = quads * 0.5f;
+		for (uint32_t y = 0; y <= quads; ++y) {
+			for (uint32_t x = 0; x <= quads; ++x) {
+				positions.push_back({ x - half, y - half, 0.0f });
+			}
+		}
+		for (uint32_t y = 0; y < quads; ++y) {
+			for (uint32_t x = 0; x < quads; ++x) {
+				uint32_t corner = y * (quads + 1) + x;
+				indices.insert(indices.end(), { corner, corner + 1, corner + quads + 2, corner, corner + quads + 2, corner + quads + 1 });
+			}
+		}
+	}
+
+	// Triangles as sorted vertex triples, to compare index buffers up to order.
+	std::vector<std::array<uint32_t, 3>> triangles(const std::vector<uint32_t>& indices) {
+		std::vector<std::array<uint32_t, 3>> result;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			std::array<uint32_t, 3> triangle = { indices[i], indices[i + 1], indices[i + 2] };
+			// Rotated so the smallest index is first, which keeps the winding.
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			result.push_back(triangle);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	CullingView view(XMFLOAT3 eye, XMFLOAT3 target) {
+		XMVECTOR eyePosition = XMLoadFloat3(&eye);
+		XMMATRIX viewMatrix = XMMatrixLookAtRH(eyePosition, XMLoadFloat3(&target), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovRH(XM_PI / 2.0f, 1.0f, 0.1f, 100.0f);
+		return BuildCullingView(XMMatrixMultiply(viewMatrix, projection), eyePosition);
+	}
+
+	XMFLOAT4X4 identity() {
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixIdentity());
+		return world;
+	}
+
+	// Meshlets respect the size limits, cover every triangle once and bound
+	// their vertices; a flat grid's cones all point along its normal.
+	void testBuild() {
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+		buildGrid(16, positions, indices);
+		const std::vector<uint32_t> original = indices;
+		std::vector<Meshlet> meshlets = BuildMeshlets(indices, reinterpret_cast<const uint8_t*>(positions.data()), sizeof(XMFLOAT3), positions.size());
+		CHECK(meshlets.size() >= 512 / kMaxMeshletTriangles);
+		CHECK(triangles(indices) == triangles(original));
+
+		uint32_t nextOffset = 0;
+		for (const auto& meshlet : meshlets) {
+			CHECK(meshlet.indexOffset == nextOffset);
+			nextOffset += meshlet.indexCount;
+			CHECK(meshlet.indexCount % 3 == 0 && meshlet.indexCount / 3 <= kMaxMeshletTriangles);
+			std::vector<uint32_t> vertices(indices.begin() + meshlet.indexOffset, indices.begin() + meshlet.indexOffset + meshlet.indexCount);
+			std::sort(vertices.begin(), vertices.end());
+			vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+			CHECK(vertices.size() == meshlet.vertexCount && meshlet.vertexCount <= kMaxMeshletVertices);
+			for (uint32_t vertex : vertices) {
+				const XMFLOAT3& p = positions[vertex];
+				const float distance = std::sqrt((p.x - meshlet.center.x) * (p.x - meshlet.center.x) + (p.y - meshlet.center.y) * (p.y - meshlet.center.y) + p.z * p.z);
+				CHECK(distance <= meshlet.radius * 1.0001f);
+			}
+			CHECK(meshlet.center.z == 0.0f);
+			CHECK(std::fabs(meshlet.coneAxis.z - 1.0f) < 1e-5f);
+			CHECK(meshlet.coneCutoff < 0.01f);
+		}
+		CHECK(nextOffset == indices.size());
+	}
+
+	// Seen from the front everything is drawn, in one merged range; from
+	// behind the cones cull it all, unless the world transform mirrors it;
+	// looking away, the frustum does.
+	void testCulling() {
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+		buildGrid(16, positions, indices);
+		std::vector<Meshlet> meshlets = BuildMeshlets(indices, reinterpret_cast<const uint8_t*>(positions.data()), sizeof(XMFLOAT3), positions.size());
+		const XMFLOAT4X4 world = identity();
+
+		std::vector<IndexRange> ranges;
+		MeshletStats stats;
+		CullMeshlets(meshlets, world, view({ 0.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, 0.0f }), true, ranges, stats);
+		CHECK(stats.tested == meshlets.size() && stats.rejected == 0);
+		CHECK(ranges.size() == 1 && ranges[0].indexOffset == 0 && ranges[0].indexCount == indices.size());
+
+		const CullingView behind = view({ 0.0f, 0.0f, -10.0f }, { 0.0f, 0.0f, 0.0f });
+		ranges.clear();
+		stats = {};
+		CullMeshlets(meshlets, world, behind, true, ranges, stats);
+		CHECK(stats.rejected == meshlets.size() && ranges.empty());
+
+		ranges.clear();
+		stats = {};
+		CullMeshlets(meshlets, world, behind, false, ranges, stats);
+		CHECK(stats.rejected == 0);
+
+		XMFLOAT4X4 mirrored;
+		XMStoreFloat4x4(&mirrored, XMMatrixScalingFromVector(XMVectorSet(1.0f, 1.0f, -1.0f, 0.0f)));
+		ranges.clear();
+		stats = {};
+		CullMeshlets(meshlets, mirrored, behind, true, ranges, stats);
+		CHECK(stats.rejected == 0);
+
+		ranges.clear();
+		stats = {};
+		CullMeshlets(meshlets, world, view({ 0.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, 20.0f }), false, ranges, stats);
+		CHECK(stats.rejected == meshlets.size() && ranges.empty());
+	}
+}
+
+int main() {
+	testBuild();
+	testCulling();
+	return TestResult("meshletTest");
+}
@@ -0,0 +1,75 @@
+// Checks occlusion tests against a single square occluder facing the camera.
+#include "occlusion.h"
+#include "testCheck.h"
+#include "threadPool.h"
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	// A 10 x 10 square centred on the z axis, 10 units in front of a camera at
+	// the origin looking down -z with a 90 degree field of view.
+	const float kSquare[] = { -5.0f, -5.0f, 0.0f, 5.0f, -5.0f, 0.0f, 5.0f, 5.0f, 0.0f, -5.0f, 5.0f, 0.0f };
+	const uint32_t kSquareIndices[] = { 0, 1, 2, 0, 2, 3 };
+
+	XMFLOAT4X4 viewProjection() {
+		XMMATRIX view = XMMatrixLookAtRH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovRH(XM_PI / 2.0f, 1.0f, 0.5f, 100.0f);
+		XMFLOAT4X4 result;
+		XMStoreFloat4x4(&result, XMMatrixMultiply(view, projection));
+		return result;
+	}
+
+	Occluder square(float z) {
+		Occluder occluder = { kSquare, 4, kSquareIndices, 6, {} };
+		XMStoreFloat4x4(&occluder.world, XMMatrixTranslationFromVector(XMVectorSet(0.0f, 0.0f, z, 0.0f)));
+		return occluder;
+	}
+
+	void testSquare() {
+		ThreadPool pool(4);
+		OcclusionBuffer buffer;
+		buffer.Resize(kOcclusionWidth, kOcclusionWidth);
+		CHECK(buffer.Width() == kOcclusionWidth && buffer.Height() == kOcclusionWidth);
+
+		OcclusionStats stats;
+		buffer.Rasterize({}, viewProjection(), pool, stats);
+		CHECK(!buffer.SphereOccluded({ 0.0f, 0.0f, -50.0f }, 1.0f));
+
+		stats = {};
+		buffer.Rasterize({ square(-10.0f) }, viewProjection(), pool, stats);
+		CHECK(stats.occluders == 1 && stats.occluderTriangles == 2);
+
+		// Behind the square, whether small or nearly as large as its shadow.
+		CHECK(buffer.SphereOccluded({ 0.0f, 0.0f, -20.0f }, 1.0f));
+		CHECK(buffer.SphereOccluded({ 3.0f, -3.0f, -40.0f }, 4.0f));
+		// In front of it.
+		CHECK(!buffer.SphereOccluded({ 0.0f, 0.0f, -5.0f }, 1.0f));
+		// Behind it but reaching past its edge, or beside it.
+		CHECK(!buffer.SphereOccluded({ 9.0f, 0.0f, -20.0f }, 2.0f));
+		CHECK(!buffer.SphereOccluded({ 14.0f, 0.0f, -20.0f }, 1.0f));
+		// Crossing the occluder or the near plane.
+		CHECK(!buffer.SphereOccluded({ 0.0f, 0.0f, -10.5f }, 1.0f));
+		CHECK(!buffer.SphereOccluded({ 0.0f, 0.0f, 0.0f }, 1.0f));
+
+		// Near is bright and uncovered pixels are black.
+		std::vector<uint8_t> pixels;
+		buffer.Visualize(pixels);
+		CHECK(pixels.size() == static_cast<size_t>(buffer.Width()) * buffer.Height() * 4);
+		if (pixels.size() == static_cast<size_t>(buffer.Width()) * buffer.Height() * 4) {
+			const size_t centre = (static_cast<size_t>(buffer.Height() / 2) * buffer.Width() + buffer.Width() / 2) * 4;
+			CHECK(pixels[centre] > 0);
+			CHECK(pixels[0] == 0 && pixels[1] == 0 && pixels[2] == 0);
+		}
+
+		// Once the square moves behind the sphere, the sphere is visible again.
+		buffer.Rasterize({ square(-30.0f) }, viewProjection(), pool, stats);
+		CHECK(!buffer.SphereOccluded({ 0.0f, 0.0f, -20.0f }, 1.0f));
+		CHECK(buffer.SphereOccluded({ 0.0f, 0.0f, -40.0f }, 1.0f));
+	}
+}
+
+int main() {
+	testSquare();
+	return TestResult("occlusionTest");
+}
@@ -0,0 +1,131 @@
+// Checks that sequences decode to exactly the frames that were encoded.
+#include "sequenceEncoder.h"
+#include "testCheck.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+	uint32_t g_random = 777;
+
+	uint8_t randomByte() {
+		g_random = g_random * 1664525u + 1013904223u;
+		return static_cast<uint8_t>(g_random >> 24);
+	}
+
+	std::string tempPath(const char* name) {
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	// Writes frames in bands of bandHeight rows from a buffer whose rows are
+	// padded, so bands cross tile rows and the encoder copies into its strip.
+	void writeFrame(SequenceEncoder& encoder, const std::vector<uint8_t>& frame, uint32_t width, uint32_t height, uint32_t bandHeight) {
+		const size_t rowBytes = static_cast<size_t>(width) * 4;
+		const size_t rowPitch = rowBytes + 36;
+		std::vector<uint8_t> padded(rowPitch * height, 0xcd);
+		for (uint32_t row = 0; row < height; ++row) {
+			memcpy(padded.data() + row * rowPitch, frame.data() + row * rowBytes, rowBytes);
+		}
+		for (uint32_t row = 0; row < height; row += bandHeight) {
+			encoder.WriteRows(padded.data() + row * rowPitch, rowPitch, std::min(bandHeight, height - row));
+		}
+		CHECK(encoder.EndFrame());
+	}
+
+	// 150 x 97 leaves partial tiles on the right and bottom edges.
+	void testRoundTrip() {
+		constexpr uint32_t kWidth = 150;
+		constexpr uint32_t kHeight = 97;
+		constexpr uint32_t kTilesPerFrame = 3 * 2;
+		const size_t frameBytes = static_cast<size_t>(kWidth) * kHeight * 4;
+		std::vector<std::vector<uint8_t>> frames;
+
+		std::vector<uint8_t> frame(frameBytes);
+		for (auto& byte : frame) {
+			byte = randomByte();
+		}
+		frames.push_back(frame);
+		// Unchanged, so every tile is skipped.
+		frames.push_back(frame);
+		// A few scattered pixels in the bottom right tile, leaving long zero runs.
+		for (uint32_t i = 0; i < 5; ++i) {
+			const size_t pixel = static_cast<size_t>(kHeight - 1 - i * 7) * kWidth + kWidth - 1 - i * 3;
+			frame[pixel * 4 + i % 4] ^= 0x5a;
+		}
+		frames.push_back(frame);
+		// A flat frame, all zero runs once XORed against itself.
+		std::fill(frame.begin(), frame.end(), 0);
+		frames.push_back(frame);
+		// A keyframe, then a frame identical to it.
+		for (size_t i = 0; i < frame.size(); i += 3) {
+			frame[i] = randomByte();
+		}
+		frames.push_back(frame);
+		frames.push_back(frame);
+
+		const std::string path = tempPath("renderlab-sequence-test.rlsq");
+		SequenceEncoder encoder;
+		CHECK(encoder.Open(path, kWidth, kHeight, 4));
+		const uint32_t bandHeights[] = { kHeight, 13, 64, 1, 40, 97 };
+		for (size_t i = 0; i < frames.size(); ++i) {
+			writeFrame(encoder, frames[i], kWidth, kHeight, bandHeights[i]);
+		}
+		const SequenceStats stats = encoder.Stats();
+		CHECK(encoder.Close());
+		CHECK(stats.frames == frames.size());
+		CHECK(stats.tiles == frames.size() * kTilesPerFrame);
+		CHECK(stats.rawBytes == frames.size() * frameBytes);
+		// Frame 1 and frame 5 skip everything, frame 2 all but one tile.
+		CHECK(stats.skippedTiles == kTilesPerFrame * 2 + kTilesPerFrame - 1);
+		CHECK(stats.encodedBytes < stats.rawBytes / 2);
+
+		SequenceDecoder decoder;
+		CHECK(decoder.Open(path));
+		CHECK(decoder.Width() == kWidth && decoder.Height() == kHeight);
+		CHECK(decoder.FrameCount() == frames.size());
+		std::vector<uint8_t> pixels;
+		for (uint32_t i = 0; i < decoder.FrameCount(); ++i) {
+			CHECK(decoder.ReadFrame(i, pixels) && pixels == frames[i]);
+		}
+		// Backwards, across the keyframe, and from a keyframe onward.
+		for (uint32_t i : { 2u, 0u, 5u, 3u, 4u }) {
+			CHECK(decoder.ReadFrame(i, pixels) && pixels == frames[i]);
+		}
+		CHECK(!decoder.ReadFrame(decoder.FrameCount(), pixels));
+		std::filesystem::remove(path);
+	}
+
+	// Frames smaller than one tile, and one pixel wide or high.
+	void testSmallFrames() {
+		const uint32_t sizes[][2] = { { 1, 1 }, { 1, 70 }, { 70, 1 }, { 63, 65 } };
+		for (const auto& size : sizes) {
+			const size_t frameBytes = static_cast<size_t>(size[0]) * size[1] * 4;
+			std::vector<uint8_t> first(frameBytes), second(frameBytes);
+			for (size_t i = 0; i < frameBytes; ++i) {
+				first[i] = randomByte();
+				second[i] = i % 5 == 0 ? randomByte() : first[i];
+			}
+			const std::string path = tempPath("renderlab-sequence-small.rlsq");
+			SequenceEncoder encoder;
+			CHECK(encoder.Open(path, size[0], size[1], 8));
+			writeFrame(encoder, first, size[0], size[1], 3);
+			writeFrame(encoder, second, size[0], size[1], size[1]);
+			CHECK(encoder.Close());
+
+			SequenceDecoder decoder;
+			std::vector<uint8_t> pixels;
+			CHECK(decoder.Open(path) && decoder.FrameCount() == 2);
+			CHECK(decoder.ReadFrame(1, pixels) && pixels == second);
+			CHECK(decoder.ReadFrame(0, pixels) && pixels == first);
+			std::filesystem::remove(path);
+		}
+	}
+}
+
+int main() {
+	testRoundTrip();
+	testSmallFrames();
+	return TestResult("sequenceEncoderTest");
+}
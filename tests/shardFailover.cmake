@@ -0,0 +1,27 @@
+# Runs the coordinator with two synthetic workers, one of which is killed after
+# reporting some of its frames, and checks that every frame was merged.
+#
+#   cmake -DSHARD=<renderlab-shard> -DWORK_DIR=<directory> -P shardFailover.cmake
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+execute_process(
+    COMMAND "${SHARD}" --frames 0 40 --workers 2 --no-pin
+        --merge "${WORK_DIR}/shard.{worker}.rlsq" "${WORK_DIR}/merged.rlsq"
+        -- "${SHARD}" --worker --size 64 64 --frame-ms 2 --index {worker} --crash 1 5
+        --sequence "${WORK_DIR}/shard.{worker}.rlsq"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+message("${output}${errors}")
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "renderlab-shard exited with ${result}")
+endif()
+if(NOT output MATCHES "40 of 40 frames")
+    message(FATAL_ERROR "not every frame was rendered")
+endif()
+if(NOT output MATCHES "worker 1 [^\n]*failed")
+    message(FATAL_ERROR "worker 1 was not killed")
+endif()
+if(NOT output MATCHES "merged into")
+    message(FATAL_ERROR "the sequences were not merged")
+endif()
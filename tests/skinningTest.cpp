@@ -0,0 +1,142 @@
+// Checks skinning and morph targets against transforms computed here.
+#include "skinning.h"
+#include "testCheck.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+	uint32_t g_random = 12345;
+
+	float randomFloat(float low, float high) {
+		g_random = g_random * 1664525u + 1013904223u;
+		return low + (high - low) * static_cast<float>(g_random >> 8) / 16777216.0f;
+	}
+
+	bool approximately(const XMFLOAT3& a, const double b[3], double tolerance = 1e-4) {
+		return std::fabs(a.x - b[0]) < tolerance && std::fabs(a.y - b[1]) < tolerance && std::fabs(a.z - b[2]) < tolerance;
+	}
+
+	// Row vector convention as in DirectXMath: translation in the last row.
+	void transform(const XMFLOAT4X4& m, const XMFLOAT3& p, double w, double result[3]) {
+		for (int c = 0; c < 3; ++c) {
+			result[c] = p.x * m.m[0][c] + p.y * m.m[1][c] + p.z * m.m[2][c] + w * m.m[3][c];
+		}
+	}
+
+	void normalize(double v[3]) {
+		const double length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int c = 0; c < 3; ++c) {
+			v[c] /= length;
+		}
+	}
+
+	XMFLOAT4X4 jointMatrix(float angle, XMFLOAT3 axis, float scale, XMFLOAT3 translation) {
+		XMVECTOR rotation = XMVectorSet(axis.x * std::sin(angle / 2.0f), axis.y * std::sin(angle / 2.0f), axis.z * std::sin(angle / 2.0f), std::cos(angle / 2.0f));
+		XMMATRIX matrix = XMMatrixMultiply(XMMatrixMultiply(XMMatrixScalingFromVector(XMVectorReplicate(scale)), XMMatrixRotationQuaternion(rotation)),
+			XMMatrixTranslationFromVector(XMLoadFloat3(&translation)));
+		XMFLOAT4X4 result;
+		XMStoreFloat4x4(&result, matrix);
+		return result;
+	}
+
+	DeformableMesh buildMesh(uint32_t vertexCount, uint16_t jointCount) {
+		DeformableMesh mesh;
+		mesh.vertexCount = vertexCount;
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			mesh.positions.push_back({ randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f) });
+			double normal[3] = { randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(0.5f, 1.0f) };
+			normalize(normal);
+			mesh.normals.push_back({ static_cast<float>(normal[0]), static_cast<float>(normal[1]), static_cast<float>(normal[2]) });
+			mesh.tangents.push_back({ 1.0f, 0.0f, 0.0f, v % 2 ? 1.0f : -1.0f });
+			float weights[4];
+			float sum = 0.0f;
+			for (int j = 0; j < 4; ++j) {
+				mesh.joints.push_back(static_cast<uint16_t>((v + j) % jointCount));
+				weights[j] = randomFloat(0.0f, 1.0f);
+				sum += weights[j];
+			}
+			mesh.weights.push_back({ weights[0] / sum, weights[1] / sum, weights[2] / sum, weights[3] / sum });
+		}
+		return mesh;
+	}
+
+	// Every output matches the weighted blend of the four joint transforms.
+	void testSkinning() {
+		const std::vector<XMFLOAT4X4> joints = {
+			jointMatrix(0.0f, { 0.0f, 0.0f, 1.0f }, 1.0f, { 0.0f, 0.0f, 0.0f }),
+			jointMatrix(XM_PI / 2.0f, { 0.0f, 0.0f, 1.0f }, 1.0f, { 1.0f, 0.0f, 0.0f }),
+			jointMatrix(XM_PI / 3.0f, { 1.0f, 0.0f, 0.0f }, 2.0f, { 0.0f, -1.0f, 0.5f }),
+			jointMatrix(-XM_PI / 4.0f, { 0.0f, 1.0f, 0.0f }, 0.5f, { 0.0f, 0.0f, 3.0f }),
+			jointMatrix(XM_PI, { 0.0f, 0.0f, 1.0f }, 1.5f, { -2.0f, 1.0f, 0.0f }),
+		};
+		const DeformableMesh mesh = buildMesh(257, static_cast<uint16_t>(joints.size()));
+		std::vector<XMFLOAT3> positions(mesh.vertexCount), normals(mesh.vertexCount);
+		std::vector<XMFLOAT4> tangents(mesh.vertexCount);
+		DeformVertices(mesh, joints.data(), nullptr, 0, 0, mesh.vertexCount, { positions.data(), normals.data(), tangents.data() });
+
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			const float weights[4] = { mesh.weights[v].x, mesh.weights[v].y, mesh.weights[v].z, mesh.weights[v].w };
+			double position[3] = {}, normal[3] = {};
+			for (int j = 0; j < 4; ++j) {
+				const XMFLOAT4X4& joint = joints[mesh.joints[v * 4 + j]];
+				double jointPosition[3], jointNormal[3];
+				transform(joint, mesh.positions[v], 1.0, jointPosition);
+				transform(joint, mesh.normals[v], 0.0, jointNormal);
+				for (int c = 0; c < 3; ++c) {
+					position[c] += weights[j] * jointPosition[c];
+					normal[c] += weights[j] * jointNormal[c];
+				}
+			}
+			normalize(normal);
+			CHECK(approximately(positions[v], position));
+			CHECK(approximately(normals[v], normal, 1e-3));
+			CHECK(tangents[v].w == mesh.tangents[v].w);
+		}
+	}
+
+	// Targets are added by weight before skinning, zero weights are skipped,
+	// and deforming in ranges matches deforming everything at once.
+	void testMorphAndRanges() {
+		DeformableMesh mesh = buildMesh(100, 1);
+		mesh.joints.clear();
+		mesh.weights.clear();
+		MorphTarget up, away;
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			up.positions.push_back({ 0.0f, 2.0f, 0.0f });
+			up.normals.push_back({ 0.0f, 0.0f, 1.0f });
+			away.positions.push_back({ 100.0f, 0.0f, 0.0f });
+		}
+		mesh.targets = { up, away };
+		const float morphWeights[] = { 0.5f, 0.0f };
+
+		std::vector<XMFLOAT3> positions(mesh.vertexCount), normals(mesh.vertexCount);
+		DeformVertices(mesh, nullptr, morphWeights, 2, 0, mesh.vertexCount, { positions.data(), normals.data(), nullptr });
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			const XMFLOAT3& base = mesh.positions[v];
+			const double position[3] = { base.x, base.y + 1.0, base.z };
+			CHECK(approximately(positions[v], position));
+			double normal[3] = { mesh.normals[v].x, mesh.normals[v].y, mesh.normals[v].z + 0.5 };
+			normalize(normal);
+			CHECK(approximately(normals[v], normal, 1e-3));
+		}
+
+		std::vector<XMFLOAT3> ranged(mesh.vertexCount), rangedNormals(mesh.vertexCount);
+		for (uint32_t first = 0; first < mesh.vertexCount; first += 32) {
+			DeformVertices(mesh, nullptr, morphWeights, 2, first, 32, { ranged.data(), rangedNormals.data(), nullptr });
+		}
+		bool same = true;
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			same = same && ranged[v].x == positions[v].x && ranged[v].y == positions[v].y && ranged[v].z == positions[v].z;
+		}
+		CHECK(same);
+	}
+}
+
+int main() {
+	testSkinning();
+	testMorphAndRanges();
+	return TestResult("skinningTest");
+}
@@ -0,0 +1,110 @@
+// Checks that task graphs run every task once, after its dependencies, and
+// find the critical path.
+#include "taskGraph.h"
+#include "testCheck.h"
+#include "threadPool.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+	void spin(double milliseconds) {
+		auto start = std::chrono::steady_clock::now();
+		while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < milliseconds) {
+		}
+	}
+
+	// A layered graph where every task depends on a few of the layer before.
+	// Each task checks its dependencies finished before it started.
+	void testOrder() {
+		ThreadPool pool(4);
+		TaskGraph graph;
+		constexpr uint32_t kLayers = 20;
+		constexpr uint32_t kWidth = 16;
+		std::vector<std::atomic<uint32_t>> runs(kLayers * kWidth);
+		std::vector<std::atomic<bool>> finished(kLayers * kWidth);
+		std::atomic<uint32_t> violations = 0;
+		for (uint32_t layer = 0; layer < kLayers; ++layer) {
+			for (uint32_t column = 0; column < kWidth; ++column) {
+				const uint32_t index = layer * kWidth + column;
+				std::vector<uint32_t> dependencies;
+				if (layer > 0) {
+					dependencies = { (layer - 1) * kWidth + column, (layer - 1) * kWidth + (column * 7 + 3) % kWidth };
+				}
+				uint32_t task = graph.Add("task", [&, index, dependencies] {
+					for (uint32_t dependency : dependencies) {
+						if (!finished[dependency].load()) {
+							++violations;
+						}
+					}
+					++runs[index];
+					finished[index] = true;
+				}, dependencies);
+				CHECK(task == index);
+			}
+		}
+		// A last task depending on everything, added through Depend.
+		std::atomic<bool> lastSawAll = false;
+		uint32_t last = graph.Add("last", [&] {
+			bool all = true;
+			for (const auto& done : finished) {
+				all = all && done.load();
+			}
+			lastSawAll = all;
+		});
+		for (uint32_t task = 0; task < last; ++task) {
+			graph.Depend(last, task);
+		}
+
+		graph.Run(pool);
+		bool once = true;
+		for (const auto& count : runs) {
+			once = once && count.load() == 1;
+		}
+		CHECK(once);
+		CHECK(violations.load() == 0);
+		CHECK(lastSawAll.load());
+		CHECK(graph.Stats().threads == pool.ThreadCount());
+	}
+
+	// a -> b -> d is the longest chain of a -> b -> d, a -> c -> d and e.
+	void testCriticalPath() {
+		ThreadPool pool(4);
+		TaskGraph graph;
+		uint32_t a = graph.Add("a", [] { spin(10.0); });
+		uint32_t b = graph.Add("b", [] { spin(30.0); }, { a });
+		uint32_t c = graph.Add("c", [] { spin(5.0); }, { a });
+		uint32_t d = graph.Add("d", [] { spin(10.0); }, { b, c });
+		graph.Add("e", [] { spin(20.0); });
+		graph.Run(pool);
+
+		const TaskGraphStats& stats = graph.Stats();
+		CHECK((stats.criticalPath == std::vector<uint32_t>{ a, b, d }));
+		CHECK(stats.criticalPathMilliseconds >= 50.0);
+		CHECK(stats.criticalPathMilliseconds <= stats.wallMilliseconds + 1.0);
+		CHECK(stats.workMilliseconds >= 75.0);
+		CHECK(graph.Milliseconds(b) >= 30.0);
+		CHECK(graph.Name(d) == "d");
+		CHECK(graph.Report().find("b") != std::string::npos);
+	}
+
+	// Graphs run on a pool of one thread, the caller, too.
+	void testSingleThread() {
+		ThreadPool pool(1);
+		TaskGraph graph;
+		std::vector<uint32_t> order;
+		uint32_t first = graph.Add("first", [&] { order.push_back(0); });
+		uint32_t second = graph.Add("second", [&] { order.push_back(1); }, { first });
+		graph.Add("third", [&] { order.push_back(2); }, { second });
+		graph.Run(pool);
+		CHECK((order == std::vector<uint32_t>{ 0, 1, 2 }));
+	}
+}
+
+int main() {
+	testOrder();
+	testCriticalPath();
+	testSingleThread();
+	return TestResult("taskGraphTest");
+}
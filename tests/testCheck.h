@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+
+// Checks for the test executables: a failed check is printed and counted, and
+// the test goes on so one run reports every failure. main returns
+// TestResult, which is 0 when every check passed.
+inline int g_testFailures = 0;
+
+inline void TestCheck(bool condition, const char* what, const char* file, int line) {
+	if (!condition) {
+		fprintf(stderr, "%s:%d: %s\n", file, line, what);
+		++g_testFailures;
+	}
+}
+
+inline int TestResult(const char* name) {
+	if (g_testFailures) {
+		fprintf(stderr, "%s: %d checks failed\n", name, g_testFailures);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+	return 0;
+}
+
+#define CHECK(condition) TestCheck((condition), #condition, __FILE__, __LINE__)
@@ -0,0 +1,226 @@
+// Checks the texture residency policy and mip streaming without a GPU.
+#include "textureResidency.h"
+#include "testCheck.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+	constexpr uint32_t kSize = 256;
+	constexpr uint32_t kBytesPerPixel = 4;
+	// Mips 0 and 1 of a 256x256 texture, everything above its tail.
+	const uint64_t kFullBytes = TextureMipBytes(kSize, kSize, kBytesPerPixel, 0, 2);
+	const uint64_t kMip1Bytes = TextureMipBytes(kSize, kSize, kBytesPerPixel, 1, 2);
+
+	void completeAll(TextureResidency& residency, const std::vector<TextureResidencyChange>& streams) {
+		for (const auto& stream : streams) {
+			residency.Complete(stream.texture);
+		}
+	}
+
+	// A texture no longer requested is shrunk to its tail to make room for one
+	// that is.
+	void testBudgetEviction() {
+		TextureResidency residency;
+		uint32_t a = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		uint32_t b = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		CHECK(residency.TailMip(a) == 2);
+		const uint64_t tails = residency.Stats().residentBytes;
+		residency.SetBudget(tails + kFullBytes);
+
+		std::vector<TextureResidencyChange> streams, evictions;
+		residency.BeginFrame();
+		residency.Request(a, 0);
+		residency.Update(streams, evictions);
+		CHECK(streams.size() == 1 && streams[0].texture == a && streams[0].mip == 0);
+		CHECK(evictions.empty());
+		CHECK(residency.Stats().pendingBytes == kFullBytes);
+		completeAll(residency, streams);
+		CHECK(residency.ResidentMip(a) == 0);
+		CHECK(residency.Stats().residentBytes == tails + kFullBytes);
+
+		residency.BeginFrame();
+		residency.Request(b, 0);
+		residency.Update(streams, evictions);
+		CHECK(evictions.size() == 1 && evictions[0].texture == a && evictions[0].mip == residency.TailMip(a));
+		CHECK(streams.size() == 1 && streams[0].texture == b && streams[0].mip == 0);
+		CHECK(residency.ResidentMip(a) == residency.TailMip(a));
+		CHECK(residency.Stats().evicted == 1);
+		CHECK(residency.Stats().evictedBytes == kFullBytes);
+		completeAll(residency, streams);
+		CHECK(residency.Stats().residentBytes == tails + kFullBytes);
+	}
+
+	// Textures still wanted are not evicted; a request that cannot fit gets
+	// the finest mips that do and is counted as deferred.
+	void testDeferral() {
+		TextureResidency residency;
+		uint32_t a = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		uint32_t b = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		const uint64_t tails = residency.Stats().residentBytes;
+		residency.SetBudget(tails + kFullBytes + kMip1Bytes);
+
+		std::vector<TextureResidencyChange> streams, evictions;
+		residency.BeginFrame();
+		residency.Request(b, 0);
+		residency.Update(streams, evictions);
+		completeAll(residency, streams);
+
+		residency.BeginFrame();
+		residency.Request(a, 0);
+		residency.Request(b, 0);
+		residency.Update(streams, evictions);
+		CHECK(evictions.empty());
+		CHECK(streams.size() == 1 && streams[0].texture == a && streams[0].mip == 1);
+		CHECK(residency.Stats().deferred == 1);
+		CHECK(residency.Stats().pendingBytes == kMip1Bytes);
+
+		// Nothing more is asked of a texture with a stream in flight.
+		residency.Update(streams, evictions);
+		CHECK(streams.empty() && evictions.empty());
+		CHECK(residency.ResidentMip(a) == residency.TailMip(a));
+		residency.Complete(a);
+		CHECK(residency.ResidentMip(a) == 1);
+
+		// With the budget full, the rest of the request stays deferred.
+		residency.Update(streams, evictions);
+		CHECK(streams.empty() && evictions.empty());
+		CHECK(residency.Stats().deferred == 1);
+		CHECK(residency.Stats().residentBytes == tails + kFullBytes + kMip1Bytes);
+	}
+
+	// Streams are asked for largest shortfall first, and the streamer hands
+	// results back in the order their jobs were submitted.
+	void testStreamingOrder() {
+		TextureResidency residency;
+		uint32_t small = residency.AddTexture(128, 128, kBytesPerPixel);
+		uint32_t large = residency.AddTexture(1024, 1024, kBytesPerPixel);
+		uint32_t medium = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		std::vector<TextureResidencyChange> streams, evictions;
+		residency.BeginFrame();
+		residency.Request(small, 0);
+		residency.Request(large, 0);
+		residency.Request(medium, 0);
+		residency.Update(streams, evictions);
+		CHECK(streams.size() == 3);
+		if (streams.size() == 3) {
+			CHECK(streams[0].texture == large && streams[1].texture == medium && streams[2].texture == small);
+		}
+
+		std::vector<std::vector<uint8_t>> sources;
+		for (uint32_t texture = 0; texture < residency.TextureCount(); ++texture) {
+			uint32_t size = texture == small ? 128 : texture == large ? 1024 : kSize;
+			sources.emplace_back(static_cast<size_t>(size) * size * kBytesPerPixel, static_cast<uint8_t>(texture * 40 + 10));
+		}
+		TextureStreamer streamer;
+		for (const auto& stream : streams) {
+			uint32_t size = stream.texture == small ? 128 : stream.texture == large ? 1024 : kSize;
+			streamer.Submit({ stream.texture, stream.mip, residency.ResidentMip(stream.texture), sources[stream.texture].data(), size, size, kBytesPerPixel });
+		}
+		std::vector<TextureStreamResult> results;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (results.size() < streams.size() && std::chrono::steady_clock::now() < deadline) {
+			streamer.TakeCompleted(results);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		CHECK(streamer.Outstanding() == 0);
+		CHECK(results.size() == streams.size());
+		for (size_t i = 0; i < results.size() && i < streams.size(); ++i) {
+			const auto& result = results[i];
+			CHECK(result.texture == streams[i].texture);
+			CHECK(result.firstMip == streams[i].mip);
+			CHECK(result.levels.size() == residency.ResidentMip(result.texture) - result.firstMip);
+			const uint8_t value = sources[result.texture][0];
+			uint32_t edge = result.texture == small ? 128 : result.texture == large ? 1024 : kSize;
+			for (const auto& level : result.levels) {
+				CHECK(level.width == edge && level.height == edge);
+				CHECK(level.pixels.size() == static_cast<size_t>(edge) * edge * kBytesPerPixel);
+				CHECK(!level.pixels.empty() && level.pixels.front() == value && level.pixels.back() == value);
+				edge /= 2;
+			}
+			residency.Complete(result.texture);
+		}
+		for (uint32_t texture = 0; texture < residency.TextureCount(); ++texture) {
+			CHECK(residency.ResidentMip(texture) == 0);
+		}
+	}
+
+	// Jobs without a source build from the pixels their load supplies, and a
+	// failed load is cancelled, leaving the texture to be streamed again.
+	void testLoadedSources() {
+		TextureResidency residency;
+		uint32_t loaded = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		uint32_t missing = residency.AddTexture(kSize, kSize, kBytesPerPixel);
+		std::vector<TextureResidencyChange> streams, evictions;
+		residency.BeginFrame();
+		residency.Request(loaded, 0);
+		residency.Request(missing, 0);
+		residency.Update(streams, evictions);
+		CHECK(streams.size() == 2);
+		CHECK(residency.Pending(loaded) && residency.Pending(missing));
+
+		TextureStreamer streamer;
+		TextureStreamJob job = { loaded, 0, residency.ResidentMip(loaded), nullptr, kSize, kSize, kBytesPerPixel };
+		job.load = [](std::vector<uint8_t>& pixels) {
+			pixels.assign(static_cast<size_t>(kSize) * kSize * kBytesPerPixel, 77);
+			return true;
+		};
+		streamer.Submit(job);
+		job.texture = missing;
+		job.load = [](std::vector<uint8_t>&) { return false; };
+		streamer.Submit(job);
+		std::vector<TextureStreamResult> results;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (results.size() < 2 && std::chrono::steady_clock::now() < deadline) {
+			streamer.TakeCompleted(results);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		CHECK(results.size() == 2);
+		if (results.size() == 2) {
+			CHECK(results[0].texture == loaded && results[0].levels.size() == 2);
+			CHECK(!results[0].levels.empty() && results[0].levels[0].pixels.front() == 77);
+			CHECK(results[1].texture == missing && results[1].levels.empty());
+		}
+
+		residency.Complete(loaded);
+		residency.Cancel(missing);
+		CHECK(!residency.Pending(missing) && residency.ResidentMip(missing) == residency.TailMip(missing));
+		CHECK(residency.Stats().pendingBytes == 0);
+		residency.BeginFrame();
+		residency.Request(missing, 0);
+		residency.Update(streams, evictions);
+		CHECK(streams.size() == 1 && streams[0].texture == missing && streams[0].mip == 0);
+	}
+
+	// Building a range of mips gives the same levels as building them all.
+	void testBuildTextureMips() {
+		const uint32_t width = 37, height = 20;
+		std::vector<uint8_t> source(static_cast<size_t>(width) * height * kBytesPerPixel);
+		for (size_t i = 0; i < source.size(); ++i) {
+			source[i] = static_cast<uint8_t>(i * 7 + i / 13);
+		}
+		const uint32_t mipCount = TextureMipCount(width, height);
+		CHECK(mipCount == 6);
+		std::vector<TextureMipLevel> all, range;
+		BuildTextureMips(source.data(), width, height, kBytesPerPixel, 0, mipCount, all);
+		BuildTextureMips(source.data(), width, height, kBytesPerPixel, 2, 5, range);
+		CHECK(all.size() == mipCount && range.size() == 3);
+		if (all.size() == mipCount && range.size() == 3) {
+			CHECK(all[0].pixels == source);
+			CHECK(all[mipCount - 1].width == 1 && all[mipCount - 1].height == 1);
+			for (uint32_t i = 0; i < 3; ++i) {
+				CHECK(range[i].width == all[i + 2].width && range[i].height == all[i + 2].height);
+				CHECK(range[i].pixels == all[i + 2].pixels);
+			}
+		}
+	}
+}
+
+int main() {
+	testBudgetEviction();
+	testDeferral();
+	testStreamingOrder();
+	testLoadedSources();
+	testBuildTextureMips();
+	return TestResult("textureResidencyTest");
+}